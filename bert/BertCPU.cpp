@@ -0,0 +1,516 @@
+#include "BertCPU.h"
+#include "attentionKeys.h"
+#include "half.h"
+#include "logger.h"
+#include "transformerKeys.h"
+#include "weightContainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace nvinfer1;
+
+namespace bert
+{
+
+namespace
+{
+// rows of the row-wise ops (layer norms, heads) handed to one task
+constexpr int kROWS_PER_TASK = 16;
+
+std::string layerPrefix(int layer)
+{
+    std::stringstream ss;
+    ss << "l" << layer << "_";
+    return ss.str();
+}
+}
+
+BertCPU::BertCPU(int numHeads, int Bmax, int S, bool runInFp16)
+    : Bert(numHeads, Bmax, S, runInFp16)
+{
+}
+
+BertCPU::BertCPU()
+{
+}
+
+BertCPU::~BertCPU()
+{
+}
+
+void BertCPU::setNumThreads(int numThreads)
+{
+    mNumThreads = numThreads;
+}
+
+void BertCPU::setLayerObserver(LayerObserver observer)
+{
+    mObserver = std::move(observer);
+}
+
+const float* BertCPU::floats(const WeightMap& weightMap, const std::string& name, size_t count)
+{
+    const auto it = weightMap.find(name);
+    if (it == weightMap.end())
+    {
+        gLogError << "BertCPU: missing weights " << name << endl;
+        return nullptr;
+    }
+    const Weights& w = it->second;
+    if (count && static_cast<size_t>(w.count) != count)
+    {
+        gLogError << "BertCPU: " << name << " has " << w.count << " values, expected " << count << endl;
+        return nullptr;
+    }
+    if (w.type == DataType::kFLOAT)
+    {
+        return static_cast<const float*>(w.values);
+    }
+    if (w.type == DataType::kINT8)
+    {
+        return dequantize(weightMap, name, w);
+    }
+    if (w.type != DataType::kHALF)
+    {
+        gLogError << "BertCPU: unsupported type of " << name << endl;
+        return nullptr;
+    }
+    // fp16 containers (convert_weights --fp16)
+    const uint16_t* src = static_cast<const uint16_t*>(w.values);
+    float* dst = new float[w.count];
+    for (int64_t i = 0; i < w.count; i++)
+    {
+        dst[i] = half_float::detail::half2float<float>(src[i]);
+    }
+    mConverted.emplace_back(dst);
+    return dst;
+}
+
+const float* BertCPU::dequantize(const WeightMap& weightMap, const std::string& name, const Weights& w)
+{
+    const auto scales = weightMap.find(name + kINT8_SCALE_SUFFIX);
+    if (scales == weightMap.end() || scales->second.type != DataType::kFLOAT || scales->second.count <= 0
+        || w.count % scales->second.count != 0)
+    {
+        gLogError << "BertCPU: int8 weights " << name << " without valid scales" << endl;
+        return nullptr;
+    }
+    const int8_t* src = static_cast<const int8_t*>(w.values);
+    const float* scale = static_cast<const float*>(scales->second.values);
+    const int64_t rowSize = w.count / scales->second.count;
+    float* dst = new float[w.count];
+    for (int64_t i = 0; i < w.count; i++)
+    {
+        dst[i] = src[i] * scale[i / rowSize];
+    }
+    mConverted.emplace_back(dst);
+    return dst;
+}
+
+bool BertCPU::kernel(const WeightMap& weightMap, const std::string& name, int out, int in, cpu::PackedMatrix& packed)
+{
+    // kernels are transposed by loadWeights into the [out][in] layout of the TensorRT fully connected layer
+    const float* w = floats(weightMap, name, static_cast<size_t>(out) * in);
+    if (!w)
+    {
+        return false;
+    }
+    packed.packTransposed(w, out, in, in);
+    if (!mConverted.empty() && mConverted.back().get() == w)
+    {
+        // the packed copy is all the forward reads
+        mConverted.pop_back();
+    }
+    return true;
+}
+
+bool BertCPU::loadNetwork(const WeightMap& weightMap)
+{
+    int numLayers = 0;
+    inferNetworkSizes(weightMap, mHiddenSize, mIntermediateSize, numLayers);
+    const int H = mHiddenSize;
+    const int I = mIntermediateSize;
+    if (H <= 0 || I <= 0 || numLayers <= 0 || H % getNumHeads() != 0)
+    {
+        gLogError << "BertCPU: invalid network sizes hidden " << H << " intermediate " << I << " layers " << numLayers
+                  << " heads " << getNumHeads() << endl;
+        return false;
+    }
+
+    const auto rowsOf = [&](const std::string& name) -> int {
+        const auto it = weightMap.find(name);
+        return it == weightMap.end() ? 0 : static_cast<int>(it->second.count / H);
+    };
+    mVocabSize = rowsOf("bert_embeddings_word_embeddings");
+    mTokenTypes = rowsOf("bert_embeddings_token_type_embeddings");
+    mMaxPositions = rowsOf("bert_embeddings_position_embeddings");
+    if (mMaxPositions < getS())
+    {
+        gLogError << "BertCPU: " << mMaxPositions << " position embeddings, sequences have " << getS() << endl;
+        return false;
+    }
+    mWordEmb = floats(weightMap, "bert_embeddings_word_embeddings", static_cast<size_t>(mVocabSize) * H);
+    mTokEmb = floats(weightMap, "bert_embeddings_token_type_embeddings", static_cast<size_t>(mTokenTypes) * H);
+    mPosEmb = floats(weightMap, "bert_embeddings_position_embeddings", static_cast<size_t>(mMaxPositions) * H);
+    mEmbLnGamma = floats(weightMap, "bert_embeddings_layernorm_gamma", H);
+    mEmbLnBeta = floats(weightMap, "bert_embeddings_layernorm_beta", H);
+    if (!mWordEmb || !mTokEmb || !mPosEmb || !mEmbLnGamma || !mEmbLnBeta)
+    {
+        return false;
+    }
+
+    mLayers.resize(numLayers);
+    for (int l = 0; l < numLayers; l++)
+    {
+        const std::string prefix = layerPrefix(l) + "attention_self_";
+        const std::string tprefix = layerPrefix(l);
+        Layer& layer = mLayers[l];
+        if (!kernel(weightMap, prefix + WQKV, 3 * H, H, layer.qkv)
+            || !kernel(weightMap, tprefix + W_AOUT, H, H, layer.attentionOut)
+            || !kernel(weightMap, tprefix + W_MID, I, H, layer.intermediate)
+            || !kernel(weightMap, tprefix + W_LOUT, H, I, layer.output))
+        {
+            return false;
+        }
+        layer.qkvBias = floats(weightMap, prefix + BQKV, 3 * H);
+        layer.attentionOutBias = floats(weightMap, tprefix + B_AOUT, H);
+        layer.attentionLnGamma = floats(weightMap, tprefix + AOUT_LN_GAMMA, H);
+        layer.attentionLnBeta = floats(weightMap, tprefix + AOUT_LN_BETA, H);
+        layer.intermediateBias = floats(weightMap, tprefix + B_MID, I);
+        layer.outputBias = floats(weightMap, tprefix + B_LOUT, H);
+        layer.outputLnGamma = floats(weightMap, tprefix + LOUT_LN_GAMMA, H);
+        layer.outputLnBeta = floats(weightMap, tprefix + LOUT_LN_BETA, H);
+        if (!layer.qkvBias || !layer.attentionOutBias || !layer.attentionLnGamma || !layer.attentionLnBeta
+            || !layer.intermediateBias || !layer.outputBias || !layer.outputLnGamma || !layer.outputLnBeta)
+        {
+            return false;
+        }
+    }
+
+    // heads of layers/squad.h. The squad weights come from a matmul with transpose_b and are already [2][hidden].
+    mSquadWeights = floats(weightMap, "cls_squad_output_weights", 2 * static_cast<size_t>(H));
+    mSquadBias = floats(weightMap, "cls_squad_output_bias", 2);
+    const auto intents = weightMap.find("dense_1_bias");
+    mNumIntents = intents == weightMap.end() ? 0 : static_cast<int>(intents->second.count);
+    mDenseBias = floats(weightMap, "dense_bias", H);
+    mDense1Kernel = floats(weightMap, "dense_1_kernel", static_cast<size_t>(mNumIntents) * H);
+    mDense1Bias = floats(weightMap, "dense_1_bias", mNumIntents);
+    return mSquadWeights && mSquadBias && mDenseBias && mDense1Kernel && mDense1Bias
+        && kernel(weightMap, "dense_kernel", H, H, mDense);
+}
+
+bool BertCPU::init(string weightsPath)
+{
+    if (getRunInFp16())
+    {
+        gLogInfo << "BertCPU: fp16 requested, computing in fp32" << endl;
+    }
+    // fp32 kernels. The store shares them with the other instances of the same file, and the embeddings, biases and
+    // layer norm parameters are used in place, so the reference is kept while the instance lives.
+    mHostWeights = WeightStore::instance().acquire(weightsPath, WeightPrepOptions());
+    if (!mHostWeights)
+    {
+        gLogError << "Cannot load weights " << weightsPath << endl;
+        return false;
+    }
+    if (!initWithWeights(mHostWeights->weights()))
+    {
+        mHostWeights.reset();
+        return false;
+    }
+    addOutputName("cls_start_logits");
+    addOutputName("cls_end_logits");
+    addOutputName("start_prob");
+    addOutputName("end_prob");
+    addOutputName("predict_prob");
+    return true;
+}
+
+bool BertCPU::initWithWeights(const WeightMap& weightMap)
+{
+    mReady = false;
+    mConverted.clear();
+    if (!loadNetwork(weightMap))
+    {
+        return false;
+    }
+
+    mPool.reset(new cpu::ThreadPool(mNumThreads));
+    const size_t M = static_cast<size_t>(getBMax()) * getS();
+    const size_t H = mHiddenSize;
+    mX.resize(M * H);
+    mAttn.resize(M * H);
+    mTmp.resize(M * H);
+    mCtx.resize(M * H);
+    mQkv.resize(M * 3 * H);
+    mMid.resize(M * mIntermediateSize);
+    mMaskIdx.resize(getBMax());
+    mLogits.resize(2 * M);
+    mProbs.resize(2 * M);
+    mClsHidden.resize(getBMax() * H);
+    mIntentProb.resize(getBMax() * mNumIntents);
+    const int headSize = mHiddenSize / getNumHeads();
+    mScratch.resize(mPool->size());
+    for (auto& s : mScratch)
+    {
+        s.keys.reserve(headSize, getS());
+        s.values.reserve(getS(), headSize);
+        s.scores.resize(static_cast<size_t>(getS()) * getS());
+        s.row.resize(H);
+    }
+
+    mReady = true;
+    gLogInfo << "BertCPU: " << mLayers.size() << " layers, hidden " << mHiddenSize << ", " << mPool->size()
+             << " threads, " << cpu::isaName(cpu::gemmIsa()) << " kernels" << endl;
+    return true;
+}
+
+bool BertCPU::initByOnnx(string modelFile)
+{
+    gLogError << "BertCPU: ONNX models are not supported, use init with a weights file" << endl;
+    return false;
+}
+
+void BertCPU::embed(int B, int S, const int* inputIds, const int* segmentIds, const int* inputMasks)
+{
+    const int H = mHiddenSize;
+    const int M = B * S;
+    mPool->parallelFor((M + kROWS_PER_TASK - 1) / kROWS_PER_TASK, [&](int task, int) {
+        const int r1 = std::min(M, (task + 1) * kROWS_PER_TASK);
+        for (int r = task * kROWS_PER_TASK; r < r1; r++)
+        {
+            // out of range ids would read past the tables on the GPU too; clamp them here instead
+            const int word = std::min(std::max(inputIds[r], 0), mVocabSize - 1);
+            const int token = std::min(std::max(segmentIds[r], 0), mTokenTypes - 1);
+            const float* w = mWordEmb + static_cast<size_t>(word) * H;
+            const float* t = mTokEmb + static_cast<size_t>(token) * H;
+            const float* p = mPosEmb + static_cast<size_t>(r % S) * H;
+            float* sum = mTmp.data() + static_cast<size_t>(r) * H;
+            for (int i = 0; i < H; i++)
+            {
+                sum[i] = w[i] + t[i] + p[i];
+            }
+            cpu::layerNorm(sum, mEmbLnGamma, mEmbLnBeta, mX.data() + static_cast<size_t>(r) * H, H);
+        }
+    });
+
+    // like the embeddings plugin: the number of leading tokens before the first masked one
+    for (int b = 0; b < B; b++)
+    {
+        const int* mask = inputMasks + static_cast<size_t>(b) * S;
+        mMaskIdx[b] = static_cast<int>(std::find(mask, mask + S, 0) - mask);
+    }
+}
+
+void BertCPU::attention(int B, int S)
+{
+    const int H = mHiddenSize;
+    const int N = getNumHeads();
+    const int h = H / N;
+    const float scale = 1.f / std::sqrt(static_cast<float>(h));
+    // the qkv rows are [q | k | v], each N heads of h values, as the qkv plugin reads them
+    mPool->parallelFor(B * N, [&](int task, int thread) {
+        const int b = task / N;
+        const int n = task % N;
+        const int valid = mMaskIdx[b];
+        const float* q = mQkv.data() + static_cast<size_t>(b) * S * 3 * H + n * h;
+        const float* k = q + H;
+        const float* v = q + 2 * H;
+        float* ctx = mCtx.data() + static_cast<size_t>(b) * S * H + n * h;
+        if (valid == 0)
+        {
+            for (int s = 0; s < S; s++)
+            {
+                std::fill(ctx + static_cast<size_t>(s) * H, ctx + static_cast<size_t>(s) * H + h, 0.f);
+            }
+            return;
+        }
+        Scratch& scratch = mScratch[thread];
+        float* scores = scratch.scores.data();
+        // masked keys get a probability of 0, so only the valid ones take part in either product
+        scratch.keys.packTransposed(k, valid, h, 3 * H);
+        cpu::gemmSerial(S, q, 3 * H, scratch.keys, scores, valid);
+        for (int s = 0; s < S; s++)
+        {
+            cpu::softmax(scores + static_cast<size_t>(s) * valid, valid, valid, scale);
+        }
+        scratch.values.pack(v, valid, h, 3 * H);
+        cpu::gemmSerial(S, scores, valid, scratch.values, ctx, H);
+    });
+}
+
+void BertCPU::skipLayerNorm(
+    int rows, const float* x, const float* skip, const float* gamma, const float* beta, float* y)
+{
+    const int H = mHiddenSize;
+    mPool->parallelFor((rows + kROWS_PER_TASK - 1) / kROWS_PER_TASK, [&](int task, int thread) {
+        const int r1 = std::min(rows, (task + 1) * kROWS_PER_TASK);
+        float* sum = mScratch[thread].row.data();
+        for (int r = task * kROWS_PER_TASK; r < r1; r++)
+        {
+            const size_t offset = static_cast<size_t>(r) * H;
+            for (int i = 0; i < H; i++)
+            {
+                sum[i] = x[offset + i] + skip[offset + i];
+            }
+            cpu::layerNorm(sum, gamma, beta, y + offset, H);
+        }
+    });
+}
+
+void BertCPU::encoderLayer(const Layer& layer, int B, int S)
+{
+    const int M = B * S;
+    const int H = mHiddenSize;
+    cpu::gemm(*mPool, M, mX.data(), H, layer.qkv, layer.qkvBias, mQkv.data(), 3 * H);
+    attention(B, S);
+    cpu::gemm(*mPool, M, mCtx.data(), H, layer.attentionOut, layer.attentionOutBias, mTmp.data(), H);
+    skipLayerNorm(M, mTmp.data(), mX.data(), layer.attentionLnGamma, layer.attentionLnBeta, mAttn.data());
+    cpu::gemm(*mPool, M, mAttn.data(), H, layer.intermediate, layer.intermediateBias, mMid.data(), mIntermediateSize,
+        cpu::Epilogue::kGELU);
+    cpu::gemm(*mPool, M, mMid.data(), mIntermediateSize, layer.output, layer.outputBias, mTmp.data(), H);
+    skipLayerNorm(M, mTmp.data(), mAttn.data(), layer.outputLnGamma, layer.outputLnBeta, mX.data());
+}
+
+void BertCPU::squadHead(int B, int S)
+{
+    const int H = mHiddenSize;
+    const int M = B * S;
+    float* start = mLogits.data();
+    float* end = start + M;
+    mPool->parallelFor((M + kROWS_PER_TASK - 1) / kROWS_PER_TASK, [&](int task, int) {
+        const int r1 = std::min(M, (task + 1) * kROWS_PER_TASK);
+        for (int r = task * kROWS_PER_TASK; r < r1; r++)
+        {
+            const float* x = mX.data() + static_cast<size_t>(r) * H;
+            float s = mSquadBias[0];
+            float e = mSquadBias[1];
+            for (int i = 0; i < H; i++)
+            {
+                s += x[i] * mSquadWeights[i];
+                e += x[i] * mSquadWeights[H + i];
+            }
+            start[r] = s;
+            end[r] = e;
+        }
+    });
+    // start_prob and end_prob are a softmax over the whole sequence, padding included, as in squadProb
+    std::copy(mLogits.begin(), mLogits.begin() + 2 * M, mProbs.begin());
+    for (int row = 0; row < 2 * B; row++)
+    {
+        cpu::softmax(mProbs.data() + static_cast<size_t>(row) * S, S, S);
+    }
+}
+
+void BertCPU::intentHead(int B, int S)
+{
+    // the first token of every sequence through dense, tanh, dense_1 and a softmax, as in predeictProb
+    const int H = mHiddenSize;
+    cpu::gemm(*mPool, B, mX.data(), S * H, mDense, mDenseBias, mClsHidden.data(), H);
+    for (int b = 0; b < B; b++)
+    {
+        float* x = mClsHidden.data() + static_cast<size_t>(b) * H;
+        for (int i = 0; i < H; i++)
+        {
+            x[i] = std::tanh(x[i]);
+        }
+        float* prob = mIntentProb.data() + static_cast<size_t>(b) * mNumIntents;
+        for (int c = 0; c < mNumIntents; c++)
+        {
+            const float* w = mDense1Kernel + static_cast<size_t>(c) * H;
+            float sum = mDense1Bias[c];
+            for (int i = 0; i < H; i++)
+            {
+                sum += x[i] * w[i];
+            }
+            prob[c] = sum;
+        }
+        cpu::softmax(prob, mNumIntents, mNumIntents);
+    }
+}
+
+bool BertCPU::run(const Weights& inputIds, const Weights& segmentIds, const Weights& inputMasks,
+    const Dims& inputDims, unsigned outputMask)
+{
+    if (!mReady)
+    {
+        gLogError << "BertCPU: forward before a successful init" << endl;
+        return false;
+    }
+    const int B = inputDims.d[0];
+    const int S = inputDims.d[1];
+    if (B <= 0 || B > getBMax() || S <= 0 || S > getS() || inputIds.count < B * S || segmentIds.count < B * S
+        || inputMasks.count < B * S)
+    {
+        gLogError << "BertCPU: invalid input " << B << " x " << S << ", instance built for " << getBMax() << " x "
+                  << getS() << endl;
+        return false;
+    }
+
+    embed(B, S, static_cast<const int*>(inputIds.values), static_cast<const int*>(segmentIds.values),
+        static_cast<const int*>(inputMasks.values));
+    if (mObserver)
+    {
+        mObserver(0, mX.data(), B * S, mHiddenSize);
+    }
+    for (size_t l = 0; l < mLayers.size(); l++)
+    {
+        encoderLayer(mLayers[l], B, S);
+        if (mObserver)
+        {
+            mObserver(static_cast<int>(l) + 1, mX.data(), B * S, mHiddenSize);
+        }
+    }
+    const unsigned squadOutputs
+        = (1u << kSTART_LOGITS) | (1u << kEND_LOGITS) | (1u << kSTART_PROB) | (1u << kEND_PROB);
+    if (outputMask & squadOutputs)
+    {
+        squadHead(B, S);
+    }
+    if (outputMask & (1u << kINTENT_PROB))
+    {
+        intentHead(B, S);
+    }
+    return true;
+}
+
+void BertCPU::forward(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, std::vector<float>& output)
+{
+    // start then end logits, the layout of BertQA::forward
+    const unsigned logits = (1u << kSTART_LOGITS) | (1u << kEND_LOGITS);
+    if (!run(inputIds, segmentIds, inputMasks, inputDims, logits))
+    {
+        return;
+    }
+    const size_t n = 2 * static_cast<size_t>(inputDims.d[0]) * inputDims.d[1];
+    output.resize(std::max(output.size(), n));
+    std::copy(mLogits.begin(), mLogits.begin() + n, output.begin());
+}
+
+bool BertCPU::forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims,
+    std::vector<float>& output, std::vector<float>& output2, std::vector<float>& output3, std::vector<float>& output4,
+    std::vector<float>& output5, unsigned outputMask)
+{
+    if (!run(inputIds, segmentIds, inputMasks, inputDims, outputMask))
+    {
+        return false;
+    }
+    const size_t B = inputDims.d[0];
+    const size_t S = inputDims.d[1];
+    const float* sources[kNB_OUTPUTS]
+        = {mLogits.data(), mLogits.data() + B * S, mProbs.data(), mProbs.data() + B * S, mIntentProb.data()};
+    std::vector<float>* outputs[kNB_OUTPUTS] = {&output, &output2, &output3, &output4, &output5};
+    for (int i = 0; i < kNB_OUTPUTS; i++)
+    {
+        if (!(outputMask & (1u << i)))
+            continue;
+        const size_t n = B * (i == kINTENT_PROB ? mNumIntents : S);
+        outputs[i]->resize(std::max(outputs[i]->size(), n));
+        std::copy(sources[i], sources[i] + n, outputs[i]->begin());
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_BERT_CPU_H
+#define TRT_BERT_CPU_H
+
+#include "BertFactory.h"
+#include "cpuOps.h"
+#include "weightStore.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief BERT on the host, from the same weights as BertQA
+//! \details Runs the network bert.cpp builds (embeddings, encoder, squad and intent heads) with packed fp32 GEMMs on
+//! AVX-512, AVX2 or plain C++ depending on the CPU, see cpu::gemmIsa. Activation buffers are allocated for
+//! Bmax x S in init and reused by every forward. fp16 is ignored, the backend always computes in fp32.
+//! Created with createBert("CPU"); like BertQA an instance runs one forward at a time.
+class BertCPU : public Bert
+{
+public:
+    BertCPU();
+    BertCPU(int numHeads, int Bmax, int S, bool runInFp16);
+    ~BertCPU();
+
+    bool init(string weightsPath);
+    bool initByOnnx(string modelFile);
+    void forward(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, std::vector<float>& output);
+    bool forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims,
+        std::vector<float>& output, std::vector<float>& output2, std::vector<float>& output3,
+        std::vector<float>& output4, std::vector<float>& output5, unsigned outputMask = kALL_OUTPUTS);
+
+    //! \brief Threads of the instance, 0 (the default) means one per hardware thread. Call before init.
+    void setNumThreads(int numThreads);
+
+    //! \brief Builds the network from weights laid out as loadWeights returns them, used in place
+    //! \details fp16 weights and int8 kernels with their kINT8_SCALE_SUFFIX scales (weightContainer.h) are widened
+    //! to fp32. weightMap must outlive the instance.
+    bool initWithWeights(const WeightMap& weightMap);
+
+    //! \brief Called with the hidden states of every forward: after the embeddings (layer 0) and after each
+    //! transformer layer (1 to the number of layers), rows x hidden size values
+    using LayerObserver = std::function<void(int layer, const float* hidden, int rows, int hiddenSize)>;
+    void setLayerObserver(LayerObserver observer);
+
+private:
+    struct Layer
+    {
+        cpu::PackedMatrix qkv;
+        cpu::PackedMatrix attentionOut;
+        cpu::PackedMatrix intermediate;
+        cpu::PackedMatrix output;
+        const float* qkvBias;
+        const float* attentionOutBias;
+        const float* attentionLnGamma;
+        const float* attentionLnBeta;
+        const float* intermediateBias;
+        const float* outputBias;
+        const float* outputLnGamma;
+        const float* outputLnBeta;
+    };
+
+    //! per-thread scratch of the attention and skip layer norm tasks
+    struct Scratch
+    {
+        cpu::PackedMatrix keys;
+        cpu::PackedMatrix values;
+        std::vector<float> scores;
+        std::vector<float> row;
+    };
+
+    bool loadNetwork(const WeightMap& weightMap);
+    const float* floats(const WeightMap& weightMap, const std::string& name, size_t count);
+    const float* dequantize(const WeightMap& weightMap, const std::string& name, const Weights& w);
+    bool kernel(const WeightMap& weightMap, const std::string& name, int out, int in, cpu::PackedMatrix& packed);
+
+    bool run(const Weights& inputIds, const Weights& segmentIds, const Weights& inputMasks, const Dims& inputDims,
+        unsigned outputMask);
+    void embed(int B, int S, const int* inputIds, const int* segmentIds, const int* inputMasks);
+    void encoderLayer(const Layer& layer, int B, int S);
+    void attention(int B, int S);
+    void skipLayerNorm(int rows, const float* x, const float* skip, const float* gamma, const float* beta, float* y);
+    void squadHead(int B, int S);
+    void intentHead(int B, int S);
+
+    std::shared_ptr<const HostWeights> mHostWeights;
+    std::vector<std::unique_ptr<float[]>> mConverted; // fp32 copies of fp16 and int8 weights
+    std::unique_ptr<cpu::ThreadPool> mPool;
+    int mNumThreads{0};
+    LayerObserver mObserver;
+    bool mReady{false};
+
+    int mHiddenSize{0};
+    int mIntermediateSize{0};
+    int mVocabSize{0};
+    int mTokenTypes{0};
+    int mMaxPositions{0};
+    int mNumIntents{0};
+
+    const float* mWordEmb{nullptr};
+    const float* mPosEmb{nullptr};
+    const float* mTokEmb{nullptr};
+    const float* mEmbLnGamma{nullptr};
+    const float* mEmbLnBeta{nullptr};
+    std::vector<Layer> mLayers;
+    const float* mSquadWeights{nullptr};
+    const float* mSquadBias{nullptr};
+    cpu::PackedMatrix mDense;
+    const float* mDenseBias{nullptr};
+    const float* mDense1Kernel{nullptr};
+    const float* mDense1Bias{nullptr};
+
+    // activations for Bmax x S tokens
+    std::vector<float> mX;
+    std::vector<float> mAttn;
+    std::vector<float> mTmp;
+    std::vector<float> mCtx;
+    std::vector<float> mQkv;
+    std::vector<float> mMid;
+    std::vector<int> mMaskIdx;
+    std::vector<float> mLogits;     // 2 x B x S, start then end
+    std::vector<float> mProbs;      // 2 x B x S
+    std::vector<float> mClsHidden;  // Bmax x hidden
+    std::vector<float> mIntentProb; // Bmax x intents
+    std::vector<Scratch> mScratch;
+};
+}
+
+#endif // TRT_BERT_CPU_H
@@ -1,5 +1,8 @@
 #include "BertFactory.h"
 #include "BertQA.h"
+#include "BertCPU.h"
+#include <cassert>
+#include <cstring>
 namespace bert
 {
 //class BertQA;
@@ -52,6 +55,10 @@ string Bert::getOutputName(int index)
 {
     return outputName_[index];
 }
+int Bert::getNbOutputNames()
+{
+    return outputName_.size();
+}
 void Bert::addOutputName(string outputName)
 {
     outputName_.push_back(outputName);
@@ -68,10 +75,57 @@ void Bert::setDeviceId(int deviceId)
     deviceId_= deviceId;
 }
 
+void Bert::setInt8(const string& calibrationCapture, const string& calibrationCache, int calibrationBatches)
+{
+    runInInt8_ = true;
+    calibrationCapture_ = calibrationCapture;
+    calibrationCache_ = calibrationCache;
+    calibrationBatches_ = calibrationBatches;
+}
 
-Bert* createBert(string type)
+bool Bert::getRunInInt8()
+{
+    return runInInt8_;
+}
+
+const string& Bert::getCalibrationCapture()
+{
+    return calibrationCapture_;
+}
+
+const string& Bert::getCalibrationCache()
+{
+    return calibrationCache_;
+}
+
+int Bert::getCalibrationBatches()
+{
+    return calibrationBatches_;
+}
+
+
+const char* getOutputKey(int output)
 {
+    static const char* keys[kNB_OUTPUTS] = {"start_logits", "end_logits", "start_prob", "end_prob", "intent_prob"};
+    assert(output >= 0 && output < kNB_OUTPUTS);
+    return keys[output];
+}
+
+int findOutputKey(const char* key)
+{
+    for(int i = 0; i < kNB_OUTPUTS; i++)
+    {
+        if(strcmp(key, getOutputKey(i)) == 0)
+            return i;
+    }
+    return -1;
+}
 
+Bert* createBert(string type)
+{
+    //"CPU": BertCPU, anything else the TensorRT engine
+    if (type == "CPU")
+        return create_bert(CPU);
     Bert* pBert = create_bert(QA);
     //Bert* pBert = create_bert(type);
     return pBert;
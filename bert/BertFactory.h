@@ -1,3 +1,6 @@
+#ifndef TRT_BERT_FACTORY_H
+#define TRT_BERT_FACTORY_H
+
 #include "NvInfer.h"
 #if 0
 #include <cuda_profiler_api.h>
@@ -23,6 +26,24 @@ namespace bert{
 
 #define create_bert(type)  new Bert##type()
 
+//outputs a request can ask for, in the order of Bert::getOutputName and forward2's output vectors
+enum BertOutput
+{
+    kSTART_LOGITS = 0,
+    kEND_LOGITS,
+    kSTART_PROB,
+    kEND_PROB,
+    kINTENT_PROB,
+    kNB_OUTPUTS
+};
+
+constexpr unsigned kALL_OUTPUTS = (1u << kNB_OUTPUTS) - 1;
+
+//name of an output in requests and responses
+const char* getOutputKey(int output);
+//returns the BertOutput for a request/response name, or -1 if unknown
+int findOutputKey(const char* key);
+
 
 class Bert
 {
@@ -30,11 +51,14 @@ public:
      Bert(){};
 	 Bert(int numHeads, int Bmax, int S, bool runInFp16);
 	 virtual ~Bert(); 
-	 virtual void init(string weightsPath){};
-	 virtual void initByOnnx(string modelFile){};
+	 //return false if the instance cannot run, its forwards then fail and it must not serve requests
+	 virtual bool init(string weightsPath){ return false; };
+	 virtual bool initByOnnx(string modelFile){ return false; };
 	 virtual void forward(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, std::vector<float>& output){};
-	 virtual void forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, std::vector<float>& output,std::vector<float>& output2,std::vector<float>& output3
-	 							,std::vector<float>& output4, std::vector<float>& output5){};
+	 //outputMask: bit i set means BertOutput i is copied back, other output vectors are left untouched
+	 //returns false, outputs untouched, if the inputs do not fit the instance or it is not initialized
+	 virtual bool forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, std::vector<float>& output,std::vector<float>& output2,std::vector<float>& output3
+	 							,std::vector<float>& output4, std::vector<float>& output5, unsigned outputMask = kALL_OUTPUTS){ return false; };
 
      void setParam(int numHeads, int Bmax, int S, bool runInFp16);
 	 int getNumHeads();
@@ -43,8 +67,15 @@ public:
 	 bool getRunInFp16();
 	 int getDeviceId();
 	 string getOutputName(int index);
+	 int getNbOutputNames();
 	 void addOutputName(string outputName);
 	 void setDeviceId(int deviceId);
+	 //int8: calibrate from a request capture (see captureFile.h), the table is cached in calibrationCache
+	 void setInt8(const string& calibrationCapture, const string& calibrationCache, int calibrationBatches = 0);
+	 bool getRunInInt8();
+	 const string& getCalibrationCapture();
+	 const string& getCalibrationCache();
+	 int getCalibrationBatches();
 	 void lock(){pthread_mutex_lock(&mutex);};
 	 int trylock(){return pthread_mutex_trylock(&mutex);};
 	 void unlock(){pthread_mutex_unlock(&mutex);};
@@ -55,6 +86,10 @@ private:
 	int S_;     //sentence len
 	bool runInFp16_;
 	int deviceId_;
+	bool runInInt8_ = false;
+	string calibrationCapture_;
+	string calibrationCache_;
+	int calibrationBatches_ = 0;
 	//string saveEngine_; 
 	//const HostTensorMap inCfg_;
 	
@@ -66,10 +101,11 @@ private:
 
 
 
+//type "CPU" creates a BertCPU, any other type a BertQA
 Bert* createBert(string type);
 
 
 
 }
-	
 
+#endif // TRT_BERT_FACTORY_H
@@ -1,5 +1,7 @@
 #include "BertFactory.h"
 #include "BertQA.h"
+#include "bertCalibrator.h"
+#include "weightStore.h"
 
 using namespace nvinfer1;
 
@@ -8,15 +10,34 @@ namespace bert{
 
 
 
-void BertQA::init(string weightsPath)
+bool BertQA::init(string weightsPath)
 {
     //1. load weight
     cudaSetDevice(getDeviceId());
     cudaStreamCreate(&stream_);
     
-    WeightMap weightMap;
     //const std::string weightsPath(locateFile(kBERT_WEIGHTS_FNAME, dataDirs_));
-    loadWeights(weightsPath, weightMap);
+    WeightPrepOptions prepOptions;
+    // in fp16 mode the kernels are converted while they are transposed, halving host memory
+    prepOptions.fp16Kernels = getRunInFp16();
+    // shared with the other instances built from the same file. our reference is dropped when init returns,
+    // the engine keeps its own copy of the weights
+    std::shared_ptr<const HostWeights> hostWeights = WeightStore::instance().acquire(weightsPath, prepOptions);
+    if (!hostWeights)
+    {
+        gLogError << "Cannot load weights " << weightsPath << endl;
+        return false;
+    }
+    const WeightMap& weightMap = hostWeights->weights();
+    for (const auto& kv : weightMap)
+    {
+        if (kv.second.type == DataType::kINT8)
+        {
+            // quantize_weights containers, TensorRT takes fp32 or fp16 weights
+            gLogError << "int8 weights (" << kv.first << ") are only supported by BertCPU" << endl;
+            return false;
+        }
+    }
 
     //2. Prepare the TRT Network
     //2.1 Create optimization profiles. In this case, we only create a single profile for the shape we care about.
@@ -38,8 +59,19 @@ void BertQA::init(string weightsPath)
         params[kv.first] = make_shared<HostTensor>(const_cast<void*>(kv.second.values), kv.second.type, shape);
     }
 
-    //2.4 Build the TRT Engine
+    //2.4 int8: calibrate on captured traffic, the calibrator is only needed while building
+    std::unique_ptr<BertBatchStream> calibrationStream;
+    std::unique_ptr<BertEntropyCalibrator> calibrator;
+    if (getRunInInt8())
+    {
+        calibrationStream.reset(new BertBatchStream(getBMax(), getS(), getCalibrationCapture(), getCalibrationBatches()));
+        calibrator.reset(new BertEntropyCalibrator(*calibrationStream, getCalibrationCache()));
+        pBertDriver->setInt8Calibrator(calibrator.get());
+    }
+
+    //2.5 Build the TRT Engine
     pBertDriver->init(params);
+    pBertDriver->setInt8Calibrator(nullptr);
 
     //3. if serial engine
     //if (!gArgs.saveEngine.empty())
@@ -60,12 +92,13 @@ void BertQA::init(string weightsPath)
     addOutputName("start_prob");
     addOutputName("end_prob");
     addOutputName("predict_prob");
+    resolveBindings();
      cudaError_t cudaerr = cudaDeviceSynchronize();
     if (cudaerr != cudaSuccess)
         printf("kernel launch failed with error \"%s\".\n",cudaGetErrorString(cudaerr));  
-
+    return true;
 }
-void BertQA::initByOnnx(string modelFile)
+bool BertQA::initByOnnx(string modelFile)
 {
     //1. load weight
     cudaSetDevice(getDeviceId());
@@ -83,8 +116,19 @@ void BertQA::initByOnnx(string modelFile)
     //2.2 create driver
     pBertDriver= new BERTDriver(getNumHeads(), getRunInFp16(), 5000_MiB, optProfiles);
 
-    //2.3 Build the TRT Engine
+    //2.3 int8: calibrate on captured traffic, the calibrator is only needed while building
+    std::unique_ptr<BertBatchStream> calibrationStream;
+    std::unique_ptr<BertEntropyCalibrator> calibrator;
+    if (getRunInInt8())
+    {
+        calibrationStream.reset(new BertBatchStream(getBMax(), getS(), getCalibrationCapture(), getCalibrationBatches()));
+        calibrator.reset(new BertEntropyCalibrator(*calibrationStream, getCalibrationCache()));
+        pBertDriver->setInt8Calibrator(calibrator.get());
+    }
+
+    //2.4 Build the TRT Engine
     pBertDriver->initByOnnx(modelFile);
+    pBertDriver->setInt8Calibrator(nullptr);
 
 
     // 4.set output layer
@@ -97,11 +141,12 @@ void BertQA::initByOnnx(string modelFile)
     #else
 
     #endif
+    resolveBindings();
     
     cudaError_t cudaerr = cudaDeviceSynchronize();
     if (cudaerr != cudaSuccess)
     printf("kernel launch failed with error \"%s\".\n",cudaGetErrorString(cudaerr));  
-
+    return true;
 }
 
 
@@ -144,45 +189,58 @@ void BertQA::forward(Weights& inputIds, Weights& segmentIds, Weights& inputMasks
     return ;
 }
 
-void BertQA::forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, 
-    std::vector<float>& output, std::vector<float>& output2, std::vector<float>& output3, std::vector<float>& output4, std::vector<float>& output5)
+void BertQA::resolveBindings()
 {
-    cudaSetDevice(getDeviceId());
-
-    std::vector<float> timesTotal(1);   // Total time
-    std::vector<float> timesCompute(1); // Computation time
-
-
+    const char* inputNames[3] = {kMODEL_INPUT0_NAME, kMODEL_INPUT1_NAME, kMODEL_INPUT2_NAME};
+    for (int i = 0; i < 3; i++)
+        inputBindings_[i] = pBertDriver->getBindingIndex(inputNames[i], DataType::kINT32);
+    // outputs without a name (initByOnnx) are never copied back
+    for (int i = 0; i < kNB_OUTPUTS; i++)
+        outputBindings_[i] = i < getNbOutputNames() ? pBertDriver->getBindingIndex(getOutputName(i), DataType::kFLOAT) : -1;
+}
 
-    const std::vector<size_t> inputShape(inputDims.d, inputDims.d + 2);
-    const HostTensorMap inCfg{
-    std::make_pair(kMODEL_INPUT0_NAME,
-    make_shared<HostTensor>(const_cast<void*>(inputIds.values), inputIds.type, inputShape)),
-    std::make_pair(kMODEL_INPUT1_NAME,
-    make_shared<HostTensor>(const_cast<void*>(segmentIds.values), segmentIds.type, inputShape)),
-    std::make_pair(kMODEL_INPUT2_NAME,
-    make_shared<HostTensor>(const_cast<void*>(inputMasks.values), inputMasks.type, inputShape))};
+bool BertQA::forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, 
+    std::vector<float>& output, std::vector<float>& output2, std::vector<float>& output3, std::vector<float>& output4, std::vector<float>& output5,
+    unsigned outputMask)
+{
+    if (!pBertDriver)
+    {
+        gLogError << "BertQA: forward before a successful init" << endl;
+        return false;
+    }
+    cudaSetDevice(getDeviceId());
 
     const int B = inputDims.d[0];
     const int S = inputDims.d[1];
+    // the copies below read B x S values of every input
+    if (B <= 0 || B > getBMax() || S <= 0 || S > getS() || inputIds.count < B * S || segmentIds.count < B * S
+        || inputMasks.count < B * S)
+    {
+        gLogError << "BertQA: invalid input " << B << " x " << S << ", instance built for " << getBMax() << " x "
+                  << getS() << endl;
+        return false;
+    }
 
+    // bindings resolved at init, the request path does no lookup and no allocation
+    const size_t inputBytes = static_cast<size_t>(B) * S * sizeof(int32_t);
+    const HostBinding inputs[3] = {{inputBindings_[0], const_cast<void*>(inputIds.values), inputBytes},
+        {inputBindings_[1], const_cast<void*>(segmentIds.values), inputBytes},
+        {inputBindings_[2], const_cast<void*>(inputMasks.values), inputBytes}};
 
+    // only the requested bindings are copied back
+    std::vector<float>* outputs[kNB_OUTPUTS] = {&output, &output2, &output3, &output4, &output5};
+    HostBinding outBindings[kNB_OUTPUTS];
+    for (int i = 0; i < kNB_OUTPUTS; i++)
+    {
+        const size_t ld = (i == kINTENT_PROB) ? 3 : static_cast<size_t>(S);
+        if (outputMask & (1u << i))
+            outBindings[i] = HostBinding{outputBindings_[i], outputs[i]->data(), B * ld * sizeof(float)};
+        else
+            outBindings[i] = HostBinding{-1, nullptr, 0};
+    }
 
-    HostTensorMap outCfg
-    = {make_pair(getOutputName(0), make_shared<HostTensor>(output.data(), DataType::kFLOAT, std::vector<size_t>{1, static_cast<size_t>(B), static_cast<size_t>(S)})),
-    make_pair(getOutputName(1), make_shared<HostTensor>(output2.data(), DataType::kFLOAT, std::vector<size_t>{1, static_cast<size_t>(B), static_cast<size_t>(S)})),
-    make_pair(getOutputName(2), make_shared<HostTensor>(output3.data(), DataType::kFLOAT, std::vector<size_t>{1, static_cast<size_t>(B), static_cast<size_t>(S)})),
-    make_pair(getOutputName(3), make_shared<HostTensor>(output4.data(), DataType::kFLOAT, std::vector<size_t>{1, static_cast<size_t>(B), static_cast<size_t>(S)})),
-    make_pair(getOutputName(4), make_shared<HostTensor>(output5.data(), DataType::kFLOAT, std::vector<size_t>{1, static_cast<size_t>(B), 3}))};
-
-
-    
-    //pBertDriver->benchmark(inCfg, outCfg, B, stream_, timesTotal, timesCompute, false);
-    pBertDriver->benchmark(inCfg, outCfg, B, stream_, timesTotal, timesCompute, true);
-
-
-    //transposeLogits(output, B, S);
-    return ;
+    pBertDriver->run(inputs, 3, outBindings, kNB_OUTPUTS, B, stream_);
+    return true;
 }
 
 BertQA::BertQA(int numHeads, int Bmax, int S, bool runInFp16):Bert(numHeads, Bmax, S, runInFp16)
@@ -41,7 +41,7 @@
 #include "bertEncoder.h"
 #include "embLayerNormPlugin.h"
 #include "squad.h"
-//#include "BertFactory.h"
+#include "BertFactory.h"
 
 using namespace nvinfer1;
 
@@ -53,11 +53,12 @@ public:
      BertQA();
 	 BertQA(int numHeads, int Bmax, int S, bool runInFp16);
 	 ~BertQA(); 
-	 void init(string weightsPath);
-	 void initByOnnx(string modelFile);
+	 bool init(string weightsPath);
+	 bool initByOnnx(string modelFile);
 	 void forward(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, std::vector<float>& output);
-	 void forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, 
-	 	          std::vector<float>& output,std::vector<float>& output2,std::vector<float>& output3, std::vector<float>& output4, std::vector<float>& output5);
+	 bool forward2(Weights& inputIds, Weights& segmentIds, Weights& inputMasks, Dims& inputDims, 
+	 	          std::vector<float>& output,std::vector<float>& output2,std::vector<float>& output3, std::vector<float>& output4, std::vector<float>& output5,
+	 	          unsigned outputMask = kALL_OUTPUTS);
 private:
 	#if 0
 	string dataDirs_;
@@ -70,8 +71,13 @@ private:
 	
 	string outputName;
 	#endif
+	//binding indices of the inputs and of the BertOutputs, looked up once the engine is built
+	void resolveBindings();
+
 	cudaStream_t stream_;
-	BERTDriver* pBertDriver;
+	BERTDriver* pBertDriver = nullptr;
+	int inputBindings_[3];
+	int outputBindings_[kNB_OUTPUTS];
 };
 }
 
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bertCalibrator.h"
+#include "bert.h"
+#include "captureFile.h"
+#include "common.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace bert
+{
+
+BertBatchStream::BertBatchStream(int batchSize, int seqLength, const std::string& capturePath, int maxBatches)
+    : mBatchSize(batchSize)
+    , mSeqLength(seqLength)
+{
+    CaptureReader reader;
+    if (!reader.open(capturePath))
+    {
+        gLogError << "Cannot open calibration capture file: " << capturePath << std::endl;
+        return;
+    }
+
+    CaptureRecord record;
+    int skipped = 0;
+    while (reader.next(record))
+    {
+        if (record.header.seqLength != seqLength)
+        {
+            skipped++;
+            continue;
+        }
+        mInputIds.insert(mInputIds.end(), record.inputIds.begin(), record.inputIds.end());
+        mSegmentIds.insert(mSegmentIds.end(), record.segmentIds.begin(), record.segmentIds.end());
+        mInputMask.insert(mInputMask.end(), record.inputMask.begin(), record.inputMask.end());
+    }
+
+    const size_t sentences = mInputIds.size() / seqLength;
+    mNbBatches = static_cast<int>(sentences / batchSize);
+    if (maxBatches > 0)
+    {
+        mNbBatches = std::min(mNbBatches, maxBatches);
+    }
+    const size_t used = static_cast<size_t>(mNbBatches) * batchSize * seqLength;
+    mInputIds.resize(used);
+    mSegmentIds.resize(used);
+    mInputMask.resize(used);
+    gLogInfo << "Calibration data: " << sentences << " sentences, " << mNbBatches << " batches of " << batchSize
+             << ", " << skipped << " records with another sequence length skipped" << std::endl;
+}
+
+void BertBatchStream::reset(int firstBatch)
+{
+    mBatchCount = firstBatch;
+}
+
+bool BertBatchStream::next()
+{
+    if (mBatchCount >= mNbBatches)
+    {
+        return false;
+    }
+    ++mBatchCount;
+    return true;
+}
+
+void BertBatchStream::skip(int skipCount)
+{
+    mBatchCount += skipCount;
+}
+
+// next() has already advanced past the batch it made current
+const int32_t* BertBatchStream::getInputIds() const
+{
+    return mInputIds.data() + static_cast<size_t>(mBatchCount - 1) * mBatchSize * mSeqLength;
+}
+
+const int32_t* BertBatchStream::getSegmentIds() const
+{
+    return mSegmentIds.data() + static_cast<size_t>(mBatchCount - 1) * mBatchSize * mSeqLength;
+}
+
+const int32_t* BertBatchStream::getInputMask() const
+{
+    return mInputMask.data() + static_cast<size_t>(mBatchCount - 1) * mBatchSize * mSeqLength;
+}
+
+float* BertBatchStream::getBatch()
+{
+    return reinterpret_cast<float*>(const_cast<int32_t*>(getInputIds()));
+}
+
+float* BertBatchStream::getLabels()
+{
+    return nullptr;
+}
+
+int BertBatchStream::getBatchesRead() const
+{
+    return mBatchCount;
+}
+
+int BertBatchStream::getBatchSize() const
+{
+    return mBatchSize;
+}
+
+nvinfer1::Dims BertBatchStream::getDims() const
+{
+    return nvinfer1::Dims{2, {mBatchSize, mSeqLength}};
+}
+
+BertEntropyCalibrator::BertEntropyCalibrator(
+    BertBatchStream& stream, const std::string& cachePath, bool readCache, DeviceOps& ops)
+    : mStream(stream)
+    , mCachePath(cachePath)
+    , mReadCache(readCache)
+    , mOps(ops)
+{
+    const nvinfer1::Dims dims = mStream.getDims();
+    mInputBytes = static_cast<size_t>(dims.d[0]) * dims.d[1] * sizeof(int32_t);
+    for (auto& input : mDeviceInputs)
+    {
+        input = mOps.deviceMalloc(mInputBytes);
+    }
+    mStream.reset(0);
+}
+
+BertEntropyCalibrator::~BertEntropyCalibrator()
+{
+    for (auto& input : mDeviceInputs)
+    {
+        mOps.deviceFree(input);
+    }
+}
+
+bool BertEntropyCalibrator::getBatch(void* bindings[], const char* names[], int nbBindings)
+{
+    if (!mStream.next())
+    {
+        return false;
+    }
+
+    const int32_t* host[3] = {mStream.getInputIds(), mStream.getSegmentIds(), mStream.getInputMask()};
+    const char* inputNames[3] = {kMODEL_INPUT0_NAME, kMODEL_INPUT1_NAME, kMODEL_INPUT2_NAME};
+    for (int i = 0; i < nbBindings; i++)
+    {
+        int input = -1;
+        for (int k = 0; k < 3; k++)
+        {
+            if (!strcmp(names[i], inputNames[k]))
+            {
+                input = k;
+            }
+        }
+        if (input < 0)
+        {
+            gLogError << "Unexpected calibration binding: " << names[i] << std::endl;
+            return false;
+        }
+        mOps.memcpyH2D(mDeviceInputs[input], host[input], mInputBytes, 0);
+        bindings[i] = mDeviceInputs[input];
+    }
+    mOps.streamSynchronize(0);
+    return true;
+}
+
+const void* BertEntropyCalibrator::readCalibrationCache(size_t& length)
+{
+    mCalibrationCache.clear();
+    std::ifstream input(mCachePath, std::ios::binary);
+    input >> std::noskipws;
+    if (mReadCache && input.good())
+    {
+        std::copy(std::istream_iterator<char>(input), std::istream_iterator<char>(),
+            std::back_inserter(mCalibrationCache));
+        gLogInfo << "Using calibration cache " << mCachePath << std::endl;
+    }
+    length = mCalibrationCache.size();
+    return length ? mCalibrationCache.data() : nullptr;
+}
+
+void BertEntropyCalibrator::writeCalibrationCache(const void* cache, size_t length)
+{
+    std::ofstream output(mCachePath, std::ios::binary);
+    output.write(reinterpret_cast<const char*>(cache), length);
+    gLogInfo << "Wrote calibration cache " << mCachePath << std::endl;
+}
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_BERT_CALIBRATOR_H
+#define TRT_BERT_CALIBRATOR_H
+
+#include "BatchStream.h"
+#include "NvInfer.h"
+#include "deviceOps.h"
+#include <string>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Batch stream over inputs captured from production traffic (see captureFile.h)
+//! \details All captured sentences with the engine's sequence length are pooled and regrouped into batches of
+//! exactly Bmax sentences; a trailing partial batch is dropped. BERT takes three int32 inputs, which are exposed by
+//! getInputIds/getSegmentIds/getInputMask. getBatch returns the input ids reinterpreted for IBatchStream
+//! compatibility only.
+class BertBatchStream : public IBatchStream
+{
+public:
+    //! \param maxBatches upper bound on the number of batches used, 0 for all of them
+    BertBatchStream(int batchSize, int seqLength, const std::string& capturePath, int maxBatches = 0);
+
+    void reset(int firstBatch) override;
+    bool next() override;
+    void skip(int skipCount) override;
+    float* getBatch() override;
+    float* getLabels() override;
+    int getBatchesRead() const override;
+    int getBatchSize() const override;
+    nvinfer1::Dims getDims() const override;
+
+    int getNbBatches() const
+    {
+        return mNbBatches;
+    }
+
+    // inputs of the current batch, each getBatchSize() x S
+    const int32_t* getInputIds() const;
+    const int32_t* getSegmentIds() const;
+    const int32_t* getInputMask() const;
+
+private:
+    int mBatchSize;
+    int mSeqLength;
+    int mNbBatches{0};
+    int mBatchCount{0}; // batches consumed by next()
+    std::vector<int32_t> mInputIds;
+    std::vector<int32_t> mSegmentIds;
+    std::vector<int32_t> mInputMask;
+};
+
+//! \brief Entropy calibrator (IInt8EntropyCalibrator2) feeding the three BERT inputs from a BertBatchStream
+//! \details The calibration table is persisted to \p cachePath and reused on the next build when \p readCache is set,
+//! so calibration runs once per model. Device copies go through DeviceOps.
+class BertEntropyCalibrator : public nvinfer1::IInt8EntropyCalibrator2
+{
+public:
+    BertEntropyCalibrator(BertBatchStream& stream, const std::string& cachePath, bool readCache = true,
+        DeviceOps& ops = getCudaDeviceOps());
+    ~BertEntropyCalibrator();
+
+    //! networks with an explicit batch dimension are calibrated with batch size 1, the bindings carry Bmax
+    int getBatchSize() const override
+    {
+        return 1;
+    }
+
+    bool getBatch(void* bindings[], const char* names[], int nbBindings) override;
+    const void* readCalibrationCache(size_t& length) override;
+    void writeCalibrationCache(const void* cache, size_t length) override;
+
+private:
+    BertBatchStream& mStream;
+    std::string mCachePath;
+    bool mReadCache;
+    DeviceOps& mOps;
+    size_t mInputBytes;
+    void* mDeviceInputs[3]; // input ids, segment ids, input mask
+    std::vector<char> mCalibrationCache;
+};
+}
+#endif // TRT_BERT_CALIBRATOR_H
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cpuOps.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BERT_CPU_X86 1
+#include <immintrin.h>
+#endif
+
+namespace bert
+{
+namespace cpu
+{
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int t = 1; t < numThreads; t++)
+    {
+        mWorkers.emplace_back(&ThreadPool::work, this, t);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+        mStart.notify_all();
+    }
+    for (auto& w : mWorkers)
+    {
+        w.join();
+    }
+}
+
+void ThreadPool::runTasks(int thread)
+{
+    for (;;)
+    {
+        const int i = mNext.fetch_add(1);
+        if (i >= mCount)
+        {
+            return;
+        }
+        (*mFn)(i, thread);
+    }
+}
+
+void ThreadPool::work(int thread)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStart.wait(lock, [&] { return mStop || mGeneration != seen; });
+            if (mStop)
+            {
+                return;
+            }
+            seen = mGeneration;
+        }
+        runTasks(thread);
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (--mBusy == 0)
+        {
+            mDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int n, const std::function<void(int, int)>& fn)
+{
+    if (n <= 0)
+    {
+        return;
+    }
+    if (n == 1 || mWorkers.empty())
+    {
+        for (int i = 0; i < n; i++)
+        {
+            fn(i, 0);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFn = &fn;
+        mCount = n;
+        mNext = 0;
+        mBusy = static_cast<int>(mWorkers.size());
+        mGeneration++;
+        mStart.notify_all();
+    }
+    runTasks(0);
+    // every worker goes through each loop, so none can still be reading mFn once mBusy drops to 0
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mBusy == 0; });
+}
+
+Isa gemmIsa()
+{
+    static const Isa isa = [] {
+        Isa best = Isa::kSCALAR;
+#ifdef BERT_CPU_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            best = Isa::kAVX512;
+        }
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            best = Isa::kAVX2;
+        }
+#endif
+        const char* env = std::getenv("BERT_CPU_ISA");
+        if (env)
+        {
+            const Isa requested = !std::strcmp(env, "scalar") ? Isa::kSCALAR
+                                                              : !std::strcmp(env, "avx2") ? Isa::kAVX2 : Isa::kAVX512;
+            best = std::min(best, requested);
+        }
+        return best;
+    }();
+    return isa;
+}
+
+const char* isaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::kAVX512: return "avx512";
+    case Isa::kAVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+void PackedMatrix::reserve(int k, int n)
+{
+    mData.reserve(static_cast<size_t>(k) * ((n + kPANEL - 1) / kPANEL) * kPANEL);
+}
+
+void PackedMatrix::packTransposed(const float* w, int n, int k, int ldw)
+{
+    mK = k;
+    mN = n;
+    mData.resize(static_cast<size_t>(k) * panels() * kPANEL);
+    for (int p = 0; p < panels(); p++)
+    {
+        float* dst = mData.data() + static_cast<size_t>(p) * k * kPANEL;
+        for (int j = 0; j < kPANEL; j++)
+        {
+            const int col = p * kPANEL + j;
+            if (col < n)
+            {
+                const float* src = w + static_cast<size_t>(col) * ldw;
+                for (int kk = 0; kk < k; kk++)
+                {
+                    dst[kk * kPANEL + j] = src[kk];
+                }
+            }
+            else
+            {
+                for (int kk = 0; kk < k; kk++)
+                {
+                    dst[kk * kPANEL + j] = 0.f;
+                }
+            }
+        }
+    }
+}
+
+void PackedMatrix::pack(const float* b, int k, int n, int ldb)
+{
+    mK = k;
+    mN = n;
+    mData.resize(static_cast<size_t>(k) * panels() * kPANEL);
+    for (int p = 0; p < panels(); p++)
+    {
+        float* dst = mData.data() + static_cast<size_t>(p) * k * kPANEL;
+        const int col = p * kPANEL;
+        const int nc = std::min(kPANEL, n - col);
+        for (int kk = 0; kk < k; kk++)
+        {
+            std::copy(b + static_cast<size_t>(kk) * ldb + col, b + static_cast<size_t>(kk) * ldb + col + nc,
+                dst + kk * kPANEL);
+            std::fill(dst + kk * kPANEL + nc, dst + (kk + 1) * kPANEL, 0.f);
+        }
+    }
+}
+
+namespace
+{
+
+// k block shared by the rows of a tile, and the tile shape handed to one task: kMC_TILES micro-tiles of rows by
+// kNC_PANELS panels. With K = 256 a panel slice is 16 KiB and the rows of a tile stay in L2.
+constexpr int kKC = 256;
+constexpr int kMC_TILES = 8;
+constexpr int kNC_PANELS = 4;
+constexpr int kMAX_MR = 6;
+
+//! c[0, m) x [0, n) (+)= a * b over kc values of k. a holds kMAX_MR row pointers, rows past m repeat row 0. b is the
+//! first panel at k, the next one starts panelStride floats later.
+using MicroKernel = void (*)(int kc, const float* const* a, const float* b, size_t panelStride, float* c, int ldc,
+    int m, int n, bool accumulate);
+
+void kernelScalar(
+    int kc, const float* const* a, const float* b, size_t, float* c, int ldc, int m, int n, bool accumulate)
+{
+    constexpr int MR = 4;
+    float acc[MR][kPANEL] = {};
+    for (int k = 0; k < kc; k++)
+    {
+        const float* bk = b + k * kPANEL;
+        for (int i = 0; i < MR; i++)
+        {
+            const float av = a[i][k];
+            for (int j = 0; j < kPANEL; j++)
+            {
+                acc[i][j] += av * bk[j];
+            }
+        }
+    }
+    for (int i = 0; i < m; i++)
+    {
+        float* ci = c + static_cast<size_t>(i) * ldc;
+        for (int j = 0; j < n; j++)
+        {
+            ci[j] = accumulate ? ci[j] + acc[i][j] : acc[i][j];
+        }
+    }
+}
+
+#ifdef BERT_CPU_X86
+__attribute__((target("avx2,fma"))) void kernelAvx2(
+    int kc, const float* const* a, const float* b, size_t, float* c, int ldc, int m, int n, bool accumulate)
+{
+    constexpr int MR = 6;
+    const float* ar[MR];
+    __m256 acc0[MR];
+    __m256 acc1[MR];
+#pragma GCC unroll 6
+    for (int i = 0; i < MR; i++)
+    {
+        ar[i] = a[i];
+        acc0[i] = _mm256_setzero_ps();
+        acc1[i] = _mm256_setzero_ps();
+    }
+    for (int k = 0; k < kc; k++)
+    {
+        const __m256 b0 = _mm256_loadu_ps(b + k * kPANEL);
+        const __m256 b1 = _mm256_loadu_ps(b + k * kPANEL + 8);
+#pragma GCC unroll 6
+        for (int i = 0; i < MR; i++)
+        {
+            const __m256 av = _mm256_broadcast_ss(ar[i] + k);
+            acc0[i] = _mm256_fmadd_ps(av, b0, acc0[i]);
+            acc1[i] = _mm256_fmadd_ps(av, b1, acc1[i]);
+        }
+    }
+#pragma GCC unroll 6
+    for (int i = 0; i < MR; i++)
+    {
+        if (i >= m)
+        {
+            break;
+        }
+        float* ci = c + static_cast<size_t>(i) * ldc;
+        if (n == kPANEL)
+        {
+            __m256 v0 = acc0[i];
+            __m256 v1 = acc1[i];
+            if (accumulate)
+            {
+                v0 = _mm256_add_ps(v0, _mm256_loadu_ps(ci));
+                v1 = _mm256_add_ps(v1, _mm256_loadu_ps(ci + 8));
+            }
+            _mm256_storeu_ps(ci, v0);
+            _mm256_storeu_ps(ci + 8, v1);
+        }
+        else
+        {
+            float tile[kPANEL];
+            _mm256_storeu_ps(tile, acc0[i]);
+            _mm256_storeu_ps(tile + 8, acc1[i]);
+            for (int j = 0; j < n; j++)
+            {
+                ci[j] = accumulate ? ci[j] + tile[j] : tile[j];
+            }
+        }
+    }
+}
+
+// 6 rows by two panels: 6 broadcasts and 2 loads feed 12 FMAs
+__attribute__((target("avx512f"))) void kernelAvx512(
+    int kc, const float* const* a, const float* b, size_t panelStride, float* c, int ldc, int m, int n, bool accumulate)
+{
+    constexpr int MR = 6;
+    const float* ar[MR];
+    __m512 acc0[MR];
+    __m512 acc1[MR];
+#pragma GCC unroll 6
+    for (int i = 0; i < MR; i++)
+    {
+        ar[i] = a[i];
+        acc0[i] = _mm512_setzero_ps();
+        acc1[i] = _mm512_setzero_ps();
+    }
+    // a single panel is read twice rather than branching in the loop
+    const float* b1 = n > kPANEL ? b + panelStride : b;
+    for (int k = 0; k < kc; k++)
+    {
+        const __m512 b0v = _mm512_loadu_ps(b + k * kPANEL);
+        const __m512 b1v = _mm512_loadu_ps(b1 + k * kPANEL);
+#pragma GCC unroll 6
+        for (int i = 0; i < MR; i++)
+        {
+            const __m512 av = _mm512_set1_ps(ar[i][k]);
+            acc0[i] = _mm512_fmadd_ps(av, b0v, acc0[i]);
+            acc1[i] = _mm512_fmadd_ps(av, b1v, acc1[i]);
+        }
+    }
+    const __mmask16 mask0 = static_cast<__mmask16>(n >= kPANEL ? 0xFFFF : (1u << n) - 1);
+    const __mmask16 mask1 = static_cast<__mmask16>(n >= 2 * kPANEL ? 0xFFFF : n > kPANEL ? (1u << (n - kPANEL)) - 1 : 0);
+#pragma GCC unroll 6
+    for (int i = 0; i < MR; i++)
+    {
+        if (i >= m)
+        {
+            break;
+        }
+        float* ci = c + static_cast<size_t>(i) * ldc;
+        __m512 v0 = acc0[i];
+        __m512 v1 = acc1[i];
+        if (accumulate)
+        {
+            v0 = _mm512_add_ps(v0, _mm512_maskz_loadu_ps(mask0, ci));
+            v1 = _mm512_add_ps(v1, _mm512_maskz_loadu_ps(mask1, ci + kPANEL));
+        }
+        _mm512_mask_storeu_ps(ci, mask0, v0);
+        _mm512_mask_storeu_ps(ci + kPANEL, mask1, v1);
+    }
+}
+#endif
+
+struct KernelInfo
+{
+    MicroKernel fn;
+    int mr;     // rows
+    int panels; // panels
+};
+
+const KernelInfo& microKernel()
+{
+    static const KernelInfo info = [] {
+        switch (gemmIsa())
+        {
+#ifdef BERT_CPU_X86
+        case Isa::kAVX512: return KernelInfo{kernelAvx512, 6, 2};
+        case Isa::kAVX2: return KernelInfo{kernelAvx2, 6, 1};
+#endif
+        default: return KernelInfo{kernelScalar, 4, 1};
+        }
+    }();
+    return info;
+}
+
+//! c[r0, r1) x panels [p0, p1) = a * b
+void gemmBlock(int r0, int r1, int p0, int p1, const float* a, int lda, const PackedMatrix& b, float* c, int ldc)
+{
+    const KernelInfo& kernel = microKernel();
+    const int K = b.rows();
+    const int colEnd = std::min(b.cols(), p1 * kPANEL);
+    if (K == 0)
+    {
+        for (int r = r0; r < r1; r++)
+        {
+            std::fill(c + static_cast<size_t>(r) * ldc + p0 * kPANEL, c + static_cast<size_t>(r) * ldc + colEnd, 0.f);
+        }
+        return;
+    }
+    const float* rows[kMAX_MR];
+    const size_t panelStride = static_cast<size_t>(K) * kPANEL;
+    for (int k0 = 0; k0 < K; k0 += kKC)
+    {
+        const int kc = std::min(kKC, K - k0);
+        for (int p = p0; p < p1; p += kernel.panels)
+        {
+            const float* bp = b.panel(p) + static_cast<size_t>(k0) * kPANEL;
+            const int col = p * kPANEL;
+            const int n = std::min(kernel.panels * kPANEL, colEnd - col);
+            for (int r = r0; r < r1; r += kernel.mr)
+            {
+                const int m = std::min(kernel.mr, r1 - r);
+                for (int i = 0; i < kernel.mr; i++)
+                {
+                    rows[i] = a + static_cast<size_t>(r + (i < m ? i : 0)) * lda + k0;
+                }
+                kernel.fn(kc, rows, bp, panelStride, c + static_cast<size_t>(r) * ldc + col, ldc, m, n, k0 > 0);
+            }
+        }
+    }
+}
+
+} // namespace
+
+void gemm(ThreadPool& pool, int m, const float* a, int lda, const PackedMatrix& b, const float* bias, float* c,
+    int ldc, Epilogue epilogue)
+{
+    const int mc = microKernel().mr * kMC_TILES;
+    const int rowBlocks = (m + mc - 1) / mc;
+    const int colBlocks = (b.panels() + kNC_PANELS - 1) / kNC_PANELS;
+    const int N = b.cols();
+    pool.parallelFor(rowBlocks * colBlocks, [&](int task, int) {
+        const int r0 = (task / colBlocks) * mc;
+        const int r1 = std::min(m, r0 + mc);
+        const int p0 = (task % colBlocks) * kNC_PANELS;
+        const int p1 = std::min(b.panels(), p0 + kNC_PANELS);
+        gemmBlock(r0, r1, p0, p1, a, lda, b, c, ldc);
+        if (!bias && epilogue == Epilogue::kNONE)
+        {
+            return;
+        }
+        // while the block is still in cache
+        const int c0 = p0 * kPANEL;
+        const int c1 = std::min(N, p1 * kPANEL);
+        for (int r = r0; r < r1; r++)
+        {
+            float* cr = c + static_cast<size_t>(r) * ldc;
+            if (bias)
+            {
+                for (int j = c0; j < c1; j++)
+                {
+                    cr[j] += bias[j];
+                }
+            }
+            if (epilogue == Epilogue::kGELU)
+            {
+                for (int j = c0; j < c1; j++)
+                {
+                    cr[j] = gelu(cr[j]);
+                }
+            }
+        }
+    });
+}
+
+void gemmSerial(int m, const float* a, int lda, const PackedMatrix& b, float* c, int ldc)
+{
+    gemmBlock(0, m, 0, b.panels(), a, lda, b, c, ldc);
+}
+
+float gelu(float x)
+{
+    // same constants as the gelu plugin
+    constexpr float A = 0.5f;
+    constexpr float B = 0.7978845608028654f;   // sqrt(2.0/M_PI)
+    constexpr float C = 0.035677408136300125f; // 0.044715 * sqrt(2.0/M_PI)
+    const float cdf = A + A * std::tanh(x * (C * x * x + B));
+    return x * cdf;
+}
+
+void layerNorm(const float* x, const float* gamma, const float* beta, float* y, int n)
+{
+    float sum = 0.f;
+    for (int i = 0; i < n; i++)
+    {
+        sum += x[i];
+    }
+    const float mu = sum / n;
+    float var = 0.f;
+    for (int i = 0; i < n; i++)
+    {
+        const float d = x[i] - mu;
+        var += d * d;
+    }
+    const float rsigma = 1.f / std::sqrt(var / n);
+    for (int i = 0; i < n; i++)
+    {
+        y[i] = gamma[i] * (x[i] - mu) * rsigma + beta[i];
+    }
+}
+
+void softmax(float* x, int n, int valid, float scale)
+{
+    valid = std::min(valid, n);
+    if (valid > 0)
+    {
+        float maxv = x[0] * scale;
+        for (int i = 1; i < valid; i++)
+        {
+            maxv = std::max(maxv, x[i] * scale);
+        }
+        float sum = 0.f;
+        for (int i = 0; i < valid; i++)
+        {
+            x[i] = std::exp(x[i] * scale - maxv);
+            sum += x[i];
+        }
+        const float inv = 1.f / sum;
+        for (int i = 0; i < valid; i++)
+        {
+            x[i] *= inv;
+        }
+    }
+    std::fill(x + std::max(valid, 0), x + n, 0.f);
+}
+
+} // namespace cpu
+} // namespace bert
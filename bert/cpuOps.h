@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_CPU_OPS_H
+#define TRT_CPU_OPS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bert
+{
+namespace cpu
+{
+
+//! \brief Fixed set of threads running parallel loops
+//! \details The calling thread takes part in every loop as thread 0, so a pool of size 1 has no worker threads.
+//! Loops must not be nested.
+class ThreadPool
+{
+public:
+    //! \param numThreads total threads including the caller, 0 means one per hardware thread
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const
+    {
+        return static_cast<int>(mWorkers.size()) + 1;
+    }
+
+    //! \brief Runs fn(index, thread) for every index in [0, n) and returns when all are done
+    //! \details thread is in [0, size()) and identifies the per-thread scratch a task may use
+    void parallelFor(int n, const std::function<void(int index, int thread)>& fn);
+
+private:
+    void work(int thread);
+    void runTasks(int thread);
+
+    std::vector<std::thread> mWorkers;
+    std::mutex mMutex;
+    std::condition_variable mStart;
+    std::condition_variable mDone;
+    const std::function<void(int, int)>* mFn{nullptr};
+    int mCount{0};
+    std::atomic<int> mNext{0};
+    int mBusy{0};
+    uint64_t mGeneration{0};
+    bool mStop{false};
+};
+
+//! \brief Instruction set of the GEMM micro-kernels
+enum class Isa
+{
+    kSCALAR,
+    kAVX2,
+    kAVX512
+};
+
+//! \brief Best instruction set of this CPU, or the one named by BERT_CPU_ISA (scalar, avx2, avx512) if it is lower
+Isa gemmIsa();
+const char* isaName(Isa isa);
+
+//! \brief Columns of a packed panel, one AVX-512 register or two AVX2 registers
+constexpr int kPANEL = 16;
+
+//! \brief Right-hand side of gemm, a K x N matrix stored as panels of kPANEL columns
+//! \details Panel p holds columns [p * kPANEL, (p + 1) * kPANEL) row after row, so the micro-kernels read one
+//! contiguous vector per k. The last panel is zero padded.
+class PackedMatrix
+{
+public:
+    //! \brief Packs the transpose of w, a N x K row major matrix such as a fully connected kernel [out][in]
+    void packTransposed(const float* w, int n, int k, int ldw);
+    //! \brief Packs b, a K x N row major matrix
+    void pack(const float* b, int k, int n, int ldb);
+    //! \brief Reserves storage for k x n, so that packing smaller matrices later does not allocate
+    void reserve(int k, int n);
+
+    int rows() const
+    {
+        return mK;
+    }
+    int cols() const
+    {
+        return mN;
+    }
+    int panels() const
+    {
+        return (mN + kPANEL - 1) / kPANEL;
+    }
+    const float* panel(int p) const
+    {
+        return mData.data() + static_cast<size_t>(p) * mK * kPANEL;
+    }
+
+private:
+    int mK{0};
+    int mN{0};
+    std::vector<float> mData;
+};
+
+enum class Epilogue
+{
+    kNONE,
+    kGELU
+};
+
+//! \brief c = epilogue(a * b + bias) for a m x K row major matrix a, on the threads of pool
+//! \param bias optional, N values
+void gemm(ThreadPool& pool, int m, const float* a, int lda, const PackedMatrix& b, const float* bias, float* c,
+    int ldc, Epilogue epilogue = Epilogue::kNONE);
+
+//! \brief c = a * b on the calling thread, for products computed inside parallel tasks
+void gemmSerial(int m, const float* a, int lda, const PackedMatrix& b, float* c, int ldc);
+
+//! \brief GELU, tanh approximation as in the gelu plugin
+float gelu(float x);
+
+//! \brief y = gamma * (x - mean) / stddev + beta over n values, like the layer norm of the plugins (no epsilon)
+void layerNorm(const float* x, const float* gamma, const float* beta, float* y, int n);
+
+//! \brief In-place softmax of x[0, valid), x[valid, n) is set to 0. x is scaled by scale first.
+void softmax(float* x, int n, int valid, float scale = 1.f);
+
+} // namespace cpu
+} // namespace bert
+
+#endif // TRT_CPU_OPS_H
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "deviceOps.h"
+#include "common.h"
+
+namespace bert
+{
+
+void* CudaDeviceOps::deviceMalloc(size_t len)
+{
+    void* ptr = nullptr;
+    CHECK(cudaMalloc(&ptr, len));
+    return ptr;
+}
+
+void CudaDeviceOps::deviceFree(void* ptr)
+{
+    CHECK(cudaFree(ptr));
+}
+
+void CudaDeviceOps::memcpyH2D(void* dst, const void* src, size_t len, cudaStream_t stream)
+{
+    CHECK(cudaMemcpyAsync(dst, src, len, cudaMemcpyHostToDevice, stream));
+}
+
+void CudaDeviceOps::memcpyD2H(void* dst, const void* src, size_t len, cudaStream_t stream)
+{
+    CHECK(cudaMemcpyAsync(dst, src, len, cudaMemcpyDeviceToHost, stream));
+}
+
+void CudaDeviceOps::eventCreate(cudaEvent_t* event)
+{
+    CHECK(cudaEventCreate(event));
+}
+
+void CudaDeviceOps::eventDestroy(cudaEvent_t event)
+{
+    CHECK(cudaEventDestroy(event));
+}
+
+void CudaDeviceOps::eventRecord(cudaEvent_t event, cudaStream_t stream)
+{
+    CHECK(cudaEventRecord(event, stream));
+}
+
+float CudaDeviceOps::eventElapsedMs(cudaEvent_t start, cudaEvent_t stop)
+{
+    float ms = 0.f;
+    CHECK(cudaEventElapsedTime(&ms, start, stop));
+    return ms;
+}
+
+void CudaDeviceOps::streamSynchronize(cudaStream_t stream)
+{
+    CHECK(cudaStreamSynchronize(stream));
+}
+
+DeviceOps& getCudaDeviceOps()
+{
+    static CudaDeviceOps ops;
+    return ops;
+}
+
+EventPool::EventPool(DeviceOps& ops)
+    : mOps(ops)
+{
+}
+
+EventPool::~EventPool()
+{
+    for (auto& events : mAll)
+    {
+        mOps.eventDestroy(events->startTotal);
+        mOps.eventDestroy(events->startCompute);
+        mOps.eventDestroy(events->stopCompute);
+        mOps.eventDestroy(events->stopTotal);
+    }
+}
+
+EventSet* EventPool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mFree.empty())
+    {
+        EventSet* events = mFree.back();
+        mFree.pop_back();
+        return events;
+    }
+
+    std::unique_ptr<EventSet> events(new EventSet);
+    mOps.eventCreate(&events->startTotal);
+    mOps.eventCreate(&events->startCompute);
+    mOps.eventCreate(&events->stopCompute);
+    mOps.eventCreate(&events->stopTotal);
+    mAll.push_back(std::move(events));
+    return mAll.back().get();
+}
+
+void EventPool::release(EventSet* events)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFree.push_back(events);
+}
+}
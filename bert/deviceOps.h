@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_DEVICE_OPS_H
+#define TRT_DEVICE_OPS_H
+
+#include <cuda_runtime_api.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Thin interface over the device calls used on the inference path
+//! \details Driver::run and the int8 calibrator only talk to the device through this interface, so a host-memory
+//! implementation can stand in for CUDA when exercising them without a GPU.
+struct DeviceOps
+{
+    virtual ~DeviceOps() {}
+
+    virtual void* deviceMalloc(size_t len) = 0;
+    virtual void deviceFree(void* ptr) = 0;
+
+    virtual void memcpyH2D(void* dst, const void* src, size_t len, cudaStream_t stream) = 0;
+    virtual void memcpyD2H(void* dst, const void* src, size_t len, cudaStream_t stream) = 0;
+
+    virtual void eventCreate(cudaEvent_t* event) = 0;
+    virtual void eventDestroy(cudaEvent_t event) = 0;
+    virtual void eventRecord(cudaEvent_t event, cudaStream_t stream) = 0;
+    //! \brief Milliseconds between two recorded events. Only valid after the stream has been synchronized.
+    virtual float eventElapsedMs(cudaEvent_t start, cudaEvent_t stop) = 0;
+
+    virtual void streamSynchronize(cudaStream_t stream) = 0;
+};
+
+//! \brief DeviceOps backed by the CUDA runtime
+struct CudaDeviceOps : DeviceOps
+{
+    void* deviceMalloc(size_t len) override;
+    void deviceFree(void* ptr) override;
+
+    void memcpyH2D(void* dst, const void* src, size_t len, cudaStream_t stream) override;
+    void memcpyD2H(void* dst, const void* src, size_t len, cudaStream_t stream) override;
+
+    void eventCreate(cudaEvent_t* event) override;
+    void eventDestroy(cudaEvent_t event) override;
+    void eventRecord(cudaEvent_t event, cudaStream_t stream) override;
+    float eventElapsedMs(cudaEvent_t start, cudaEvent_t stop) override;
+
+    void streamSynchronize(cudaStream_t stream) override;
+};
+
+//! \brief Process-wide CUDA implementation used by default by every Driver
+DeviceOps& getCudaDeviceOps();
+
+//! \brief Events bracketing one inference: [startTotal [startCompute compute stopCompute] stopTotal]
+struct EventSet
+{
+    cudaEvent_t startTotal{nullptr};
+    cudaEvent_t startCompute{nullptr};
+    cudaEvent_t stopCompute{nullptr};
+    cudaEvent_t stopTotal{nullptr};
+};
+
+//! \brief Pool of reusable event sets
+//! \details Events are created on first use on the current device and live until the pool is destroyed,
+//! so the steady-state run path never creates or destroys CUDA events.
+class EventPool
+{
+public:
+    explicit EventPool(DeviceOps& ops);
+    ~EventPool();
+
+    EventPool(const EventPool&) = delete;
+    EventPool& operator=(const EventPool&) = delete;
+
+    EventSet* acquire();
+    void release(EventSet* events);
+
+private:
+    DeviceOps& mOps;
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<EventSet>> mAll;
+    std::vector<EventSet*> mFree;
+};
+}
+#endif // TRT_DEVICE_OPS_H
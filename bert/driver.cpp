@@ -18,6 +18,7 @@
 #include "cuda_profiler_api.h"
 #include <iostream>
 #include "OnnxParser.h"
+#include "requestTrace.h"
 
 using namespace nvinfer1;
 using namespace samplesCommon;
@@ -54,6 +55,11 @@ IBuilderConfig* Driver::getBuilderConfig() const
     {
         config->setFlag(BuilderFlag::kFP16);
     }
+    if (mCalibrator)
+    {
+        config->setFlag(BuilderFlag::kINT8);
+        config->setInt8Calibrator(mCalibrator);
+    }
     return config;
 }
 
@@ -126,15 +132,32 @@ void Driver::buildNetwork(INetworkDefinition* network, const HostTensorMap& para
     network->markOutput(*fc->getOutput(0));
 }
 
+void Driver::setDeviceOps(DeviceOps* ops)
+{
+    mDeviceOps = ops;
+    mEventPool.reset(new EventPool(*ops));
+}
+
+void Driver::setInt8Calibrator(IInt8Calibrator* calibrator)
+{
+    mCalibrator = calibrator;
+}
+
+int Driver::getBindingIndex(const std::string& name, DataType type) const
+{
+    const int idx = mEngine->getBindingIndex(name.c_str());
+    assert(idx >= 0);
+    assert(mEngine->getBindingDataType(idx) == type);
+    return idx;
+}
+
 void Driver::h2d(const HostTensorMap& hostBuffers, cudaStream_t stream)
 {
     for (auto& kv : hostBuffers)
     {
-        const int idx = mEngine->getBindingIndex(kv.first.c_str());
-        assert(idx >= 0);
-        assert(mEngine->getBindingDataType(idx) == kv.second->mType);
+        const int idx = getBindingIndex(kv.first, kv.second->mType);
         const size_t len = kv.second->mNbBytes;
-        CHECK(cudaMemcpyAsync(mBuffers[idx], kv.second->mData, len, cudaMemcpyHostToDevice, stream));
+        mDeviceOps->memcpyH2D(mBuffers[idx], kv.second->mData, len, stream);
         gLogVerbose << "Binding: " << kv.first << ", idx: " << idx << ", uploading " << len << " bytes" << std::endl;
     }
 }
@@ -143,15 +166,79 @@ void Driver::d2h(HostTensorMap& hostBuffers, cudaStream_t stream)
 {
     for (auto& kv : hostBuffers)
     {
-        const int idx = mEngine->getBindingIndex(kv.first.c_str());
-        assert(idx >= 0);
-        assert(mEngine->getBindingDataType(idx) == kv.second->mType);
+        const int idx = getBindingIndex(kv.first, kv.second->mType);
         const size_t len = kv.second->mNbBytes;
-        CHECK(cudaMemcpyAsync(kv.second->mData, mBuffers[idx], len, cudaMemcpyDeviceToHost, stream));
+        mDeviceOps->memcpyD2H(kv.second->mData, mBuffers[idx], len, stream);
         gLogVerbose << "Binding: " << kv.first << ", idx: " << idx << ", downloading " << len << " bytes" << std::endl;
     }
 }
 
+void Driver::h2d(const HostBinding* bindings, int count, cudaStream_t stream)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (bindings[i].index >= 0)
+        {
+            mDeviceOps->memcpyH2D(mBuffers[bindings[i].index], bindings[i].data, bindings[i].nbBytes, stream);
+        }
+    }
+}
+
+void Driver::d2h(const HostBinding* bindings, int count, cudaStream_t stream)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (bindings[i].index >= 0)
+        {
+            mDeviceOps->memcpyD2H(bindings[i].data, mBuffers[bindings[i].index], bindings[i].nbBytes, stream);
+        }
+    }
+}
+
+void Driver::run(const HostBinding* in, int nbIn, const HostBinding* out, int nbOut, const int batchSize,
+    cudaStream_t stream)
+{
+    {
+        TraceScope span("enqueue");
+        h2d(in, nbIn, stream);
+        infer(batchSize, stream);
+        d2h(out, nbOut, stream);
+    }
+    TraceScope span("stream_sync");
+    mDeviceOps->streamSynchronize(stream);
+}
+
+void Driver::run(const HostTensorMap& inCfg, HostTensorMap& outCfg, const int batchSize, cudaStream_t stream,
+    RunTimes* times)
+{
+    if (!times)
+    {
+        {
+            TraceScope span("enqueue");
+            h2d(inCfg, stream);
+            infer(batchSize, stream);
+            d2h(outCfg, stream);
+        }
+        TraceScope span("stream_sync");
+        mDeviceOps->streamSynchronize(stream);
+        return;
+    }
+
+    EventSet* events = mEventPool->acquire();
+    mDeviceOps->eventRecord(events->startTotal, stream);
+    h2d(inCfg, stream);
+    mDeviceOps->eventRecord(events->startCompute, stream);
+    infer(batchSize, stream);
+    mDeviceOps->eventRecord(events->stopCompute, stream);
+    d2h(outCfg, stream);
+    mDeviceOps->eventRecord(events->stopTotal, stream);
+    mDeviceOps->streamSynchronize(stream);
+
+    times->msCompute = mDeviceOps->eventElapsedMs(events->startCompute, events->stopCompute);
+    times->msTotal = mDeviceOps->eventElapsedMs(events->startTotal, events->stopTotal);
+    mEventPool->release(events);
+}
+
 void Driver::benchmark(const HostTensorMap& inCfg, HostTensorMap& outCfg, const int batchSize, cudaStream_t stream,
     vector<float>& timesTotal, vector<float>& timesCompute, const bool withMemcpy)
 {
@@ -315,6 +402,11 @@ IBuilderConfig* DynamicDriver::getBuilderConfig() const
             profile->setDimensions(kv.first.c_str(), OptProfileSelector::kOPT, get<OPIDX_OPT>(kv.second));
         }
         config->addOptimizationProfile(profile);
+        // calibration runs at the shapes of the first profile
+        if (mCalibrator && !config->getCalibrationProfile())
+        {
+            config->setCalibrationProfile(profile);
+        }
     }
     return config;
 }
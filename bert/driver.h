@@ -18,6 +18,7 @@
 #define TRT_DRIVER_H
 
 #include "buffers.h"
+#include "deviceOps.h"
 #include <typeinfo>
 #include <vector>
 
@@ -37,6 +38,15 @@ struct HostTensor
 
 using HostTensorMap = std::map<std::string, std::shared_ptr<HostTensor>>;
 
+//! \brief Host buffer of one engine binding, by index: see Driver::getBindingIndex. Bindings with a negative index
+//! are skipped.
+struct HostBinding
+{
+    int index;
+    void* data;
+    size_t nbBytes;
+};
+
 struct InferDeleter1
 {
     template <typename T>
@@ -52,6 +62,13 @@ struct InferDeleter1
 template <typename T>
 using SampleUniquePtr = std::unique_ptr<T, InferDeleter1>;
 
+//! \brief Device-side timings of a single Driver::run, in milliseconds
+struct RunTimes
+{
+    float msTotal{0.f};   // h2d + compute + d2h
+    float msCompute{0.f}; // compute only
+};
+
 struct Driver
 {
     std::vector<void*> mBuffers;
@@ -65,6 +82,11 @@ struct Driver
     size_t mMaxWorkspaceSize;
     bool mUseFp16;
 
+    DeviceOps* mDeviceOps{&getCudaDeviceOps()};
+    //! int8 calibrator, not owned. When set, the engine is built with int8 enabled (on top of fp16 if requested)
+    nvinfer1::IInt8Calibrator* mCalibrator{nullptr};
+    std::unique_ptr<EventPool> mEventPool{new EventPool(getCudaDeviceOps())};
+
     Driver(const int maxBatchSize, const bool useFp16, const size_t maxWorkspaceSize);
 
     Driver(const std::string& enginePath);
@@ -80,14 +102,37 @@ struct Driver
     void init(const HostTensorMap& params);
 	void initByOnnx(std::string modelFile);
 
+    //! \brief Replaces the device calls used by h2d/d2h/run. Must be called before the first run.
+    void setDeviceOps(DeviceOps* ops);
+
+    //! \brief Enables int8 for the next build, calibrated by \p calibrator. Must be called before init.
+    void setInt8Calibrator(nvinfer1::IInt8Calibrator* calibrator);
+
+    //! \brief Returns the binding index of a named tensor and checks it has the expected type
+    virtual int getBindingIndex(const std::string& name, nvinfer1::DataType type) const;
+
     void h2d(const HostTensorMap& inCfg, cudaStream_t stream);
 
     void d2h(HostTensorMap& outCfg, cudaStream_t stream);
 
-    void infer(const int batchSize, cudaStream_t stream);
+    void h2d(const HostBinding* bindings, int count, cudaStream_t stream);
+
+    void d2h(const HostBinding* bindings, int count, cudaStream_t stream);
+
+    virtual void infer(const int batchSize, cudaStream_t stream);
 
     void infer(const HostTensorMap& inCfg, HostTensorMap& outCfg, const int batchSize, cudaStream_t stream);
 
+    //! \brief Production inference path: h2d, enqueue, d2h and a sync on \p stream only
+    //! \details Timing is only recorded when \p times is given, using events from the driver's pool.
+    //! Unlike benchmark, nothing is created, profiled or logged per call.
+    void run(const HostTensorMap& inCfg, HostTensorMap& outCfg, const int batchSize, cudaStream_t stream,
+        RunTimes* times = nullptr);
+
+    //! \brief run on bindings resolved once by the caller: no name lookup and no allocation per call
+    void run(const HostBinding* in, int nbIn, const HostBinding* out, int nbOut, const int batchSize,
+        cudaStream_t stream);
+
     void benchmark(const HostTensorMap& inCfg, HostTensorMap& outCfg, const int batchSize, cudaStream_t stream,
         std::vector<float>& timesTotal, std::vector<float>& timesCompute, const bool withMemcpy = true);
 
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "ExternalData.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace onnx2trt
+{
+
+ExternalDataFiles::~ExternalDataFiles()
+{
+    for (auto& file : mFiles)
+    {
+        if (file.second.size > 0)
+        {
+            munmap(file.second.address, file.second.size);
+        }
+    }
+}
+
+void ExternalDataFiles::setDirectory(std::string directory)
+{
+    mDirectory = std::move(directory);
+}
+
+// Weights may only come from files next to the model, a model must not be able to make the
+// parser read arbitrary files.
+static bool isInsideModelDirectory(const std::string& location)
+{
+    if (location.empty() || location[0] == '/')
+    {
+        return false;
+    }
+    size_t begin = 0;
+    while (begin <= location.size())
+    {
+        size_t end = location.find('/', begin);
+        if (end == std::string::npos)
+        {
+            end = location.size();
+        }
+        if (location.compare(begin, end - begin, "..") == 0)
+        {
+            return false;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+const void* ExternalDataFiles::map(const std::string& location, size_t offset, size_t length, std::string* error)
+{
+    if (!isInsideModelDirectory(location))
+    {
+        *error = "external data location must be a relative path inside the model directory: " + location;
+        return nullptr;
+    }
+    auto it = mFiles.find(location);
+    if (it == mFiles.end())
+    {
+        const std::string path = mDirectory.empty() ? location : mDirectory + "/" + location;
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            *error = "could not open " + path + ": " + std::strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        Mapping mapping{nullptr, 0};
+        if (fstat(fd, &st) != 0)
+        {
+            *error = "could not stat " + path + ": " + std::strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        if (st.st_size > 0)
+        {
+            void* address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED)
+            {
+                *error = "could not map " + path + ": " + std::strerror(errno);
+                close(fd);
+                return nullptr;
+            }
+            mapping = Mapping{address, static_cast<size_t>(st.st_size)};
+        }
+        // The mapping keeps the file alive.
+        close(fd);
+        it = mFiles.emplace(location, mapping).first;
+    }
+    const Mapping& mapping = it->second;
+    if (offset > mapping.size || length > mapping.size - offset)
+    {
+        *error = "external data range [" + std::to_string(offset) + ", " + std::to_string(offset + length)
+            + ") is outside of " + location + " (" + std::to_string(mapping.size) + " bytes)";
+        return nullptr;
+    }
+    return static_cast<const char*>(mapping.address) + offset;
+}
+
+} // namespace onnx2trt
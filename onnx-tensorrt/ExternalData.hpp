@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
+namespace onnx2trt
+{
+
+// Read-only memory maps of the files holding the external_data of ONNX initializers.
+// Weights point straight into the mappings, so a weight is only paged in from disk when
+// TensorRT reads it, and no copy of it is ever made on the heap. Mappings are created on
+// first use and stay valid until the object is destroyed.
+class ExternalDataFiles
+{
+public:
+    ExternalDataFiles() = default;
+    ExternalDataFiles(const ExternalDataFiles&) = delete;
+    ExternalDataFiles& operator=(const ExternalDataFiles&) = delete;
+    ~ExternalDataFiles();
+
+    // Locations are resolved relative to the directory of the model file.
+    void setDirectory(std::string directory);
+
+    // Returns the address of bytes [offset, offset + length) of the file at location, or
+    // nullptr and a description in *error if the location is not a relative path inside
+    // the model directory, the file cannot be mapped or the range is out of bounds.
+    const void* map(const std::string& location, size_t offset, size_t length, std::string* error);
+
+private:
+    struct Mapping
+    {
+        void* address;
+        size_t size;
+    };
+    std::string mDirectory;
+    std::unordered_map<std::string, Mapping> mFiles;
+};
+
+} // namespace onnx2trt
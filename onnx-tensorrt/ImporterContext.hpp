@@ -22,10 +22,11 @@
 
 #pragma once
 
+#include "ExternalData.hpp"
+#include "WeightsArena.hpp"
 #include "onnx2trt.hpp"
 #include "onnx2trt_utils.hpp"
 
-#include <list>
 #include <unordered_map>
 
 namespace onnx2trt
@@ -35,7 +36,8 @@ class ImporterContext final : public IImporterContext
 {
     nvinfer1::INetworkDefinition* _network;
     nvinfer1::ILogger* _logger;
-    std::list<std::vector<uint8_t>> _temp_bufs;
+    WeightsArena _temp_weights; // Freed with the parser, which has to outlive the engine build.
+    ExternalDataFiles _external_data;
     StringMap<nvinfer1::ITensor*> _user_inputs;
     StringMap<nvinfer1::ITensor**> _user_outputs;
     StringMap<int64_t> _opsets;
@@ -139,16 +141,32 @@ public:
     {
         ShapedWeights weights(type, nullptr, shape);
         // Need special logic for handling scalars.
-        if (shape.nbDims == 0)
-        {
-            _temp_bufs.push_back(std::vector<uint8_t>(getDtypeSize(type)));
-        }
-        else
+        weights.values = _temp_weights.allocate(shape.nbDims == 0 ? getDtypeSize(type) : weights.size_bytes());
+        return weights;
+    }
+    virtual void setTempWeightsTag(const std::string& tag) override
+    {
+        _temp_weights.setTag(tag);
+    }
+    const WeightsArena& tempWeights() const
+    {
+        return _temp_weights;
+    }
+
+    virtual const void* mapExternalData(const std::string& location, size_t offset, size_t length) override
+    {
+        std::string error;
+        const void* data = _external_data.map(location, offset, length, &error);
+        if (!data)
         {
-            _temp_bufs.push_back(std::vector<uint8_t>(weights.size_bytes()));
+            auto* ctx = this; // To enable logging.
+            LOG_ERROR(error);
         }
-        weights.values = _temp_bufs.back().data();
-        return weights;
+        return data;
+    }
+    void setModelDirectory(std::string directory)
+    {
+        _external_data.setDirectory(std::move(directory));
     }
 
     bool setUserInput(const char* name, nvinfer1::ITensor* input)
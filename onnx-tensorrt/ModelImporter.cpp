@@ -85,6 +85,7 @@ Status parseGraph(
     IImporterContext* ctx, const ::ONNX_NAMESPACE::GraphProto& graph, bool deserializingINetwork, int* currentNode)
 {
     // Import initializers.
+    ctx->setTempWeightsTag("initializer");
     for (const ::ONNX_NAMESPACE::TensorProto& initializer : graph.initializer())
     {
         LOG_VERBOSE("Importing initializer: " << initializer.name());
@@ -105,6 +106,7 @@ Status parseGraph(
         }
         const auto& node = graph.node(nodeIndex);
         LOG_VERBOSE("Parsing node: " << node.name() << " [" << node.op_type() << "]");
+        ctx->setTempWeightsTag(node.op_type());
 
         // Assemble node inputs. These may come from outside the subgraph.
         std::vector<TensorOrWeights> nodeInputs;
@@ -617,19 +619,32 @@ Status ModelImporter::importModel(
     }
 
     removeShapeTensorCasts(ctx);
+    LOG_INFO(_importer_ctx.tempWeights().report());
     return Status::success();
 }
 
 bool ModelImporter::parseFromFile(const char* onnxModelFile, int verbosity)
 {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
-    ::ONNX_NAMESPACE::ModelProto onnx_model;
+    _current_node = -1;
+    // The model is parsed straight from the file into the copy that owns the weights, and initializers stored as
+    // external data are mapped from the files next to it rather than read into memory.
+    _onnx_models.emplace_back();
+    ::ONNX_NAMESPACE::ModelProto& onnx_model = _onnx_models.back();
+    const std::string modelPath(onnxModelFile);
+    const size_t slash = modelPath.find_last_of('/');
+    _importer_ctx.setModelDirectory(slash == std::string::npos ? "." : modelPath.substr(0, slash));
 
     bool is_binary = ParseFromFile_WAR(&onnx_model, onnxModelFile);
-    if (!is_binary && !ParseFromTextFile(&onnx_model, onnxModelFile))
+    if (!is_binary)
     {
-        cerr << "Failed to parse ONNX model from file" << onnxModelFile << endl;
-        return EXIT_FAILURE;
+        onnx_model.Clear();
+        if (!ParseFromTextFile(&onnx_model, onnxModelFile))
+        {
+            cerr << "Failed to parse ONNX model from file " << onnxModelFile << endl;
+            _onnx_models.pop_back();
+            return false;
+        }
     }
 
     if (verbosity >= (int) nvinfer1::ILogger::Severity::kWARNING)
@@ -646,50 +661,49 @@ bool ModelImporter::parseFromFile(const char* onnxModelFile, int verbosity)
         cout << "Doc string:       " << onnx_model.doc_string() << endl;
         cout << "----------------------------------------------------------------" << endl;
     }
+    if (verbosity >= (int) nvinfer1::ILogger::Severity::kWARNING
+        && onnx_model.ir_version() > ::ONNX_NAMESPACE::IR_VERSION)
+    {
+        cerr << "WARNING: ONNX model has a newer ir_version (" << onnx_ir_version_string(onnx_model.ir_version())
+             << ") than this parser was built against (" << onnx_ir_version_string(::ONNX_NAMESPACE::IR_VERSION)
+             << ")." << endl;
+    }
 
-    { //...Read input file, parse it
-        std::ifstream onnx_file(onnxModelFile, std::ios::binary | std::ios::ate);
-        std::streamsize file_size = onnx_file.tellg();
-        onnx_file.seekg(0, std::ios::beg);
-        std::vector<char> onnx_buf(file_size);
-        if (!onnx_file.read(onnx_buf.data(), onnx_buf.size()))
-        {
-            cerr << "ERROR: Failed to read from file " << onnxModelFile << endl;
-            return false;
-        }
-        if (!parse(onnx_buf.data(), onnx_buf.size()))
+    Status status = this->importModel(onnx_model, 0, nullptr);
+    if (status.is_error())
+    {
+        status.setNode(_current_node);
+        _errors.push_back(status);
+        int nerror = getNbErrors();
+        for (int i = 0; i < nerror; ++i)
         {
-            int nerror = getNbErrors();
-            for (int i = 0; i < nerror; ++i)
+            nvonnxparser::IParserError const* error = getError(i);
+            if (error->node() != -1)
             {
-                nvonnxparser::IParserError const* error = getError(i);
-                if (error->node() != -1)
+                ::ONNX_NAMESPACE::NodeProto const& node = onnx_model.graph().node(error->node());
+                cerr << "While parsing node number " << error->node() << " [" << node.op_type();
+                if (node.output().size())
                 {
-                    ::ONNX_NAMESPACE::NodeProto const& node = onnx_model.graph().node(error->node());
-                    cerr << "While parsing node number " << error->node() << " [" << node.op_type();
-                    if (node.output().size() && verbosity >= (int) nvinfer1::ILogger::Severity::kVERBOSE)
-                    {
-                        cerr << " -> \"" << node.output(0) << "\"";
-                    }
-                    cerr << "]:" << endl;
-                    if (verbosity >= (int) nvinfer1::ILogger::Severity::kVERBOSE)
-                    {
-                        cout << "--- Begin node ---" << endl;
-                        cout << node << endl;
-                        cout << "--- End node ---" << endl;
-                    }
+                    cerr << " -> \"" << node.output(0) << "\"";
+                }
+                cerr << "]:" << endl;
+                if (verbosity >= (int) nvinfer1::ILogger::Severity::kINFO)
+                {
+                    cerr << "--- Begin node ---" << endl;
+                    cerr << node << endl;
+                    cerr << "--- End node ---" << endl;
                 }
-                cerr << "ERROR: " << error->file() << ":" << error->line() << " In function " << error->func() << ":\n"
-                     << "[" << static_cast<int>(error->code()) << "] " << error->desc() << endl;
             }
-            return false;
+            cerr << "ERROR: " << error->file() << ":" << error->line() << " In function " << error->func() << ":\n"
+                 << "[" << static_cast<int>(error->code()) << "] " << error->desc() << endl;
         }
+        return false;
+    }
 
-        if (verbosity >= (int) nvinfer1::ILogger::Severity::kVERBOSE)
-        {
-            cout << " ----- Parsing of ONNX model " << onnxModelFile << " is Done ---- " << endl;
-        }
-    } //...End Reading input file, parsing it
+    if (verbosity >= (int) nvinfer1::ILogger::Severity::kVERBOSE)
+    {
+        cout << " ----- Parsing of ONNX model " << onnxModelFile << " is Done ---- " << endl;
+    }
     return true;
 }
 
@@ -23,8 +23,14 @@
 #include "ShapedWeights.hpp"
 #include "onnx2trt_utils.hpp"
 #include "trt_utils.hpp"
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
 
 namespace onnx2trt
 {
@@ -84,55 +90,266 @@ ShapedWeights::operator nvinfer1::Weights() const
     return w;
 }
 
-template <typename DType>
-void transpose2DWeights(ShapedWeights const& weights, nvinfer1::Dims const& new_shape, ShapedWeights* result)
+namespace
 {
-    DType const* src = reinterpret_cast<DType*>(weights.values);
-    DType* dst = reinterpret_cast<DType*>(result->values);
-    int src_stride = weights.shape.d[1];
-    int dst_stride = result->shape.d[1];
-    for (int i = 0; i < new_shape.d[0]; ++i)
+
+// Weights with at least this many elements are transposed on several threads.
+constexpr size_t kParallelTransposeElements = 1 << 20;
+constexpr size_t kTransposeTile = 32;
+
+// Runs f(begin, end) over [0, n) on up to maxThreads threads (0: hardware_concurrency), in chunks of at least
+// grain.
+template <typename Func>
+void parallelFor(size_t n, size_t grain, int maxThreads, Func f)
+{
+    const size_t nbCores
+        = maxThreads > 0 ? static_cast<size_t>(maxThreads) : std::max(1u, std::thread::hardware_concurrency());
+    const size_t nbThreads = std::min(nbCores, std::max<size_t>(1, n / std::max<size_t>(grain, 1)));
+    if (nbThreads <= 1)
+    {
+        f(size_t{0}, n);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(nbThreads - 1);
+    const size_t chunk = (n + nbThreads - 1) / nbThreads;
+    for (size_t begin = chunk; begin < n; begin += chunk)
+    {
+        threads.emplace_back(f, begin, std::min(n, begin + chunk));
+    }
+    f(size_t{0}, std::min(n, chunk));
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+// The permutation as seen from the output: its dimensions, row-major, and the input stride of each of them.
+// Size 1 axes are dropped and output axes that are also adjacent in the input are merged, so a 2-D
+// transpose of a [1, K, N] tensor or a [B, M, K] -> [B, M, K] permutation end up as what they really are.
+struct TransposePlan
+{
+    int rank{0};
+    size_t dims[nvinfer1::Dims::MAX_DIMS];
+    size_t srcStrides[nvinfer1::Dims::MAX_DIMS];
+};
+
+TransposePlan makeTransposePlan(nvinfer1::Dims const& shape, nvinfer1::Permutation const& perm)
+{
+    size_t inputStrides[nvinfer1::Dims::MAX_DIMS];
+    size_t stride = 1;
+    for (int d = shape.nbDims - 1; d >= 0; --d)
+    {
+        inputStrides[d] = stride;
+        stride *= shape.d[d];
+    }
+    TransposePlan plan;
+    for (int d = 0; d < shape.nbDims; ++d)
     {
-        for (int j = 0; j < new_shape.d[1]; ++j)
+        const size_t dim = shape.d[perm.order[d]];
+        const size_t srcStride = inputStrides[perm.order[d]];
+        if (dim == 1)
+        {
+            continue;
+        }
+        if (plan.rank > 0 && plan.srcStrides[plan.rank - 1] == srcStride * dim)
         {
-            dst[i * dst_stride + j] = src[j * src_stride + i];
+            plan.dims[plan.rank - 1] *= dim;
+            plan.srcStrides[plan.rank - 1] = srcStride;
+            continue;
         }
+        plan.dims[plan.rank] = dim;
+        plan.srcStrides[plan.rank] = srcStride;
+        ++plan.rank;
     }
+    return plan;
 }
 
-bool transposeWeights(ShapedWeights const& weights, nvinfer1::Permutation const& perm, ShapedWeights* result)
+// Source offset of the index-th element of the output axes in [0, rank).
+size_t sourceOffset(TransposePlan const& plan, int rank, size_t index)
 {
-    nvinfer1::Dims shape = weights.shape;
-    nvinfer1::Dims new_shape;
-    new_shape.nbDims = shape.nbDims;
-    for (int d = 0; d < shape.nbDims; ++d)
+    size_t offset = 0;
+    for (int d = rank - 1; d >= 0; --d)
     {
-        new_shape.d[d] = shape.d[perm.order[d]];
-        result->shape.d[d] = new_shape.d[d];
+        offset += (index % plan.dims[d]) * plan.srcStrides[d];
+        index /= plan.dims[d];
     }
-    // TODO: Need to generalize this transpose implementation
-    assert(perm.order[0] == 1 && perm.order[1] == 0);
+    return offset;
+}
 
-    if (shape.nbDims == 2)
+// dst[i * dstStride + j] = src[j * srcStride + i] for i in [0, rows), j in [0, cols).
+template <typename T>
+void transposeTile(T const* src, size_t srcStride, T* dst, size_t dstStride, size_t rows, size_t cols)
+{
+    for (size_t i = 0; i < rows; ++i)
     {
-        if (weights.type == ::ONNX_NAMESPACE::TensorProto::FLOAT)
+        for (size_t j = 0; j < cols; ++j)
         {
-            transpose2DWeights<float>(weights, new_shape, result);
+            dst[i * dstStride + j] = src[j * srcStride + i];
         }
-        else if (weights.type == ::ONNX_NAMESPACE::TensorProto::FLOAT16)
+    }
+}
+
+#if defined(__SSE2__)
+// 4-byte elements are moved 4x4 at a time through SSE registers.
+template <>
+void transposeTile<uint32_t>(
+    uint32_t const* src, size_t srcStride, uint32_t* dst, size_t dstStride, size_t rows, size_t cols)
+{
+    const size_t rows4 = rows & ~size_t{3};
+    const size_t cols4 = cols & ~size_t{3};
+    for (size_t i = 0; i < rows4; i += 4)
+    {
+        for (size_t j = 0; j < cols4; j += 4)
         {
-            transpose2DWeights<uint16_t>(weights, new_shape, result);
+            uint32_t const* s = src + j * srcStride + i;
+            __m128 r0 = _mm_loadu_ps(reinterpret_cast<float const*>(s));
+            __m128 r1 = _mm_loadu_ps(reinterpret_cast<float const*>(s + srcStride));
+            __m128 r2 = _mm_loadu_ps(reinterpret_cast<float const*>(s + 2 * srcStride));
+            __m128 r3 = _mm_loadu_ps(reinterpret_cast<float const*>(s + 3 * srcStride));
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            uint32_t* d = dst + i * dstStride + j;
+            _mm_storeu_ps(reinterpret_cast<float*>(d), r0);
+            _mm_storeu_ps(reinterpret_cast<float*>(d + dstStride), r1);
+            _mm_storeu_ps(reinterpret_cast<float*>(d + 2 * dstStride), r2);
+            _mm_storeu_ps(reinterpret_cast<float*>(d + 3 * dstStride), r3);
         }
-        else
+        for (size_t j = cols4; j < cols; ++j)
         {
-            return false;
+            for (size_t i2 = i; i2 < i + 4; ++i2)
+            {
+                dst[i2 * dstStride + j] = src[j * srcStride + i2];
+            }
         }
     }
-    else
+    for (size_t i = rows4; i < rows; ++i)
+    {
+        for (size_t j = 0; j < cols; ++j)
+        {
+            dst[i * dstStride + j] = src[j * srcStride + i];
+        }
+    }
+}
+#endif
+
+template <typename T>
+void transposeElements(TransposePlan const& plan, T const* src, T* dst, int maxThreads)
+{
+    size_t count = 1;
+    for (int d = 0; d < plan.rank; ++d)
+    {
+        count *= plan.dims[d];
+    }
+    const size_t grain = kParallelTransposeElements / 4;
+    const int last = plan.rank - 1;
+    if (count == 0)
+    {
+        return;
+    }
+    if (plan.rank == 0 || (plan.rank == 1 && plan.srcStrides[0] == 1))
+    {
+        std::memcpy(dst, src, count * sizeof(T));
+        return;
+    }
+    if (plan.srcStrides[last] == 1)
+    {
+        // Blocked case: the innermost axis is kept, rows are copied whole.
+        const size_t rowSize = plan.dims[last];
+        const size_t nbRows = count / rowSize;
+        const size_t rowGrain = count < kParallelTransposeElements ? nbRows : std::max<size_t>(1, grain / rowSize);
+        parallelFor(nbRows, rowGrain, maxThreads, [&](size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r)
+            {
+                std::memcpy(dst + r * rowSize, src + sourceOffset(plan, last, r), rowSize * sizeof(T));
+            }
+        });
+        return;
+    }
+
+    // 2-D case, possibly batched: the input innermost axis is output axis k and the output innermost axis
+    // is strided in the input. Tiles of kTransposeTile^2 keep both the reads and the writes in cache.
+    int k = 0;
+    while (plan.srcStrides[k] != 1)
+    {
+        ++k;
+    }
+    size_t dstStrideK = 1;
+    for (int d = k + 1; d < plan.rank; ++d)
+    {
+        dstStrideK *= plan.dims[d];
+    }
+    const size_t rows = plan.dims[k];
+    const size_t cols = plan.dims[last];
+    const size_t srcStrideCols = plan.srcStrides[last];
+    const size_t nbRowTiles = (rows + kTransposeTile - 1) / kTransposeTile;
+    const size_t nbMatrices = count / (rows * cols);
+    const size_t tileGrain = count < kParallelTransposeElements
+        ? nbMatrices * nbRowTiles
+        : std::max<size_t>(1, grain / (kTransposeTile * cols));
+    parallelFor(nbMatrices * nbRowTiles, tileGrain, maxThreads, [&](size_t begin, size_t end) {
+        for (size_t unit = begin; unit < end; ++unit)
+        {
+            const size_t m = unit / nbRowTiles;
+            const size_t i0 = (unit % nbRowTiles) * kTransposeTile;
+            const size_t i1 = std::min(rows, i0 + kTransposeTile);
+            // Offsets of the m-th matrix, over the output axes other than k and the last one.
+            size_t srcOffset = 0;
+            size_t dstOffset = 0;
+            size_t index = m;
+            size_t dstStride = cols;
+            for (int d = last - 1; d >= 0; --d)
+            {
+                if (d != k)
+                {
+                    srcOffset += (index % plan.dims[d]) * plan.srcStrides[d];
+                    dstOffset += (index % plan.dims[d]) * dstStride;
+                    index /= plan.dims[d];
+                }
+                dstStride *= plan.dims[d];
+            }
+            for (size_t j0 = 0; j0 < cols; j0 += kTransposeTile)
+            {
+                const size_t j1 = std::min(cols, j0 + kTransposeTile);
+                transposeTile(src + srcOffset + j0 * srcStrideCols + i0, srcStrideCols,
+                    dst + dstOffset + i0 * dstStrideK + j0, dstStrideK, i1 - i0, j1 - j0);
+            }
+        }
+    });
+}
+
+} // namespace
+
+bool transposeWeights(
+    ShapedWeights const& weights, nvinfer1::Permutation const& perm, ShapedWeights* result, int maxThreads)
+{
+    nvinfer1::Dims shape = weights.shape;
+    result->shape.nbDims = shape.nbDims;
+    for (int d = 0; d < shape.nbDims; ++d)
+    {
+        result->shape.d[d] = shape.d[perm.order[d]];
+    }
+    const TransposePlan plan = makeTransposePlan(shape, perm);
+
+    // Only the element size matters, so all weight types are handled.
+    switch (getDtypeSize(weights.type))
     {
-        // TODO: Implement general transposes and multiple data types
-        // Unsupported weights transpose
-        return false;
+    case 1:
+        transposeElements(
+            plan, static_cast<uint8_t const*>(weights.values), static_cast<uint8_t*>(result->values), maxThreads);
+        break;
+    case 2:
+        transposeElements(
+            plan, static_cast<uint16_t const*>(weights.values), static_cast<uint16_t*>(result->values), maxThreads);
+        break;
+    case 4:
+        transposeElements(
+            plan, static_cast<uint32_t const*>(weights.values), static_cast<uint32_t*>(result->values), maxThreads);
+        break;
+    case 8:
+        transposeElements(
+            plan, static_cast<uint64_t const*>(weights.values), static_cast<uint64_t*>(result->values), maxThreads);
+        break;
+    default: return false;
     }
     return true;
 }
@@ -44,6 +44,8 @@ public:
     operator nvinfer1::Weights() const;
 };
 
-bool transposeWeights(ShapedWeights const& weights, nvinfer1::Permutation const& perm, ShapedWeights* result);
+// Weights of a million elements or more are transposed on up to maxThreads threads, 0 for one per hardware thread.
+bool transposeWeights(
+    ShapedWeights const& weights, nvinfer1::Permutation const& perm, ShapedWeights* result, int maxThreads = 0);
 
 } // namespace onnx2trt
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "WeightsArena.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace onnx2trt
+{
+
+constexpr size_t WeightsArena::kAlignment;
+constexpr size_t WeightsArena::kBlockSize;
+
+void* WeightsArena::allocate(size_t size)
+{
+    auto& usage = mUsage[mTag];
+    ++usage.count;
+    usage.bytes += size;
+    mBytesAllocated += size;
+
+    // Scalars and empty weights still get their own address.
+    const size_t padded = (std::max<size_t>(size, 1) + kAlignment - 1) / kAlignment * kAlignment;
+    if (padded > mRemaining)
+    {
+        // Large weights get a block of their own, so that the current block keeps serving small ones.
+        const bool dedicated = padded > kBlockSize / 4;
+        const size_t blockSize = (dedicated ? padded : kBlockSize) + kAlignment;
+        mBlocks.emplace_back(new uint8_t[blockSize]());
+        mBytesReserved += blockSize;
+        uint8_t* block = mBlocks.back().get();
+        uint8_t* aligned = reinterpret_cast<uint8_t*>(
+            (reinterpret_cast<uintptr_t>(block) + kAlignment - 1) / kAlignment * kAlignment);
+        if (dedicated)
+        {
+            return aligned;
+        }
+        mCursor = aligned;
+        mRemaining = blockSize - (aligned - block);
+    }
+    void* result = mCursor;
+    mCursor += padded;
+    mRemaining -= padded;
+    return result;
+}
+
+std::string WeightsArena::report() const
+{
+    std::vector<std::pair<std::string, Usage>> tags(mUsage.begin(), mUsage.end());
+    std::sort(tags.begin(), tags.end(),
+        [](const std::pair<std::string, Usage>& a, const std::pair<std::string, Usage>& b) {
+            return a.second.bytes > b.second.bytes;
+        });
+    std::ostringstream ss;
+    ss << "Temporary weights: " << mBytesAllocated << " bytes in " << mBlocks.size() << " blocks of "
+       << mBytesReserved << " bytes";
+    for (const auto& tag : tags)
+    {
+        ss << "\n    " << (tag.first.empty() ? "(untagged)" : tag.first) << ": " << tag.second.bytes << " bytes, "
+           << tag.second.count << " allocations";
+    }
+    return ss.str();
+}
+
+} // namespace onnx2trt
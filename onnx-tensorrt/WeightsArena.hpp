@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace onnx2trt
+{
+
+// Bump allocator for the temporary weights created while importing a model (INT64 conversions, transposes,
+// folded scales, ...). Allocations are carved out of large zeroed blocks, aligned for vector loads and
+// freed together when the arena is destroyed, which is how the network uses them: they must outlive the
+// engine build and are dropped with the parser.
+class WeightsArena
+{
+public:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kBlockSize = 4 << 20;
+
+    struct Usage
+    {
+        size_t count{0};
+        size_t bytes{0};
+    };
+
+    WeightsArena() = default;
+    WeightsArena(const WeightsArena&) = delete;
+    WeightsArena& operator=(const WeightsArena&) = delete;
+
+    // Returns size zeroed bytes aligned to kAlignment, accounted to the current tag.
+    void* allocate(size_t size);
+
+    // Op type (or other label) the following allocations are accounted to.
+    void setTag(const std::string& tag)
+    {
+        mTag = tag;
+    }
+
+    size_t bytesAllocated() const
+    {
+        return mBytesAllocated;
+    }
+    size_t bytesReserved() const
+    {
+        return mBytesReserved;
+    }
+    const std::unordered_map<std::string, Usage>& usage() const
+    {
+        return mUsage;
+    }
+
+    // One line summary followed by one line per tag, largest first.
+    std::string report() const;
+
+private:
+    std::vector<std::unique_ptr<uint8_t[]>> mBlocks;
+    uint8_t* mCursor{nullptr};
+    size_t mRemaining{0};
+    size_t mBytesAllocated{0};
+    size_t mBytesReserved{0};
+    std::string mTag;
+    std::unordered_map<std::string, Usage> mUsage;
+};
+
+} // namespace onnx2trt
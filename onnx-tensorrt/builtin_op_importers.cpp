@@ -1697,6 +1697,25 @@ DEFINE_BUILTIN_OP_IMPORTER(EmbLayerNorm)
 
 #endif
 }
+// The BERT plugins take B x S x hidden x 1 x 1 tensors, exported models carry B x S x hidden
+nvinfer1::ITensor* toBertLayout(IImporterContext* ctx, nvinfer1::ITensor& tensor)
+{
+    if (tensor.getDimensions().nbDims == 5)
+    {
+        return &tensor;
+    }
+    return reshapeTensor(ctx, tensor, nvinfer1::Dims{5, {0, 0, 0, 1, 1}});
+}
+
+nvinfer1::ITensor* fromBertLayout(IImporterContext* ctx, nvinfer1::ITensor& tensor, int nbDims)
+{
+    if (nbDims == 5)
+    {
+        return &tensor;
+    }
+    return reshapeTensor(ctx, tensor, makeDims(nbDims, 0));
+}
+
 DEFINE_BUILTIN_OP_IMPORTER(SkipLayerNorm)
 {
 
@@ -1706,6 +1725,8 @@ DEFINE_BUILTIN_OP_IMPORTER(SkipLayerNorm)
 
     nvinfer1::ITensor* inputTensor = &convertToTensor(inputs.at(0), ctx);
     nvinfer1::ITensor* skip = &convertToTensor(inputs.at(1), ctx);
+    const int nbDims = inputTensor->getDimensions().nbDims;
+    ASSERT((nbDims == 3 || nbDims == 5) && skip->getDimensions().nbDims == nbDims, ErrorCode::kUNSUPPORTED_NODE);
     const Weights wgamma   = Weights(inputs.at(2).weights());
     const Weights wbeta    = Weights(inputs.at(3).weights());
     
@@ -1714,15 +1735,50 @@ DEFINE_BUILTIN_OP_IMPORTER(SkipLayerNorm)
     const int hiddenSize = inputs.at(3).shape().d[0];
 
     test::SkipLayerNormPluginDynamic skipln_plug("skipln", hiddenSize, wbeta, wgamma);
-    ITensor* skiplnInputs[2] = {inputTensor, skip};
+    ITensor* skiplnInputs[2] = {toBertLayout(ctx, *inputTensor), toBertLayout(ctx, *skip)};
 
     IPluginV2Layer* skiplnLayer = ctx->network()->addPluginV2(skiplnInputs, 2, skipln_plug);
     ASSERT(skiplnLayer != nullptr && "SkipLayerNorm plugin was not found in the plugin registry!",
         ErrorCode::kUNSUPPORTED_NODE);
-    RETURN_ALL_OUTPUTS(skiplnLayer);
+    return {{fromBertLayout(ctx, *skiplnLayer->getOutput(0), nbDims)}};
 
 }
 
+// LayerNorm over the last axis, produced by the fuse_bert_layer_norm pass. Built from native layers since the
+// SkipLayerNorm plugin has no epsilon.
+DEFINE_BUILTIN_OP_IMPORTER(LayerNorm)
+{
+    ASSERT(inputs.size() == 3, ErrorCode::kUNSUPPORTED_NODE);
+    ASSERT(inputs.at(1).is_weights(), ErrorCode::kUNSUPPORTED_NODE);
+    ASSERT(inputs.at(2).is_weights(), ErrorCode::kUNSUPPORTED_NODE);
+
+    nvinfer1::ITensor* input = &convertToTensor(inputs.at(0), ctx);
+    OnnxAttrs attrs(node, ctx);
+    const float epsilon = attrs.get("epsilon", 1e-5f);
+    const uint32_t lastAxis = 1u << (input->getDimensions().nbDims - 1);
+    auto* network = ctx->network();
+
+    nvinfer1::ITensor* mean = network->addReduce(*input, ReduceOperation::kAVG, lastAxis, true)->getOutput(0);
+    nvinfer1::ITensor* centered = network->addElementWise(*input, *mean, ElementWiseOperation::kSUB)->getOutput(0);
+    nvinfer1::ITensor* squared
+        = network->addElementWise(*centered, *centered, ElementWiseOperation::kPROD)->getOutput(0);
+    nvinfer1::ITensor* variance = network->addReduce(*squared, ReduceOperation::kAVG, lastAxis, true)->getOutput(0);
+    nvinfer1::ITensor* eps
+        = addConstantScalar(ctx, epsilon, ::ONNX_NAMESPACE::TensorProto::FLOAT)->getOutput(0);
+    TRT_CHECK(broadcastTensors(ctx, variance, eps));
+    nvinfer1::ITensor* shifted = network->addElementWise(*variance, *eps, ElementWiseOperation::kSUM)->getOutput(0);
+    nvinfer1::ITensor* stddev = network->addUnary(*shifted, UnaryOperation::kSQRT)->getOutput(0);
+    nvinfer1::ITensor* normalized
+        = network->addElementWise(*centered, *stddev, ElementWiseOperation::kDIV)->getOutput(0);
+
+    nvinfer1::ITensor* gamma = &convertToTensor(inputs.at(1), ctx);
+    nvinfer1::ITensor* beta = &convertToTensor(inputs.at(2), ctx);
+    TRT_CHECK(broadcastTensors(ctx, normalized, gamma, beta));
+    nvinfer1::ITensor* scaled = network->addElementWise(*normalized, *gamma, ElementWiseOperation::kPROD)->getOutput(0);
+    auto* layer = network->addElementWise(*scaled, *beta, ElementWiseOperation::kSUM);
+    RETURN_FIRST_OUTPUT(layer);
+}
+
 DEFINE_BUILTIN_OP_IMPORTER(Gelu)
 {
     nvinfer1::ITensor* inputTensor = &convertToTensor(inputs.at(0), ctx);
@@ -1736,33 +1792,46 @@ DEFINE_BUILTIN_OP_IMPORTER(Gelu)
 
 }
 
+// Number of valid tokens of each sequence, [B] int32, from a B x S input mask
+DEFINE_BUILTIN_OP_IMPORTER(MaskIndex)
+{
+    nvinfer1::ITensor& mask = convertToTensor(inputs.at(0), ctx);
+    ASSERT(mask.getDimensions().nbDims == 2, ErrorCode::kUNSUPPORTED_NODE);
+    auto* network = ctx->network();
+
+    nvinfer1::IIdentityLayer* toFloat = network->addIdentity(mask);
+    toFloat->setOutputType(0, nvinfer1::DataType::kFLOAT);
+    nvinfer1::ITensor* count
+        = network->addReduce(*toFloat->getOutput(0), ReduceOperation::kSUM, 1u << 1, false)->getOutput(0);
+    nvinfer1::IIdentityLayer* layer = network->addIdentity(*count);
+    layer->setOutputType(0, nvinfer1::DataType::kINT32);
+    RETURN_FIRST_OUTPUT(layer);
+}
+
 DEFINE_BUILTIN_OP_IMPORTER(QkvToContext)
 {
        ASSERT(inputs.at(0).is_tensor(), nvonnxparser::ErrorCode::kINVALID_NODE);
        auto& input = inputs.at(0).tensor();
-       ASSERT(inputs.at(1).is_tensor(), nvonnxparser::ErrorCode::kINVALID_NODE);
-       auto& input_mask = inputs.at(1).tensor();
+       const int nbDims = input.getDimensions().nbDims;
+       ASSERT(nbDims == 3 || nbDims == 5, ErrorCode::kUNSUPPORTED_NODE);
+       const bool hasMask = inputs.size() > 1;
+       ASSERT(!hasMask || inputs.at(1).is_tensor(), nvonnxparser::ErrorCode::kINVALID_NODE);
        
+       // Models imported with EmbLayerNorm carry no attributes, the fusion passes set them
        OnnxAttrs attrs(node, ctx);  
-       //const int hiddenSize = attrs.get<int>("hiddenSize");
-       //const int numHeads = attrs.get<int>("numAttentionHeads");
-//       const int hiddenSize = 768;
-       const int hiddenSize = inputs.at(0).shape().d[2];
-       const int numHeads = 12;
-       const int headSize = hiddenSize / numHeads;
-       assert(hiddenSize % numHeads == 0);
+       const int hiddenSize = attrs.get<int>("hidden_size", inputs.at(0).shape().d[2]);
+       const int numHeads = attrs.get<int>("num_heads", 12);
+       ASSERT(hiddenSize > 0 && hiddenSize % numHeads == 0, ErrorCode::kUNSUPPORTED_NODE);
 
-    
-       const bool hasMask = true;
        test::QKVToContextPluginDynamic qkvPlugin("qkv2ctx", hiddenSize, numHeads, hasMask);
-       ITensor* qkvIn[2] = {&input, &input_mask};
+       ITensor* qkvIn[2] = {toBertLayout(ctx, input), hasMask ? &inputs.at(1).tensor() : nullptr};
        IPluginV2Layer* qkv2ctxLayer = ctx->network()->addPluginV2(qkvIn, 1 + hasMask, qkvPlugin);
        ASSERT(qkv2ctxLayer != nullptr && "QkvToContext plugin was not found in the plugin registry!",
         ErrorCode::kUNSUPPORTED_NODE);
        
        //qkv2ctxLayer->setName((prefix + "QKV2CTX").c_str());
        //setOutputName(qkv2ctxLayer, prefix, "context_layer");
-       RETURN_ALL_OUTPUTS(qkv2ctxLayer);
+       return {{fromBertLayout(ctx, *qkv2ctxLayer->getOutput(0), nbDims)}};
 }
 
 
@@ -46,10 +46,13 @@ void print_usage() {
        << "                [-t onnx_model.pbtxt] (output ONNX text file without weights)" << "\n"
        << "                [-T onnx_model.pbtxt] (output ONNX text file with weights)" << "\n"
        << "                [-m onnx_model_out.pb] (output ONNX model)" << "\n"
+       << "                [-x weights.bin] (with -m, store the initializers in this file next to the output" << "\n"
+       << "                                  model as external data)" << "\n"
        << "                [-b max_batch_size (default 32)]" << "\n"
        << "                [-w max_workspace_size_bytes (default 1 GiB)]" << "\n"
        << "                [-d model_data_type_bit_depth] (32 => float32, 16 => float16)" << "\n"
-       << "                [-O passes] (optimize onnx model. Argument is a semicolon-separated list of passes)" << "\n"
+       << "                [-O passes] (optimize onnx model. Argument is a semicolon-separated list of passes," << "\n"
+       << "                             or bert for the BERT fusion passes)" << "\n"
        << "                [-p] (list available optimization passes and exit)" << "\n"
        << "                [-l] (list layers and their shapes)" << "\n"
        << "                [-g] (debug mode)" << "\n"
@@ -60,11 +63,81 @@ void print_usage() {
        << "                [-h] (show help)" << endl;
 }
 
+// Moves the values of initializers of at least kMinExternalBytes into the file data_filename,
+// in the directory of model_filename, and turns them into references to it. Offsets are
+// aligned so that the parser can use the weights straight from a mapping of the file.
+bool write_external_data(::ONNX_NAMESPACE::ModelProto& model,
+                         const std::string& model_filename,
+                         const std::string& data_filename) {
+  const size_t kMinExternalBytes = 1024;
+  const size_t kAlignment = 64;
+  if( data_filename.empty() || data_filename.find('/') != std::string::npos ) {
+    cerr << "ERROR: External data must be a file name without directory: " << data_filename << endl;
+    return false;
+  }
+  const size_t slash = model_filename.find_last_of('/');
+  const std::string data_path = slash == std::string::npos
+                              ? data_filename : model_filename.substr(0, slash + 1) + data_filename;
+  std::ofstream data_file(data_path.c_str(), std::ios::binary | std::ios::trunc);
+  if( !data_file ) {
+    cerr << "ERROR: Could not open " << data_path << endl;
+    return false;
+  }
+  size_t offset = 0;
+  for( auto& tensor : *model.mutable_graph()->mutable_initializer() ) {
+    if( tensor.data_location() == ::ONNX_NAMESPACE::TensorProto::EXTERNAL ) {
+      continue;
+    }
+    // Only types whose in-memory layout is the raw one are moved
+    std::string bytes;
+    if( !tensor.raw_data().empty() ) {
+      bytes = tensor.raw_data();
+    } else if( tensor.float_data_size() ) {
+      bytes.assign(reinterpret_cast<const char*>(tensor.float_data().data()),
+                   tensor.float_data_size() * sizeof(float));
+    } else if( tensor.int64_data_size() ) {
+      bytes.assign(reinterpret_cast<const char*>(tensor.int64_data().data()),
+                   tensor.int64_data_size() * sizeof(int64_t));
+    } else if( tensor.int32_data_size() && tensor.data_type() == ::ONNX_NAMESPACE::TensorProto::INT32 ) {
+      bytes.assign(reinterpret_cast<const char*>(tensor.int32_data().data()),
+                   tensor.int32_data_size() * sizeof(int32_t));
+    }
+    if( bytes.size() < kMinExternalBytes ) {
+      continue;
+    }
+    const size_t padding = (kAlignment - offset % kAlignment) % kAlignment;
+    data_file.write(std::string(padding, '\0').data(), padding);
+    offset += padding;
+    data_file.write(bytes.data(), bytes.size());
+    tensor.clear_raw_data();
+    tensor.clear_float_data();
+    tensor.clear_int64_data();
+    tensor.clear_int32_data();
+    tensor.clear_external_data();
+    tensor.set_data_location(::ONNX_NAMESPACE::TensorProto::EXTERNAL);
+    auto add_entry = [&tensor](const char* key, const std::string& value) {
+      auto* entry = tensor.add_external_data();
+      entry->set_key(key);
+      entry->set_value(value);
+    };
+    add_entry("location", data_filename);
+    add_entry("offset", std::to_string(offset));
+    add_entry("length", std::to_string(bytes.size()));
+    offset += bytes.size();
+  }
+  if( !data_file ) {
+    cerr << "ERROR: Problem writing " << data_path << endl;
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char* argv[]) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
   std::string engine_filename;
   std::string model_filename;
+  std::string external_data_filename;
   std::string text_filename;
   std::string optimization_passes_string;
   std::string full_text_filename;
@@ -79,7 +152,7 @@ int main(int argc, char* argv[]) {
   bool debug_builder = false;
 
   int arg = 0;
-  while( (arg = ::getopt(argc, argv, "o:b:w:t:T:m:d:O:plgFvqVh")) != -1 ) {
+  while( (arg = ::getopt(argc, argv, "o:b:w:t:T:m:x:d:O:plgFvqVh")) != -1 ) {
     switch (arg){
     case 'o':
       if( optarg ) { engine_filename = optarg; break; }
@@ -87,6 +160,9 @@ int main(int argc, char* argv[]) {
     case 'm':
       if( optarg ) { model_filename  = optarg; break; }
       else { cerr << "ERROR: -m flag requires argument" << endl; return -1; }
+    case 'x':
+      if( optarg ) { external_data_filename = optarg; break; }
+      else { cerr << "ERROR: -x flag requires argument" << endl; return -1; }
     case 't':
       if( optarg ) { text_filename = optarg; break; }
       else { cerr << "ERROR: -t flag requires argument" << endl; return -1; }
@@ -104,7 +180,14 @@ int main(int argc, char* argv[]) {
       else { cerr << "ERROR: -d flag requires argument" << endl; return -1; }
     case 'O':
       optimize_model = true;
-      if( optarg ) { optimization_passes_string = optarg; break; }
+      if( optarg ) {
+        optimization_passes_string = optarg;
+        if( optimization_passes_string == "bert" ) {
+          optimization_passes_string = "fold_constants;fuse_bert_layer_norm;fuse_bert_skip_layer_norm;fuse_bert_gelu;"
+                                       "fuse_bert_qkv_matmul;fuse_bert_attention;eliminate_unused_initializer";
+        }
+        break;
+      }
       else { cerr << "ERROR: -O flag requires argument" << endl; return -1; }
     case 'p': print_optimization_passes_info = true; break;
     case 'l': print_layer_info = true; break;
@@ -153,36 +236,17 @@ int main(int argc, char* argv[]) {
     return -3;
   }
 
+  // The parser reads the model from the file itself, it is only loaded here to be written back out
   ::ONNX_NAMESPACE::ModelProto _the_onnx_model;
   ::ONNX_NAMESPACE::ModelProto& onnx_model = _the_onnx_model;
-  bool is_binary = common::ParseFromFile_WAR(&onnx_model, onnx_filename.c_str());
-  if( !is_binary && !common::ParseFromTextFile(&onnx_model, onnx_filename.c_str()) ) {
-    cerr << "Failed to parse ONNX model" << endl;
-    return -3;
-  }
-
-  if( verbosity >= (int)nvinfer1::ILogger::Severity::kWARNING ) {
-    int64_t opset_version = (onnx_model.opset_import().size() ?
-                             onnx_model.opset_import(0).version() : 0);
-    cout << "----------------------------------------------------------------" << endl;
-    cout << "Input filename:   " << onnx_filename << endl;
-    cout << "ONNX IR version:  " << common::onnx_ir_version_string(onnx_model.ir_version()) << endl;
-    cout << "Opset version:    " << opset_version << endl;
-    cout << "Producer name:    " << onnx_model.producer_name() << endl;
-    cout << "Producer version: " << onnx_model.producer_version() << endl;
-    cout << "Domain:           " << onnx_model.domain() << endl;
-    cout << "Model version:    " << onnx_model.model_version() << endl;
-    cout << "Doc string:       " << onnx_model.doc_string() << endl;
-    cout << "----------------------------------------------------------------" << endl;
+  if( !model_filename.empty() || !text_filename.empty() || !full_text_filename.empty() ) {
+    bool is_binary = common::ParseFromFile_WAR(&onnx_model, onnx_filename.c_str());
+    if( !is_binary && !common::ParseFromTextFile(&onnx_model, onnx_filename.c_str()) ) {
+      cerr << "Failed to parse ONNX model" << endl;
+      return -3;
+    }
   }
 
-  if( onnx_model.ir_version() > ::ONNX_NAMESPACE::IR_VERSION ) {
-    cerr << "WARNING: ONNX model has a newer ir_version ("
-         << common::onnx_ir_version_string(onnx_model.ir_version())
-         << ") than this parser was built against ("
-         << common::onnx_ir_version_string(::ONNX_NAMESPACE::IR_VERSION) << ")." << endl;
-  }
-  
   if( !model_filename.empty() ) {
     if( optimize_model ) {
       std::vector<std::string> passes;
@@ -200,10 +264,14 @@ int main(int argc, char* argv[]) {
         ::ONNX_NAMESPACE::ModelProto _the_onnx_model_optimized = optimize_model_fixed
                                                                ? ::ONNX_NAMESPACE::optimization::OptimizeFixed(onnx_model, passes)
                                                                : ::ONNX_NAMESPACE::optimization::Optimize(onnx_model, passes);
-        onnx_model = _the_onnx_model_optimized;
+        onnx_model.Swap(&_the_onnx_model_optimized);
       }
     }
 
+    if( !external_data_filename.empty() &&
+        !write_external_data(onnx_model, model_filename, external_data_filename) ) {
+      return -3;
+    }
     if( !common::MessageToFile( &onnx_model, model_filename.c_str() ) ) {
       cerr << "ERROR: Problem writing ONNX model" << endl;
     }
@@ -244,43 +312,9 @@ int main(int argc, char* argv[]) {
     cout << "Parsing model" << endl;
   }
 
-  {
-    std::ifstream onnx_file(onnx_filename.c_str(),
-                            std::ios::binary | std::ios::ate);
-    std::streamsize file_size = onnx_file.tellg();
-    onnx_file.seekg(0, std::ios::beg);
-    std::vector<char> onnx_buf(file_size);
-    if( !onnx_file.read(onnx_buf.data(), onnx_buf.size()) ) {
-      cerr << "ERROR: Failed to read from file " << onnx_filename << endl;
-      return -4;
-    }
-    if( !trt_parser->parse(onnx_buf.data(), onnx_buf.size()) ) {
-      int nerror = trt_parser->getNbErrors();
-      for( int i=0; i<nerror; ++i ) {
-        nvonnxparser::IParserError const* error = trt_parser->getError(i);
-        if( error->node() != -1 ) {
-          ::ONNX_NAMESPACE::NodeProto const& node =
-            onnx_model.graph().node(error->node());
-          cerr << "While parsing node number " << error->node()
-               << " [" << node.op_type();
-          if( node.output().size() ) {
-            cerr << " -> \"" << node.output(0) << "\"";
-          }
-          cerr << "]:" << endl;
-          if( verbosity >= (int)nvinfer1::ILogger::Severity::kINFO ) {
-            cerr << "--- Begin node ---" << endl;
-            cerr << node << endl;
-            cerr << "--- End node ---" << endl;
-          }
-        }
-        cerr << "ERROR: "
-             << error->file() << ":" << error->line()
-             << " In function " << error->func() << ":\n"
-             << "[" << static_cast<int>(error->code()) << "] " << error->desc()
-             << endl;
-      }
-      return -5;
-    }
+  // Parsing from the file lets the parser map external data relative to the model
+  if( !trt_parser->parseFromFile(onnx_filename.c_str(), verbosity) ) {
+    return -5;
   }
 
   bool fp16 = trt_builder->platformHasFastFp16();
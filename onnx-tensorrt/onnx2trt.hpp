@@ -64,6 +64,10 @@ public:
     virtual void registerTensor(TensorOrWeights tensor, const std::string& basename) = 0;
     virtual void registerLayer(nvinfer1::ILayer* layer, const std::string& basename) = 0;
     virtual ShapedWeights createTempWeights(ShapedWeights::DataType type, nvinfer1::Dims shape) = 0;
+    // Op type the temporary weights created next are accounted to.
+    virtual void setTempWeightsTag(const std::string& tag) = 0;
+    // Maps [offset, offset + length) of an external data file of the model, nullptr on failure.
+    virtual const void* mapExternalData(const std::string& location, size_t offset, size_t length) = 0;
     virtual int64_t getOpsetVersion(const char* domain = "") const = 0;
     virtual nvinfer1::ILogger& logger() = 0;
 
@@ -23,6 +23,7 @@
 #include "onnx2trt_utils.hpp"
 #include "OnnxAttrs.hpp"
 #include "ShapeTensor.hpp"
+#include <cstdlib>
 #include <set>
 
 namespace onnx2trt
@@ -308,9 +309,81 @@ bool convertOnnxPadding(const std::vector<int64_t>& onnxPadding, nvinfer1::Dims2
     return true;
 }
 
+// Initializers saved with external data point into a memory map of the data file instead of being copied out of it.
+// Only INT64 values are still converted, into a temporary INT32 buffer.
+static bool convertExternalWeights(
+    const ::ONNX_NAMESPACE::TensorProto& onnxTensor, onnx2trt::ShapedWeights* weights, IImporterContext* ctx)
+{
+    std::string location;
+    int64_t offset{0};
+    int64_t length{-1};
+    bool valid{true};
+    auto parseInt = [&valid](const std::string& text) {
+        char* end{nullptr};
+        const long long value = std::strtoll(text.c_str(), &end, 10);
+        valid = valid && !text.empty() && *end == '\0' && value >= 0;
+        return static_cast<int64_t>(value);
+    };
+    for (const auto& entry : onnxTensor.external_data())
+    {
+        if (entry.key() == "location")
+        {
+            location = entry.value();
+        }
+        else if (entry.key() == "offset")
+        {
+            offset = parseInt(entry.value());
+        }
+        else if (entry.key() == "length")
+        {
+            length = parseInt(entry.value());
+        }
+    }
+
+    nvinfer1::Dims shape;
+    shape.nbDims = onnxTensor.dims().size();
+    std::copy(onnxTensor.dims().begin(), onnxTensor.dims().end(), shape.d);
+
+    auto onnxDtype = onnxTensor.data_type();
+    if (onnxDtype != ::ONNX_NAMESPACE::TensorProto::FLOAT && onnxDtype != ::ONNX_NAMESPACE::TensorProto::FLOAT16
+        && onnxDtype != ::ONNX_NAMESPACE::TensorProto::INT32 && onnxDtype != ::ONNX_NAMESPACE::TensorProto::INT64
+        && onnxDtype != ::ONNX_NAMESPACE::TensorProto::INT8 && onnxDtype != ::ONNX_NAMESPACE::TensorProto::BOOL)
+    {
+        LOG_ERROR("Found unsupported datatype (" << onnxDtype << ") when importing initializer: " << onnxTensor.name());
+        return false;
+    }
+    const size_t nbytes = volume(shape) * getDtypeSize(onnxDtype);
+    if (!valid || location.empty() || (length >= 0 && static_cast<size_t>(length) != nbytes))
+    {
+        LOG_ERROR("Invalid external data when importing initializer: " << onnxTensor.name() << ". Expected size: "
+                                                                       << nbytes << " , actual size: " << length);
+        return false;
+    }
+
+    const void* data = ctx->mapExternalData(location, static_cast<size_t>(offset), nbytes);
+    if (!data)
+    {
+        LOG_ERROR("Failed to map external data of initializer: " << onnxTensor.name());
+        return false;
+    }
+    void* dataPtr = const_cast<void*>(data);
+    if (onnxDtype == ::ONNX_NAMESPACE::TensorProto::INT64)
+    {
+        dataPtr = convertINT64(static_cast<const int64_t*>(data), shape, ctx);
+        onnxDtype = ::ONNX_NAMESPACE::TensorProto::INT32;
+    }
+    *weights = onnx2trt::ShapedWeights(onnxDtype, dataPtr, shape);
+    return true;
+}
+
 bool convertOnnxWeights(
     const ::ONNX_NAMESPACE::TensorProto& onnxTensor, onnx2trt::ShapedWeights* weights, IImporterContext* ctx)
 {
+    if (onnxTensor.data_location() == ::ONNX_NAMESPACE::TensorProto::EXTERNAL)
+    {
+        return convertExternalWeights(onnxTensor, weights, ctx);
+    }
+
     // Pass through for optional (empty) initializers for unused attributes.
     if (isOnnxTensorEmpty(onnxTensor))
     {
@@ -6,9 +6,16 @@
 namespace ONNX_NAMESPACE {
 
 // Part 1: convert ONNX Protobuf to IR
-std::unique_ptr<Graph> graphProtoToGraph(const GraphProto& gp, bool nested);
-
-Tensor tensorProtoToTensor(const ONNX_NAMESPACE::TensorProto& tp) {
+std::unique_ptr<Graph> graphProtoToGraph(
+    const GraphProto& gp,
+    bool nested,
+    bool borrow_raw_data = false);
+
+// With borrow_raw_data, the tensor references the raw_data of tp instead of
+// copying it, so tp has to outlive the tensor and all of its copies.
+Tensor tensorProtoToTensor(
+    const ONNX_NAMESPACE::TensorProto& tp,
+    bool borrow_raw_data = false) {
   Tensor ret;
 
   ret.sizes().reserve(tp.dims_size());
@@ -20,10 +27,7 @@ Tensor tensorProtoToTensor(const ONNX_NAMESPACE::TensorProto& tp) {
   switch (tp.data_type()) {
     case ONNX_NAMESPACE::TensorProto_DataType_FLOAT:
     case ONNX_NAMESPACE::TensorProto_DataType_COMPLEX64: {
-      ret.floats().reserve(tp.float_data_size());
-      for (int i = 0; i < tp.float_data_size(); i++) {
-        ret.floats().push_back(tp.float_data(i));
-      }
+      ret.floats().assign(tp.float_data().begin(), tp.float_data().end());
       break;
     }
     case ONNX_NAMESPACE::TensorProto_DataType_FLOAT16:
@@ -34,40 +38,25 @@ Tensor tensorProtoToTensor(const ONNX_NAMESPACE::TensorProto& tp) {
     case ONNX_NAMESPACE::TensorProto_DataType_INT32:
     case ONNX_NAMESPACE::TensorProto_DataType_UINT8:
     case ONNX_NAMESPACE::TensorProto_DataType_UINT16: {
-      ret.int32s().reserve(tp.int32_data_size());
-      for (int i = 0; i < tp.int32_data_size(); i++) {
-        ret.int32s().push_back(tp.int32_data(i));
-      }
+      ret.int32s().assign(tp.int32_data().begin(), tp.int32_data().end());
       break;
     }
     case ONNX_NAMESPACE::TensorProto_DataType_INT64: {
-      ret.int64s().reserve(tp.int64_data_size());
-      for (int i = 0; i < tp.int64_data_size(); i++) {
-        ret.int64s().push_back(tp.int64_data(i));
-      }
+      ret.int64s().assign(tp.int64_data().begin(), tp.int64_data().end());
       break;
     }
     case ONNX_NAMESPACE::TensorProto_DataType_UINT32:
     case ONNX_NAMESPACE::TensorProto_DataType_UINT64: {
-      ret.uint64s().reserve(tp.uint64_data_size());
-      for (int i = 0; i < tp.uint64_data_size(); i++) {
-        ret.uint64s().push_back(tp.uint64_data(i));
-      }
+      ret.uint64s().assign(tp.uint64_data().begin(), tp.uint64_data().end());
       break;
     }
     case ONNX_NAMESPACE::TensorProto_DataType_DOUBLE:
     case ONNX_NAMESPACE::TensorProto_DataType_COMPLEX128: {
-      ret.doubles().reserve(tp.double_data_size());
-      for (int i = 0; i < tp.double_data_size(); i++) {
-        ret.doubles().push_back(tp.double_data(i));
-      }
+      ret.doubles().assign(tp.double_data().begin(), tp.double_data().end());
       break;
     }
     case ONNX_NAMESPACE::TensorProto_DataType_STRING: {
-      ret.strings().reserve(tp.string_data_size());
-      for (int i = 0; i < tp.string_data_size(); i++) {
-        ret.strings().push_back(tp.string_data(i));
-      }
+      ret.strings().assign(tp.string_data().begin(), tp.string_data().end());
       break;
     }
     case ONNX_NAMESPACE::TensorProto_DataType_UNDEFINED:
@@ -77,7 +66,12 @@ Tensor tensorProtoToTensor(const ONNX_NAMESPACE::TensorProto& tp) {
   // The only way to know if we should be using raw_data or
   // <type>_data is to look at which of them is size zero.
   if (tp.has_raw_data()) {
-    ret.set_raw_data(tp.raw_data());
+    if (borrow_raw_data) {
+      ret.set_raw_data_borrowed(
+          tp.raw_data().data(), tp.raw_data().size(), nullptr);
+    } else {
+      ret.set_raw_data(tp.raw_data());
+    }
   }
 
   if (tp.has_name()) {
@@ -89,7 +83,10 @@ Tensor tensorProtoToTensor(const ONNX_NAMESPACE::TensorProto& tp) {
   return ret;
 }
 
-void convertAttribute(const ONNX_NAMESPACE::AttributeProto& ap, Node* n) {
+void convertAttribute(
+    const ONNX_NAMESPACE::AttributeProto& ap,
+    Node* n,
+    bool borrow_raw_data) {
   Symbol sym = Symbol(ap.name());
   switch (ap.type()) {
     case ONNX_NAMESPACE::AttributeProto_AttributeType_FLOAT:
@@ -129,25 +126,25 @@ void convertAttribute(const ONNX_NAMESPACE::AttributeProto& ap, Node* n) {
       break;
     }
     case ONNX_NAMESPACE::AttributeProto_AttributeType_TENSOR:
-      n->t_(sym, tensorProtoToTensor(ap.t()));
+      n->t_(sym, tensorProtoToTensor(ap.t(), borrow_raw_data));
       break;
     case ONNX_NAMESPACE::AttributeProto_AttributeType_TENSORS: {
       std::vector<Tensor> tensors;
       tensors.reserve(ap.tensors_size());
       for (int i = 0; i < ap.tensors_size(); i++) {
-        tensors.push_back(tensorProtoToTensor(ap.tensors(i)));
+        tensors.push_back(tensorProtoToTensor(ap.tensors(i), borrow_raw_data));
       }
       n->ts_(sym, std::move(tensors));
       break;
     }
     case ONNX_NAMESPACE::AttributeProto_AttributeType_GRAPH:
-      n->g_(sym, graphProtoToGraph(ap.g(), true));
+      n->g_(sym, graphProtoToGraph(ap.g(), true, borrow_raw_data));
       break;
     case ONNX_NAMESPACE::AttributeProto_AttributeType_GRAPHS: {
       std::vector<std::shared_ptr<Graph>> graphs;
       graphs.reserve(ap.graphs_size());
       for (int i = 0; i < ap.graphs_size(); i++) {
-        graphs.push_back(graphProtoToGraph(ap.graphs(i), true));
+        graphs.push_back(graphProtoToGraph(ap.graphs(i), true, borrow_raw_data));
       }
       n->gs_(sym, std::move(graphs));
       break;
@@ -162,9 +159,12 @@ void convertAttribute(const ONNX_NAMESPACE::AttributeProto& ap, Node* n) {
   }
 }
 
-void convertAttributes(ONNX_NAMESPACE::NodeProto& np, Node* n) {
+void convertAttributes(
+    const ONNX_NAMESPACE::NodeProto& np,
+    Node* n,
+    bool borrow_raw_data) {
   for (int i = 0; i < np.attribute_size(); i++) {
-    convertAttribute(np.attribute(i), n);
+    convertAttribute(np.attribute(i), n, borrow_raw_data);
   }
 }
 
@@ -184,7 +184,8 @@ std::vector<Dimension> tensorShapeProtoToDimensions(
 
 std::unique_ptr<Graph> graphProtoToGraph(
     const ONNX_NAMESPACE::GraphProto& gp,
-    bool nested) {
+    bool nested,
+    bool borrow_raw_data) {
   std::unique_ptr<Graph> g(new Graph());
 
   if (gp.has_name()) {
@@ -228,7 +229,7 @@ std::unique_ptr<Graph> graphProtoToGraph(
   }
 
   for (int i = 0; i < gp.input_size(); i++) {
-    auto vip = gp.input(i);
+    const auto& vip = gp.input(i);
     auto v = g->addInput();
     v->setElemType(vip.type().tensor_type().elem_type());
     v->setSizes(tensorShapeProtoToDimensions(vip.type().tensor_type().shape()));
@@ -237,7 +238,7 @@ std::unique_ptr<Graph> graphProtoToGraph(
   }
 
   for (int i = 0; i < gp.node_size(); i++) {
-    auto np = gp.node(i);
+    const auto& np = gp.node(i);
     auto* n =
         g->create(Symbol(np.op_type()), /* num_outputs = */ np.output_size());
     g->appendNode(n);
@@ -248,7 +249,7 @@ std::unique_ptr<Graph> graphProtoToGraph(
       out->setUniqueName(np.output(j));
       value_by_name_of[np.output(j)] = out;
     }
-    convertAttributes(np, n);
+    convertAttributes(np, n, borrow_raw_data);
     std::vector<std::string> inputs;
     inputs.reserve(np.input_size());
     for (int j = 0; j < np.input_size(); j++) {
@@ -315,21 +316,25 @@ std::unique_ptr<Graph> graphProtoToGraph(
   }
 
   for (int i = 0; i < gp.initializer_size(); i++) {
-    auto init = tensorProtoToTensor(gp.initializer(i));
-    g->addInitializer(init, init.name());
+    auto init = tensorProtoToTensor(gp.initializer(i), borrow_raw_data);
+    std::string name = init.name();
+    g->addInitializer(std::move(init), std::move(name));
   }
 
   return g;
 }
 
-std::unique_ptr<Graph> ImportModelProto(const ModelProto& mp) {
+std::unique_ptr<Graph> ImportModelProto(
+    const ModelProto& mp,
+    bool borrow_raw_data) {
   if (!mp.has_ir_version()) {
     return nullptr;
   } else if (mp.ir_version() == 1) {
     return nullptr;
   }
 
-  std::unique_ptr<Graph> g(graphProtoToGraph(mp.graph(), false));
+  std::unique_ptr<Graph> g(
+      graphProtoToGraph(mp.graph(), false, borrow_raw_data));
   for (int i = 0; i < mp.opset_import_size(); i++) {
     OpSetID new_opset_version(
         mp.opset_import(i).domain(), mp.opset_import(i).version());
@@ -409,8 +414,8 @@ void encodeTensor(ONNX_NAMESPACE::TensorProto* p, const Tensor& tensor) {
     case ONNX_NAMESPACE::TensorProto_DataType_UNDEFINED:
       fail_convert("Unknown tensor data type");
   }
-  if (!tensor.raw().empty()) {
-    p->set_raw_data(tensor.raw());
+  if (tensor.raw_size() > 0) {
+    p->set_raw_data(tensor.raw_data(), tensor.raw_size());
   }
 }
 
@@ -35,7 +35,13 @@ class ConvertError final : public std::runtime_error {
 
 void ExportModelProto(ModelProto* p_m, const std::shared_ptr<Graph>& g);
 
-std::unique_ptr<Graph> ImportModelProto(const ModelProto& mp);
+// With borrow_raw_data, initializers and tensor attributes reference the
+// raw_data of mp instead of copying it: mp must then outlive the graph and
+// every tensor copied out of it, and must not be modified meanwhile. Tensors
+// copy the bytes the first time they are written to.
+std::unique_ptr<Graph> ImportModelProto(
+    const ModelProto& mp,
+    bool borrow_raw_data = false);
 
 ModelProto PrepareOutput(const ModelProto& mp_in);
 
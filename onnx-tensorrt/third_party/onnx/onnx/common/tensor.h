@@ -5,6 +5,7 @@
 
 #include <cmath>
 #include <functional>
+#include <memory>
 #include <numeric>
 #include "onnx/common/assertions.h"
 #include "onnx/onnx_pb.h"
@@ -28,8 +29,27 @@ private:
   std::vector<uint64_t> uint64_data_;
   std::vector<std::string> string_data_;
 
+  // Raw bytes are shared between copies of a tensor. raw_holder_ keeps them
+  // alive: it is either a string owned by the tensors sharing it, or whatever
+  // the bytes are borrowed from (a protobuf message, a mapped file, an
+  // arena, ...). Non-const accessors copy shared or borrowed bytes into a
+  // string of this tensor first, so writes are never seen by other tensors.
   bool is_raw_data_;
-  std::string raw_data_;
+  bool raw_owned_;
+  std::shared_ptr<const void> raw_holder_;
+  const char* raw_ptr_;
+  size_t raw_size_;
+
+  char* mutable_raw_data() {
+    if (!raw_owned_ || raw_holder_.use_count() != 1) {
+      auto owned = std::make_shared<std::string>(
+          raw_size_ ? std::string(raw_ptr_, raw_size_) : std::string());
+      raw_ptr_ = owned->data();
+      raw_holder_ = std::move(owned);
+      raw_owned_ = true;
+    }
+    return const_cast<char*>(raw_ptr_);
+  }
 
   template <typename F, typename T>
   void bin_func(const F& f, T* ptr, const T* a_ptr);
@@ -48,6 +68,9 @@ private:
   , has_name_(false)
   , elem_type_(ONNX_NAMESPACE::TensorProto_DataType_UNDEFINED)
   , is_raw_data_(false)
+  , raw_owned_(false)
+  , raw_ptr_(nullptr)
+  , raw_size_(0)
   {}
 
   const std::vector<int64_t>& sizes() const {
@@ -121,13 +144,40 @@ private:
     return uint64_data_;
   }
 
-  const std::string& raw() const {
-    return raw_data_;
+  // Copy of the raw bytes, prefer raw_data() and raw_size()
+  std::string raw() const {
+    return raw_size_ ? std::string(raw_ptr_, raw_size_) : std::string();
+  }
+
+  const char* raw_data() const {
+    return raw_ptr_;
+  }
+
+  size_t raw_size() const {
+    return raw_size_;
   }
 
   void set_raw_data(std::string raw_data) {
+    auto owned = std::make_shared<std::string>(std::move(raw_data));
+    is_raw_data_ = true;
+    raw_owned_ = true;
+    raw_ptr_ = owned->data();
+    raw_size_ = owned->size();
+    raw_holder_ = std::move(owned);
+  }
+
+  // Uses size bytes at data without copying them. holder keeps them alive
+  // and may be null if the caller guarantees they outlive every copy of the
+  // tensor.
+  void set_raw_data_borrowed(
+      const char* data,
+      size_t size,
+      std::shared_ptr<const void> holder) {
     is_raw_data_ = true;
-    raw_data_ = std::move(raw_data);
+    raw_owned_ = false;
+    raw_ptr_ = data;
+    raw_size_ = size;
+    raw_holder_ = std::move(holder);
   }
 
   template <typename T>
@@ -217,7 +267,7 @@ private:
   template <>                                     \
   inline type* Tensor::data<type>() {             \
     if (is_raw_data_) {                           \
-      return (type*)&raw_data_.data()[0];         \
+      return (type*)mutable_raw_data();           \
     } else {                                      \
       return field.data();                        \
     }                                             \
@@ -226,7 +276,7 @@ private:
   template <>                                     \
   inline const type* Tensor::data<type>() const { \
     if (is_raw_data_) {                           \
-      return (type*)(raw_data_.data());           \
+      return (const type*)(raw_ptr_);             \
     } else {                                      \
       return field.data();                        \
     }                                             \
@@ -23,7 +23,8 @@ struct Optimizer {
   ~Optimizer();
 
   ModelProto optimize(const ModelProto& mp_in) {
-    std::shared_ptr<Graph> g(ImportModelProto(mp_in));
+    // mp_in outlives the graph, so its weights are used in place
+    std::shared_ptr<Graph> g(ImportModelProto(mp_in, true));
 
     if (g.get() == nullptr) {
       std::cerr << "Warning: onnx optimizer is unable to parse input model. "
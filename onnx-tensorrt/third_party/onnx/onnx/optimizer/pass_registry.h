@@ -14,7 +14,13 @@
 #include "onnx/optimizer/passes/eliminate_nop_transpose.h"
 #include "onnx/optimizer/passes/eliminate_unused_initializer.h"
 #include "onnx/optimizer/passes/extract_constant_to_initializer.h"
+#include "onnx/optimizer/passes/fold_constants.h"
 #include "onnx/optimizer/passes/fuse_add_bias_into_conv.h"
+#include "onnx/optimizer/passes/fuse_bert_attention.h"
+#include "onnx/optimizer/passes/fuse_bert_gelu.h"
+#include "onnx/optimizer/passes/fuse_bert_layer_norm.h"
+#include "onnx/optimizer/passes/fuse_bert_qkv_matmul.h"
+#include "onnx/optimizer/passes/fuse_bert_skip_layer_norm.h"
 #include "onnx/optimizer/passes/fuse_bn_into_conv.h"
 #include "onnx/optimizer/passes/fuse_consecutive_concats.h"
 #include "onnx/optimizer/passes/fuse_consecutive_log_softmax.h"
@@ -50,7 +56,13 @@ struct GlobalPassRegistry {
     registerPass<EliminateNopTranspose>();
     registerPass<EliminateUnusedInitializer>();
     registerPass<ExtractConstantToInitializer>();
+    registerPass<FoldConstants>();
     registerPass<FuseAddBiasIntoConv>();
+    registerPass<FuseBertAttention>();
+    registerPass<FuseBertGelu>();
+    registerPass<FuseBertLayerNorm>();
+    registerPass<FuseBertQkvMatMul>();
+    registerPass<FuseBertSkipLayerNorm>();
     registerPass<FuseBNIntoConv>();
     registerPass<FuseConsecutiveConcats>();
     registerPass<FuseConsecutiveLogSoftmax>();
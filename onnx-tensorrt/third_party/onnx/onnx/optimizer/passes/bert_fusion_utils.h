@@ -0,0 +1,224 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Matching helpers shared by the fuse_bert_* passes. They rewrite the
+// subgraphs exported BERT models are made of into the nodes
+// onnx-tensorrt maps onto the BERT plugins:
+//
+//   LayerNorm(x, gamma, beta)              epsilon
+//   SkipLayerNorm(x, skip, gamma, beta)    CustomSkipLayerNormPluginDynamic
+//   Gelu(x)                                CustomGeluPluginDynamic
+//   MaskIndex(mask)                        valid tokens per sequence, int32
+//   QkvToContext(qkv, mask_index)          CustomQKVToContextPluginDynamic
+//
+// No shape inference is run before the passes, so the patterns only rely on
+// the shapes of initializers and on constant attributes.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "onnx/optimizer/pass.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+namespace bert_fusion {
+
+inline Symbol kindErf() {
+  static const Symbol kind("Erf");
+  return kind;
+}
+inline Symbol kindSplit() {
+  static const Symbol kind("Split");
+  return kind;
+}
+inline Symbol kindLayerNorm() {
+  static const Symbol kind("LayerNorm");
+  return kind;
+}
+inline Symbol kindSkipLayerNorm() {
+  static const Symbol kind("SkipLayerNorm");
+  return kind;
+}
+inline Symbol kindGelu() {
+  static const Symbol kind("Gelu");
+  return kind;
+}
+inline Symbol kindMaskIndex() {
+  static const Symbol kind("MaskIndex");
+  return kind;
+}
+inline Symbol kindQkvToContext() {
+  static const Symbol kind("QkvToContext");
+  return kind;
+}
+
+// Returns the node producing v if it is of the given kind
+inline Node* producer(Value* v, NodeKind kind) {
+  return v->node()->kind() == kind ? v->node() : nullptr;
+}
+
+// Tensor of a Constant node output or of an initializer, nullptr otherwise.
+// The pointer is invalidated by adding initializers to the graph.
+inline const Tensor* constantTensor(Graph& graph, Value* v) {
+  Node* n = v->node();
+  if (n->kind() == kConstant && n->hasAttribute(kvalue)) {
+    return &n->t(kvalue);
+  }
+  if (n->kind() == kParam) {
+    auto it = graph.getInitializer(v->uniqueName());
+    if (it != graph.initializers().end()) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+inline bool isConstant(Graph& graph, Value* v) {
+  return constantTensor(graph, v) != nullptr;
+}
+
+inline int64_t elementCount(const Tensor& t) {
+  int64_t count = 1;
+  for (auto d : t.sizes()) {
+    count *= d;
+  }
+  return count;
+}
+
+// Copies a float tensor into values
+inline bool readFloats(const Tensor& t, std::vector<float>& values) {
+  if (t.elem_type() != TensorProto_DataType_FLOAT) {
+    return false;
+  }
+  const float* data = t.data<float>();
+  values.assign(data, data + elementCount(t));
+  return true;
+}
+
+// Copies an int64 tensor, such as a Reshape shape, into values
+inline bool readInts(const Tensor& t, std::vector<int64_t>& values) {
+  if (t.elem_type() != TensorProto_DataType_INT64) {
+    return false;
+  }
+  const int64_t* data = t.data<int64_t>();
+  values.assign(data, data + elementCount(t));
+  return true;
+}
+
+// Value of a constant holding a single number
+inline bool scalarValue(Graph& graph, Value* v, double* value) {
+  const Tensor* t = constantTensor(graph, v);
+  if (!t || elementCount(*t) != 1) {
+    return false;
+  }
+  switch (t->elem_type()) {
+    case TensorProto_DataType_FLOAT:
+      *value = *t->data<float>();
+      return true;
+    case TensorProto_DataType_DOUBLE:
+      *value = *t->data<double>();
+      return true;
+    case TensorProto_DataType_INT32:
+      *value = *t->data<int32_t>();
+      return true;
+    case TensorProto_DataType_INT64:
+      *value = static_cast<double>(*t->data<int64_t>());
+      return true;
+    default:
+      return false;
+  }
+}
+
+inline bool isScalar(Graph& graph, Value* v, double expected, double rtol = 1e-3) {
+  double value;
+  return scalarValue(graph, v, &value) &&
+      std::fabs(value - expected) <= rtol * std::fabs(expected);
+}
+
+// For a commutative binary node with a scalar constant operand close to
+// expected, returns the other operand
+inline Value* otherThanScalar(Graph& graph, Node* n, double expected) {
+  if (n->inputs().size() != 2) {
+    return nullptr;
+  }
+  if (isScalar(graph, n->inputs()[1], expected)) {
+    return n->inputs()[0];
+  }
+  if (isScalar(graph, n->inputs()[0], expected)) {
+    return n->inputs()[1];
+  }
+  return nullptr;
+}
+
+// For a commutative binary node with exactly one constant operand, returns
+// the other operand and sets *constant
+inline Value* otherThanConstant(Graph& graph, Node* n, Value** constant) {
+  if (n->inputs().size() != 2) {
+    return nullptr;
+  }
+  const bool c0 = isConstant(graph, n->inputs()[0]);
+  const bool c1 = isConstant(graph, n->inputs()[1]);
+  if (c0 == c1) {
+    return nullptr;
+  }
+  *constant = n->inputs()[c0 ? 0 : 1];
+  return n->inputs()[c0 ? 1 : 0];
+}
+
+// True for a reduction over the last axis only, with kept dimensions
+inline bool reducesLastAxis(Node* n) {
+  if (!n->hasAttribute(kaxes) || n->is(kaxes).size() != 1) {
+    return false;
+  }
+  if (n->hasAttribute(kkeepdims) && n->i(kkeepdims) == 0) {
+    return false;
+  }
+  const int64_t axis = n->is(kaxes)[0];
+  if (axis == -1) {
+    return true;
+  }
+  Value* in = n->inputs()[0];
+  if (in->has_sizes() && !in->sizes().empty()) {
+    return axis == static_cast<int64_t>(in->sizes().size()) - 1;
+  }
+  // BERT activations are B x S x hidden
+  return axis == 2;
+}
+
+inline bool hasPerm(Node* n, const std::vector<int64_t>& perm) {
+  return n->kind() == kTranspose && n->hasAttribute(kperm) &&
+      n->is(kperm) == perm;
+}
+
+// Moves the uses of n to replacement and drops the inputs of n, so that the
+// subgraph feeding n can be destroyed before the pass iterator destroys n
+inline void replaceNode(Node* n, Node* replacement) {
+  n->replaceAllUsesWith(replacement);
+  n->removeAllInputs();
+}
+
+// Destroys the nodes of a replaced subgraph once they have no uses left.
+// Nodes still used outside the subgraph are kept. Must not contain the node
+// the pass iterator is on.
+inline void destroyDeadNodes(std::vector<Node*> nodes) {
+  std::sort(nodes.begin(), nodes.end());
+  nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto& n : nodes) {
+      if (n && n->kind() != kParam && !n->hasUses()) {
+        n->destroy();
+        n = nullptr;
+        changed = true;
+      }
+    }
+  }
+}
+
+} // namespace bert_fusion
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
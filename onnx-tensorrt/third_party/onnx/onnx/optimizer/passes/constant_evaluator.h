@@ -0,0 +1,979 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// CPU evaluation of the ops that show up on constant paths of exported
+// models: shape arithmetic (Gather, Concat, Slice, Unsqueeze, Cast, ...),
+// weight-only expressions (Transpose, MatMul, elementwise math) and
+// generators (ConstantOfShape, Range). Used by the fold_constants pass.
+//
+// FLOAT, DOUBLE, INT32 and INT64 tensors are supported. Elementwise loops
+// run over contiguous rows with unit or zero strides so that they can be
+// vectorized; layout ops compute a source index per output element.
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+
+#include "onnx/common/ir.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+namespace constant_folding {
+
+typedef std::vector<int64_t> Dims;
+
+inline Symbol kindShape() {
+  static const Symbol kind("Shape");
+  return kind;
+}
+inline Symbol kindSize() {
+  static const Symbol kind("Size");
+  return kind;
+}
+inline Symbol kindGather() {
+  static const Symbol kind("Gather");
+  return kind;
+}
+inline Symbol kindFlatten() {
+  static const Symbol kind("Flatten");
+  return kind;
+}
+inline Symbol kindConstantOfShape() {
+  static const Symbol kind("ConstantOfShape");
+  return kind;
+}
+inline Symbol kindRange() {
+  static const Symbol kind("Range");
+  return kind;
+}
+inline Symbol kindReciprocal() {
+  static const Symbol kind("Reciprocal");
+  return kind;
+}
+inline Symbol kindErf() {
+  static const Symbol kind("Erf");
+  return kind;
+}
+inline Symbol kindAbs() {
+  static const Symbol kind("Abs");
+  return kind;
+}
+inline Symbol kindFloor() {
+  static const Symbol kind("Floor");
+  return kind;
+}
+inline Symbol kindCeil() {
+  static const Symbol kind("Ceil");
+  return kind;
+}
+
+inline int64_t count(const Dims& dims) {
+  int64_t n = 1;
+  for (auto d : dims) {
+    n *= d;
+  }
+  return n;
+}
+
+inline Dims stridesOf(const Dims& dims) {
+  Dims strides(dims.size(), 1);
+  for (int i = static_cast<int>(dims.size()) - 2; i >= 0; i--) {
+    strides[i] = strides[i + 1] * dims[i + 1];
+  }
+  return strides;
+}
+
+// Wraps a negative axis, returns false if it is out of range
+inline bool normalizeAxis(int64_t* axis, int64_t rank) {
+  if (*axis < 0) {
+    *axis += rank;
+  }
+  return *axis >= 0 && *axis < rank;
+}
+
+// Advances a row-major multi-index over dims, returns false at the end
+inline bool nextIndex(Dims& index, const Dims& dims) {
+  for (int i = static_cast<int>(dims.size()) - 1; i >= 0; i--) {
+    if (++index[i] < dims[i]) {
+      return true;
+    }
+    index[i] = 0;
+  }
+  return false;
+}
+
+template <typename T>
+struct Elem;
+template <>
+struct Elem<float> {
+  static const int32_t type = TensorProto_DataType_FLOAT;
+  static std::vector<float>& field(Tensor& t) {
+    return t.floats();
+  }
+};
+template <>
+struct Elem<double> {
+  static const int32_t type = TensorProto_DataType_DOUBLE;
+  static std::vector<double>& field(Tensor& t) {
+    return t.doubles();
+  }
+};
+template <>
+struct Elem<int32_t> {
+  static const int32_t type = TensorProto_DataType_INT32;
+  static std::vector<int32_t>& field(Tensor& t) {
+    return t.int32s();
+  }
+};
+template <>
+struct Elem<int64_t> {
+  static const int32_t type = TensorProto_DataType_INT64;
+  static std::vector<int64_t>& field(Tensor& t) {
+    return t.int64s();
+  }
+};
+
+inline bool isSupported(const Tensor& t) {
+  switch (t.elem_type()) {
+    case TensorProto_DataType_FLOAT:
+    case TensorProto_DataType_DOUBLE:
+    case TensorProto_DataType_INT32:
+    case TensorProto_DataType_INT64:
+      return !t.is_segment();
+    default:
+      return false;
+  }
+}
+
+inline bool isFloating(int32_t type) {
+  return type == TensorProto_DataType_FLOAT ||
+      type == TensorProto_DataType_DOUBLE;
+}
+
+template <typename T>
+void makeTensor(const Dims& dims, std::vector<T>&& values, Tensor* out) {
+  *out = Tensor();
+  out->elem_type() = Elem<T>::type;
+  out->sizes() = dims;
+  Elem<T>::field(*out) = std::move(values);
+}
+
+// Calls FN<T>(args...) with T the C++ type of an element type
+#define ONNX_FOLD_DISPATCH(type, FN, ...)             \
+  switch (type) {                                     \
+    case TensorProto_DataType_FLOAT:                  \
+      return FN<float>(__VA_ARGS__);                  \
+    case TensorProto_DataType_DOUBLE:                 \
+      return FN<double>(__VA_ARGS__);                 \
+    case TensorProto_DataType_INT32:                  \
+      return FN<int32_t>(__VA_ARGS__);                \
+    case TensorProto_DataType_INT64:                  \
+      return FN<int64_t>(__VA_ARGS__);                \
+    default:                                          \
+      return false;                                   \
+  }
+
+// Integer tensors used as shapes, axes or indices
+inline bool readIndices(const Tensor* t, std::vector<int64_t>* values) {
+  if (!t) {
+    return false;
+  }
+  const int64_t n = count(t->sizes());
+  if (t->elem_type() == TensorProto_DataType_INT64) {
+    values->assign(t->data<int64_t>(), t->data<int64_t>() + n);
+    return true;
+  }
+  if (t->elem_type() == TensorProto_DataType_INT32) {
+    values->assign(t->data<int32_t>(), t->data<int32_t>() + n);
+    return true;
+  }
+  return false;
+}
+
+// Axes from the attribute (before opset 13) or the optional input
+inline bool readAxes(Node* n, const Tensor* input, std::vector<int64_t>* axes) {
+  if (n->hasAttribute(kaxes)) {
+    *axes = n->is(kaxes);
+    return true;
+  }
+  return readIndices(input, axes);
+}
+
+// ---------------------------------------------------------------------------
+// Layout ops
+
+template <typename T>
+bool copyAs(const Tensor& in, const Dims& dims, Tensor* out) {
+  const T* src = in.data<T>();
+  makeTensor(dims, std::vector<T>(src, src + count(dims)), out);
+  return true;
+}
+
+template <typename T>
+bool gatherElements(
+    const Tensor& in,
+    const std::vector<int64_t>& index,
+    const Dims& dims,
+    Tensor* out) {
+  const T* src = in.data<T>();
+  std::vector<T> values(index.size());
+  for (size_t i = 0; i < index.size(); i++) {
+    values[i] = src[index[i]];
+  }
+  makeTensor(dims, std::move(values), out);
+  return true;
+}
+
+inline bool evalReshape(const Tensor& in, const Tensor* shape, Tensor* out) {
+  std::vector<int64_t> dims;
+  if (!readIndices(shape, &dims)) {
+    return false;
+  }
+  int inferred = -1;
+  int64_t known = 1;
+  for (size_t i = 0; i < dims.size(); i++) {
+    if (dims[i] == 0) {
+      if (i >= in.sizes().size()) {
+        return false;
+      }
+      dims[i] = in.sizes()[i];
+    }
+    if (dims[i] == -1) {
+      if (inferred >= 0) {
+        return false;
+      }
+      inferred = static_cast<int>(i);
+    } else {
+      known *= dims[i];
+    }
+  }
+  const int64_t total = count(in.sizes());
+  if (inferred >= 0) {
+    if (known == 0 || total % known) {
+      return false;
+    }
+    dims[inferred] = total / known;
+  }
+  if (count(dims) != total) {
+    return false;
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), copyAs, in, dims, out)
+}
+
+inline bool evalUnsqueeze(Node* n, const Tensor& in, const Tensor* axesInput, Tensor* out) {
+  std::vector<int64_t> axes;
+  if (!readAxes(n, axesInput, &axes)) {
+    return false;
+  }
+  const int64_t rank = static_cast<int64_t>(in.sizes().size() + axes.size());
+  for (auto& axis : axes) {
+    if (!normalizeAxis(&axis, rank)) {
+      return false;
+    }
+  }
+  std::sort(axes.begin(), axes.end());
+  Dims dims;
+  auto src = in.sizes().begin();
+  for (int64_t i = 0, a = 0; i < rank; i++) {
+    if (a < static_cast<int64_t>(axes.size()) && axes[a] == i) {
+      dims.push_back(1);
+      a++;
+    } else if (src != in.sizes().end()) {
+      dims.push_back(*src++);
+    } else {
+      return false;
+    }
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), copyAs, in, dims, out)
+}
+
+inline bool evalSqueeze(Node* n, const Tensor& in, const Tensor* axesInput, Tensor* out) {
+  std::vector<int64_t> axes;
+  const int64_t rank = static_cast<int64_t>(in.sizes().size());
+  if (!readAxes(n, axesInput, &axes)) {
+    for (int64_t i = 0; i < rank; i++) {
+      if (in.sizes()[i] == 1) {
+        axes.push_back(i);
+      }
+    }
+  }
+  for (auto& axis : axes) {
+    if (!normalizeAxis(&axis, rank) || in.sizes()[axis] != 1) {
+      return false;
+    }
+  }
+  Dims dims;
+  for (int64_t i = 0; i < rank; i++) {
+    if (std::find(axes.begin(), axes.end(), i) == axes.end()) {
+      dims.push_back(in.sizes()[i]);
+    }
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), copyAs, in, dims, out)
+}
+
+inline bool evalFlatten(Node* n, const Tensor& in, Tensor* out) {
+  const int64_t rank = static_cast<int64_t>(in.sizes().size());
+  int64_t axis = n->hasAttribute(kaxis) ? n->i(kaxis) : 1;
+  if (axis < 0) {
+    axis += rank;
+  }
+  if (axis < 0 || axis > rank) {
+    return false;
+  }
+  const Dims dims{count(Dims(in.sizes().begin(), in.sizes().begin() + axis)),
+                  count(Dims(in.sizes().begin() + axis, in.sizes().end()))};
+  ONNX_FOLD_DISPATCH(in.elem_type(), copyAs, in, dims, out)
+}
+
+inline bool evalTranspose(Node* n, const Tensor& in, Tensor* out) {
+  const Dims& inDims = in.sizes();
+  const int64_t rank = static_cast<int64_t>(inDims.size());
+  std::vector<int64_t> perm;
+  if (n->hasAttribute(kperm)) {
+    perm = n->is(kperm);
+  } else {
+    for (int64_t i = rank - 1; i >= 0; i--) {
+      perm.push_back(i);
+    }
+  }
+  if (static_cast<int64_t>(perm.size()) != rank) {
+    return false;
+  }
+  const Dims inStrides = stridesOf(inDims);
+  Dims dims(rank);
+  Dims strides(rank);
+  for (int64_t i = 0; i < rank; i++) {
+    if (perm[i] < 0 || perm[i] >= rank) {
+      return false;
+    }
+    dims[i] = inDims[perm[i]];
+    strides[i] = inStrides[perm[i]];
+  }
+  std::vector<int64_t> index;
+  index.reserve(count(dims));
+  if (count(dims) > 0) {
+    Dims pos(rank, 0);
+    do {
+      int64_t src = 0;
+      for (int64_t i = 0; i < rank; i++) {
+        src += pos[i] * strides[i];
+      }
+      index.push_back(src);
+    } while (nextIndex(pos, dims));
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), gatherElements, in, index, dims, out)
+}
+
+inline bool evalGather(Node* n, const Tensor& in, const Tensor* indices, Tensor* out) {
+  std::vector<int64_t> idx;
+  if (!readIndices(indices, &idx)) {
+    return false;
+  }
+  const Dims& inDims = in.sizes();
+  int64_t axis = n->hasAttribute(kaxis) ? n->i(kaxis) : 0;
+  if (!normalizeAxis(&axis, static_cast<int64_t>(inDims.size()))) {
+    return false;
+  }
+  const int64_t outer = count(Dims(inDims.begin(), inDims.begin() + axis));
+  const int64_t inner = count(Dims(inDims.begin() + axis + 1, inDims.end()));
+  const int64_t extent = inDims[axis];
+  for (auto& i : idx) {
+    if (!normalizeAxis(&i, extent)) {
+      return false;
+    }
+  }
+  Dims dims(inDims.begin(), inDims.begin() + axis);
+  dims.insert(dims.end(), indices->sizes().begin(), indices->sizes().end());
+  dims.insert(dims.end(), inDims.begin() + axis + 1, inDims.end());
+  std::vector<int64_t> index;
+  index.reserve(outer * idx.size() * inner);
+  for (int64_t o = 0; o < outer; o++) {
+    for (auto i : idx) {
+      for (int64_t j = 0; j < inner; j++) {
+        index.push_back((o * extent + i) * inner + j);
+      }
+    }
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), gatherElements, in, index, dims, out)
+}
+
+// Slice with starts/ends/axes/steps as inputs (opset 10+) or attributes
+inline bool evalSlice(Node* n, const std::vector<const Tensor*>& inputs, Tensor* out) {
+  const Tensor& in = *inputs[0];
+  const Dims& inDims = in.sizes();
+  const int64_t rank = static_cast<int64_t>(inDims.size());
+  static const Symbol kstarts("starts");
+  static const Symbol kends("ends");
+  std::vector<int64_t> starts, ends, axes, steps;
+  if (n->hasAttribute(kstarts)) {
+    starts = n->is(kstarts);
+    ends = n->is(kends);
+    if (n->hasAttribute(kaxes)) {
+      axes = n->is(kaxes);
+    }
+  } else {
+    if (inputs.size() < 3 || !readIndices(inputs[1], &starts) ||
+        !readIndices(inputs[2], &ends)) {
+      return false;
+    }
+    if (inputs.size() > 3 && inputs[3]) {
+      readIndices(inputs[3], &axes);
+    }
+    if (inputs.size() > 4 && inputs[4]) {
+      readIndices(inputs[4], &steps);
+    }
+  }
+  if (axes.empty()) {
+    for (size_t i = 0; i < starts.size(); i++) {
+      axes.push_back(static_cast<int64_t>(i));
+    }
+  }
+  if (steps.empty()) {
+    steps.assign(starts.size(), 1);
+  }
+  if (ends.size() != starts.size() || axes.size() != starts.size() ||
+      steps.size() != starts.size()) {
+    return false;
+  }
+
+  Dims first(rank, 0);
+  Dims step(rank, 1);
+  Dims dims(inDims);
+  for (size_t i = 0; i < axes.size(); i++) {
+    int64_t axis = axes[i];
+    if (!normalizeAxis(&axis, rank) || steps[i] == 0) {
+      return false;
+    }
+    const int64_t extent = inDims[axis];
+    int64_t begin = starts[i] < 0 ? starts[i] + extent : starts[i];
+    int64_t end = ends[i] < 0 ? ends[i] + extent : ends[i];
+    if (steps[i] > 0) {
+      begin = std::max<int64_t>(0, std::min(begin, extent));
+      end = std::max<int64_t>(0, std::min(end, extent));
+      dims[axis] = end > begin ? (end - begin + steps[i] - 1) / steps[i] : 0;
+    } else {
+      begin = std::max<int64_t>(-1, std::min(begin, extent - 1));
+      end = std::max<int64_t>(-1, std::min(end, extent - 1));
+      dims[axis] = begin > end ? (begin - end - steps[i] - 1) / -steps[i] : 0;
+    }
+    first[axis] = begin;
+    step[axis] = steps[i];
+  }
+  const Dims inStrides = stridesOf(inDims);
+  std::vector<int64_t> index;
+  if (count(dims) > 0) {
+    index.reserve(count(dims));
+    Dims pos(rank, 0);
+    do {
+      int64_t src = 0;
+      for (int64_t i = 0; i < rank; i++) {
+        src += (first[i] + pos[i] * step[i]) * inStrides[i];
+      }
+      index.push_back(src);
+    } while (nextIndex(pos, dims));
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), gatherElements, in, index, dims, out)
+}
+
+template <typename T>
+bool concatAs(const std::vector<const Tensor*>& inputs, int64_t axis, const Dims& dims, Tensor* out) {
+  const int64_t outer = count(Dims(dims.begin(), dims.begin() + axis));
+  std::vector<T> values;
+  values.reserve(count(dims));
+  for (int64_t o = 0; o < outer; o++) {
+    for (const Tensor* t : inputs) {
+      const int64_t chunk = count(Dims(t->sizes().begin() + axis, t->sizes().end()));
+      const T* src = t->data<T>() + o * chunk;
+      values.insert(values.end(), src, src + chunk);
+    }
+  }
+  makeTensor(dims, std::move(values), out);
+  return true;
+}
+
+inline bool evalConcat(Node* n, const std::vector<const Tensor*>& inputs, Tensor* out) {
+  if (inputs.empty() || !n->hasAttribute(kaxis)) {
+    return false;
+  }
+  Dims dims = inputs[0]->sizes();
+  int64_t axis = n->i(kaxis);
+  if (!normalizeAxis(&axis, static_cast<int64_t>(dims.size()))) {
+    return false;
+  }
+  dims[axis] = 0;
+  for (const Tensor* t : inputs) {
+    if (t->elem_type() != inputs[0]->elem_type() ||
+        t->sizes().size() != dims.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < dims.size(); i++) {
+      if (static_cast<int64_t>(i) != axis && t->sizes()[i] != dims[i]) {
+        return false;
+      }
+    }
+    dims[axis] += t->sizes()[axis];
+  }
+  ONNX_FOLD_DISPATCH(inputs[0]->elem_type(), concatAs, inputs, axis, dims, out)
+}
+
+// Multidirectional broadcast of two shapes
+inline bool broadcastDims(const Dims& a, const Dims& b, Dims* out) {
+  const size_t rank = std::max(a.size(), b.size());
+  out->assign(rank, 1);
+  for (size_t i = 0; i < rank; i++) {
+    const int64_t da = i < rank - a.size() ? 1 : a[i - (rank - a.size())];
+    const int64_t db = i < rank - b.size() ? 1 : b[i - (rank - b.size())];
+    if (da != db && da != 1 && db != 1) {
+      return false;
+    }
+    (*out)[i] = da == 1 ? db : da;
+  }
+  return true;
+}
+
+// Strides of dims read as a broadcast to outDims, 0 along broadcast axes
+inline Dims broadcastStrides(const Dims& dims, const Dims& outDims) {
+  const Dims strides = stridesOf(dims);
+  Dims result(outDims.size(), 0);
+  const size_t offset = outDims.size() - dims.size();
+  for (size_t i = 0; i < dims.size(); i++) {
+    result[offset + i] = dims[i] == 1 ? 0 : strides[i];
+  }
+  return result;
+}
+
+inline bool evalExpand(const Tensor& in, const Tensor* shape, Tensor* out) {
+  std::vector<int64_t> target;
+  Dims dims;
+  if (!readIndices(shape, &target) || !broadcastDims(in.sizes(), target, &dims)) {
+    return false;
+  }
+  const Dims strides = broadcastStrides(in.sizes(), dims);
+  std::vector<int64_t> index;
+  if (count(dims) > 0) {
+    index.reserve(count(dims));
+    Dims pos(dims.size(), 0);
+    do {
+      int64_t src = 0;
+      for (size_t i = 0; i < dims.size(); i++) {
+        src += pos[i] * strides[i];
+      }
+      index.push_back(src);
+    } while (nextIndex(pos, dims));
+  }
+  ONNX_FOLD_DISPATCH(in.elem_type(), gatherElements, in, index, dims, out)
+}
+
+// ---------------------------------------------------------------------------
+// Elementwise ops
+
+struct AddOp {
+  template <typename T>
+  T operator()(T a, T b) const {
+    return a + b;
+  }
+};
+struct SubOp {
+  template <typename T>
+  T operator()(T a, T b) const {
+    return a - b;
+  }
+};
+struct MulOp {
+  template <typename T>
+  T operator()(T a, T b) const {
+    return a * b;
+  }
+};
+struct DivOp {
+  template <typename T>
+  T operator()(T a, T b) const {
+    return a / b;
+  }
+};
+struct PowOp {
+  template <typename T>
+  T operator()(T a, T b) const {
+    return static_cast<T>(std::pow(static_cast<double>(a), static_cast<double>(b)));
+  }
+};
+
+// out[i] = op(a[i * sa], b[i * sb]) for unit or zero strides. The stride
+// cases are split so that each loop is a plain vectorizable one.
+template <typename T, typename Op>
+void binaryRow(const T* a, int64_t sa, const T* b, int64_t sb, T* out, int64_t n, Op op) {
+  if (sa && sb) {
+    for (int64_t i = 0; i < n; i++) {
+      out[i] = op(a[i], b[i]);
+    }
+  } else if (sb) {
+    const T x = a[0];
+    for (int64_t i = 0; i < n; i++) {
+      out[i] = op(x, b[i]);
+    }
+  } else if (sa) {
+    const T y = b[0];
+    for (int64_t i = 0; i < n; i++) {
+      out[i] = op(a[i], y);
+    }
+  } else {
+    std::fill(out, out + n, op(a[0], b[0]));
+  }
+}
+
+template <typename T, typename Op>
+bool binaryAs(const Tensor& a, const Tensor& b, Op op, Tensor* out) {
+  Dims dims;
+  if (!broadcastDims(a.sizes(), b.sizes(), &dims)) {
+    return false;
+  }
+  const T* pa = a.data<T>();
+  const T* pb = b.data<T>();
+  std::vector<T> values(count(dims));
+  if (values.empty()) {
+    makeTensor(dims, std::move(values), out);
+    return true;
+  }
+  if (a.sizes() == b.sizes() || count(a.sizes()) == 1 || count(b.sizes()) == 1) {
+    binaryRow(pa, count(a.sizes()) == 1 ? 0 : 1, pb, count(b.sizes()) == 1 ? 0 : 1,
+              values.data(), static_cast<int64_t>(values.size()), op);
+  } else {
+    // Rows along the last axis, outer axes walked with a multi-index
+    const Dims sa = broadcastStrides(a.sizes(), dims);
+    const Dims sb = broadcastStrides(b.sizes(), dims);
+    const int64_t inner = dims.back();
+    const Dims outer(dims.begin(), dims.end() - 1);
+    Dims pos(outer.size(), 0);
+    T* dst = values.data();
+    do {
+      int64_t oa = 0, ob = 0;
+      for (size_t i = 0; i < outer.size(); i++) {
+        oa += pos[i] * sa[i];
+        ob += pos[i] * sb[i];
+      }
+      binaryRow(pa + oa, sa.back(), pb + ob, sb.back(), dst, inner, op);
+      dst += inner;
+    } while (!outer.empty() && nextIndex(pos, outer));
+  }
+  makeTensor(dims, std::move(values), out);
+  return true;
+}
+
+template <typename Op>
+bool evalBinary(const Tensor& a, const Tensor& b, Op op, Tensor* out) {
+  if (a.elem_type() != b.elem_type()) {
+    return false;
+  }
+  switch (a.elem_type()) {
+    case TensorProto_DataType_FLOAT:
+      return binaryAs<float>(a, b, op, out);
+    case TensorProto_DataType_DOUBLE:
+      return binaryAs<double>(a, b, op, out);
+    case TensorProto_DataType_INT32:
+      return binaryAs<int32_t>(a, b, op, out);
+    case TensorProto_DataType_INT64:
+      return binaryAs<int64_t>(a, b, op, out);
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+bool hasZero(const Tensor& t) {
+  const T* p = t.data<T>();
+  return std::find(p, p + count(t.sizes()), T(0)) != p + count(t.sizes());
+}
+
+template <typename T, typename F>
+bool unaryAs(const Tensor& in, F f, Tensor* out) {
+  const T* src = in.data<T>();
+  std::vector<T> values(count(in.sizes()));
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = static_cast<T>(f(src[i]));
+  }
+  makeTensor(in.sizes(), std::move(values), out);
+  return true;
+}
+
+// Math on floating point tensors only, Neg and Abs also on integers
+inline bool evalUnary(NodeKind kind, const Tensor& in, Tensor* out) {
+  const int32_t type = in.elem_type();
+  if (kind == kNeg || kind == kindAbs()) {
+    const bool neg = kind == kNeg;
+    switch (type) {
+      case TensorProto_DataType_INT32:
+        return unaryAs<int32_t>(in, [neg](int32_t x) { return neg ? -x : std::abs(x); }, out);
+      case TensorProto_DataType_INT64:
+        return unaryAs<int64_t>(in, [neg](int64_t x) { return neg ? -x : std::abs(x); }, out);
+      default:
+        break;
+    }
+  }
+  if (!isFloating(type)) {
+    return false;
+  }
+  double (*f)(double) = nullptr;
+  if (kind == kSqrt) {
+    f = [](double x) { return std::sqrt(x); };
+  } else if (kind == kindReciprocal()) {
+    f = [](double x) { return 1.0 / x; };
+  } else if (kind == kExp) {
+    f = [](double x) { return std::exp(x); };
+  } else if (kind == kLog) {
+    f = [](double x) { return std::log(x); };
+  } else if (kind == kindErf()) {
+    f = [](double x) { return std::erf(x); };
+  } else if (kind == kNeg) {
+    f = [](double x) { return -x; };
+  } else if (kind == kindAbs()) {
+    f = [](double x) { return std::fabs(x); };
+  } else if (kind == kindFloor()) {
+    f = [](double x) { return std::floor(x); };
+  } else if (kind == kindCeil()) {
+    f = [](double x) { return std::ceil(x); };
+  } else {
+    return false;
+  }
+  return type == TensorProto_DataType_FLOAT ? unaryAs<float>(in, f, out)
+                                            : unaryAs<double>(in, f, out);
+}
+
+template <typename From, typename To>
+bool castAs(const Tensor& in, Tensor* out) {
+  const From* src = in.data<From>();
+  std::vector<To> values(count(in.sizes()));
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = static_cast<To>(src[i]);
+  }
+  makeTensor(in.sizes(), std::move(values), out);
+  return true;
+}
+
+template <typename From>
+bool castFrom(const Tensor& in, int32_t to, Tensor* out) {
+  switch (to) {
+    case TensorProto_DataType_FLOAT:
+      return castAs<From, float>(in, out);
+    case TensorProto_DataType_DOUBLE:
+      return castAs<From, double>(in, out);
+    case TensorProto_DataType_INT32:
+      return castAs<From, int32_t>(in, out);
+    case TensorProto_DataType_INT64:
+      return castAs<From, int64_t>(in, out);
+    default:
+      return false;
+  }
+}
+
+inline bool evalCast(Node* n, const Tensor& in, Tensor* out) {
+  if (!n->hasAttribute(kto)) {
+    return false;
+  }
+  const int32_t to = static_cast<int32_t>(n->i(kto));
+  ONNX_FOLD_DISPATCH(in.elem_type(), castFrom, in, to, out)
+}
+
+// ---------------------------------------------------------------------------
+// MatMul and generators
+
+// [.., M, K] x [K, N], the weight-only products of exported models
+template <typename T>
+bool matmulAs(const Tensor& a, const Tensor& b, Tensor* out) {
+  const Dims& da = a.sizes();
+  const Dims& db = b.sizes();
+  if (da.empty() || db.size() != 2 || da.back() != db[0]) {
+    return false;
+  }
+  const int64_t K = db[0];
+  const int64_t N = db[1];
+  const int64_t rows = K ? count(da) / K : 0;
+  const T* pa = a.data<T>();
+  const T* pb = b.data<T>();
+  std::vector<T> values(rows * N, T(0));
+  // i-k-j order keeps the inner loop contiguous in b and out
+  for (int64_t i = 0; i < rows; i++) {
+    T* row = values.data() + i * N;
+    for (int64_t k = 0; k < K; k++) {
+      const T x = pa[i * K + k];
+      const T* brow = pb + k * N;
+      for (int64_t j = 0; j < N; j++) {
+        row[j] += x * brow[j];
+      }
+    }
+  }
+  Dims dims(da.begin(), da.end() - 1);
+  dims.push_back(N);
+  makeTensor(dims, std::move(values), out);
+  return true;
+}
+
+inline bool evalMatMul(const Tensor& a, const Tensor& b, Tensor* out) {
+  if (a.elem_type() != b.elem_type() || !isFloating(a.elem_type())) {
+    return false;
+  }
+  return a.elem_type() == TensorProto_DataType_FLOAT ? matmulAs<float>(a, b, out)
+                                                     : matmulAs<double>(a, b, out);
+}
+
+template <typename T>
+bool fillAs(const Tensor& value, const Dims& dims, Tensor* out) {
+  makeTensor(dims, std::vector<T>(count(dims), *value.data<T>()), out);
+  return true;
+}
+
+inline bool evalConstantOfShape(Node* n, const Tensor* shape, Tensor* out) {
+  std::vector<int64_t> dims;
+  if (!readIndices(shape, &dims)) {
+    return false;
+  }
+  if (!n->hasAttribute(kvalue)) {
+    makeTensor(dims, std::vector<float>(count(dims), 0.f), out);
+    return true;
+  }
+  const Tensor& value = n->t(kvalue);
+  if (!isSupported(value) || count(value.sizes()) != 1) {
+    return false;
+  }
+  ONNX_FOLD_DISPATCH(value.elem_type(), fillAs, value, dims, out)
+}
+
+template <typename T>
+bool rangeAs(const Tensor& start, const Tensor& limit, const Tensor& delta, Tensor* out) {
+  const T first = *start.data<T>();
+  const T last = *limit.data<T>();
+  const T step = *delta.data<T>();
+  if (step == T(0)) {
+    return false;
+  }
+  const int64_t n = std::max<int64_t>(
+      0, static_cast<int64_t>(std::ceil(static_cast<double>(last - first) / static_cast<double>(step))));
+  std::vector<T> values(n);
+  for (int64_t i = 0; i < n; i++) {
+    values[i] = static_cast<T>(first + static_cast<T>(i) * step);
+  }
+  makeTensor(Dims{n}, std::move(values), out);
+  return true;
+}
+
+inline bool evalRange(const std::vector<const Tensor*>& inputs, Tensor* out) {
+  if (inputs.size() != 3 || inputs[1]->elem_type() != inputs[0]->elem_type() ||
+      inputs[2]->elem_type() != inputs[0]->elem_type()) {
+    return false;
+  }
+  ONNX_FOLD_DISPATCH(inputs[0]->elem_type(), rangeAs, *inputs[0], *inputs[1], *inputs[2], out)
+}
+
+// ---------------------------------------------------------------------------
+
+// Kinds evaluate() handles, besides Shape and Size which only need the
+// static shape of their input
+inline bool canEvaluate(NodeKind kind) {
+  static const std::unordered_set<uint32_t> kinds{
+      kIdentity, kReshape, kUnsqueeze, kSqueeze, kindFlatten(), kTranspose,
+      kindGather(), kSlice, kConcat, kExpand, kAdd, kSub, kMul, kDiv, kPow,
+      kSqrt, kindReciprocal(), kExp, kLog, kindErf(), kNeg, kindAbs(),
+      kindFloor(), kindCeil(), kCast, kMatMul, kindConstantOfShape(),
+      kindRange()};
+  return kinds.count(kind) > 0;
+}
+
+// Evaluates n on constant inputs, absent optional inputs are nullptr.
+// Returns false for unsupported kinds, types or attributes.
+inline bool evaluate(Node* n, const std::vector<const Tensor*>& inputs, Tensor* out) {
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (inputs[i] && !isSupported(*inputs[i])) {
+      return false;
+    }
+  }
+  if (inputs.empty() || !inputs[0]) {
+    return false;
+  }
+  const NodeKind kind = n->kind();
+  const Tensor& in = *inputs[0];
+  const Tensor* second = inputs.size() > 1 ? inputs[1] : nullptr;
+  if (kind == kIdentity) {
+    *out = in;
+    return true;
+  }
+  if (kind == kReshape) {
+    return evalReshape(in, second, out);
+  }
+  if (kind == kUnsqueeze) {
+    return evalUnsqueeze(n, in, second, out);
+  }
+  if (kind == kSqueeze) {
+    return evalSqueeze(n, in, second, out);
+  }
+  if (kind == kindFlatten()) {
+    return evalFlatten(n, in, out);
+  }
+  if (kind == kTranspose) {
+    return evalTranspose(n, in, out);
+  }
+  if (kind == kindGather()) {
+    return evalGather(n, in, second, out);
+  }
+  if (kind == kSlice) {
+    return evalSlice(n, inputs, out);
+  }
+  if (kind == kConcat) {
+    return evalConcat(n, inputs, out);
+  }
+  if (kind == kExpand) {
+    return evalExpand(in, second, out);
+  }
+  if (kind == kCast) {
+    return evalCast(n, in, out);
+  }
+  if (kind == kindConstantOfShape()) {
+    return evalConstantOfShape(n, &in, out);
+  }
+  if (kind == kindRange()) {
+    return evalRange(inputs, out);
+  }
+  if (inputs.size() == 1) {
+    return evalUnary(kind, in, out);
+  }
+  if (inputs.size() != 2 || !second) {
+    return false;
+  }
+  const Tensor& b = *second;
+  if (kind == kMatMul) {
+    return evalMatMul(in, b, out);
+  }
+  if (kind == kAdd) {
+    return evalBinary(in, b, AddOp(), out);
+  }
+  if (kind == kSub) {
+    return evalBinary(in, b, SubOp(), out);
+  }
+  if (kind == kMul) {
+    return evalBinary(in, b, MulOp(), out);
+  }
+  if (kind == kDiv) {
+    // Integer division by zero is left to the runtime
+    if (b.elem_type() == TensorProto_DataType_INT32 ? hasZero<int32_t>(b)
+            : b.elem_type() == TensorProto_DataType_INT64 ? hasZero<int64_t>(b)
+            : false) {
+      return false;
+    }
+    return evalBinary(in, b, DivOp(), out);
+  }
+  if (kind == kPow) {
+    // Exponents of another type are left to the runtime
+    if (!isFloating(in.elem_type())) {
+      return false;
+    }
+    return evalBinary(in, b, PowOp(), out);
+  }
+  return false;
+}
+
+#undef ONNX_FOLD_DISPATCH
+
+} // namespace constant_folding
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
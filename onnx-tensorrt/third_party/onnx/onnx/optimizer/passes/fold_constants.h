@@ -0,0 +1,147 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Before:
+//   Y = Op(C1, C2, ...)     with constant inputs (initializers or Constant)
+//   S = Shape(X)            with a static shape of X
+// After:
+//   Y, S are initializers
+//
+// Nodes are visited in topological order, so whole weight-only and
+// static-shape chains collapse in one run. Initializers left without uses
+// are removed by eliminate_unused_initializer. Graph outputs are not folded
+// and neither are nodes whose result would be much larger than their inputs
+// (e.g. ConstantOfShape of an activation shape).
+
+#include "onnx/optimizer/pass.h"
+#include "onnx/optimizer/passes/constant_evaluator.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+
+struct FoldConstants final : public PredicateBasedPass {
+  explicit FoldConstants()
+      : PredicateBasedPass(
+            PassType::Fuse,
+            PassEfficiency::Complete,
+            PassOptimizationType::Compute) {}
+
+  // Results up to this many elements are always folded, larger ones only if
+  // they do not grow the model
+  static constexpr int64_t kMaxGrowthElements = 1 << 16;
+
+  std::string getPassName() const override {
+    return "fold_constants";
+  }
+
+  bool patternMatchPredicate(Node* node) override {
+    return node->outputs().size() == 1 &&
+        (node->kind() == constant_folding::kindShape() ||
+         node->kind() == constant_folding::kindSize() ||
+         constant_folding::canEvaluate(node->kind()));
+  }
+
+  static const Tensor* constantTensor(Graph& graph, Value* v) {
+    Node* n = v->node();
+    if (n->kind() == kConstant && n->hasAttribute(kvalue)) {
+      return &n->t(kvalue);
+    }
+    if (n->kind() == kParam) {
+      auto it = graph.getInitializer(v->uniqueName());
+      if (it != graph.initializers().end()) {
+        return &*it;
+      }
+    }
+    return nullptr;
+  }
+
+  // Shape and Size of an input with static dimensions
+  static bool evaluateShape(Graph& graph, Node* n, Tensor* out) {
+    Value* in = n->inputs()[0];
+    std::vector<int64_t> dims;
+    if (const Tensor* t = constantTensor(graph, in)) {
+      dims = t->sizes();
+    } else if (in->has_sizes()) {
+      for (const auto& d : in->sizes()) {
+        if (!d.is_int || d.dim < 0) {
+          return false;
+        }
+        dims.push_back(d.dim);
+      }
+    } else {
+      return false;
+    }
+    if (n->kind() == constant_folding::kindSize()) {
+      constant_folding::makeTensor(
+          {}, std::vector<int64_t>{constant_folding::count(dims)}, out);
+    } else {
+      const int64_t rank = static_cast<int64_t>(dims.size());
+      constant_folding::makeTensor({rank}, std::move(dims), out);
+    }
+    return true;
+  }
+
+  bool runTransform(Node* n, Graph& graph, NodeDestroyType& destroy_current)
+      override {
+    using namespace constant_folding;
+    destroy_current = NodeDestroyType::DestroyZero;
+
+    Value* output = n->output();
+    for (const auto& use : output->uses()) {
+      if (use.user == graph.return_node()) {
+        return false;
+      }
+    }
+
+    Tensor result;
+    if (n->kind() == kindShape() || n->kind() == kindSize()) {
+      if (!evaluateShape(graph, n, &result)) {
+        return false;
+      }
+    } else {
+      std::vector<const Tensor*> inputs;
+      int64_t inputElements = 0;
+      for (Value* v : n->inputs()) {
+        if (v->node()->kind() == kUndefined) {
+          inputs.push_back(nullptr);
+          continue;
+        }
+        const Tensor* t = constantTensor(graph, v);
+        if (!t) {
+          return false;
+        }
+        inputs.push_back(t);
+        inputElements += count(t->sizes());
+      }
+      if (!evaluate(n, inputs, &result)) {
+        return false;
+      }
+      const int64_t elements = count(result.sizes());
+      if (elements > kMaxGrowthElements && elements > inputElements) {
+        return false;
+      }
+    }
+
+    Value* folded = graph.addInitializerAndInput(result, output->uniqueName());
+    output->replaceAllUsesWith(folded);
+    std::vector<Node*> producers;
+    for (Value* v : n->inputs()) {
+      if (std::find(producers.begin(), producers.end(), v->node()) == producers.end()) {
+        producers.push_back(v->node());
+      }
+    }
+    n->removeAllInputs();
+    for (Node* p : producers) {
+      if (p->kind() == kConstant && !p->hasUses()) {
+        p->destroy();
+      }
+    }
+    destroy_current = NodeDestroyType::DestroyOne;
+    return true;
+  }
+};
+
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
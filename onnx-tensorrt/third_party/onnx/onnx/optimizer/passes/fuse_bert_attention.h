@@ -0,0 +1,289 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Before:
+//   q, k, v = Split(QKV, axis=-1)                   from fuse_bert_qkv_matmul
+//   Qh = Transpose(Reshape(q, [0, 0, N, H]), perm=[0, 2, 1, 3])
+//   Kt = Transpose(Reshape(k, [0, 0, N, H]), perm=[0, 2, 3, 1])
+//   Vh = Transpose(Reshape(v, [0, 0, N, H]), perm=[0, 2, 1, 3])
+//   P = Softmax(Add(Div(MatMul(Qh, Kt), sqrt(H)), MaskBias))
+//   Y = Reshape(Transpose(MatMul(P, Vh), perm=[0, 2, 1, 3]), [0, 0, N * H])
+// After:
+//   Y = QkvToContext(QKV, MaskIndex(mask)), num_heads=N, hidden_size=N * H
+//
+// QKV must be MatMul(X, W) or Add(MatMul(X, W), b) with constant W and b,
+// whose columns are reordered into q, k, v order if the Split is not. Kt
+// may also be Transpose(Qh-like, perm=[0, 1, 3, 2]) and the scale a Mul by
+// 1 / sqrt(H). MaskBias has to be computed from a graph input through
+// elementwise and reshaping nodes only; the plugin takes the number of
+// valid tokens of each sequence, so masks are assumed to be prefixes.
+
+#include "onnx/optimizer/passes/bert_fusion_utils.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+
+struct FuseBertAttention final : public PredicateBasedPass {
+  explicit FuseBertAttention()
+      : PredicateBasedPass(
+            PassType::Fuse,
+            PassEfficiency::Complete,
+            PassOptimizationType::Compute) {}
+
+  std::string getPassName() const override {
+    return "fuse_bert_attention";
+  }
+
+  bool patternMatchPredicate(Node* node) override {
+    return node->kind() == kReshape &&
+        bert_fusion::hasPerm(node->inputs()[0]->node(), {0, 2, 1, 3});
+  }
+
+  // Transpose(Reshape(x, [0, 0, N, H]), perm), returns x and sets the head
+  // shape, or returns nullptr
+  static Value* matchHeads(
+      Graph& graph,
+      Node* transpose,
+      const std::vector<int64_t>& perm,
+      int64_t* numHeads,
+      int64_t* headSize,
+      std::vector<Node*>& nodes) {
+    using namespace bert_fusion;
+    if (!hasPerm(transpose, perm)) {
+      return nullptr;
+    }
+    Node* reshape = producer(transpose->inputs()[0], kReshape);
+    if (!reshape || reshape->inputs().size() != 2) {
+      return nullptr;
+    }
+    const Tensor* shapeTensor = constantTensor(graph, reshape->inputs()[1]);
+    std::vector<int64_t> shape;
+    if (!shapeTensor || !readInts(*shapeTensor, shape) || shape.size() != 4 ||
+        shape[2] <= 0 || shape[3] <= 0) {
+      return nullptr;
+    }
+    *numHeads = shape[2];
+    *headSize = shape[3];
+    nodes.push_back(transpose);
+    nodes.push_back(reshape);
+    nodes.push_back(reshapeShapeNode(reshape));
+    return reshape->inputs()[0];
+  }
+
+  static Node* reshapeShapeNode(Node* reshape) {
+    return reshape->inputs()[1]->node();
+  }
+
+  // Follows the additive mask back to the graph input it is computed from
+  static Value* traceMask(Graph& graph, Value* bias, std::vector<Node*>& nodes) {
+    using namespace bert_fusion;
+    Value* v = bias;
+    for (int depth = 0; depth < 16; depth++) {
+      Node* p = v->node();
+      if (p->kind() == kParam) {
+        return isConstant(graph, v) ? nullptr : v;
+      }
+      if (p->kind() != kUnsqueeze && p->kind() != kCast && p->kind() != kSub &&
+          p->kind() != kMul && p->kind() != kReshape &&
+          p->kind() != kExpand) {
+        return nullptr;
+      }
+      Value* next = nullptr;
+      for (Value* in : p->inputs()) {
+        if (isConstant(graph, in)) {
+          continue;
+        }
+        if (next) {
+          return nullptr;
+        }
+        next = in;
+      }
+      if (!next) {
+        return nullptr;
+      }
+      nodes.push_back(p);
+      v = next;
+    }
+    return nullptr;
+  }
+
+  static Value* maskIndex(Graph& graph, Value* mask) {
+    for (const auto& use : mask->uses()) {
+      if (use.user->kind() == bert_fusion::kindMaskIndex()) {
+        return use.user->output();
+      }
+    }
+    Node* idx = graph.create(bert_fusion::kindMaskIndex(), {mask}, 1);
+    idx->output()->setElemType(TensorProto_DataType_INT32);
+    graph.prependNode(idx);
+    return idx->output();
+  }
+
+  // Reorders the column blocks of a [.., 3E] constant into q, k, v order
+  static Value* permuteBlocks(
+      Graph& graph,
+      Value* v,
+      const int order[3],
+      int64_t blockSize) {
+    const Tensor* t = bert_fusion::constantTensor(graph, v);
+    std::vector<float> values;
+    if (!t || t->sizes().empty() || t->sizes().back() != 3 * blockSize ||
+        !bert_fusion::readFloats(*t, values)) {
+      return nullptr;
+    }
+    Tensor permuted;
+    permuted.elem_type() = TensorProto_DataType_FLOAT;
+    permuted.sizes() = t->sizes();
+    permuted.floats().resize(values.size());
+    const int64_t rows = static_cast<int64_t>(values.size()) / (3 * blockSize);
+    for (int64_t r = 0; r < rows; r++) {
+      for (int i = 0; i < 3; i++) {
+        std::copy_n(
+            values.data() + (r * 3 + order[i]) * blockSize,
+            blockSize,
+            permuted.floats().data() + (r * 3 + i) * blockSize);
+      }
+    }
+    return graph.addInitializerAndInput(permuted);
+  }
+
+  bool runTransform(Node* n, Graph& graph, NodeDestroyType& destroy_current)
+      override {
+    using namespace bert_fusion;
+    destroy_current = NodeDestroyType::DestroyZero;
+
+    std::vector<Node*> nodes;
+    Node* outTranspose = n->inputs()[0]->node();
+    Node* context = producer(outTranspose->inputs()[0], kMatMul);
+    if (!context) {
+      return false;
+    }
+    Node* softmax = producer(context->inputs()[0], kSoftmax);
+    if (!softmax) {
+      return false;
+    }
+    nodes.insert(nodes.end(), {outTranspose, context, softmax});
+    if (n->inputs().size() > 1) {
+      nodes.push_back(reshapeShapeNode(n));
+    }
+
+    // Scores, with or without the additive mask
+    Node* scaled = softmax->inputs()[0]->node();
+    Value* maskBias = nullptr;
+    if (scaled->kind() == kAdd && scaled->inputs().size() == 2) {
+      nodes.push_back(scaled);
+      Node* lhs = scaled->inputs()[0]->node();
+      Node* rhs = scaled->inputs()[1]->node();
+      const bool lhsScores = lhs->kind() == kDiv || lhs->kind() == kMul;
+      maskBias = scaled->inputs()[lhsScores ? 1 : 0];
+      scaled = lhsScores ? lhs : rhs;
+    }
+    Value* scaleValue = nullptr;
+    Value* rawScores = scaled->kind() == kDiv || scaled->kind() == kMul
+        ? otherThanConstant(graph, scaled, &scaleValue)
+        : nullptr;
+    Node* scores = rawScores ? producer(rawScores, kMatMul) : nullptr;
+    if (!scores || (scaled->kind() == kDiv && scaled->inputs()[1] != scaleValue)) {
+      return false;
+    }
+    nodes.insert(nodes.end(), {scaled, scores, scaleValue->node()});
+
+    // Heads of q, k and v
+    int64_t numHeads[3];
+    int64_t headSize[3];
+    Value* q = matchHeads(graph, scores->inputs()[0]->node(), {0, 2, 1, 3},
+                          &numHeads[0], &headSize[0], nodes);
+    Node* kt = scores->inputs()[1]->node();
+    Value* k = matchHeads(graph, kt, {0, 2, 3, 1}, &numHeads[1], &headSize[1], nodes);
+    if (!k && hasPerm(kt, {0, 1, 3, 2})) {
+      nodes.push_back(kt);
+      k = matchHeads(graph, kt->inputs()[0]->node(), {0, 2, 1, 3},
+                     &numHeads[1], &headSize[1], nodes);
+    }
+    Value* v = matchHeads(graph, context->inputs()[1]->node(), {0, 2, 1, 3},
+                          &numHeads[2], &headSize[2], nodes);
+    if (!q || !k || !v || numHeads[0] != numHeads[1] ||
+        numHeads[0] != numHeads[2] || headSize[0] != headSize[1] ||
+        headSize[0] != headSize[2]) {
+      return false;
+    }
+    const int64_t N = numHeads[0];
+    const int64_t H = headSize[0];
+    const double scale = std::sqrt(static_cast<double>(H));
+    if (!isScalar(graph, scaleValue, scaled->kind() == kDiv ? scale : 1.0 / scale)) {
+      return false;
+    }
+
+    // q, k and v have to come from one Split of MatMul(X, W) [+ b]
+    Node* split = q->node();
+    if (split->kind() != kindSplit() || split->outputs().size() != 3 ||
+        k->node() != split || v->node() != split) {
+      return false;
+    }
+    int order[3] = {static_cast<int>(q->offset()), static_cast<int>(k->offset()),
+                    static_cast<int>(v->offset())};
+    if (order[0] == order[1] || order[0] == order[2] || order[1] == order[2]) {
+      return false;
+    }
+    Value* qkv = split->inputs()[0];
+    Node* biasAdd = nullptr;
+    Node* matmul = producer(qkv, kMatMul);
+    Value* bias = nullptr;
+    if (!matmul) {
+      biasAdd = producer(qkv, kAdd);
+      Value* product = biasAdd ? otherThanConstant(graph, biasAdd, &bias) : nullptr;
+      matmul = product ? producer(product, kMatMul) : nullptr;
+    }
+    const Tensor* w = matmul ? constantTensor(graph, matmul->inputs()[1]) : nullptr;
+    if (!w || w->sizes().size() != 2 || w->sizes()[1] != 3 * N * H) {
+      return false;
+    }
+    nodes.push_back(split);
+
+    Value* mask = nullptr;
+    if (maskBias) {
+      mask = traceMask(graph, maskBias, nodes);
+      if (!mask) {
+        return false;
+      }
+    }
+
+    const bool inOrder = order[0] == 0 && order[1] == 1 && order[2] == 2;
+    if (!inOrder) {
+      // The permuted weights must not change what other nodes compute
+      if (qkv->uses().size() != 1 || matmul->output()->uses().size() != 1 ||
+          q->uses().size() != 1 || k->uses().size() != 1 || v->uses().size() != 1) {
+        return false;
+      }
+      Value* permutedWeight = permuteBlocks(graph, matmul->inputs()[1], order, N * H);
+      Value* permutedBias = bias ? permuteBlocks(graph, bias, order, N * H) : nullptr;
+      if (!permutedWeight || (bias && !permutedBias)) {
+        return false;
+      }
+      matmul->replaceInputWith(matmul->inputs()[1], permutedWeight);
+      if (bias) {
+        biasAdd->replaceInputWith(bias, permutedBias);
+      }
+    }
+
+    Value* maskIdx = mask ? maskIndex(graph, mask) : nullptr;
+    Node* attention = graph.create(kindQkvToContext(), {qkv}, 1);
+    if (maskIdx) {
+      attention->addInput(maskIdx);
+    }
+    attention->i_(Symbol("num_heads"), N);
+    attention->i_(Symbol("hidden_size"), N * H);
+    attention->i_(Symbol("has_mask"), maskIdx ? 1 : 0);
+    attention->output()->copyMetadata(n->output());
+    attention->insertBefore(n);
+    replaceNode(n, attention);
+    destroy_current = NodeDestroyType::DestroyOne;
+    destroyDeadNodes(nodes);
+    return true;
+  }
+};
+
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
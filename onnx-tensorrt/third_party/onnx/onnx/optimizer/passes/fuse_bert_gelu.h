@@ -0,0 +1,170 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Before (erf form):
+//   Y = X * 0.5 * (1 + Erf(X / sqrt(2)))
+// Before (tanh form):
+//   Y = X * 0.5 * (1 + Tanh(sqrt(2 / pi) * (X + 0.044715 * X^3)))
+// After:
+//   Y = Gelu(X)
+//
+// The products may be grouped in any order, X / sqrt(2) may be written as
+// X * (1 / sqrt(2)) and X^3 as Pow(X, 3) or X * X * X. The plugin computes
+// the tanh approximation, which is within 1e-3 of the erf form.
+
+#include "onnx/optimizer/passes/bert_fusion_utils.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+
+struct FuseBertGelu final : public PredicateBasedPass {
+  explicit FuseBertGelu()
+      : PredicateBasedPass(
+            PassType::Fuse,
+            PassEfficiency::Complete,
+            PassOptimizationType::Compute) {}
+
+  std::string getPassName() const override {
+    return "fuse_bert_gelu";
+  }
+
+  bool patternMatchPredicate(Node* node) override {
+    return node->kind() == kMul;
+  }
+
+  // Flattens a product into its factors. Inner Mul nodes are only expanded
+  // when the product has no other use.
+  static void collectFactors(
+      Value* v,
+      bool root,
+      std::vector<Value*>& factors,
+      std::vector<Node*>& nodes) {
+    Node* mul = bert_fusion::producer(v, kMul);
+    if (!mul || mul->inputs().size() != 2 ||
+        (!root && v->uses().size() != 1) || factors.size() > 4) {
+      factors.push_back(v);
+      return;
+    }
+    nodes.push_back(mul);
+    collectFactors(mul->inputs()[0], false, factors, nodes);
+    collectFactors(mul->inputs()[1], false, factors, nodes);
+  }
+
+  // Splits factors into one scalar close to expected and the rest
+  static bool takeScalar(
+      Graph& graph,
+      std::vector<Value*>& factors,
+      double expected) {
+    for (auto it = factors.begin(); it != factors.end(); ++it) {
+      if (bert_fusion::isScalar(graph, *it, expected)) {
+        factors.erase(it);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // X^3 written as Pow(X, 3) or as a product
+  static bool isCube(Graph& graph, std::vector<Value*> factors, Value* x) {
+    if (factors.size() == 1) {
+      Node* pow = bert_fusion::producer(factors[0], kPow);
+      return pow && pow->inputs()[0] == x &&
+          bert_fusion::isScalar(graph, pow->inputs()[1], 3.0);
+    }
+    return factors.size() == 3 && factors[0] == x && factors[1] == x &&
+        factors[2] == x;
+  }
+
+  // Argument of Erf: X / sqrt(2) or X * (1 / sqrt(2))
+  bool matchErfArgument(Graph& graph, Value* arg, Value* x, std::vector<Node*>& nodes) {
+    Node* n = arg->node();
+    if (n->kind() == kDiv && n->inputs()[0] == x &&
+        bert_fusion::isScalar(graph, n->inputs()[1], std::sqrt(2.0))) {
+      nodes.push_back(n);
+      return true;
+    }
+    if (n->kind() == kMul && bert_fusion::otherThanScalar(graph, n, 1.0 / std::sqrt(2.0)) == x) {
+      nodes.push_back(n);
+      return true;
+    }
+    return false;
+  }
+
+  // Argument of Tanh: sqrt(2 / pi) * (X + 0.044715 * X^3)
+  bool matchTanhArgument(Graph& graph, Value* arg, Value* x, std::vector<Node*>& nodes) {
+    std::vector<Value*> factors;
+    collectFactors(arg, true, factors, nodes);
+    if (!takeScalar(graph, factors, std::sqrt(2.0 / M_PI)) || factors.size() != 1) {
+      return false;
+    }
+    Node* add = bert_fusion::producer(factors[0], kAdd);
+    if (!add || add->inputs().size() != 2) {
+      return false;
+    }
+    nodes.push_back(add);
+    for (int i = 0; i < 2; i++) {
+      if (add->inputs()[i] != x) {
+        continue;
+      }
+      std::vector<Value*> cubic;
+      collectFactors(add->inputs()[1 - i], true, cubic, nodes);
+      if (takeScalar(graph, cubic, 0.044715) && isCube(graph, cubic, x)) {
+        if (cubic.size() == 1) {
+          nodes.push_back(cubic[0]->node());
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool runTransform(Node* n, Graph& graph, NodeDestroyType& destroy_current)
+      override {
+    using namespace bert_fusion;
+    destroy_current = NodeDestroyType::DestroyZero;
+
+    std::vector<Value*> factors;
+    std::vector<Node*> nodes;
+    collectFactors(n->output(), true, factors, nodes);
+    if (!takeScalar(graph, factors, 0.5) || factors.size() != 2) {
+      return false;
+    }
+
+    for (int i = 0; i < 2; i++) {
+      Value* x = factors[i];
+      Node* onePlus = producer(factors[1 - i], kAdd);
+      if (!onePlus) {
+        continue;
+      }
+      Value* activation = otherThanScalar(graph, onePlus, 1.0);
+      if (!activation) {
+        continue;
+      }
+      Node* act = activation->node();
+      std::vector<Node*> matched = nodes;
+      matched.push_back(onePlus);
+      matched.push_back(act);
+      const bool isGelu =
+          (act->kind() == kindErf() && matchErfArgument(graph, act->inputs()[0], x, matched)) ||
+          (act->kind() == kTanh && matchTanhArgument(graph, act->inputs()[0], x, matched));
+      if (!isGelu) {
+        continue;
+      }
+
+      Node* gelu = graph.create(kindGelu(), {x}, 1);
+      gelu->output()->copyMetadata(n->output());
+      gelu->insertBefore(n);
+      replaceNode(n, gelu);
+      destroy_current = NodeDestroyType::DestroyOne;
+      matched.erase(std::remove(matched.begin(), matched.end(), n), matched.end());
+      destroyDeadNodes(matched);
+      return true;
+    }
+    return false;
+  }
+};
+
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
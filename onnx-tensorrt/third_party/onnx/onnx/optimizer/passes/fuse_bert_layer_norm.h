@@ -0,0 +1,120 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Before:
+//   mean = ReduceMean(X, axes=[-1])
+//   D = Sub(X, mean)
+//   var = ReduceMean(Pow(D, 2), axes=[-1])     or Mul(D, D)
+//   N = Div(D, Sqrt(Add(var, epsilon)))
+//   Y = Add(Mul(N, gamma), beta)
+// After:
+//   Y = LayerNorm(X, gamma, beta), epsilon
+//
+// gamma, beta and epsilon must be constants. D may be computed twice, as
+// exporters sometimes do.
+
+#include "onnx/optimizer/passes/bert_fusion_utils.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+
+struct FuseBertLayerNorm final : public PredicateBasedPass {
+  explicit FuseBertLayerNorm()
+      : PredicateBasedPass(
+            PassType::Fuse,
+            PassEfficiency::Complete,
+            PassOptimizationType::Compute) {}
+
+  std::string getPassName() const override {
+    return "fuse_bert_layer_norm";
+  }
+
+  bool patternMatchPredicate(Node* node) override {
+    return node->kind() == kAdd;
+  }
+
+  // X - mean(X) over the last axis, returns X
+  static Value* matchCentered(Node* sub, Node** mean) {
+    if (!sub || sub->kind() != kSub) {
+      return nullptr;
+    }
+    *mean = bert_fusion::producer(sub->inputs()[1], kReduceMean);
+    if (!*mean || !bert_fusion::reducesLastAxis(*mean) ||
+        (*mean)->inputs()[0] != sub->inputs()[0]) {
+      return nullptr;
+    }
+    return sub->inputs()[0];
+  }
+
+  bool runTransform(Node* n, Graph& graph, NodeDestroyType& destroy_current)
+      override {
+    using namespace bert_fusion;
+    destroy_current = NodeDestroyType::DestroyZero;
+
+    Value* beta = nullptr;
+    Value* scaled = otherThanConstant(graph, n, &beta);
+    Node* mul = scaled ? producer(scaled, kMul) : nullptr;
+    if (!mul) {
+      return false;
+    }
+    Value* gamma = nullptr;
+    Value* normalized = otherThanConstant(graph, mul, &gamma);
+    Node* div = normalized ? producer(normalized, kDiv) : nullptr;
+    if (!div) {
+      return false;
+    }
+    Node* mean = nullptr;
+    Value* x = matchCentered(div->inputs()[0]->node(), &mean);
+    Node* sqrt = producer(div->inputs()[1], kSqrt);
+    if (!x || !sqrt) {
+      return false;
+    }
+    Node* addEps = producer(sqrt->inputs()[0], kAdd);
+    Value* epsilonValue = nullptr;
+    Value* variance = addEps ? otherThanConstant(graph, addEps, &epsilonValue) : nullptr;
+    double epsilon;
+    if (!variance || !scalarValue(graph, epsilonValue, &epsilon)) {
+      return false;
+    }
+    Node* varMean = producer(variance, kReduceMean);
+    if (!varMean || !reducesLastAxis(varMean)) {
+      return false;
+    }
+    Node* square = varMean->inputs()[0]->node();
+    Value* centered = nullptr;
+    if (square->kind() == kPow && isScalar(graph, square->inputs()[1], 2.0)) {
+      centered = square->inputs()[0];
+    } else if (
+        square->kind() == kMul && square->inputs()[0] == square->inputs()[1]) {
+      centered = square->inputs()[0];
+    } else {
+      return false;
+    }
+    Node* mean2 = nullptr;
+    if (matchCentered(centered->node(), &mean2) != x) {
+      return false;
+    }
+
+    const Tensor* g = constantTensor(graph, gamma);
+    const Tensor* b = constantTensor(graph, beta);
+    if (g->sizes().size() != 1 || b->sizes() != g->sizes()) {
+      return false;
+    }
+
+    Node* ln = graph.create(kindLayerNorm(), {x, gamma, beta}, 1);
+    ln->f_(kepsilon, epsilon);
+    ln->output()->copyMetadata(n->output());
+    ln->insertBefore(n);
+    replaceNode(n, ln);
+    destroy_current = NodeDestroyType::DestroyOne;
+    destroyDeadNodes({mul, div, sqrt, addEps, varMean, square,
+                      centered->node(), mean2, div->inputs()[0]->node(),
+                      mean, epsilonValue->node()});
+    return true;
+  }
+};
+
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
@@ -0,0 +1,179 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Before:
+//   Q = Add(MatMul(X, Wq), bq)
+//   K = Add(MatMul(X, Wk), bk)
+//   V = Add(MatMul(X, Wv), bv)
+// After:
+//   Q, K, V = Split(Add(MatMul(X, [Wq|Wk|Wv]), [bq|bk|bv]), axis=-1)
+//
+// Wq, Wk and Wv are float initializers of the same shape [hidden, E]. The
+// biases are optional but must be present on all three projections or none.
+// The merged weight is laid out the way the QKV plugin reads its input,
+// which fuse_bert_attention relies on.
+
+#include "onnx/optimizer/passes/bert_fusion_utils.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+
+struct FuseBertQkvMatMul final : public PredicateBasedPass {
+  explicit FuseBertQkvMatMul()
+      : PredicateBasedPass(
+            PassType::Fuse,
+            PassEfficiency::Complete,
+            PassOptimizationType::Compute) {}
+
+  std::string getPassName() const override {
+    return "fuse_bert_qkv_matmul";
+  }
+
+  bool patternMatchPredicate(Node* node) override {
+    return node->kind() == kMatMul;
+  }
+
+  struct Projection {
+    Node* matmul;
+    Node* add;
+    std::vector<float> weight;
+    std::vector<float> bias;
+  };
+
+  // MatMul(X, W) with a 2-D float initializer W and an optional constant
+  // bias, returns false if the node is something else
+  static bool readProjection(Graph& graph, Node* matmul, Projection& p) {
+    using namespace bert_fusion;
+    const Tensor* w = constantTensor(graph, matmul->inputs()[1]);
+    if (!w || w->sizes().size() != 2 || !readFloats(*w, p.weight)) {
+      return false;
+    }
+    p.matmul = matmul;
+    p.add = nullptr;
+    p.bias.clear();
+    const int64_t cols = w->sizes()[1];
+    if (matmul->output()->uses().size() != 1) {
+      return true;
+    }
+    Node* add = matmul->output()->uses()[0].user;
+    Value* bias = nullptr;
+    if (add->kind() != kAdd ||
+        otherThanConstant(graph, add, &bias) != matmul->output()) {
+      return true;
+    }
+    const Tensor* b = constantTensor(graph, bias);
+    if (b->sizes().size() != 1 || b->sizes()[0] != cols ||
+        !readFloats(*b, p.bias)) {
+      return true;
+    }
+    p.add = add;
+    return true;
+  }
+
+  bool runTransform(Node* n, Graph& graph, NodeDestroyType& destroy_current)
+      override {
+    using namespace bert_fusion;
+    destroy_current = NodeDestroyType::DestroyZero;
+
+    Value* x = n->inputs()[0];
+    const Tensor* w = constantTensor(graph, n->inputs()[1]);
+    if (!w || w->sizes().size() != 2) {
+      return false;
+    }
+    const std::vector<int64_t> wShape = w->sizes();
+
+    std::vector<Projection> projections;
+    for (const auto& use : x->uses()) {
+      Node* user = use.user;
+      if (user->kind() != kMatMul || use.offset != 0) {
+        continue;
+      }
+      const Tensor* uw = constantTensor(graph, user->inputs()[1]);
+      if (!uw || uw->sizes() != wShape) {
+        continue;
+      }
+      Projection p;
+      if (readProjection(graph, user, p)) {
+        projections.push_back(std::move(p));
+      }
+    }
+    if (projections.size() != 3) {
+      return false;
+    }
+    std::sort(
+        projections.begin(),
+        projections.end(),
+        [](const Projection& a, const Projection& b) {
+          return a.matmul->isBefore(b.matmul);
+        });
+    if (projections[0].matmul != n) {
+      return false;
+    }
+    const bool hasBias = projections[0].add != nullptr;
+    for (const auto& p : projections) {
+      if ((p.add != nullptr) != hasBias) {
+        return false;
+      }
+    }
+
+    // [K, E] x 3 -> [K, 3E], row by row
+    const int64_t rows = wShape[0];
+    const int64_t cols = wShape[1];
+    Tensor weight;
+    weight.elem_type() = TensorProto_DataType_FLOAT;
+    weight.sizes() = {rows, 3 * cols};
+    weight.floats().resize(rows * 3 * cols);
+    Tensor bias;
+    bias.elem_type() = TensorProto_DataType_FLOAT;
+    bias.sizes() = {3 * cols};
+    for (int64_t r = 0; r < rows; r++) {
+      for (int i = 0; i < 3; i++) {
+        std::copy_n(
+            projections[i].weight.data() + r * cols,
+            cols,
+            weight.floats().data() + (r * 3 + i) * cols);
+      }
+    }
+    for (const auto& p : projections) {
+      bias.floats().insert(bias.floats().end(), p.bias.begin(), p.bias.end());
+    }
+
+    Node* matmul = graph.create(kMatMul, 1);
+    matmul->addInput(x);
+    matmul->addInput(graph.addInitializerAndInput(weight));
+    matmul->insertBefore(n);
+    Value* merged = matmul->output();
+    if (hasBias) {
+      Node* add = graph.create(kAdd, 1);
+      add->addInput(merged);
+      add->addInput(graph.addInitializerAndInput(bias));
+      add->insertBefore(n);
+      merged = add->output();
+    }
+    Node* split = graph.create(kindSplit(), {merged}, 3);
+    split->i_(kaxis, -1);
+    split->is_(ksplit, {cols, cols, cols});
+    split->insertBefore(n);
+
+    std::vector<Node*> dead;
+    for (int i = 0; i < 3; i++) {
+      Node* last = hasBias ? projections[i].add : projections[i].matmul;
+      split->outputs()[i]->copyMetadata(last->output());
+      last->output()->replaceAllUsesWith(split->outputs()[i]);
+      dead.push_back(projections[i].matmul);
+      if (hasBias) {
+        dead.push_back(projections[i].add);
+      }
+    }
+    dead.erase(std::remove(dead.begin(), dead.end(), n), dead.end());
+    n->removeAllInputs();
+    destroy_current = NodeDestroyType::DestroyOne;
+    destroyDeadNodes(dead);
+    return true;
+  }
+};
+
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
@@ -0,0 +1,64 @@
+// ATTENTION: The code in this file is highly EXPERIMENTAL.
+// Adventurous users should note that the APIs will probably change.
+
+#pragma once
+
+// Before:
+//   Y = LayerNorm(Add(X, Skip), gamma, beta)
+// After:
+//   Y = SkipLayerNorm(X, Skip, gamma, beta)
+//
+// Runs after fuse_bert_layer_norm. X and Skip must both be computed tensors,
+// the residual connections of BERT. The plugin normalizes without an epsilon,
+// so only LayerNorms with a negligible epsilon are fused.
+
+#include "onnx/optimizer/passes/bert_fusion_utils.h"
+
+namespace ONNX_NAMESPACE {
+namespace optimization {
+
+struct FuseBertSkipLayerNorm final : public PredicateBasedPass {
+  explicit FuseBertSkipLayerNorm()
+      : PredicateBasedPass(
+            PassType::Fuse,
+            PassEfficiency::Complete,
+            PassOptimizationType::Compute) {}
+
+  std::string getPassName() const override {
+    return "fuse_bert_skip_layer_norm";
+  }
+
+  bool patternMatchPredicate(Node* node) override {
+    return node->kind() == bert_fusion::kindLayerNorm() &&
+        node->inputs()[0]->node()->kind() == kAdd;
+  }
+
+  bool runTransform(Node* n, Graph& graph, NodeDestroyType& destroy_current)
+      override {
+    using namespace bert_fusion;
+    destroy_current = NodeDestroyType::DestroyZero;
+
+    if (n->hasAttribute(kepsilon) && n->f(kepsilon) > 1e-5) {
+      return false;
+    }
+    Node* add = n->inputs()[0]->node();
+    if (add->inputs().size() != 2 || isConstant(graph, add->inputs()[0]) ||
+        isConstant(graph, add->inputs()[1])) {
+      return false;
+    }
+
+    Node* skipln = graph.create(
+        kindSkipLayerNorm(),
+        {add->inputs()[0], add->inputs()[1], n->inputs()[1], n->inputs()[2]},
+        1);
+    skipln->output()->copyMetadata(n->output());
+    skipln->insertBefore(n);
+    replaceNode(n, skipln);
+    destroy_current = NodeDestroyType::DestroyOne;
+    destroyDeadNodes({add});
+    return true;
+  }
+};
+
+} // namespace optimization
+} // namespace ONNX_NAMESPACE
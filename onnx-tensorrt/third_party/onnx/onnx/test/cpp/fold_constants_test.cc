@@ -0,0 +1,394 @@
+#include <cmath>
+#include <limits>
+
+#include "gtest/gtest.h"
+#include "onnx/optimizer/passes/fold_constants.h"
+#include "onnx/test/cpp/graph_builder.h"
+
+namespace ONNX_NAMESPACE {
+namespace Test {
+namespace {
+
+const int32_t kFloat = TensorProto_DataType_FLOAT;
+const int32_t kInt32 = TensorProto_DataType_INT32;
+const int32_t kInt64 = TensorProto_DataType_INT64;
+
+class FoldConstantsTest : public ::testing::Test {
+ protected:
+  // Runs fold_constants with v read by an Identity, since graph outputs are
+  // never folded. Returns the initializer v became, nullptr if it was kept.
+  // Outputs registered before are left in front of that Identity.
+  const TensorProto* fold(Value* v) {
+    b_.output(b_.op("Identity", {v}));
+    model_ = b_.optimize({"fold_constants"});
+    const GraphProto& g = model_.graph();
+    for (int i = g.node_size() - 1; i >= 0; i--) {
+      if (g.node(i).op_type() == "Identity") {
+        return initializer(g, g.node(i).input(0));
+      }
+    }
+    return nullptr;
+  }
+
+  void expectFolded(
+      Value* v,
+      const std::vector<int64_t>& expectedDims,
+      const std::vector<double>& expectedValues,
+      int32_t expectedType = kFloat) {
+    const TensorProto* t = fold(v);
+    ASSERT_NE(t, nullptr) << "not folded";
+    EXPECT_EQ(t->data_type(), expectedType);
+    EXPECT_EQ(dims(*t), expectedDims);
+    const std::vector<double> actual = values(*t);
+    ASSERT_EQ(actual.size(), expectedValues.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+      EXPECT_NEAR(actual[i], expectedValues[i], 1e-6) << "at " << i;
+    }
+  }
+
+  Value* floats(const std::vector<int64_t>& sizes, const std::vector<double>& v) {
+    return b_.constant(sizes, v, kFloat);
+  }
+
+  Value* slice(Value* data, std::vector<int64_t> starts, std::vector<int64_t> ends,
+               std::vector<int64_t> axes, std::vector<int64_t> steps) {
+    return b_.op(
+        "Slice",
+        {data, b_.ints(starts), b_.ints(ends), b_.ints(axes), b_.ints(steps)});
+  }
+
+  GraphBuilder b_;
+  ModelProto model_;
+};
+
+// 0, 1, ..., n - 1, e.g. a 2 x 4 tensor 0 1 2 3 / 4 5 6 7
+std::vector<double> iota(int n) {
+  std::vector<double> v(n);
+  for (int i = 0; i < n; i++) {
+    v[i] = i;
+  }
+  return v;
+}
+
+} // namespace
+
+TEST_F(FoldConstantsTest, Identity) {
+  expectFolded(b_.op("Identity", {floats({2}, {1, 2})}), {2}, {1, 2});
+}
+
+TEST_F(FoldConstantsTest, ReshapeCopiesZeroAndInfersMinusOne) {
+  Value* x = floats({2, 3, 2}, iota(12));
+  expectFolded(b_.op("Reshape", {x, b_.ints({0, -1})}), {2, 6}, iota(12));
+}
+
+TEST_F(FoldConstantsTest, ReshapeOfAnotherSizeIsKept) {
+  Value* x = floats({2, 3}, iota(6));
+  EXPECT_EQ(fold(b_.op("Reshape", {x, b_.ints({4, -1})})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, UnsqueezeAndSqueeze) {
+  Value* x = floats({2, 3}, iota(6));
+  Value* u = b_.op("Unsqueeze", {x}, [](Node* n) { n->is_(kaxes, {0, -1}); });
+  b_.output(b_.op("Identity", {u}));
+  b_.output(b_.op("Identity", {b_.op("Squeeze", {u})}));
+  expectFolded(b_.op("Squeeze", {u}, [](Node* n) { n->is_(kaxes, {-1}); }), {1, 2, 3}, iota(6));
+  const GraphProto& g = model_.graph();
+  EXPECT_EQ(dims(*initializer(g, g.node(0).input(0))), std::vector<int64_t>({1, 2, 3, 1}));
+  EXPECT_EQ(dims(*initializer(g, g.node(1).input(0))), std::vector<int64_t>({2, 3}));
+}
+
+TEST_F(FoldConstantsTest, Flatten) {
+  Value* x = floats({2, 3, 2}, iota(12));
+  expectFolded(b_.op("Flatten", {x}, [](Node* n) { n->i_(kaxis, -1); }), {6, 2}, iota(12));
+}
+
+TEST_F(FoldConstantsTest, Transpose) {
+  Value* x = floats({2, 3}, iota(6));
+  expectFolded(b_.op("Transpose", {x}), {3, 2}, {0, 3, 1, 4, 2, 5});
+}
+
+TEST_F(FoldConstantsTest, TransposeWithPerm) {
+  Value* x = floats({2, 1, 3}, iota(6));
+  expectFolded(
+      b_.op("Transpose", {x}, [](Node* n) { n->is_(kperm, {2, 0, 1}); }),
+      {3, 2, 1},
+      {0, 3, 1, 4, 2, 5});
+}
+
+TEST_F(FoldConstantsTest, GatherWithNegativeIndices) {
+  Value* x = floats({2, 4}, iota(8));
+  Value* indices = b_.constant({2}, {-1, 1}, kInt64);
+  expectFolded(
+      b_.op("Gather", {x, indices}, [](Node* n) { n->i_(kaxis, 1); }),
+      {2, 2},
+      {3, 1, 7, 5});
+}
+
+TEST_F(FoldConstantsTest, GatherOutOfRangeIsKept) {
+  Value* x = floats({2, 4}, iota(8));
+  Value* indices = b_.constant({}, {2}, kInt64);
+  EXPECT_EQ(fold(b_.op("Gather", {x, indices})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, SliceWithNegativeBounds) {
+  Value* x = floats({2, 4}, iota(8));
+  expectFolded(slice(x, {-3}, {-1}, {-1}, {1}), {2, 2}, {1, 2, 5, 6});
+}
+
+TEST_F(FoldConstantsTest, SliceClampsBounds) {
+  Value* x = floats({2, 4}, iota(8));
+  // INT64_MAX is how exporters write "to the end"
+  expectFolded(
+      slice(x, {-10, 2}, {10, std::numeric_limits<int64_t>::max()}, {0, 1}, {1, 1}),
+      {2, 2},
+      {2, 3, 6, 7});
+}
+
+TEST_F(FoldConstantsTest, SliceWithNegativeStep) {
+  Value* x = floats({2, 4}, iota(8));
+  expectFolded(slice(x, {10}, {0}, {1}, {-1}), {2, 3}, {3, 2, 1, 7, 6, 5});
+}
+
+TEST_F(FoldConstantsTest, SliceToEmpty) {
+  Value* x = floats({2, 4}, iota(8));
+  expectFolded(slice(x, {3}, {1}, {1}, {1}), {2, 0}, {});
+}
+
+TEST_F(FoldConstantsTest, SliceWithAttributes) {
+  Value* x = floats({2, 4}, iota(8));
+  Value* s = b_.op("Slice", {x}, [](Node* n) {
+    n->is_(Symbol("starts"), {1});
+    n->is_(Symbol("ends"), {-1});
+    n->is_(kaxes, {1});
+  });
+  expectFolded(s, {2, 2}, {1, 2, 5, 6});
+}
+
+TEST_F(FoldConstantsTest, Concat) {
+  Value* a = b_.constant({1}, {-1}, kInt64);
+  Value* c = b_.constant({2}, {3, 4}, kInt64);
+  expectFolded(
+      b_.op("Concat", {a, c}, [](Node* n) { n->i_(kaxis, 0); }), {3}, {-1, 3, 4}, kInt64);
+}
+
+TEST_F(FoldConstantsTest, Expand) {
+  Value* x = floats({1, 2}, {1, 2});
+  expectFolded(b_.op("Expand", {x, b_.ints({3, 1})}), {3, 2}, {1, 2, 1, 2, 1, 2});
+}
+
+TEST_F(FoldConstantsTest, BinaryOpsBroadcast) {
+  // [2] with [3, 1]
+  Value* add = b_.op("Add", {floats({2}, {10, 20}), floats({3, 1}, {100, 200, 300})});
+  expectFolded(add, {3, 2}, {110, 120, 210, 220, 310, 320});
+}
+
+TEST_F(FoldConstantsTest, BinaryOpsBroadcastInnerAndOuterAxes) {
+  // [2, 1, 3] with [4, 1]: both sides broadcast
+  Value* sub = b_.op("Sub", {floats({2, 1, 3}, iota(6)), floats({4, 1}, {0, 10, 20, 30})});
+  std::vector<double> expected;
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 4; j++) {
+      for (int k = 0; k < 3; k++) {
+        expected.push_back(i * 3 + k - 10 * j);
+      }
+    }
+  }
+  expectFolded(sub, {2, 4, 3}, expected);
+}
+
+TEST_F(FoldConstantsTest, BinaryOpsWithScalars) {
+  Value* mul = b_.op("Mul", {floats({}, {2}), floats({3}, {1, 2, 3})});
+  Value* div = b_.op("Div", {mul, floats({}, {4})});
+  expectFolded(b_.op("Pow", {div, floats({}, {2})}), {3}, {0.25, 1, 2.25});
+}
+
+TEST_F(FoldConstantsTest, IncompatibleShapesAreKept) {
+  EXPECT_EQ(fold(b_.op("Add", {floats({2}, {1, 2}), floats({3}, {1, 2, 3})})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, IntegerDivision) {
+  Value* a = b_.constant({2}, {7, -7}, kInt64);
+  expectFolded(b_.op("Div", {a, b_.constant({}, {2}, kInt64)}), {2}, {3, -3}, kInt64);
+}
+
+TEST_F(FoldConstantsTest, IntegerDivisionByZeroIsKept) {
+  Value* a = b_.constant({2}, {7, 8}, kInt32);
+  EXPECT_EQ(fold(b_.op("Div", {a, b_.constant({2}, {1, 0}, kInt32)})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, IntegerPowIsKept) {
+  Value* a = b_.constant({2}, {2, 3}, kInt64);
+  EXPECT_EQ(fold(b_.op("Pow", {a, b_.constant({}, {2}, kInt64)})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, MixedTypesAreKept) {
+  EXPECT_EQ(fold(b_.op("Add", {floats({1}, {1}), b_.constant({1}, {1}, kInt64)})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, UnaryFloatOps) {
+  const std::vector<std::pair<const char*, double (*)(double)>> ops{
+      {"Sqrt", [](double x) { return std::sqrt(x); }},
+      {"Reciprocal", [](double x) { return 1 / x; }},
+      {"Exp", [](double x) { return std::exp(x); }},
+      {"Log", [](double x) { return std::log(x); }},
+      {"Erf", [](double x) { return std::erf(x); }},
+      {"Neg", [](double x) { return -x; }},
+      {"Abs", [](double x) { return std::fabs(x); }},
+      {"Floor", [](double x) { return std::floor(x); }},
+      {"Ceil", [](double x) { return std::ceil(x); }}};
+  const std::vector<double> in{0.5, 2, 3.75};
+  for (const auto& op : ops) {
+    GraphBuilder b;
+    b.output(b.op("Identity", {b.op(op.first, {b.constant({3}, in)})}));
+    ModelProto model = b.optimize({"fold_constants"});
+    const GraphProto& g = model.graph();
+    ASSERT_EQ(g.node_size(), 1) << op.first;
+    const TensorProto* t = initializer(g, g.node(0).input(0));
+    ASSERT_NE(t, nullptr) << op.first;
+    const std::vector<double> actual = values(*t);
+    ASSERT_EQ(actual.size(), in.size()) << op.first;
+    for (size_t i = 0; i < in.size(); i++) {
+      EXPECT_NEAR(actual[i], static_cast<float>(op.second(in[i])), 1e-6) << op.first << " at " << i;
+    }
+  }
+}
+
+TEST_F(FoldConstantsTest, UnaryIntegerOps) {
+  Value* x = b_.constant({3}, {-2, 0, 5}, kInt32);
+  expectFolded(b_.op("Neg", {b_.op("Abs", {x})}), {3}, {-2, 0, -5}, kInt32);
+}
+
+TEST_F(FoldConstantsTest, FloatMathOnIntegersIsKept) {
+  EXPECT_EQ(fold(b_.op("Sqrt", {b_.constant({1}, {4}, kInt64)})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, Cast) {
+  Value* x = floats({3}, {-1.5, 0.25, 2.75});
+  expectFolded(
+      b_.op("Cast", {x}, [](Node* n) { n->i_(kto, TensorProto_DataType_INT64); }),
+      {3},
+      {-1, 0, 2},
+      kInt64);
+}
+
+TEST_F(FoldConstantsTest, MatMul) {
+  Value* a = floats({2, 1, 3}, {1, 0, 1, 0, 1, 0});
+  Value* w = floats({3, 2}, {1, 2, 3, 4, 5, 6});
+  expectFolded(b_.op("MatMul", {a, w}), {2, 1, 2}, {6, 8, 3, 4});
+}
+
+TEST_F(FoldConstantsTest, MatMulOfMismatchedShapesIsKept) {
+  EXPECT_EQ(fold(b_.op("MatMul", {floats({2, 2}, iota(4)), floats({3, 2}, iota(6))})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, ConstantOfShape) {
+  Value* zeros = b_.op("ConstantOfShape", {b_.ints({2, 2})});
+  b_.output(b_.op("Identity", {zeros}));
+  Tensor seven;
+  seven.elem_type() = kInt64;
+  seven.sizes() = {1};
+  seven.int64s().push_back(7);
+  expectFolded(
+      b_.op("ConstantOfShape", {b_.ints({3})}, [&seven](Node* n) { n->t_(kvalue, seven); }),
+      {3},
+      {7, 7, 7},
+      kInt64);
+  const GraphProto& g = model_.graph();
+  const TensorProto* t = initializer(g, g.node(0).input(0));
+  ASSERT_NE(t, nullptr);
+  EXPECT_EQ(t->data_type(), kFloat);
+  EXPECT_EQ(values(*t), std::vector<double>(4, 0));
+}
+
+TEST_F(FoldConstantsTest, Range) {
+  Value* r = b_.op(
+      "Range",
+      {b_.constant({}, {0}, kInt64), b_.constant({}, {7}, kInt64), b_.constant({}, {3}, kInt64)});
+  expectFolded(r, {3}, {0, 3, 6}, kInt64);
+}
+
+TEST_F(FoldConstantsTest, RangeWithNegativeDelta) {
+  Value* r = b_.op("Range", {floats({}, {1}), floats({}, {-1}), floats({}, {-0.5})});
+  expectFolded(r, {4}, {1, 0.5, 0, -0.5});
+}
+
+TEST_F(FoldConstantsTest, ShapeAndSizeOfStaticInput) {
+  Value* x = b_.input("x", kFloat, {Dimension(2), Dimension(3)});
+  b_.output(b_.op("Identity", {b_.op("Size", {x})}));
+  expectFolded(b_.op("Shape", {x}), {2}, {2, 3}, kInt64);
+  const GraphProto& g = model_.graph();
+  const TensorProto* size = initializer(g, g.node(0).input(0));
+  ASSERT_NE(size, nullptr);
+  EXPECT_EQ(dims(*size), std::vector<int64_t>());
+  EXPECT_EQ(values(*size), std::vector<double>({6}));
+}
+
+TEST_F(FoldConstantsTest, ShapeOfDynamicInputIsKept) {
+  Value* x = b_.input("x", kFloat, {Dimension("B"), Dimension(3)});
+  EXPECT_EQ(fold(b_.op("Shape", {x})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, ShapeChainCollapses) {
+  // Reshape(x, Concat([-1], Unsqueeze(Gather(Shape(x), 1)))), the way
+  // exporters flatten activations
+  Value* x = b_.input("x", kFloat, {Dimension(2), Dimension(3), Dimension(4)});
+  Value* d1 = b_.op(
+      "Gather", {b_.op("Shape", {x}), b_.constant({}, {1}, kInt64)}, [](Node* n) { n->i_(kaxis, 0); });
+  Value* u = b_.op("Unsqueeze", {d1}, [](Node* n) { n->is_(kaxes, {0}); });
+  Value* shape = b_.op(
+      "Concat", {b_.constant({1}, {-1}, kInt64), u}, [](Node* n) { n->i_(kaxis, 0); });
+  b_.output(b_.op("Reshape", {x, shape}));
+  ModelProto model = b_.optimize({"fold_constants", "eliminate_unused_initializer"});
+
+  const GraphProto& g = model.graph();
+  ASSERT_EQ(g.node_size(), 1);
+  EXPECT_EQ(g.node(0).op_type(), "Reshape");
+  EXPECT_EQ(g.initializer_size(), 1);
+  const TensorProto* folded = initializer(g, g.node(0).input(1));
+  ASSERT_NE(folded, nullptr);
+  EXPECT_EQ(values(*folded), std::vector<double>({-1, 3}));
+}
+
+TEST_F(FoldConstantsTest, ConstantNodesAreConsumed) {
+  Tensor two;
+  two.elem_type() = kFloat;
+  two.sizes() = {};
+  two.floats().push_back(2);
+  Value* c = b_.op("Constant", {}, [&two](Node* n) { n->t_(kvalue, two); });
+  expectFolded(b_.op("Mul", {c, floats({2}, {1, 2})}), {2}, {2, 4});
+  EXPECT_EQ(model_.graph().node_size(), 1);
+}
+
+TEST_F(FoldConstantsTest, GraphOutputsAreKept) {
+  b_.output(b_.op("Add", {floats({1}, {1}), floats({1}, {2})}));
+  ModelProto model = b_.optimize({"fold_constants"});
+  ASSERT_EQ(model.graph().node_size(), 1);
+  EXPECT_EQ(model.graph().node(0).op_type(), "Add");
+}
+
+TEST_F(FoldConstantsTest, GrowthUpToTheLimitIsFolded) {
+  const int64_t limit = optimization::FoldConstants::kMaxGrowthElements;
+  const TensorProto* t = fold(b_.op("ConstantOfShape", {b_.ints({limit})}));
+  ASSERT_NE(t, nullptr);
+  EXPECT_EQ(dims(*t), std::vector<int64_t>({limit}));
+}
+
+TEST_F(FoldConstantsTest, GrowthPastTheLimitIsKept) {
+  const int64_t limit = optimization::FoldConstants::kMaxGrowthElements;
+  EXPECT_EQ(fold(b_.op("ConstantOfShape", {b_.ints({limit + 1})})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, ExpandPastTheLimitIsKept) {
+  const int64_t limit = optimization::FoldConstants::kMaxGrowthElements;
+  EXPECT_EQ(fold(b_.op("Expand", {floats({1}, {1}), b_.ints({2, limit})})), nullptr);
+}
+
+TEST_F(FoldConstantsTest, LargeResultsThatDoNotGrowAreFolded) {
+  const int64_t n = optimization::FoldConstants::kMaxGrowthElements + 1;
+  const TensorProto* t = fold(b_.op("Neg", {floats({n}, std::vector<double>(n, 1))}));
+  ASSERT_NE(t, nullptr);
+  EXPECT_EQ(dims(*t), std::vector<int64_t>({n}));
+}
+
+} // namespace Test
+} // namespace ONNX_NAMESPACE
@@ -0,0 +1,308 @@
+#include <cmath>
+
+#include "gtest/gtest.h"
+#include "onnx/test/cpp/graph_builder.h"
+
+namespace ONNX_NAMESPACE {
+namespace Test {
+namespace {
+
+const int64_t kHidden = 8;
+const int64_t kHeads = 2;
+const int64_t kHeadSize = 4;
+
+Value* hiddenInput(GraphBuilder& b, const std::string& name) {
+  return b.input(
+      name,
+      TensorProto_DataType_FLOAT,
+      {Dimension("B"), Dimension("S"), Dimension(kHidden)});
+}
+
+Value* reduceMean(GraphBuilder& b, Value* x) {
+  return b.op("ReduceMean", {x}, [](Node* n) { n->is_(kaxes, {-1}); });
+}
+
+// Decomposed layer normalization over the last axis, as exported from PyTorch
+// (squares as Pow) or TensorFlow (squares as Mul)
+Value* layerNorm(GraphBuilder& b, Value* x, bool pow, double epsilon) {
+  Value* d = b.op("Sub", {x, reduceMean(b, x)});
+  Value* squares = pow ? b.op("Pow", {d, b.scalar(2)}) : b.op("Mul", {d, d});
+  Value* stddev =
+      b.op("Sqrt", {b.op("Add", {reduceMean(b, squares), b.scalar(epsilon)})});
+  Value* gamma = b.constant({kHidden}, std::vector<double>(kHidden, 1));
+  Value* beta = b.constant({kHidden}, std::vector<double>(kHidden, 0));
+  return b.op("Add", {b.op("Mul", {b.op("Div", {d, stddev}), gamma}), beta});
+}
+
+// Add(MatMul(x, W), bias), W[r][c] = seed + r * cols + c and bias = seed
+Value* dense(GraphBuilder& b, Value* x, int64_t rows, int64_t cols, double seed) {
+  std::vector<double> w(rows * cols);
+  for (size_t i = 0; i < w.size(); i++) {
+    w[i] = seed + i;
+  }
+  Value* matmul = b.op("MatMul", {x, b.constant({rows, cols}, w)});
+  return b.op(
+      "Add", {matmul, b.constant({cols}, std::vector<double>(cols, seed))});
+}
+
+Value* transpose(GraphBuilder& b, Value* x, std::vector<int64_t> perm) {
+  return b.op("Transpose", {x}, [perm](Node* n) { n->is_(kperm, std::vector<int64_t>(perm)); });
+}
+
+Value* heads(GraphBuilder& b, Value* x, std::vector<int64_t> perm) {
+  return transpose(
+      b, b.op("Reshape", {x, b.ints({0, 0, kHeads, kHeadSize})}), perm);
+}
+
+Value* erfGelu(GraphBuilder& b, Value* x, double half) {
+  Value* erf = b.op("Erf", {b.op("Div", {x, b.scalar(std::sqrt(2.0))})});
+  return b.op(
+      "Mul",
+      {b.op("Mul", {x, b.scalar(half)}), b.op("Add", {erf, b.scalar(1)})});
+}
+
+Value* tanhGelu(GraphBuilder& b, Value* x) {
+  Value* cube = b.op("Mul", {x, b.op("Mul", {x, x})});
+  Value* inner = b.op("Add", {x, b.op("Mul", {b.scalar(0.044715), cube})});
+  Value* th =
+      b.op("Tanh", {b.op("Mul", {inner, b.scalar(std::sqrt(2 / M_PI))})});
+  return b.op(
+      "Mul",
+      {b.op("Mul", {b.scalar(0.5), x}), b.op("Add", {b.scalar(1), th})});
+}
+
+// Self attention with the key projection first in the graph, so the fused
+// weight has to be reordered into q, k, v
+Value* attention(GraphBuilder& b, Value* x, Value* mask) {
+  Value* k = dense(b, x, kHidden, kHidden, 2);
+  Value* q = dense(b, x, kHidden, kHidden, 1);
+  Value* v = dense(b, x, kHidden, kHidden, 3);
+  Value* scores = b.op(
+      "Div",
+      {b.op("MatMul", {heads(b, q, {0, 2, 1, 3}), heads(b, k, {0, 2, 3, 1})}),
+       b.scalar(std::sqrt(static_cast<double>(kHeadSize)))});
+  Value* m = b.op("Unsqueeze", {mask}, [](Node* n) { n->is_(kaxes, {1, 2}); });
+  m = b.op("Cast", {m}, [](Node* n) { n->i_(kto, TensorProto_DataType_FLOAT); });
+  m = b.op("Mul", {b.op("Sub", {b.scalar(1), m}), b.scalar(-10000)});
+  Value* probs = b.op(
+      "Softmax", {b.op("Add", {scores, m})}, [](Node* n) { n->i_(kaxis, -1); });
+  Value* context = transpose(
+      b, b.op("MatMul", {probs, heads(b, v, {0, 2, 1, 3})}), {0, 2, 1, 3});
+  return b.op("Reshape", {context, b.ints({0, 0, kHidden})});
+}
+
+std::vector<std::string> opTypes(const GraphProto& graph) {
+  std::vector<std::string> types;
+  for (const auto& n : graph.node()) {
+    types.push_back(n.op_type());
+  }
+  return types;
+}
+
+} // namespace
+
+TEST(FuseBertLayerNormTest, FusesPowAndMulVariants) {
+  for (bool pow : {true, false}) {
+    GraphBuilder b;
+    Value* x = hiddenInput(b, "x");
+    b.output(layerNorm(b, x, pow, 1e-12));
+    ModelProto model = b.optimize({"fuse_bert_layer_norm"});
+
+    const GraphProto& g = model.graph();
+    ASSERT_EQ(g.node_size(), 1) << "pow " << pow;
+    const NodeProto& ln = g.node(0);
+    EXPECT_EQ(ln.op_type(), "LayerNorm");
+    ASSERT_EQ(ln.input_size(), 3);
+    EXPECT_EQ(ln.input(0), "x");
+    EXPECT_EQ(values(*initializer(g, ln.input(1))), std::vector<double>(kHidden, 1));
+    EXPECT_EQ(values(*initializer(g, ln.input(2))), std::vector<double>(kHidden, 0));
+    ASSERT_NE(attribute(ln, "epsilon"), nullptr);
+    EXPECT_FLOAT_EQ(attribute(ln, "epsilon")->f(), 1e-12f);
+    EXPECT_EQ(ln.output(0), g.output(0).name());
+  }
+}
+
+TEST(FuseBertLayerNormTest, KeepsNormalizationWithRuntimeEpsilon) {
+  GraphBuilder b;
+  Value* x = hiddenInput(b, "x");
+  Value* epsilon = b.input("epsilon", TensorProto_DataType_FLOAT, {});
+  Value* d = b.op("Sub", {x, reduceMean(b, x)});
+  Value* stddev = b.op(
+      "Sqrt",
+      {b.op("Add", {reduceMean(b, b.op("Mul", {d, d})), epsilon})});
+  b.output(b.op(
+      "Add",
+      {b.op("Mul", {b.op("Div", {d, stddev}), b.constant({kHidden}, std::vector<double>(kHidden, 1))}),
+       b.constant({kHidden}, std::vector<double>(kHidden, 0))}));
+  ModelProto model = b.optimize({"fuse_bert_layer_norm"});
+  EXPECT_TRUE(nodesOfType(model.graph(), "LayerNorm").empty());
+  EXPECT_EQ(nodesOfType(model.graph(), "ReduceMean").size(), 2u);
+}
+
+TEST(FuseBertSkipLayerNormTest, FusesResidualAdd) {
+  GraphBuilder b;
+  Value* x = b.op("Relu", {hiddenInput(b, "x")});
+  Value* skip = b.op("Relu", {hiddenInput(b, "skip")});
+  b.output(layerNorm(b, b.op("Add", {x, skip}), true, 1e-12));
+  ModelProto model =
+      b.optimize({"fuse_bert_layer_norm", "fuse_bert_skip_layer_norm"});
+
+  const GraphProto& g = model.graph();
+  auto fused = nodesOfType(g, "SkipLayerNorm");
+  ASSERT_EQ(fused.size(), 1u);
+  EXPECT_TRUE(nodesOfType(g, "LayerNorm").empty());
+  EXPECT_TRUE(nodesOfType(g, "Add").empty());
+  ASSERT_EQ(fused[0]->input_size(), 4);
+  EXPECT_EQ(producer(g, fused[0]->input(0))->op_type(), "Relu");
+  EXPECT_EQ(producer(g, fused[0]->input(1))->op_type(), "Relu");
+  EXPECT_NE(fused[0]->input(0), fused[0]->input(1));
+}
+
+TEST(FuseBertSkipLayerNormTest, KeepsLayerNormWithLargeEpsilon) {
+  GraphBuilder b;
+  Value* x = b.op("Relu", {hiddenInput(b, "x")});
+  Value* skip = b.op("Relu", {hiddenInput(b, "skip")});
+  b.output(layerNorm(b, b.op("Add", {x, skip}), true, 1e-3));
+  ModelProto model =
+      b.optimize({"fuse_bert_layer_norm", "fuse_bert_skip_layer_norm"});
+  EXPECT_TRUE(nodesOfType(model.graph(), "SkipLayerNorm").empty());
+  EXPECT_EQ(nodesOfType(model.graph(), "LayerNorm").size(), 1u);
+}
+
+TEST(FuseBertGeluTest, FusesErfAndTanhForms) {
+  for (bool erf : {true, false}) {
+    GraphBuilder b;
+    Value* x = b.op("Relu", {hiddenInput(b, "x")});
+    b.output(erf ? erfGelu(b, x, 0.5) : tanhGelu(b, x));
+    ModelProto model = b.optimize({"fuse_bert_gelu"});
+    EXPECT_EQ(opTypes(model.graph()), std::vector<std::string>({"Relu", "Gelu"}))
+        << (erf ? "erf" : "tanh");
+  }
+}
+
+TEST(FuseBertGeluTest, KeepsOtherConstants) {
+  GraphBuilder b;
+  Value* x = b.op("Relu", {hiddenInput(b, "x")});
+  b.output(erfGelu(b, x, 0.4));
+  ModelProto model = b.optimize({"fuse_bert_gelu"});
+  EXPECT_TRUE(nodesOfType(model.graph(), "Gelu").empty());
+  EXPECT_EQ(nodesOfType(model.graph(), "Erf").size(), 1u);
+}
+
+TEST(FuseBertQkvMatMulTest, MergesProjectionsInGraphOrder) {
+  GraphBuilder b;
+  Value* x = hiddenInput(b, "x");
+  for (double seed : {2, 1, 3}) {
+    b.output(b.op("Relu", {dense(b, x, kHidden, kHidden, seed)}));
+  }
+  ModelProto model = b.optimize({"fuse_bert_qkv_matmul"});
+
+  const GraphProto& g = model.graph();
+  auto matmuls = nodesOfType(g, "MatMul");
+  auto splits = nodesOfType(g, "Split");
+  ASSERT_EQ(matmuls.size(), 1u);
+  ASSERT_EQ(splits.size(), 1u);
+  EXPECT_EQ(nodesOfType(g, "Add").size(), 1u);
+  EXPECT_EQ(splits[0]->output_size(), 3);
+
+  const TensorProto* w = initializer(g, matmuls[0]->input(1));
+  ASSERT_NE(w, nullptr);
+  EXPECT_EQ(dims(*w), std::vector<int64_t>({kHidden, 3 * kHidden}));
+  const std::vector<double> weight = values(*w);
+  for (int64_t r = 0; r < kHidden; r++) {
+    for (int64_t i = 0; i < 3; i++) {
+      const double seed = i == 0 ? 2 : i == 1 ? 1 : 3;
+      for (int64_t c = 0; c < kHidden; c++) {
+        ASSERT_EQ(weight[(r * 3 + i) * kHidden + c], seed + r * kHidden + c)
+            << "row " << r << " projection " << i << " column " << c;
+      }
+    }
+  }
+
+  // every Relu now reads its own output of the Split
+  for (const NodeProto* relu : nodesOfType(g, "Relu")) {
+    EXPECT_EQ(producer(g, relu->input(0)), splits[0]);
+  }
+}
+
+TEST(FuseBertQkvMatMulTest, KeepsProjectionsWithMixedBiases) {
+  GraphBuilder b;
+  Value* x = hiddenInput(b, "x");
+  b.output(dense(b, x, kHidden, kHidden, 1));
+  b.output(dense(b, x, kHidden, kHidden, 2));
+  b.output(b.op(
+      "MatMul",
+      {x, b.constant({kHidden, kHidden}, std::vector<double>(kHidden * kHidden, 3))}));
+  ModelProto model = b.optimize({"fuse_bert_qkv_matmul"});
+  EXPECT_EQ(nodesOfType(model.graph(), "MatMul").size(), 3u);
+  EXPECT_TRUE(nodesOfType(model.graph(), "Split").empty());
+}
+
+TEST(FuseBertAttentionTest, FusesEncoderLayer) {
+  GraphBuilder b;
+  Value* x = hiddenInput(b, "x");
+  Value* mask = b.input(
+      "mask", TensorProto_DataType_INT64, {Dimension("B"), Dimension("S")});
+  Value* h = layerNorm(b, x, true, 1e-12);
+  Value* attended =
+      layerNorm(b, b.op("Add", {dense(b, attention(b, h, mask), kHidden, kHidden, 4), h}), false, 1e-12);
+  Value* intermediate = erfGelu(b, dense(b, attended, kHidden, 4 * kHidden, 5), 0.5);
+  b.output(layerNorm(
+      b,
+      b.op("Add", {dense(b, intermediate, 4 * kHidden, kHidden, 6), attended}),
+      true,
+      1e-12));
+  ModelProto model = b.optimize({"fold_constants",
+                                 "fuse_bert_layer_norm",
+                                 "fuse_bert_skip_layer_norm",
+                                 "fuse_bert_gelu",
+                                 "fuse_bert_qkv_matmul",
+                                 "fuse_bert_attention",
+                                 "eliminate_unused_initializer"});
+
+  const GraphProto& g = model.graph();
+  EXPECT_EQ(
+      opTypes(g),
+      std::vector<std::string>({"MaskIndex",
+                                "LayerNorm",
+                                "MatMul",
+                                "Add",
+                                "QkvToContext",
+                                "MatMul",
+                                "Add",
+                                "SkipLayerNorm",
+                                "MatMul",
+                                "Add",
+                                "Gelu",
+                                "MatMul",
+                                "Add",
+                                "SkipLayerNorm"}));
+  EXPECT_EQ(g.initializer_size(), g.node_size());
+
+  const NodeProto* context = nodesOfType(g, "QkvToContext")[0];
+  EXPECT_EQ(attribute(*context, "num_heads")->i(), kHeads);
+  EXPECT_EQ(attribute(*context, "hidden_size")->i(), kHidden);
+  EXPECT_EQ(attribute(*context, "has_mask")->i(), 1);
+  ASSERT_EQ(context->input_size(), 2);
+  EXPECT_EQ(producer(g, context->input(1))->op_type(), "MaskIndex");
+  EXPECT_EQ(producer(g, context->input(1))->input(0), "mask");
+
+  // the merged projection is back in q, k, v order
+  const NodeProto* bias = producer(g, context->input(0));
+  ASSERT_EQ(bias->op_type(), "Add");
+  const NodeProto* matmul = producer(g, bias->input(0));
+  ASSERT_EQ(matmul->op_type(), "MatMul");
+  const std::vector<double> weight = values(*initializer(g, matmul->input(1)));
+  const std::vector<double> biases = values(*initializer(g, bias->input(1)));
+  ASSERT_EQ(weight.size(), static_cast<size_t>(kHidden * 3 * kHidden));
+  ASSERT_EQ(biases.size(), static_cast<size_t>(3 * kHidden));
+  for (int64_t i = 0; i < 3; i++) {
+    for (int64_t c = 0; c < kHidden; c++) {
+      EXPECT_EQ(weight[i * kHidden + c], i + 1 + c);
+      EXPECT_EQ(biases[i * kHidden + c], i + 1);
+    }
+  }
+}
+
+} // namespace Test
+} // namespace ONNX_NAMESPACE
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "onnx/common/ir.h"
+#include "onnx/common/ir_pb_converter.h"
+#include "onnx/optimizer/optimize.h"
+
+namespace ONNX_NAMESPACE {
+namespace Test {
+
+// Builds an IR graph node by node for the optimizer tests. optimize() runs
+// passes through the same proto round trip as optimization::Optimize users.
+class GraphBuilder {
+ public:
+  GraphBuilder() : graph_(new Graph()) {}
+
+  Value* input(
+      const std::string& name,
+      int32_t elem_type,
+      const std::vector<Dimension>& sizes) {
+    Value* v = graph_->addInput();
+    v->setUniqueName(name);
+    v->setElemType(elem_type);
+    v->setSizes(sizes);
+    return v;
+  }
+
+  // Initializer of the given shape, values are converted to elem_type
+  Value* constant(
+      const std::vector<int64_t>& sizes,
+      const std::vector<double>& values,
+      int32_t elem_type = TensorProto_DataType_FLOAT) {
+    Tensor t;
+    t.elem_type() = elem_type;
+    t.sizes() = sizes;
+    for (double v : values) {
+      switch (elem_type) {
+        case TensorProto_DataType_INT64:
+          t.int64s().push_back(static_cast<int64_t>(v));
+          break;
+        case TensorProto_DataType_INT32:
+          t.int32s().push_back(static_cast<int32_t>(v));
+          break;
+        case TensorProto_DataType_DOUBLE:
+          t.doubles().push_back(v);
+          break;
+        default:
+          t.floats().push_back(static_cast<float>(v));
+      }
+    }
+    return graph_->addInitializerAndInput(t, nextName());
+  }
+
+  Value* scalar(double value) {
+    return constant({}, {value});
+  }
+
+  // 1-D int64 initializer, e.g. a shape or the indices of a Slice. Values
+  // do not go through double, so INT64_MAX bounds are kept exact.
+  Value* ints(const std::vector<int64_t>& values) {
+    Tensor t;
+    t.elem_type() = TensorProto_DataType_INT64;
+    t.sizes() = {static_cast<int64_t>(values.size())};
+    t.int64s() = values;
+    return graph_->addInitializerAndInput(t, nextName());
+  }
+
+  Value* op(
+      const char* kind,
+      const std::vector<Value*>& inputs,
+      const std::function<void(Node*)>& attributes = nullptr) {
+    Node* n = graph_->create(Symbol(kind), 1);
+    for (Value* v : inputs) {
+      n->addInput(v);
+    }
+    graph_->appendNode(n);
+    n->output()->setUniqueName(nextName());
+    if (attributes) {
+      attributes(n);
+    }
+    return n->output();
+  }
+
+  void output(Value* v) {
+    graph_->registerOutput(v);
+  }
+
+  ModelProto optimize(const std::vector<std::string>& passes) {
+    ModelProto model;
+    model.set_ir_version(3);
+    model.add_opset_import()->set_version(11);
+    ExportModelProto(&model, graph_);
+    return optimization::Optimize(model, passes);
+  }
+
+ private:
+  std::string nextName() {
+    return "t" + std::to_string(next_id_++);
+  }
+
+  std::shared_ptr<Graph> graph_;
+  int next_id_ = 0;
+};
+
+inline std::vector<const NodeProto*> nodesOfType(
+    const GraphProto& graph,
+    const std::string& op_type) {
+  std::vector<const NodeProto*> nodes;
+  for (const auto& n : graph.node()) {
+    if (n.op_type() == op_type) {
+      nodes.push_back(&n);
+    }
+  }
+  return nodes;
+}
+
+// Node computing the named value, nullptr for inputs and initializers
+inline const NodeProto* producer(
+    const GraphProto& graph,
+    const std::string& name) {
+  for (const auto& n : graph.node()) {
+    for (const auto& o : n.output()) {
+      if (o == name) {
+        return &n;
+      }
+    }
+  }
+  return nullptr;
+}
+
+inline const TensorProto* initializer(
+    const GraphProto& graph,
+    const std::string& name) {
+  for (const auto& t : graph.initializer()) {
+    if (t.name() == name) {
+      return &t;
+    }
+  }
+  return nullptr;
+}
+
+inline const AttributeProto* attribute(
+    const NodeProto& node,
+    const std::string& name) {
+  for (const auto& a : node.attribute()) {
+    if (a.name() == name) {
+      return &a;
+    }
+  }
+  return nullptr;
+}
+
+inline std::vector<int64_t> dims(const TensorProto& t) {
+  return std::vector<int64_t>(t.dims().begin(), t.dims().end());
+}
+
+template <typename T>
+void appendRaw(const std::string& raw, std::vector<double>* values) {
+  for (size_t i = 0; i + sizeof(T) <= raw.size(); i += sizeof(T)) {
+    T v;
+    memcpy(&v, raw.data() + i, sizeof(T));
+    values->push_back(static_cast<double>(v));
+  }
+}
+
+// Values of a numeric tensor, from its typed field or its raw data
+inline std::vector<double> values(const TensorProto& t) {
+  std::vector<double> result;
+  if (t.has_raw_data()) {
+    switch (t.data_type()) {
+      case TensorProto_DataType_FLOAT:
+        appendRaw<float>(t.raw_data(), &result);
+        break;
+      case TensorProto_DataType_DOUBLE:
+        appendRaw<double>(t.raw_data(), &result);
+        break;
+      case TensorProto_DataType_INT32:
+        appendRaw<int32_t>(t.raw_data(), &result);
+        break;
+      case TensorProto_DataType_INT64:
+        appendRaw<int64_t>(t.raw_data(), &result);
+        break;
+    }
+    return result;
+  }
+  result.insert(result.end(), t.float_data().begin(), t.float_data().end());
+  result.insert(result.end(), t.double_data().begin(), t.double_data().end());
+  result.insert(result.end(), t.int32_data().begin(), t.int32_data().end());
+  result.insert(result.end(), t.int64_data().begin(), t.int64_data().end());
+  return result;
+}
+
+} // namespace Test
+} // namespace ONNX_NAMESPACE
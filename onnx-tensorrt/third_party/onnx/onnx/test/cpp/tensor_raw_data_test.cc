@@ -0,0 +1,219 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "onnx/common/ir.h"
+#include "onnx/common/ir_pb_converter.h"
+#include "onnx/optimizer/optimize.h"
+#include "onnx/test/cpp/graph_builder.h"
+
+namespace ONNX_NAMESPACE {
+namespace Test {
+namespace {
+
+const float kValues[4] = {1, 2, 3, 4};
+
+std::string rawBytes() {
+  return std::string(reinterpret_cast<const char*>(kValues), sizeof(kValues));
+}
+
+Tensor rawTensor() {
+  Tensor t;
+  t.elem_type() = TensorProto_DataType_FLOAT;
+  t.sizes() = {4};
+  t.set_raw_data(rawBytes());
+  return t;
+}
+
+float at(const Tensor& t, int i) {
+  return t.data<float>()[i];
+}
+
+// Model whose initializer "w" and Constant "c" both hold kValues as raw data
+ModelProto rawDataModel() {
+  ModelProto m;
+  m.set_ir_version(3);
+  m.add_opset_import()->set_version(11);
+  GraphProto* g = m.mutable_graph();
+  g->set_name("g");
+
+  TensorProto* w = g->add_initializer();
+  w->set_name("w");
+  w->set_data_type(TensorProto_DataType_FLOAT);
+  w->add_dims(4);
+  w->set_raw_data(rawBytes());
+  ValueInfoProto* in = g->add_input();
+  in->set_name("w");
+  in->mutable_type()->mutable_tensor_type()->set_elem_type(
+      TensorProto_DataType_FLOAT);
+
+  NodeProto* c = g->add_node();
+  c->set_op_type("Constant");
+  c->add_output("c");
+  AttributeProto* value = c->add_attribute();
+  value->set_name("value");
+  value->set_type(AttributeProto_AttributeType_TENSOR);
+  *value->mutable_t() = *w;
+  value->mutable_t()->clear_name();
+
+  NodeProto* add = g->add_node();
+  add->set_op_type("Add");
+  add->add_input("w");
+  add->add_input("c");
+  add->add_output("s");
+  NodeProto* id = g->add_node();
+  id->set_op_type("Identity");
+  id->add_input("s");
+  id->add_output("y");
+  ValueInfoProto* out = g->add_output();
+  out->set_name("y");
+  out->mutable_type()->mutable_tensor_type()->set_elem_type(
+      TensorProto_DataType_FLOAT);
+  return m;
+}
+
+const Node* constantNode(Graph& g) {
+  for (const Node* n : g.nodes()) {
+    if (n->kind() == kConstant) {
+      return n;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST(TensorRawDataTest, CopiesShareBytesUntilWritten) {
+  Tensor a = rawTensor();
+  Tensor b = a;
+  EXPECT_EQ(a.raw_data(), b.raw_data());
+
+  b.data<float>()[0] = 9;
+  EXPECT_NE(a.raw_data(), b.raw_data());
+  EXPECT_EQ(at(a, 0), 1);
+  EXPECT_EQ(at(b, 0), 9);
+  EXPECT_EQ(at(b, 3), 4);
+}
+
+TEST(TensorRawDataTest, WritingTheOriginalLeavesTheCopy) {
+  Tensor a = rawTensor();
+  Tensor b = a;
+  a.data<float>()[1] = 7;
+  EXPECT_EQ(at(a, 1), 7);
+  EXPECT_EQ(at(b, 1), 2);
+}
+
+TEST(TensorRawDataTest, UnsharedBytesAreWrittenInPlace) {
+  Tensor a = rawTensor();
+  const char* before = a.raw_data();
+  a.data<float>()[2] = 5;
+  EXPECT_EQ(a.raw_data(), before);
+  EXPECT_EQ(at(a, 2), 5);
+
+  // once the copy is gone the bytes belong to a alone again
+  {
+    Tensor b = a;
+  }
+  a.data<float>()[2] = 6;
+  EXPECT_EQ(a.raw_data(), before);
+}
+
+TEST(TensorRawDataTest, RawIsACopy) {
+  Tensor a = rawTensor();
+  std::string raw = a.raw();
+  EXPECT_EQ(raw, rawBytes());
+  EXPECT_NE(raw.data(), a.raw_data());
+  raw[0] = 'x';
+  EXPECT_EQ(at(a, 0), 1);
+  EXPECT_EQ(a.raw_size(), sizeof(kValues));
+}
+
+TEST(TensorRawDataTest, BorrowedBytesAreCopiedOnFirstWrite) {
+  const std::string backing = rawBytes();
+  Tensor a;
+  a.elem_type() = TensorProto_DataType_FLOAT;
+  a.sizes() = {4};
+  a.set_raw_data_borrowed(backing.data(), backing.size(), nullptr);
+  EXPECT_EQ(a.raw_data(), backing.data());
+  EXPECT_EQ(at(a, 3), 4);
+
+  Tensor b = a;
+  a.data<float>()[3] = 8;
+  EXPECT_NE(a.raw_data(), backing.data());
+  EXPECT_EQ(at(a, 3), 8);
+  EXPECT_EQ(at(b, 3), 4);
+  EXPECT_EQ(b.raw_data(), backing.data());
+  EXPECT_EQ(backing, rawBytes());
+}
+
+TEST(TensorRawDataTest, HolderKeepsBorrowedBytesAlive) {
+  Tensor copy;
+  {
+    auto holder = std::make_shared<std::string>(rawBytes());
+    Tensor a;
+    a.elem_type() = TensorProto_DataType_FLOAT;
+    a.sizes() = {4};
+    a.set_raw_data_borrowed(holder->data(), holder->size(), holder);
+    copy = a;
+  }
+  EXPECT_EQ(at(copy, 0), 1);
+  EXPECT_EQ(at(copy, 3), 4);
+}
+
+TEST(TensorRawDataTest, ImportBorrowsFromTheModel) {
+  const ModelProto m = rawDataModel();
+  const std::string& wRaw = m.graph().initializer(0).raw_data();
+  const std::string& cRaw = m.graph().node(0).attribute(0).t().raw_data();
+
+  std::unique_ptr<Graph> g = ImportModelProto(m, true);
+  ASSERT_NE(g.get(), nullptr);
+  ASSERT_EQ(g->initializers().size(), 1u);
+  EXPECT_EQ(g->initializers()[0].raw_data(), wRaw.data());
+  const Node* c = constantNode(*g);
+  ASSERT_NE(c, nullptr);
+  EXPECT_EQ(c->t(kvalue).raw_data(), cRaw.data());
+
+  Tensor w = g->initializers()[0];
+  w.data<float>()[0] = 9;
+  Tensor value = c->t(kvalue);
+  value.data<float>()[1] = 9;
+  EXPECT_EQ(at(w, 0), 9);
+  EXPECT_EQ(at(value, 1), 9);
+  EXPECT_EQ(wRaw, rawBytes());
+  EXPECT_EQ(cRaw, rawBytes());
+  EXPECT_EQ(g->initializers()[0].raw_data(), wRaw.data());
+}
+
+TEST(TensorRawDataTest, ImportCopiesByDefault) {
+  const ModelProto m = rawDataModel();
+  std::unique_ptr<Graph> g = ImportModelProto(m);
+  ASSERT_NE(g.get(), nullptr);
+  ASSERT_EQ(g->initializers().size(), 1u);
+  EXPECT_NE(
+      g->initializers()[0].raw_data(),
+      m.graph().initializer(0).raw_data().data());
+  EXPECT_EQ(g->initializers()[0].raw(), rawBytes());
+  const Node* c = constantNode(*g);
+  ASSERT_NE(c, nullptr);
+  EXPECT_NE(
+      c->t(kvalue).raw_data(),
+      m.graph().node(0).attribute(0).t().raw_data().data());
+}
+
+TEST(TensorRawDataTest, OptimizeLeavesTheInputModelUntouched) {
+  const ModelProto m = rawDataModel();
+  const std::string before = m.SerializeAsString();
+  ModelProto out = optimization::Optimize(m, {"fold_constants"});
+  EXPECT_EQ(m.SerializeAsString(), before);
+
+  // w + c was folded into a new initializer, computed from borrowed bytes
+  const std::vector<const NodeProto*> ids = nodesOfType(out.graph(), "Identity");
+  ASSERT_EQ(ids.size(), 1u);
+  const TensorProto* sum = initializer(out.graph(), ids[0]->input(0));
+  ASSERT_NE(sum, nullptr);
+  EXPECT_EQ(values(*sum), std::vector<double>({2, 4, 6, 8}));
+}
+
+} // namespace Test
+} // namespace ONNX_NAMESPACE
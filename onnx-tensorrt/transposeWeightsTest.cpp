@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2018, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Checks transposeWeights against a plain odometer transpose, for every element size and for the paths
+// the transpose plan picks: copies once size 1 axes are dropped and adjacent axes merged, whole rows when
+// the innermost axis is kept, (batched) tiles otherwise, on one thread or several for large weights.
+
+#include "ShapedWeights.hpp"
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace onnx2trt;
+
+namespace
+{
+
+struct Case
+{
+    std::vector<int> shape;
+    std::vector<int> perm;
+};
+
+nvinfer1::Dims makeDims(std::vector<int> const& shape)
+{
+    nvinfer1::Dims dims{};
+    dims.nbDims = static_cast<int>(shape.size());
+    for (size_t d = 0; d < shape.size(); ++d)
+    {
+        dims.d[d] = shape[d];
+    }
+    return dims;
+}
+
+size_t volume(std::vector<int> const& shape)
+{
+    size_t count = 1;
+    for (int dim : shape)
+    {
+        count *= dim;
+    }
+    return count;
+}
+
+// Output element i is input element src(i), walking the output index like an odometer.
+std::vector<uint8_t> referenceTranspose(std::vector<uint8_t> const& src, Case const& c, size_t elementSize)
+{
+    const int rank = static_cast<int>(c.shape.size());
+    std::vector<size_t> inStrides(rank);
+    size_t stride = 1;
+    for (int d = rank - 1; d >= 0; --d)
+    {
+        inStrides[d] = stride;
+        stride *= c.shape[d];
+    }
+    const size_t count = volume(c.shape);
+    std::vector<uint8_t> dst(count * elementSize);
+    std::vector<int> index(rank, 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t offset = 0;
+        for (int d = 0; d < rank; ++d)
+        {
+            offset += index[d] * inStrides[c.perm[d]];
+        }
+        std::memcpy(&dst[i * elementSize], &src[offset * elementSize], elementSize);
+        for (int d = rank - 1; d >= 0 && ++index[d] == c.shape[c.perm[d]]; --d)
+        {
+            index[d] = 0;
+        }
+    }
+    return dst;
+}
+
+struct ElementType
+{
+    ShapedWeights::DataType type;
+    size_t size;
+};
+
+const ElementType kElementTypes[] = {
+    {::ONNX_NAMESPACE::TensorProto::UINT8, 1},
+    {::ONNX_NAMESPACE::TensorProto::FLOAT16, 2},
+    {::ONNX_NAMESPACE::TensorProto::FLOAT, 4},
+    {::ONNX_NAMESPACE::TensorProto::DOUBLE, 8},
+};
+
+// Transposes c with each element size and thread count and compares with the reference.
+void expectMatchesReference(Case const& c, std::vector<int> const& threadCounts = {1})
+{
+    nvinfer1::Permutation perm{};
+    for (size_t d = 0; d < c.perm.size(); ++d)
+    {
+        perm.order[d] = c.perm[d];
+    }
+    for (ElementType const& element : kElementTypes)
+    {
+        const size_t bytes = volume(c.shape) * element.size;
+        // every byte differs from its neighbours, so misplaced bytes of an element are caught as well
+        std::vector<uint8_t> src(bytes);
+        for (size_t i = 0; i < bytes; ++i)
+        {
+            src[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+        }
+        const std::vector<uint8_t> expected = referenceTranspose(src, c, element.size);
+
+        for (int threads : threadCounts)
+        {
+            SCOPED_TRACE(testing::Message() << "element size " << element.size << ", " << threads << " threads");
+            std::vector<uint8_t> dst(bytes + 1, 0xcd);
+            ShapedWeights weights(element.type, src.data(), makeDims(c.shape));
+            ShapedWeights result(element.type, dst.data(), nvinfer1::Dims{});
+            ASSERT_TRUE(transposeWeights(weights, perm, &result, threads));
+
+            ASSERT_EQ(result.shape.nbDims, static_cast<int>(c.shape.size()));
+            for (size_t d = 0; d < c.shape.size(); ++d)
+            {
+                EXPECT_EQ(result.shape.d[d], c.shape[c.perm[d]]) << "dimension " << d;
+            }
+            for (size_t i = 0; i < bytes; ++i)
+            {
+                ASSERT_EQ(dst[i], expected[i]) << "byte " << i << " of element " << i / element.size;
+            }
+            EXPECT_EQ(dst[bytes], 0xcd) << "wrote past the result";
+        }
+    }
+}
+
+} // namespace
+
+TEST(TransposeWeightsTest, Matrix)
+{
+    // not a multiple of the tile or of the SSE block
+    expectMatchesReference({{37, 53}, {1, 0}});
+    expectMatchesReference({{4, 4}, {1, 0}});
+    expectMatchesReference({{1, 7}, {1, 0}});
+}
+
+TEST(TransposeWeightsTest, IdentityIsACopy)
+{
+    expectMatchesReference({{4, 6, 8}, {0, 1, 2}});
+    expectMatchesReference({{5}, {0}});
+}
+
+TEST(TransposeWeightsTest, ScalarsAndEmptyWeights)
+{
+    expectMatchesReference({{}, {}});
+    expectMatchesReference({{0, 4}, {1, 0}});
+}
+
+TEST(TransposeWeightsTest, SizeOneAxesAreDropped)
+{
+    // [5, 1, 7] -> [1, 5, 7] is a copy, [1, 64, 48] -> [1, 48, 64] a plain 2-D transpose
+    expectMatchesReference({{5, 1, 7}, {1, 0, 2}});
+    expectMatchesReference({{1, 64, 48}, {0, 2, 1}});
+    expectMatchesReference({{3, 1, 1, 5}, {3, 2, 1, 0}});
+}
+
+TEST(TransposeWeightsTest, AdjacentAxesAreMerged)
+{
+    // axes 1 and 2 stay together: a [2, 128, 3] -> [2, 3, 128] batched transpose
+    expectMatchesReference({{2, 8, 16, 3}, {0, 3, 1, 2}});
+    // axes 0 and 1 stay together in front: rows of 6 are copied whole
+    expectMatchesReference({{2, 3, 4, 6}, {2, 0, 1, 3}});
+}
+
+TEST(TransposeWeightsTest, InnermostAxisKeptCopiesRows)
+{
+    expectMatchesReference({{2, 3, 4, 5}, {0, 2, 1, 3}});
+    expectMatchesReference({{3, 4, 5}, {1, 0, 2}});
+}
+
+TEST(TransposeWeightsTest, BatchedTiles)
+{
+    expectMatchesReference({{6, 33, 35}, {0, 2, 1}});
+    expectMatchesReference({{3, 4, 5, 6}, {3, 2, 1, 0}});
+    expectMatchesReference({{7, 40, 3}, {2, 0, 1}});
+}
+
+TEST(TransposeWeightsTest, MaxRank)
+{
+    expectMatchesReference({{2, 3, 2, 1, 2, 3, 2, 2}, {7, 1, 4, 0, 6, 2, 5, 3}});
+}
+
+TEST(TransposeWeightsTest, LargeWeightsOnSeveralThreads)
+{
+    // a million elements and more go parallel; the result must not depend on the number of threads
+    expectMatchesReference({{1024, 1030}, {1, 0}}, {1, 3, 8});
+    expectMatchesReference({{64, 130, 128}, {1, 0, 2}}, {1, 3, 8});
+    expectMatchesReference({{4, 300, 900}, {0, 2, 1}}, {1, 3});
+}
+
+TEST(TransposeWeightsTest, UnsupportedElementSize)
+{
+    std::vector<uint8_t> src(4);
+    std::vector<uint8_t> dst(4);
+    ShapedWeights weights(::ONNX_NAMESPACE::TensorProto::COMPLEX128, src.data(), makeDims({2, 2}));
+    ShapedWeights result(::ONNX_NAMESPACE::TensorProto::COMPLEX128, dst.data(), nvinfer1::Dims{});
+    nvinfer1::Permutation perm{{1, 0}};
+    EXPECT_FALSE(transposeWeights(weights, perm, &result));
+}
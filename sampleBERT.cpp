@@ -273,7 +273,8 @@ void thread_function(int deviceId) {
     Bert* pBert2 = createBert("QA");
     pBert2->setParam(numHeads,Bmax,S,gArgs.runInFp16);
     pBert2->setDeviceId(deviceId);
-    pBert2->init(weightsPath);
+    if (!pBert2->init(weightsPath))
+        return;
     pBert2->forward(inputIds[0], segmentIds[0], inputMasks[0], inputDims[0], output);
     sleep(3600);
 }
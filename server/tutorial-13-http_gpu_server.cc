@@ -29,16 +29,31 @@
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include <atomic>
+#include <memory>
 #include <thread>
 #include <chrono>
 #include <random>
+#include <algorithm>
 #include <google/protobuf/text_format.h>
 #include "workflow/HttpMessage.h"
 #include "workflow/HttpUtil.h"
 #include "workflow/WFServer.h"
 #include "workflow/WFHttpServer.h"
+#include "workflow/WFTaskFactory.h"
 #include "compatible_server_req_res.pb.h"
+#include <cuda_runtime_api.h>
 #include "BertFactory.h"
+#include "cpuAffinity.h"
+#include "weightStore.h"
+#include "workQueue.h"
+#include "requestCapture.h"
+#include "responseEncoding.h"
+#include "requestTrace.h"
+#include "batchStats.h"
+#include "objectPool.h"
+#include "vocabulary.h"
+#include "localTransport.h"
 #include "json.hpp"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
@@ -167,10 +182,69 @@ void loadInputs(const std::string& weightsPath, int& Bmax, int& S, std::vector<n
 
 #if 1
 
+struct BertJob;
+struct RankJob;
+
+//liveness of a client connection, shared by the connection context and the requests in flight on it
+struct PeerState
+{
+    std::atomic<bool> closed{false};
+};
+
+//why a request was dropped before its forward or its reply
+enum CancelReason
+{
+    kNOT_CANCELLED = 0,
+    kEXPIRED,      //deadline passed
+    kDISCONNECTED, //client closed the connection
+    kFAILED,       //the instance refused the inputs, the outputs hold nothing of this request
+};
+
+//HTTP status of a dropped request
+const char *cancel_status(int reason)
+{
+    return reason == kEXPIRED ? "504" : reason == kFAILED ? "500" : "503";
+}
+
+//wasted work avoided, reported by /debug/queues
+struct CancelCounters
+{
+    std::atomic<uint64_t> expiredQueued{0};      //forward skipped
+    std::atomic<uint64_t> disconnectedQueued{0}; //forward skipped
+    std::atomic<uint64_t> expiredReply{0};       //forward done, serialization skipped
+    std::atomic<uint64_t> disconnectedReply{0};  //forward done, serialization skipped
+};
+CancelCounters gCancel;
+
+//deadline of requests without X-Request-Timeout-Ms, 0 means none (BERT_REQUEST_TIMEOUT_MS)
+uint64_t gDefaultTimeoutUs = 0;
+
+//request bodies are parsed into an arena per handler thread, cleared rather than freed between requests. bodies
+//larger than the first buffer spill into chunks that Clear gives back
+const size_t kPARSE_ARENA = 512 << 10;
+const size_t kPARSE_STACK = 64 << 10;
+typedef rapidjson::GenericDocument<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<>, rapidjson::MemoryPoolAllocator<>>
+    ArenaDocument;
+struct ParseArena
+{
+    std::vector<char> buffer;
+    rapidjson::MemoryPoolAllocator<> allocator;
+
+    ParseArena() : buffer(kPARSE_ARENA), allocator(buffer.data(), buffer.size()) {}
+};
+
+ParseArena &parse_arena()
+{
+    static thread_local ParseArena arena;
+    return arena;
+}
+
 struct tutorial_series_context
 {
 	std::string url;
 	WFHttpTask *proxy_task;
+	BertJob *job = nullptr;   //a tensor request
+	RankJob *rank = nullptr;  //a /rank request
 };
 
 struct MMInput
@@ -182,6 +256,11 @@ struct MMInput
     vector<int> data_masks;
     vector<int> data_segs;
     Dims inputDims;
+    unsigned outputMask;  //bit per BertOutput, see BertFactory.h
+    uint64_t arrivalUs;   //see RequestCapture::nowUs
+    uint64_t deadlineUs;  //same clock, 0: no deadline
+    std::shared_ptr<PeerState> peer;
+    bool capture;         //sampled for the request capture
     Bert* pBert;
 };
 
@@ -196,9 +275,82 @@ struct MMOutput
     std::vector<float> output5;
 };
 
+//one request, from dispatch to reply; owned by the series context.
+//jobs come from ObjectPool<BertJob>: the input and output vectors keep their capacity across requests
+struct BertJob
+{
+    MMInput input;
+    MMOutput output;
+    int cancelled = kNOT_CANCELLED; //set by the instance queue when the forward was skipped or failed
+    RequestTrace trace;             //stages of the request, see /debug/traces
+    uint64_t forwardDoneNs = 0;     //end of the queue job, start of the wait for a reply thread
+    WFCounterTask *task = nullptr;  //completed once the forward is done
+    uint64_t queuedNs = 0;          //pushed on the instance queue
+    int instance = 0;
+    LocalRequest *local = nullptr;  //the inputs of a local request are read from it, see process_local
+
+    //before going back to the pool: drop what belongs to the request, keep the buffers
+    void reset()
+    {
+        input.data_ids.clear();
+        input.data_masks.clear();
+        input.data_segs.clear();
+        input.peer.reset();
+        cancelled = kNOT_CANCELLED;
+        forwardDoneNs = 0;
+        task = nullptr;
+        local = nullptr;
+    }
+};
+
+//one /rank request: its docs are scored as query-doc pairs, Bmax pairs per batch, the batches run in parallel on
+//the instances. RankJobs come from ObjectPool<RankJob>, the request and the batch list keep their capacity
+struct RankJob
+{
+    ProtoContent::GpuRequest request;
+    std::vector<BertJob*> batches;
+};
+
+//tokens of the /rank queries and docs (BERT_VOCAB), /rank is disabled when it cannot be loaded
+Vocabulary gVocabulary;
+
+int cancel_reason(const MMInput *in)
+{
+    if (in->peer && in->peer->closed.load(std::memory_order_relaxed))
+        return kDISCONNECTED;
+    if (in->deadlineUs && RequestCapture::nowUs() > in->deadlineUs)
+        return kEXPIRED;
+    return kNOT_CANCELLED;
+}
+
+//the connection context lives as long as the connection, its deleter marks the peer closed
+std::shared_ptr<PeerState> peer_of(WFHttpTask *proxy_task)
+{
+    WFConnection *conn = proxy_task->get_connection();
+    if (!conn)
+        return nullptr;
+    auto *state = (std::shared_ptr<PeerState> *)conn->get_context();
+    if (!state)
+    {
+        state = new std::shared_ptr<PeerState>(new PeerState);
+        conn->set_context(state, [](void *ctx) {
+            auto *state = (std::shared_ptr<PeerState> *)ctx;
+            (*state)->closed.store(true, std::memory_order_relaxed);
+            delete state;
+        });
+    }
+    return *state;
+}
+
 vector<Bert*> pBertVec;
+//one execution queue per instance, same index as pBertVec: a batch only waits for batches on its own instance
+vector<WorkQueue*> gQueues;
+//padding and empty slots of the batches run by every instance, same index as pBertVec
+vector<BatchStats*> gBatchStats;
 pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond_ = PTHREAD_COND_INITIALIZER;
+//instance threads done with init, successful or not. Guarded by mutex_
+int gInitDone = 0;
 Bert* createMyBert(int deviceId)
 {
     string dataDir = "./data_hz";
@@ -212,8 +364,15 @@ Bert* createMyBert(int deviceId)
     Bert* pBert = createBert("QA");
     pBert->setParam(numHeads,Bmax,S,false); //fp32
     //pBert->setParam(numHeads,Bmax,S,true); //fp16
+    //pBert->setInt8(dataDir+"/calib/requests.cap", dataDir+"/calib/bert.calib"); //int8, calibrated from captured requests
     pBert->setDeviceId(deviceId);
-    pBert->init(weightsPath);
+    if (!pBert->init(weightsPath))
+    {
+        //its forwards would fail every batch routed to it
+        fprintf(stderr, "device %d: the instance failed to initialize, it serves no requests\n", deviceId);
+        delete pBert;
+        return nullptr;
+    }
     return pBert;
 }
 
@@ -227,11 +386,58 @@ public:
 }
 };
 
+// NUMA placement (see cpuAffinity.h): the init thread and the forwards of an instance run on the CPUs of the node
+// its GPU hangs off, and the host buffers it allocates (staging, pinned copies) are placed on that node
+struct DevicePlacement
+{
+    int node = -1;         // -1: unknown, the instance runs on the CPUs the process started with
+    std::vector<int> cpus;
+};
+vector<DevicePlacement> gPlacement;
+
+void initPlacement(int devices)
+{
+    CpuTopology topology;
+    std::vector<int> processCpus;
+    currentThreadCpus(processCpus);
+    gPlacement.assign(devices, DevicePlacement());
+    for (int i = 0; i < devices; i++)
+    {
+        DevicePlacement& p = gPlacement[i];
+        char busId[32];
+        if (cudaDeviceGetPCIBusId(busId, sizeof(busId), i) == cudaSuccess)
+        {
+            p.node = topology.pciDeviceNode(busId);
+            p.cpus = topology.nodeCpus(p.node);
+        }
+        if (p.cpus.empty())
+        {
+            p.node = -1;
+            p.cpus = processCpus;
+        }
+        fprintf(stderr, "device %d: NUMA node %d, %zu cpus\n", i, p.node, p.cpus.size());
+    }
+}
+
+// moves the calling thread (and its new allocations) to the node of deviceId
+void placeOnDevice(int deviceId)
+{
+    static thread_local int placedDevice = -1;
+    if (deviceId == placedDevice || deviceId < 0 || deviceId >= (int)gPlacement.size())
+        return;
+    placedDevice = deviceId;
+    pinCurrentThread(gPlacement[deviceId].cpus);
+    preferNode(gPlacement[deviceId].node);
+}
+
 void thread_function(int deviceId) {
+  placeOnDevice(deviceId);
   Bert* pBert= MyBertIns::get_instance(deviceId);
   pthread_mutex_lock(&mutex_);
-  pBertVec.push_back(pBert);
-  
+  //main waits for the signal either way, only instances that can run are registered
+  if (pBert)
+    pBertVec.push_back(pBert);
+  gInitDone++;
   pthread_cond_signal(&cond_);
   pthread_mutex_unlock(&mutex_);
   sleep(3600);
@@ -244,10 +450,7 @@ void createThreadBertIns(int deviceId)
   threadObj1.detach();
 }
 
-typedef WFThreadTask<MMInput, MMOutput> MMTask;
-
-
-void http_callback(MMTask *task)
+void http_callback(WFCounterTask *task)
 {
     auto start = system_clock::now();
 
@@ -267,9 +470,29 @@ void http_callback(MMTask *task)
     proxy_resp->append_output_body(buf, len);
 #endif
 
-    MMOutput *pOutput = task->get_output();
-    MMInput *pIn = task->get_input();
+    MMOutput *pOutput = &context->job->output;
+    MMInput *pIn = &context->job->input;
+    RequestTrace &trace = context->job->trace;
     assert(task->get_state() == WFT_STATE_SUCCESS);
+    const uint64_t replyStartNs = traceNowNs();
+    trace.add("reply_wait", context->job->forwardDoneNs, replyStartNs);
+
+    //nobody is waiting for the reply any more: skip the serialization
+    int cancelled = context->job->cancelled;
+    if (!cancelled)
+    {
+        cancelled = cancel_reason(pIn);
+        if (cancelled == kEXPIRED)
+            gCancel.expiredReply++;
+        else if (cancelled == kDISCONNECTED)
+            gCancel.disconnectedReply++;
+    }
+    if (cancelled)
+    {
+        proxy_resp->set_status_code(cancel_status(cancelled));
+        RequestTracer::instance().finish(trace);
+        return;
+    }
 
     int batch_size = tmp_batch_size;
     int sentence_len = tmp_sentence_len;
@@ -338,26 +561,86 @@ void http_callback(MMTask *task)
         writer.EndArray(); 
     
  
-    rapidjson::StringBuffer strBuf;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(strBuf);
+    //only the outputs named by the request were copied back, only those are written
+    const std::vector<float>* outputs[kNB_OUTPUTS] = {&pOutput->output, &pOutput->output2,
+        &pOutput->output3, &pOutput->output4, &pOutput->output5};
+
+    //body format and compression negotiated through Accept and Accept-Encoding (see responseEncoding.h)
+    static thread_local std::string accept;
+    static thread_local std::string acceptEncoding;
+    accept.clear();
+    acceptEncoding.clear();
+    {
+        HttpHeaderCursor cursor(req);
+        cursor.find("Accept", accept);
+        cursor.rewind();
+        cursor.find("Accept-Encoding", acceptEncoding);
+    }
+    TensorDtype dtype;
+    const bool tensor = acceptsTensor(accept, dtype);
+    //the body buffers of this thread are reused by its next replies
+    static thread_local rapidjson::StringBuffer strBuf;
+    static thread_local TensorResponseWriter tensorWriter(TensorDtype::kFP32);
+    strBuf.Clear();
+    const char* body;
+    size_t bodySize;
+    if (tensor)
+    {
+        tensorWriter.reset(dtype);
+        for(int k = 0; k < kNB_OUTPUTS; k++)
+        {
+            if(!(pIn->outputMask & (1u << k)))
+                continue;
+            tensorWriter.add(getOutputKey(k), outputs[k]->data(), batch_size, (k == kINTENT_PROB ? 3 : sentence_len));
+        }
+        const std::string& bytes = tensorWriter.finish();
+        body = bytes.data();
+        bodySize = bytes.size();
+        proxy_resp->add_header_pair("Content-Type", kTENSOR_CONTENT_TYPE);
+    }
+    else
+    {
+    static thread_local rapidjson::Writer<rapidjson::StringBuffer> writer(strBuf);
+    writer.Reset(strBuf);
     writer.StartObject();
     writer.Key("outputs");  
     
     writer.StartObject();
     writer.SetMaxDecimalPlaces(5); // precision of  5 after dot
-    writer_json_prob(writer, "start_logits", pOutput->output, sentence_len);
-    writer_json_prob(writer, "end_logits", pOutput->output2, sentence_len);
-    writer_json_prob(writer, "start_prob", pOutput->output3, sentence_len);
-    writer_json_prob(writer, "end_prob", pOutput->output4, sentence_len);
-    writer_json_prob(writer, "intent_prob", pOutput->output5, 3);
+    for(int k = 0; k < kNB_OUTPUTS; k++)
+    {
+        if(!(pIn->outputMask & (1u << k)))
+            continue;
+        const std::vector<float>& out = *outputs[k];
+        writer_json_prob(writer, getOutputKey(k), out, (k == kINTENT_PROB ? 3 : sentence_len));
+    }
 
     
     writer.EndObject();   
     writer.EndObject();
-    proxy_resp->append_output_body(strBuf.GetString(),  strBuf.GetSize());
+        body = strBuf.GetString();
+        bodySize = strBuf.GetSize();
+        proxy_resp->add_header_pair("Content-Type", "application/json");
+    }
+    proxy_resp->add_header_pair("Vary", "Accept, Accept-Encoding");
+
+    //the compressors and their output buffer are reused by every reply of this thread
+    static thread_local std::string compressed;
+    const ContentEncoding encoding = chooseEncoding(acceptEncoding);
+    if (encoding != ContentEncoding::kIDENTITY && compressBody(encoding, body, bodySize, compressed)
+        && compressed.size() < bodySize)
+    {
+        proxy_resp->add_header_pair("Content-Encoding", encodingName(encoding));
+        proxy_resp->append_output_body(compressed.data(), compressed.size());
+    }
+    else
+    {
+        proxy_resp->append_output_body(body, bodySize);
+    }
 
 
  #endif
+    trace.add("serialize", replyStartNs, traceNowNs());
 
     
 
@@ -366,6 +649,24 @@ void http_callback(MMTask *task)
     auto duration = duration_cast<microseconds>(end - start);
     printf(" reply time1 is %d ms. \n", (duration)/1000);
 
+    if (pIn->capture)
+    {
+        const int B = pIn->inputDims.d[0];
+        const int S = pIn->inputDims.d[1];
+        const size_t n = static_cast<size_t>(B) * S;
+        //the forward read the first B x S values of each input, those are the ones captured
+        if (pIn->data_ids.size() >= n && pIn->data_segs.size() >= n && pIn->data_masks.size() >= n)
+        {
+            CaptureRecordHeader header;
+            header.batchSize = B;
+            header.seqLength = S;
+            header.latencyUs = RequestCapture::nowUs() - pIn->arrivalUs;
+            header.arrivalUs = pIn->arrivalUs;
+            RequestCapture::instance().submit(header, pIn->data_ids.data(), pIn->data_segs.data(), pIn->data_masks.data());
+        }
+    }
+    RequestTracer::instance().finish(trace);
+
     #if 0
     json jOut(pOutput->output);
     proxy_resp->append_output_body(jOut.dump(2).c_str(), jOut.dump(2).size());
@@ -383,17 +684,17 @@ void http_callback(MMTask *task)
     //pIn->pBert->unlock();
     //pthread_mutex_unlock(&mutex_);
 }
-void bert_forward(const MMInput *in, MMOutput *out)
+bool bert_forward(const MMInput *in, MMOutput *out)
 {
     auto start   = system_clock::now();
 
-    in->pBert->forward2(((MMInput *)in)->inputIds, ((MMInput *)in)->segmentIds, ((MMInput *)in)->inputMasks, ((MMInput *)in)->inputDims, 
-                    out->output, out->output2, out->output3, out->output4, out->output5);
+    const bool ok = in->pBert->forward2(((MMInput *)in)->inputIds, ((MMInput *)in)->segmentIds, ((MMInput *)in)->inputMasks, ((MMInput *)in)->inputDims, 
+                    out->output, out->output2, out->output3, out->output4, out->output5, in->outputMask);
 
     auto end   = system_clock::now();
     auto duration = duration_cast<microseconds>(end - start);
-    in->pBert->unlock();
     printf(" forward process time1 is %d ms. \n", (duration)/1000);
+    return ok;
 }
 
 /*
@@ -422,30 +723,482 @@ void pwork_callback(const ParallelWork *pwork)
 	}
 }*/
 const int deviceCounts =1;
-default_random_engine e;
-Bert* getFreeBert(Bert** ppBert)
+
+// the instance with the fewest batches queued or running, ties go round robin
+int pickInstance()
 {
-#if 1
-    while(true)
+    static std::atomic<unsigned> next{0};
+    const int n = gQueues.size();
+    const unsigned first = next.fetch_add(1, std::memory_order_relaxed);
+    int best = first % n;
+    for (int k = 1; k < n; k++)
+    {
+        const int i = (first + k) % n;
+        if (gQueues[i]->depth() < gQueues[best]->depth())
+            best = i;
+    }
+    return best;
+}
+
+void create_queues()
+{
+    for (size_t i = 0; i < pBertVec.size(); i++)
+    {
+        const int deviceId = pBertVec[i]->getDeviceId();
+        // the worker runs every forward of the instance: bind it to the device and its node once
+        gQueues.push_back(new WorkQueue([deviceId] {
+            placeOnDevice(deviceId);
+            cudaSetDevice(deviceId);
+        }));
+        gBatchStats.push_back(new BatchStats);
+    }
+}
+
+// GET /debug/queues: depth of the execution queue of every instance
+void reply_queues(WFHttpTask *proxy_task)
+{
+    rapidjson::StringBuffer strBuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strBuf);
+    writer.StartObject();
+    writer.Key("instances");
+    writer.StartArray();
+    for (size_t i = 0; i < gQueues.size(); i++)
     {
-    for(int i = 0; i < deviceCounts ; i++)
+        writer.StartObject();
+        writer.Key("device");
+        writer.Int(pBertVec[i]->getDeviceId());
+        writer.Key("depth");
+        writer.Uint64(gQueues[i]->depth());
+        writer.Key("processed");
+        writer.Uint64(gQueues[i]->processed());
+        writeBatchStats(writer, gBatchStats[i]->snapshot());
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.Key("cancelled");
+    writer.StartObject();
+    writer.Key("expired_queued");
+    writer.Uint64(gCancel.expiredQueued);
+    writer.Key("disconnected_queued");
+    writer.Uint64(gCancel.disconnectedQueued);
+    writer.Key("expired_reply");
+    writer.Uint64(gCancel.expiredReply);
+    writer.Key("disconnected_reply");
+    writer.Uint64(gCancel.disconnectedReply);
+    writer.EndObject();
+    writer.EndObject();
+    HttpResponse *resp = proxy_task->get_resp();
+    resp->add_header_pair("Content-Type", "application/json");
+    resp->append_output_body(strBuf.GetString(), strBuf.GetSize());
+}
+
+//runs on the worker of the job's instance. task is counted once the forward is done or skipped
+void run_job(BertJob *job)
+{
+    WFCounterTask *task = job->task;
+    job->trace.add("queue", job->queuedNs, traceNowNs());
+    //requests that expired or lost their client while queued are dropped without running
+    job->cancelled = cancel_reason(&job->input);
+    if (job->cancelled == kEXPIRED)
+        gCancel.expiredQueued++;
+    else if (job->cancelled == kDISCONNECTED)
+        gCancel.disconnectedQueued++;
+    else
     {
-      if(ppBert[i]->trylock() == 0)
-      //if(pthread_mutex_trylock(&mutex_)==0)
-        return ppBert[i];
+        //the driver adds its enqueue and synchronization spans to the current trace
+        RequestTracer::setCurrent(&job->trace);
+        const uint64_t forwardNs = traceNowNs();
+        {
+            TraceScope span("forward");
+            if (!bert_forward(&job->input, &job->output))
+                job->cancelled = kFAILED;
+        }
+        RequestTracer::setCurrent(nullptr);
+        const MMInput &in = job->input;
+        if (!job->cancelled)
+            gBatchStats[job->instance]->record((const int *)in.inputMasks.values, in.inputMasks.count,
+                in.inputDims.d[0], in.inputDims.d[1], traceNowNs() - forwardNs);
     }
+    job->forwardDoneNs = traceNowNs();
+    //counting here would run http_callback, and the serialization and compression of the reply, on this worker,
+    //in front of the next batch of the instance. The go task moves it to the compute threads, at the cost of one
+    //workflow task allocated per request, like the server and counter tasks of the request.
+    WFTaskFactory::create_go_task("bert_reply", [task] { task->count(); })->start();
+}
 
+void queue_job(BertJob *job, int instance, WFCounterTask *task)
+{
+    job->task = task;
+    job->instance = instance;
+    job->input.pBert = pBertVec[instance];
+    job->queuedNs = traceNowNs();
+    //a single pointer fits in std::function without an allocation
+    gQueues[instance]->push([job] { run_job(job); });
+}
 
-    usleep(1000);
+//series callback of the requests: jobs and contexts go back to their pools
+void release_context(const SeriesWork *series)
+{
+    tutorial_series_context *context = (tutorial_series_context *)series->get_context();
+    if (context->job)
+    {
+        context->job->reset();
+        ObjectPool<BertJob>::release(context->job);
     }
-#else
-    int i = e()%deviceCounts;
-    ppBert[i]->lock();
-    return ppBert[i];
-#endif
+    if (context->rank)
+    {
+        for (BertJob *job : context->rank->batches)
+        {
+            job->reset();
+            ObjectPool<BertJob>::release(job);
+        }
+        context->rank->batches.clear();
+        context->rank->request.Clear();
+        ObjectPool<RankJob>::release(context->rank);
+    }
+    context->job = nullptr;
+    context->rank = nullptr;
+    ObjectPool<tutorial_series_context>::release(context);
+}
 
+//GpuResultDoc scores of a query-doc pair: dnn_5000..dnn_5002 are the intent probabilities of the row, dnn_5003 the
+//highest start probability over the doc tokens (segment 1)
+void fill_rank_doc(const BertJob *job, int row, ProtoContent::GpuResultDoc *doc)
+{
+    const int S = job->input.inputDims.d[1];
+    const float *intent = job->output.output5.data() + row * 3;
+    doc->set_dnn_5000(intent[0]);
+    doc->set_dnn_5001(intent[1]);
+    doc->set_dnn_5002(intent[2]);
+    const float *start = job->output.output3.data() + row * S;
+    const int *segs = job->input.data_segs.data() + row * S;
+    const int *masks = job->input.data_masks.data() + row * S;
+    float best = 0.f;
+    for (int i = 0; i < S; i++)
+    {
+        if (segs[i] == 1 && masks[i] && start[i] > best)
+            best = start[i];
+    }
+    doc->set_dnn_5003(best);
 }
-void process2(WFHttpTask *proxy_task, Bert** ppBert)
+
+void rank_callback(WFCounterTask *task)
+{
+    SeriesWork *series = series_of(task);
+    tutorial_series_context *context = (tutorial_series_context *)series->get_context();
+    HttpResponse *proxy_resp = context->proxy_task->get_resp();
+    RankJob *rank = context->rank;
+    const uint64_t replyStartNs = traceNowNs();
+
+    //one batch dropped drops the whole ranking, the caller needs every doc scored
+    int cancelled = kNOT_CANCELLED;
+    for (BertJob *job : rank->batches)
+    {
+        job->trace.add("reply_wait", job->forwardDoneNs, replyStartNs);
+        if (!cancelled)
+            cancelled = job->cancelled;
+    }
+    if (!cancelled)
+    {
+        cancelled = cancel_reason(&rank->batches[0]->input);
+        if (cancelled == kEXPIRED)
+            gCancel.expiredReply++;
+        else if (cancelled == kDISCONNECTED)
+            gCancel.disconnectedReply++;
+    }
+    if (cancelled)
+    {
+        proxy_resp->set_status_code(cancel_status(cancelled));
+    }
+    else
+    {
+        const ProtoContent::GpuRequest &request = rank->request;
+        static thread_local ProtoContent::GpuResult result;
+        static thread_local std::string body;
+        result.Clear();
+        result.set_request_id(request.request_id());
+        const int Bmax = tmp_batch_size;
+        for (int i = 0; i < request.dnn_words_size(); i++)
+        {
+            ProtoContent::GpuResultDoc *doc = result.add_doc();
+            doc->mutable_docid()->CopyFrom(request.dnn_words(i).docid());
+            fill_rank_doc(rank->batches[i / Bmax], i % Bmax, doc);
+        }
+        body.clear();
+        result.SerializeToString(&body);
+        proxy_resp->add_header_pair("Content-Type", "application/x-protobuf");
+        proxy_resp->append_output_body(body.data(), body.size());
+    }
+
+    const uint64_t replyDoneNs = traceNowNs();
+    for (BertJob *job : rank->batches)
+    {
+        if (!cancelled)
+            job->trace.add("serialize", replyStartNs, replyDoneNs);
+        RequestTracer::instance().finish(job->trace);
+    }
+}
+
+//answers 400 to a request rejected while it is parsed, the job goes back to the pool
+void reject_request(WFHttpTask *proxy_task, BertJob *job)
+{
+    proxy_task->get_resp()->set_status_code("400");
+    job->trace.add("parse", job->trace.startNs, traceNowNs());
+    RequestTracer::instance().finish(job->trace);
+    job->reset();
+    ObjectPool<BertJob>::release(job);
+}
+
+//POST /rank, body: a binary GpuRequest. Every doc of dnn_words is paired with the query (the terms of
+//newkeywords(0)) as "[CLS] query [SEP] doc [SEP]"; the pairs are packed Bmax per batch and the batches are queued on
+//the instances at once. Replies a binary GpuResult with the docs in request order. keywords and run_graphes are
+//not supported here: a request that sets them gets 400 rather than a ranking that ignores them.
+void process_rank(WFHttpTask *proxy_task)
+{
+    HttpRequest *req = proxy_task->get_req();
+    HttpResponse *resp = proxy_task->get_resp();
+    if (gVocabulary.empty())
+    {
+        resp->set_status_code("501");
+        return;
+    }
+    const void *body = NULL;
+    size_t size = 0;
+    req->get_parsed_body(&body, &size);
+    RankJob *rank = ObjectPool<RankJob>::acquire();
+    ProtoContent::GpuRequest &request = rank->request;
+    const bool parsed = request.ParseFromArray(body, size);
+    if (!parsed || request.keywords_size() > 0 || request.run_graphes_size() > 0)
+    {
+        if (parsed)
+            printf("GpuRequest keywords/run_graphes are not supported on /rank\n");
+        else
+            printf("GpuRequest parse error\n");
+        request.Clear();
+        ObjectPool<RankJob>::release(rank);
+        //traced like the rejected /infer requests
+        BertJob *job = ObjectPool<BertJob>::acquire();
+        RequestTracer::instance().begin(job->trace);
+        reject_request(proxy_task, job);
+        return;
+    }
+
+    const int S = tmp_sentence_len;
+    const int Bmax = tmp_batch_size;
+    const int nbDocs = request.dnn_words_size();
+    const int nbBatches = (nbDocs + Bmax - 1) / Bmax;
+    if (nbBatches == 0)
+    {
+        static thread_local ProtoContent::GpuResult empty;
+        static thread_local std::string bytes;
+        empty.Clear();
+        empty.set_request_id(request.request_id());
+        bytes.clear();
+        empty.SerializeToString(&bytes);
+        resp->add_header_pair("Content-Type", "application/x-protobuf");
+        resp->append_output_body(bytes.data(), bytes.size());
+        request.Clear();
+        ObjectPool<RankJob>::release(rank);
+        return;
+    }
+
+    static thread_local std::vector<int> query;
+    static thread_local std::vector<int> doc;
+    query.clear();
+    if (request.newkeywords_size() > 0)
+    {
+        for (const std::string &term : request.newkeywords(0).words())
+            gVocabulary.appendTerm(term, query);
+    }
+
+    const uint64_t arrivalUs = RequestCapture::nowUs();
+    uint64_t deadlineUs = gDefaultTimeoutUs ? arrivalUs + gDefaultTimeoutUs : 0;
+    {
+        HttpHeaderCursor cursor(req);
+        static thread_local std::string timeout;
+        if (cursor.find("X-Request-Timeout-Ms", timeout) && atoll(timeout.c_str()) > 0)
+            deadlineUs = arrivalUs + 1000ull * atoll(timeout.c_str());
+    }
+    std::shared_ptr<PeerState> peer = peer_of(proxy_task);
+
+    //the counter completes once the last batch is done
+    WFCounterTask *task = WFTaskFactory::create_counter_task(nbBatches, rank_callback);
+    SeriesWork *series = series_of(proxy_task);
+    tutorial_series_context *context = ObjectPool<tutorial_series_context>::acquire();
+    context->url = req->get_request_uri();
+    context->proxy_task = proxy_task;
+    context->rank = rank;
+    series->set_context(context);
+    series->set_callback(release_context);
+    *series << task;
+
+    for (int b = 0; b < nbBatches; b++)
+    {
+        BertJob *job = ObjectPool<BertJob>::acquire();
+        RequestTracer::instance().begin(job->trace);
+        MMInput *input = &job->input;
+        MMOutput *output = &job->output;
+        //rows past the last doc stay zero: empty slots, see /debug/queues
+        input->data_ids.assign(Bmax * S, 0);
+        input->data_segs.assign(Bmax * S, 0);
+        input->data_masks.assign(Bmax * S, 0);
+        const int rows = std::min(Bmax, nbDocs - b * Bmax);
+        for (int r = 0; r < rows; r++)
+        {
+            doc.clear();
+            for (const std::string &term : request.dnn_words(b * Bmax + r).words())
+                gVocabulary.appendTerm(term, doc);
+            encodePair(gVocabulary, query, doc, S, input->data_ids.data() + r * S, input->data_segs.data() + r * S,
+                input->data_masks.data() + r * S);
+        }
+        input->inputIds = Weights{DataType::kINT32, input->data_ids.data(), Bmax * S};
+        input->segmentIds = Weights{DataType::kINT32, input->data_segs.data(), Bmax * S};
+        input->inputMasks = Weights{DataType::kINT32, input->data_masks.data(), Bmax * S};
+        input->inputDims.nbDims = 2;
+        input->inputDims.d[0] = Bmax;
+        input->inputDims.d[1] = S;
+        input->outputMask = (1u << kSTART_PROB) | (1u << kINTENT_PROB);
+        output->output3.resize(Bmax * S);
+        output->output5.resize(Bmax * 3);
+        input->arrivalUs = arrivalUs;
+        input->deadlineUs = deadlineUs;
+        input->peer = peer;
+        input->capture = false;
+        rank->batches.push_back(job);
+        job->trace.add("parse", job->trace.startNs, traceNowNs());
+        //batches go to the least loaded instances one after the other, so they spread over the pool
+        queue_job(job, pickInstance(), task);
+    }
+}
+
+//clients on this host, over a Unix socket (BERT_LOCAL_SOCKET, see localTransport.h)
+LocalServer gLocalServer;
+
+void local_callback(WFCounterTask *task)
+{
+    BertJob *job = (BertJob *)task->user_data;
+    LocalRequest *request = job->local;
+    const uint64_t replyStartNs = traceNowNs();
+    job->trace.add("reply_wait", job->forwardDoneNs, replyStartNs);
+
+    int cancelled = job->cancelled;
+    if (!cancelled)
+    {
+        cancelled = cancel_reason(&job->input);
+        if (cancelled == kEXPIRED)
+            gCancel.expiredReply++;
+        else if (cancelled == kDISCONNECTED)
+            gCancel.disconnectedReply++;
+    }
+    if (cancelled)
+    {
+        gLocalServer.reply(request, cancelled == kEXPIRED ? kLOCAL_EXPIRED : kLOCAL_UNAVAILABLE);
+    }
+    else
+    {
+        //sent straight from the output vectors, or copied into the slot of the request
+        const std::vector<float> *vecs[kNB_OUTPUTS] = {&job->output.output, &job->output.output2,
+            &job->output.output3, &job->output.output4, &job->output.output5};
+        iovec outputs[kNB_OUTPUTS];
+        int nbOutputs = 0;
+        for (int k = 0; k < kNB_OUTPUTS; k++)
+        {
+            if (!(job->input.outputMask & (1u << k)))
+                continue;
+            outputs[nbOutputs].iov_base = (void *)vecs[k]->data();
+            outputs[nbOutputs].iov_len = vecs[k]->size() * sizeof(float);
+            nbOutputs++;
+        }
+        gLocalServer.reply(request, kLOCAL_OK, outputs, nbOutputs);
+        job->trace.add("serialize", replyStartNs, traceNowNs());
+    }
+    RequestTracer::instance().finish(job->trace);
+    job->reset();
+    ObjectPool<BertJob>::release(job);
+}
+
+//runs on the poll thread of gLocalServer: the request only goes through the same instance queues as the HTTP ones,
+//its inputs are not copied
+void process_local(LocalRequest *request)
+{
+    const LocalRequestHeader &header = request->header;
+    const int S = tmp_sentence_len;
+    const int Bmax = tmp_batch_size;
+    const unsigned outputMask = header.outputMask ? header.outputMask : kALL_OUTPUTS;
+    size_t outputBytes = 0;
+    for (int k = 0; k < kNB_OUTPUTS; k++)
+    {
+        if (outputMask & (1u << k))
+            outputBytes += sizeof(float) * Bmax * (k == kINTENT_PROB ? 3 : S);
+    }
+    if ((outputMask & ~kALL_OUTPUTS) || outputBytes > gLocalServer.outputCapacity(request))
+    {
+        gLocalServer.reply(request, kLOCAL_BAD_REQUEST);
+        return;
+    }
+
+    BertJob *job = ObjectPool<BertJob>::acquire();
+    RequestTracer::instance().begin(job->trace);
+    MMInput *input = &job->input;
+    MMOutput *output = &job->output;
+    input->inputIds = Weights{DataType::kINT32, request->inputIds, Bmax * S};
+    input->segmentIds = Weights{DataType::kINT32, request->segmentIds, Bmax * S};
+    input->inputMasks = Weights{DataType::kINT32, request->inputMask, Bmax * S};
+    input->inputDims.nbDims = 2;
+    input->inputDims.d[0] = Bmax;
+    input->inputDims.d[1] = S;
+    input->outputMask = outputMask;
+    std::vector<float>* outputs[kNB_OUTPUTS] = {&output->output, &output->output2,
+        &output->output3, &output->output4, &output->output5};
+    for (int k = 0; k < kNB_OUTPUTS; k++)
+    {
+        if (outputMask & (1u << k))
+            outputs[k]->resize(Bmax * (k == kINTENT_PROB ? 3 : S));
+    }
+    input->arrivalUs = RequestCapture::nowUs();
+    input->deadlineUs = header.timeoutMs ? input->arrivalUs + 1000ull * header.timeoutMs
+        : (gDefaultTimeoutUs ? input->arrivalUs + gDefaultTimeoutUs : 0);
+    //one PeerState per connection, marked closed by local_close
+    LocalConnection &connection = *request->connection;
+    if (!connection.context)
+        connection.context = std::make_shared<PeerState>();
+    input->peer = std::static_pointer_cast<PeerState>(connection.context);
+    input->capture = false;
+    job->local = request;
+
+    //a counter of its own, not tied to any connection of the HTTP server
+    WFCounterTask *task = WFTaskFactory::create_counter_task(1, local_callback);
+    task->user_data = job;
+    task->start();
+    job->trace.add("parse", job->trace.startNs, traceNowNs());
+    queue_job(job, pickInstance(), task);
+}
+
+void local_close(LocalConnection &connection)
+{
+    if (connection.context)
+        std::static_pointer_cast<PeerState>(connection.context)->closed.store(true, std::memory_order_relaxed);
+}
+
+//true if inputs[name] is an array of arrays of ints
+bool is_int_rows(const ArenaDocument::ValueType &inputs, const char *name)
+{
+    if (!inputs.HasMember(name) || !inputs[name].IsArray())
+        return false;
+    for (auto& row : inputs[name].GetArray())
+    {
+        if (!row.IsArray())
+            return false;
+        for (auto& v : row.GetArray())
+        {
+            if (!v.IsInt())
+                return false;
+        }
+    }
+    return true;
+}
+
+void process2(WFHttpTask *proxy_task)
 {
     printf(" process2 start s. \n");
 
@@ -454,6 +1207,30 @@ void process2(WFHttpTask *proxy_task, Bert** ppBert)
 
     // 1   get req to json
     HttpRequest *req = proxy_task->get_req();
+    if (strcmp(req->get_request_uri(), "/debug/queues") == 0)
+    {
+        reply_queues(proxy_task);
+        return;
+    }
+    if (strcmp(req->get_request_uri(), "/debug/traces") == 0)
+    {
+        //open in chrome://tracing or ui.perfetto.dev
+        std::string traces;
+        RequestTracer::instance().dumpChromeJson(traces);
+        proxy_task->get_resp()->add_header_pair("Content-Type", "application/json");
+        proxy_task->get_resp()->append_output_body(traces.data(), traces.size());
+        return;
+    }
+
+    if (strcmp(req->get_request_uri(), "/rank") == 0)
+    {
+        process_rank(proxy_task);
+        return;
+    }
+
+    // 2 create the job, it is handed to an instance queue once the request is parsed
+    BertJob *job = ObjectPool<BertJob>::acquire();
+    RequestTracer::instance().begin(job->trace);
     const char* pChar = NULL;
     size_t size_ = 0;
     bool ret = req->get_parsed_body((const void **)&pChar, &size_);
@@ -463,19 +1240,24 @@ auto duration1 = duration_cast<microseconds>(end1 - start);
 printf(" req->get_parsed_body process time1 is %d ms. \n", (duration1)/1000);
 
 
-    // 2 create bert task 
-    ParallelWork *pwork = Workflow::create_parallel_work(nullptr);
-    typedef WFThreadTaskFactory<MMInput, MMOutput> MMFactory;
-    MMTask *task = MMFactory::create_thread_task("bert_task",
-                    bert_forward,
-                    http_callback);
     // 3 create input & output
 
     int S = tmp_sentence_len;
     int Bmax = tmp_batch_size;
 
-    MMInput *input = task->get_input();
-    MMOutput *output = task->get_output();
+    MMInput *input = &job->input;
+    MMOutput *output = &job->output;
+    input->arrivalUs = RequestCapture::nowUs();
+    input->deadlineUs = gDefaultTimeoutUs ? input->arrivalUs + gDefaultTimeoutUs : 0;
+    {
+        //X-Request-Timeout-Ms: the client gives up after that many milliseconds
+        HttpHeaderCursor cursor(req);
+        static thread_local std::string timeout;
+        if (cursor.find("X-Request-Timeout-Ms", timeout) && atoll(timeout.c_str()) > 0)
+            input->deadlineUs = input->arrivalUs + 1000ull * atoll(timeout.c_str());
+    }
+    input->peer = peer_of(proxy_task);
+    input->capture = RequestCapture::instance().sample();
     //3.2 choose free pBert(on different device)
 
     
@@ -484,11 +1266,6 @@ printf(" req->get_parsed_body process time1 is %d ms. \n", (duration1)/1000);
     input->inputDims.nbDims = 2;
     input->inputDims.d[0] = Bmax;
     input->inputDims.d[1] = S ;
-    output->output.resize(1 * Bmax * S);
-    output->output2.resize(1 * Bmax * S);
-    output->output3.resize(1 * Bmax * S);
-    output->output4.resize(1 * Bmax * S);
-    output->output5.resize(1 * Bmax * 3);
     
 
 #if 0
@@ -510,34 +1287,26 @@ printf(" req->get_parsed_body process time1 is %d ms. \n", (duration1)/1000);
     set_weights(input->segmentIds, "segment_ids", input->data_segs);
 
 #else
-    rapidjson::Document doc;
+    //values and the parse stack both come from the arena of this thread, emptied for every request
+    ParseArena &arena = parse_arena();
+    arena.allocator.Clear();
+    ArenaDocument doc(&arena.allocator, kPARSE_STACK, &arena.allocator);
     rapidjson::ParseResult result = doc.Parse<rapidjson::kParseStopWhenDoneFlag>(pChar);
-    
-    if (!result) {
-    
-    printf("JSON parse error: %s (%u)", rapidjson::GetParseError_En(result.Code()), result.Offset());
-    return;
-        }
-#if 0
-    //save
-    rapidjson::StringBuffer buffer2;
-
-  buffer2.Clear();
-
-  rapidjson::Writer<rapidjson::StringBuffer> writer2(buffer2);
-  doc.Accept(writer2);
-
-    std::string tmp_(buffer2.GetString());
-    //std::ofstream out("aa.txt");
-    std::string tmp2 = "ha.txt";
-    auto now_ms = std::chrono::time_point_cast<std::chrono::milliseconds>(start);
-auto epoch = now_ms.time_since_epoch();
-auto value = std::chrono::duration_cast<std::chrono::milliseconds>(epoch);
-long duration_ = value.count();
-    std::ofstream out(std::to_string(duration_));
-    out << tmp_;
-     out << std::endl;
-#endif
+    if (!result)
+    {
+        printf("JSON parse error: %s (%u)\n", rapidjson::GetParseError_En(result.Code()), result.Offset());
+        reject_request(proxy_task, job);
+        return;
+    }
+    //set_weights reads "inputs" as three arrays of rows of ints
+    if (!doc.IsObject() || !doc.HasMember("inputs") || !doc["inputs"].IsObject()
+        || !is_int_rows(doc["inputs"], "input_ids") || !is_int_rows(doc["inputs"], "input_mask")
+        || !is_int_rows(doc["inputs"], "segment_ids"))
+    {
+        printf("malformed inputs\n");
+        reject_request(proxy_task, job);
+        return;
+    }
 #if 0
 #define set_weights(dst, name, data_,num) \
         dst.type = DataType::kINT32;\
@@ -552,7 +1321,6 @@ long duration_ = value.count();
         dst.type = DataType::kINT32;\
         const rapidjson::Value& array##num = doc["inputs"][name];\
         size_t len##num = array##num.Size();\
-        dst.count = len##num;\
         for(int i = 0;i < len##num; i++)\
         {\
             for(auto& v: array##num[i].GetArray())\
@@ -560,6 +1328,7 @@ long duration_ = value.count();
                 data_.push_back(v.GetInt());\
             }\
         }\
+        dst.count = data_.size();\
         dst.values = data_.data();
 
 
@@ -570,6 +1339,46 @@ long duration_ = value.count();
     set_weights(input->inputMasks, "input_mask", input->data_masks,2);
     set_weights(input->segmentIds, "segment_ids", input->data_segs,3);
 #endif
+    //forward2 reads Bmax x S values of every input
+    if (input->inputIds.count < Bmax * S || input->inputMasks.count < Bmax * S || input->segmentIds.count < Bmax * S)
+    {
+        printf("inputs hold fewer than %d x %d values\n", Bmax, S);
+        reject_request(proxy_task, job);
+        return;
+    }
+
+    // 3.3 outputs the caller wants, e.g. "outputs": ["intent_prob"]. all of them if absent
+    input->outputMask = kALL_OUTPUTS;
+    if (doc.HasMember("outputs") && doc["outputs"].IsArray())
+    {
+        input->outputMask = 0;
+        for (auto& v : doc["outputs"].GetArray())
+        {
+            int k = v.IsString() ? findOutputKey(v.GetString()) : -1;
+            if (k < 0)
+            {
+                printf("unknown output requested\n");
+                reject_request(proxy_task, job);
+                return;
+            }
+            input->outputMask |= (1u << k);
+        }
+        //"outputs": [] would run the batch and send nothing back
+        if (!input->outputMask)
+        {
+            printf("no output requested\n");
+            reject_request(proxy_task, job);
+            return;
+        }
+    }
+    //only the requested outputs are copied back, so only those need room
+    std::vector<float>* outputs[kNB_OUTPUTS] = {&output->output, &output->output2,
+        &output->output3, &output->output4, &output->output5};
+    for (int k = 0; k < kNB_OUTPUTS; k++)
+    {
+        if (input->outputMask & (1u << k))
+            outputs[k]->resize(1 * Bmax * (k == kINTENT_PROB ? 3 : S));
+    }
 
 
 
@@ -583,21 +1392,25 @@ long duration_ = value.count();
         }
     }
 #endif
-    input->pBert = getFreeBert(ppBert);
-    // 4 create series
+    // 4 pick the instance, then queue the forward on it. The counter completes on a compute thread, so building the
+    // reply never holds up the next batch of the instance.
+    const int instance = pickInstance();
+    WFCounterTask *task = WFTaskFactory::create_counter_task(1, http_callback);
+    // 5 create series
     SeriesWork *series = series_of(proxy_task);
     // SeriesWork *series = Workflow::create_series_work(task, nullptr);
 
-    tutorial_series_context *context = new tutorial_series_context;
+    tutorial_series_context *context = ObjectPool<tutorial_series_context>::acquire();
     context->url = req->get_request_uri();
     context->proxy_task = proxy_task;
+    context->job = job;
 
     series->set_context(context);
-    series->set_callback([](const SeriesWork *series) {
-        delete (tutorial_series_context *)series->get_context();
-    });
+    series->set_callback(release_context);
 #if 1
     *series << task;
+    job->trace.add("parse", job->trace.startNs, traceNowNs());
+    queue_job(job, instance, task);
 #else
 		
     pwork->add_series(series);
@@ -781,34 +1594,91 @@ out.close();
 #endif
     unsigned short port;
 
-    if (argc != 2)
+    if (argc < 2 || argc > 4)
     {
-        fprintf(stderr, "USAGE: %s <port>\n", argv[0]);
+        fprintf(stderr, "USAGE: %s <port> [capture_file [sample_rate]]\n", argv[0]);
+        fprintf(stderr, "  capture_file: record a sample of the requests for replay_capture, 1%% unless sample_rate is given\n");
+        fprintf(stderr, "  BERT_NETWORK_CPUS: cpu list (e.g. 0-3,32-35) of the network threads, all cpus by default\n");
+        fprintf(stderr, "  BERT_SYSFS_ROOT: sysfs tree the NUMA placement is read from, /sys by default\n");
+        fprintf(stderr, "  BERT_REQUEST_TIMEOUT_MS: deadline of requests without an X-Request-Timeout-Ms header\n");
+        fprintf(stderr, "  BERT_TRACE_SAMPLE_RATE: fraction of the requests traced for /debug/traces, 0.001 by default\n");
+        fprintf(stderr, "  BERT_TRACE_SLOW_MS: requests at least this long are always traced, 100 by default, 0 disables\n");
+        fprintf(stderr, "  BERT_VOCAB: vocab.txt of the /rank tokenization, ./data_hz/vocab.txt by default\n");
+        fprintf(stderr, "  BERT_LOCAL_SOCKET: also serve clients on this host on this Unix socket (util/localTransport.h)\n");
         exit(1);
     }
 
-    const char *root = (argc >= 3 ? argv[2] : ".");
+    if (argc >= 3 && !RequestCapture::instance().start(argv[2], argc == 4 ? atof(argv[3]) : 0.01))
+    {
+        exit(1);
+    }
 
-    for(int i = 0; i < deviceCounts; i++)
     {
-        createThreadBertIns(i);
-        pthread_mutex_lock(&mutex_);
-        pthread_cond_wait(&cond_, &mutex_);
+        // all instances are built from the same weights: keep them loaded until the last engine is built
+        WeightStore::Retain retainWeights;
+        initPlacement(deviceCounts);
+        for(int i = 0; i < deviceCounts; i++)
+        {
+            createThreadBertIns(i);
+            pthread_mutex_lock(&mutex_);
+            //a failed init can signal before this thread waits
+            while (gInitDone <= i)
+                pthread_cond_wait(&cond_, &mutex_);
 
-        pthread_mutex_unlock(&mutex_);
+            pthread_mutex_unlock(&mutex_);
+        }
+    }
+    if (pBertVec.empty())
+    {
+        fprintf(stderr, "no instance could be initialized\n");
+        exit(1);
     }
-    Bert** ppBert = pBertVec.data();
-    //ppBert[1] = createMyBert(3);
-    auto&& proc = std::bind(process2, std::placeholders::_1, ppBert);
+    create_queues();
+    auto&& proc = process2;
 
     signal(SIGINT, sig_handler);
 
+    const char* timeoutMs = getenv("BERT_REQUEST_TIMEOUT_MS");
+    if (timeoutMs)
+        gDefaultTimeoutUs = 1000ull * atoll(timeoutMs);
+
+    const char* vocabPath = getenv("BERT_VOCAB");
+    if (!gVocabulary.load(vocabPath ? vocabPath : "./data_hz/vocab.txt"))
+        fprintf(stderr, "no vocabulary at %s, /rank is disabled\n", vocabPath ? vocabPath : "./data_hz/vocab.txt");
+
+    const char* traceSampleRate = getenv("BERT_TRACE_SAMPLE_RATE");
+    const char* traceSlowMs = getenv("BERT_TRACE_SLOW_MS");
+    RequestTracer::instance().configure(traceSampleRate ? atof(traceSampleRate) : 0.001,
+        1000ull * (traceSlowMs ? atoll(traceSlowMs) : 100));
+
+    // the server starts its poller, handler and compute threads from this one, they inherit its cpu set
+    const char* networkCpuList = getenv("BERT_NETWORK_CPUS");
+    if (networkCpuList && *networkCpuList)
+    {
+        std::vector<int> networkCpus;
+        if (!parseCpuList(networkCpuList, networkCpus) || !pinCurrentThread(networkCpus))
+        {
+            fprintf(stderr, "invalid BERT_NETWORK_CPUS: %s\n", networkCpuList);
+            exit(1);
+        }
+    }
+
+    //started after the pinning above: its poll thread runs on the network cpus
+    const char* localSocket = getenv("BERT_LOCAL_SOCKET");
+    if (localSocket && *localSocket
+        && !gLocalServer.start(localSocket, tmp_batch_size, tmp_sentence_len, process_local, local_close))
+    {
+        exit(1);
+    }
+
     WFHttpServer server(proc);
     port = atoi(argv[1]);
     if (server.start(port) == 0)
     {
         pause();
+        gLocalServer.stop();
         server.stop();
+        RequestCapture::instance().stop();
     }
     else
     {
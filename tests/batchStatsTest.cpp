@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "batchStats.h"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace bert;
+
+namespace
+{
+//! \brief batchSize x seqLength mask whose row r starts with tokens[r] ones, rows past tokens are empty
+std::vector<int> mask(int batchSize, int seqLength, const std::vector<int>& tokens)
+{
+    std::vector<int> m(static_cast<size_t>(batchSize) * seqLength, 0);
+    for (size_t r = 0; r < tokens.size(); r++)
+    {
+        std::fill(m.begin() + r * seqLength, m.begin() + r * seqLength + tokens[r], 1);
+    }
+    return m;
+}
+
+void record(BatchStats& stats, int batchSize, int seqLength, const std::vector<int>& tokens, uint64_t ns = 1000)
+{
+    const std::vector<int> m = mask(batchSize, seqLength, tokens);
+    stats.record(m.data(), m.size(), batchSize, seqLength, ns);
+}
+
+//! \brief Index of the only non-zero bin, -1 if there is not exactly one
+int onlyBin(const uint64_t (&bins)[kFILL_BINS])
+{
+    int found = -1;
+    for (int i = 0; i < kFILL_BINS; i++)
+    {
+        if (bins[i])
+        {
+            if (found >= 0)
+            {
+                return -1;
+            }
+            found = i;
+        }
+    }
+    return found;
+}
+} // namespace
+
+TEST(BatchStatsTest, CountsRealAndPaddedWork)
+{
+    BatchStats stats;
+    // 4 slots of 8: 8 + 3 tokens in two sentences, two empty slots
+    record(stats, 4, 8, {8, 3}, 2000);
+    record(stats, 4, 8, {1, 1, 1, 1}, 2000);
+    const BatchStats::Snapshot s = stats.snapshot();
+    EXPECT_EQ(s.batches, 2u);
+    EXPECT_EQ(s.slots, 8u);
+    EXPECT_EQ(s.filledSlots, 6u);
+    EXPECT_EQ(s.positions, 64u);
+    EXPECT_EQ(s.realTokens, 15u);
+    EXPECT_EQ(s.paddedTokens(), 49u);
+    EXPECT_EQ(s.busyNs, 4000u);
+    EXPECT_DOUBLE_EQ(s.effectiveTokensPerSecond(), 15 * 1e9 / 4000);
+}
+
+TEST(BatchStatsTest, BinBoundaries)
+{
+    // 10 slots of 10 positions: a fill of k/10 lands in bin k, a full batch in the last bin
+    for (int filled = 0; filled <= 10; filled++)
+    {
+        SCOPED_TRACE(filled);
+        BatchStats stats;
+        record(stats, 10, 10, std::vector<int>(filled, 10));
+        const BatchStats::Snapshot s = stats.snapshot();
+        EXPECT_EQ(onlyBin(s.slotFill), std::min(filled, kFILL_BINS - 1));
+        EXPECT_EQ(onlyBin(s.tokenFill), std::min(filled, kFILL_BINS - 1));
+    }
+
+    // just under a boundary stays in the bin below: 19 of 100 tokens is bin 1, 20 is bin 2, 99 is bin 9
+    for (const auto& tokensAndBin : {std::make_pair(19, 1), std::make_pair(20, 2), std::make_pair(99, 9)})
+    {
+        BatchStats stats;
+        std::vector<int> tokens(10, 10);
+        tokens.resize(tokensAndBin.first / 10);
+        if (tokensAndBin.first % 10)
+        {
+            tokens.push_back(tokensAndBin.first % 10);
+        }
+        record(stats, 10, 10, tokens);
+        EXPECT_EQ(onlyBin(stats.snapshot().tokenFill), tokensAndBin.second) << tokensAndBin.first;
+    }
+}
+
+TEST(BatchStatsTest, RowsPastTheBatchSizeAreIgnored)
+{
+    BatchStats stats;
+    // a mask of 6 full rows for a batch of 4
+    const std::vector<int> full(6 * 8, 1);
+    stats.record(full.data(), full.size(), 4, 8, 1000);
+    const BatchStats::Snapshot s = stats.snapshot();
+    EXPECT_EQ(s.slots, 4u);
+    EXPECT_EQ(s.filledSlots, 4u);
+    EXPECT_EQ(s.realTokens, 32u);
+    EXPECT_EQ(s.paddedTokens(), 0u);
+    EXPECT_EQ(onlyBin(s.slotFill), kFILL_BINS - 1);
+
+    // a short mask: the rows it does not cover are empty slots
+    stats.record(full.data(), 8, 4, 8, 1000);
+    EXPECT_EQ(stats.snapshot().filledSlots, 5u);
+    EXPECT_EQ(stats.snapshot().slotFill[2], 1u);
+}
+
+TEST(BatchStatsTest, EmptyStats)
+{
+    BatchStats stats;
+    BatchStats::Snapshot s = stats.snapshot();
+    EXPECT_EQ(s.batches, 0u);
+    EXPECT_EQ(s.effectiveTokensPerSecond(), 0.);
+    EXPECT_EQ(onlyBin(s.tokenFill), -1);
+
+    // a zero sized batch counts in the first bins
+    stats.record(nullptr, 0, 0, 8, 0);
+    s = stats.snapshot();
+    EXPECT_EQ(s.batches, 1u);
+    EXPECT_EQ(s.tokenFill[0], 1u);
+    EXPECT_EQ(s.slotFill[0], 1u);
+}
+
+TEST(BatchStatsTest, DebugQueuesJson)
+{
+    BatchStats stats;
+    record(stats, 4, 8, {8, 3}, 2000);
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writeBatchStats(writer, stats.snapshot());
+    writer.EndObject();
+
+    rapidjson::Document document;
+    document.Parse(buffer.GetString());
+    ASSERT_FALSE(document.HasParseError()) << buffer.GetString();
+    EXPECT_EQ(document["batches"].GetUint64(), 1u);
+    EXPECT_EQ(document["real_tokens"].GetUint64(), 11u);
+    EXPECT_EQ(document["padded_tokens"].GetUint64(), 21u);
+    EXPECT_EQ(document["sentences"].GetUint64(), 2u);
+    EXPECT_EQ(document["slots"].GetUint64(), 4u);
+    EXPECT_DOUBLE_EQ(document["effective_tokens_per_s"].GetDouble(), 11 * 1e9 / 2000);
+    // 11 of 32 tokens, 2 of 4 slots
+    for (const char* key : {"token_fill", "slot_fill"})
+    {
+        SCOPED_TRACE(key);
+        const rapidjson::Value& bins = document[key];
+        ASSERT_TRUE(bins.IsArray());
+        ASSERT_EQ(bins.Size(), static_cast<unsigned>(kFILL_BINS));
+        for (int b = 0; b < kFILL_BINS; b++)
+        {
+            const int expected = key[0] == 't' ? 3 : 5;
+            EXPECT_EQ(bins[b].GetUint64(), b == expected ? 1u : 0u) << b;
+        }
+    }
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bert.h"
+#include "bertCalibrator.h"
+#include "captureFile.h"
+#include "hostDeviceOps.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <gtest/gtest.h>
+
+using namespace bert;
+
+namespace
+{
+typedef HostDeviceOps::Op Op;
+
+constexpr int kSEQ_LENGTH = 4;
+constexpr int kBATCH_SIZE = 2;
+const char* kCAPTURE_PATH = "calibrator_test.cap";
+const char* kCACHE_PATH = "calibrator_test.calib";
+
+//! Value of token i of the sentence n of the capture, in every input so each tensor can be told apart
+int32_t inputId(int sentence, int i)
+{
+    return 100 * sentence + i;
+}
+
+int32_t segmentId(int sentence, int i)
+{
+    return (sentence + i) % 2;
+}
+
+int32_t inputMask(int sentence, int i)
+{
+    return i <= sentence % kSEQ_LENGTH;
+}
+
+//! \brief Writes records of 1, 2, 1, 2 and 1 sentences of kSEQ_LENGTH, 7 sentences in all, with a record of another
+//! sequence length in the middle
+class BertCalibratorTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        CaptureWriter writer;
+        ASSERT_TRUE(writer.open(kCAPTURE_PATH));
+        int sentence = 0;
+        for (int r = 0; r < 5; r++)
+        {
+            const int B = r % 2 + 1;
+            std::vector<int32_t> ids, segments, mask;
+            for (int b = 0; b < B; b++, sentence++)
+            {
+                for (int i = 0; i < kSEQ_LENGTH; i++)
+                {
+                    ids.push_back(inputId(sentence, i));
+                    segments.push_back(segmentId(sentence, i));
+                    mask.push_back(inputMask(sentence, i));
+                }
+            }
+            CaptureRecordHeader header{};
+            header.batchSize = B;
+            header.seqLength = kSEQ_LENGTH;
+            ASSERT_TRUE(writer.write(header, ids.data(), segments.data(), mask.data()));
+
+            if (r == 2)
+            {
+                CaptureRecordHeader other{};
+                other.batchSize = 1;
+                other.seqLength = 2 * kSEQ_LENGTH;
+                const std::vector<int32_t> ones(2 * kSEQ_LENGTH, 1);
+                ASSERT_TRUE(writer.write(other, ones.data(), ones.data(), ones.data()));
+            }
+        }
+        writer.close();
+        remove(kCACHE_PATH);
+    }
+
+    void TearDown() override
+    {
+        remove(kCAPTURE_PATH);
+        remove(kCACHE_PATH);
+    }
+
+    //! Checks that a B x S tensor of the current batch holds the sentences it should
+    static void expectBatch(const int32_t* data, int batch, int32_t (*value)(int, int))
+    {
+        for (int b = 0; b < kBATCH_SIZE; b++)
+        {
+            for (int i = 0; i < kSEQ_LENGTH; i++)
+            {
+                ASSERT_EQ(data[b * kSEQ_LENGTH + i], value(batch * kBATCH_SIZE + b, i))
+                    << "batch " << batch << " sentence " << b << " token " << i;
+            }
+        }
+    }
+
+    HostDeviceOps ops;
+};
+} // namespace
+
+TEST_F(BertCalibratorTest, StreamRegroupsSentencesAndDropsThePartialBatch)
+{
+    BertBatchStream stream(kBATCH_SIZE, kSEQ_LENGTH, kCAPTURE_PATH);
+    // 7 sentences: 3 full batches, the last sentence and the record of length 8 are left out
+    EXPECT_EQ(stream.getNbBatches(), 3);
+    EXPECT_EQ(stream.getDims().nbDims, 2);
+    EXPECT_EQ(stream.getDims().d[0], kBATCH_SIZE);
+    EXPECT_EQ(stream.getDims().d[1], kSEQ_LENGTH);
+
+    int batch = 0;
+    while (stream.next())
+    {
+        expectBatch(stream.getInputIds(), batch, inputId);
+        expectBatch(stream.getSegmentIds(), batch, segmentId);
+        expectBatch(stream.getInputMask(), batch, inputMask);
+        EXPECT_EQ(reinterpret_cast<const int32_t*>(stream.getBatch()), stream.getInputIds());
+        batch++;
+        EXPECT_EQ(stream.getBatchesRead(), batch);
+    }
+    EXPECT_EQ(batch, 3);
+
+    stream.reset(1);
+    ASSERT_TRUE(stream.next());
+    expectBatch(stream.getInputIds(), 1, inputId);
+}
+
+TEST_F(BertCalibratorTest, StreamHonorsMaxBatches)
+{
+    BertBatchStream stream(kBATCH_SIZE, kSEQ_LENGTH, kCAPTURE_PATH, 1);
+    EXPECT_EQ(stream.getNbBatches(), 1);
+    ASSERT_TRUE(stream.next());
+    EXPECT_FALSE(stream.next());
+}
+
+TEST_F(BertCalibratorTest, StreamOfAMissingCaptureIsEmpty)
+{
+    BertBatchStream stream(kBATCH_SIZE, kSEQ_LENGTH, "no_such_capture.cap");
+    EXPECT_EQ(stream.getNbBatches(), 0);
+    EXPECT_FALSE(stream.next());
+}
+
+TEST_F(BertCalibratorTest, GetBatchCopiesEachInputToItsBinding)
+{
+    BertBatchStream stream(kBATCH_SIZE, kSEQ_LENGTH, kCAPTURE_PATH);
+    {
+        BertEntropyCalibrator calibrator(stream, kCACHE_PATH, true, ops);
+        EXPECT_EQ(ops.liveBuffers(), 3);
+        const size_t inputBytes = kBATCH_SIZE * kSEQ_LENGTH * sizeof(int32_t);
+
+        // bindings in another order than the inputs
+        const char* names[3] = {kMODEL_INPUT2_NAME, kMODEL_INPUT0_NAME, kMODEL_INPUT1_NAME};
+        void* bindings[3];
+        void* firstBindings[3];
+        int batch = 0;
+        for (; ; batch++)
+        {
+            const size_t first = ops.calls.size();
+            if (!calibrator.getBatch(bindings, names, 3))
+            {
+                EXPECT_EQ(ops.calls.size(), first) << "nothing is copied once the stream is exhausted";
+                break;
+            }
+            const std::vector<Op> expected{
+                HostDeviceOps::kH2D, HostDeviceOps::kH2D, HostDeviceOps::kH2D, HostDeviceOps::kSTREAM_SYNC};
+            EXPECT_EQ(ops.ops(first), expected);
+            for (int i = 0; i < 3; i++)
+            {
+                EXPECT_EQ(ops.calls[first + i].target, bindings[i]);
+                EXPECT_EQ(ops.calls[first + i].len, inputBytes);
+            }
+            expectBatch(static_cast<const int32_t*>(bindings[0]), batch, inputMask);
+            expectBatch(static_cast<const int32_t*>(bindings[1]), batch, inputId);
+            expectBatch(static_cast<const int32_t*>(bindings[2]), batch, segmentId);
+
+            // the device inputs are allocated once and reused by every batch
+            if (batch == 0)
+            {
+                std::copy(bindings, bindings + 3, firstBindings);
+            }
+            EXPECT_TRUE(std::equal(bindings, bindings + 3, firstBindings));
+        }
+        EXPECT_EQ(batch, 3);
+    }
+    EXPECT_EQ(ops.liveBuffers(), 0);
+}
+
+TEST_F(BertCalibratorTest, GetBatchRejectsUnknownBindings)
+{
+    BertBatchStream stream(kBATCH_SIZE, kSEQ_LENGTH, kCAPTURE_PATH);
+    BertEntropyCalibrator calibrator(stream, kCACHE_PATH, true, ops);
+    const char* names[2] = {kMODEL_INPUT0_NAME, "logits"};
+    void* bindings[2];
+    EXPECT_FALSE(calibrator.getBatch(bindings, names, 2));
+}
+
+TEST_F(BertCalibratorTest, CalibrationCacheRoundTrips)
+{
+    BertBatchStream stream(kBATCH_SIZE, kSEQ_LENGTH, kCAPTURE_PATH);
+    // the table is written and read back as bytes
+    const char kTABLE[] = "TRT-7000-EntropyCalibration2\ninput_ids: 3c010a14\n\0\xff";
+    const std::string table(kTABLE, sizeof(kTABLE) - 1);
+    {
+        BertEntropyCalibrator calibrator(stream, kCACHE_PATH, true, ops);
+        size_t length = 1;
+        EXPECT_EQ(calibrator.readCalibrationCache(length), nullptr);
+        EXPECT_EQ(length, 0u);
+        calibrator.writeCalibrationCache(table.data(), table.size());
+    }
+    {
+        BertEntropyCalibrator calibrator(stream, kCACHE_PATH, true, ops);
+        size_t length = 0;
+        const void* cache = calibrator.readCalibrationCache(length);
+        ASSERT_NE(cache, nullptr);
+        EXPECT_EQ(std::string(static_cast<const char*>(cache), length), table);
+    }
+    {
+        // readCache off: calibrate again even though a table exists
+        BertEntropyCalibrator calibrator(stream, kCACHE_PATH, false, ops);
+        size_t length = 1;
+        EXPECT_EQ(calibrator.readCalibrationCache(length), nullptr);
+        EXPECT_EQ(length, 0u);
+    }
+}
@@ -0,0 +1,611 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "BertCPU.h"
+#include "attentionKeys.h"
+#include "cpuOps.h"
+#include "transformerKeys.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <map>
+
+// The GEMM micro-kernel is chosen once per process: ctest runs this binary once per BERT_CPU_ISA value so that the
+// scalar, AVX2 and AVX-512 paths are all covered on a machine that has them.
+
+using namespace bert;
+using nvinfer1::DataType;
+using nvinfer1::Weights;
+
+namespace
+{
+//! \brief Deterministic values in [-scale, scale)
+class Random
+{
+public:
+    explicit Random(uint32_t seed)
+        : mState(seed)
+    {
+    }
+
+    float next(float scale = 1.f)
+    {
+        mState = mState * 1664525u + 1013904223u;
+        return scale * (static_cast<float>(mState >> 8) / (1u << 23) - 1.f);
+    }
+
+    std::vector<float> values(size_t n, float scale = 1.f)
+    {
+        std::vector<float> v(n);
+        for (float& x : v)
+        {
+            x = next(scale);
+        }
+        return v;
+    }
+
+private:
+    uint32_t mState;
+};
+
+double geluReference(double x)
+{
+    return 0.5 * x * (1.0 + std::tanh(std::sqrt(2.0 / M_PI) * (x + 0.044715 * x * x * x)));
+}
+
+void softmaxReference(std::vector<double>& x, int valid)
+{
+    double maxv = x[0];
+    for (int i = 1; i < valid; i++)
+    {
+        maxv = std::max(maxv, x[i]);
+    }
+    double sum = 0.0;
+    for (int i = 0; i < valid; i++)
+    {
+        x[i] = std::exp(x[i] - maxv);
+        sum += x[i];
+    }
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        x[i] = static_cast<int>(i) < valid ? x[i] / sum : 0.0;
+    }
+}
+
+std::vector<double> layerNormReference(const std::vector<double>& x, const float* gamma, const float* beta)
+{
+    const size_t n = x.size();
+    double mu = 0.0;
+    for (double v : x)
+    {
+        mu += v;
+    }
+    mu /= n;
+    double var = 0.0;
+    for (double v : x)
+    {
+        var += (v - mu) * (v - mu);
+    }
+    const double rsigma = 1.0 / std::sqrt(var / n);
+    std::vector<double> y(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        y[i] = gamma[i] * (x[i] - mu) * rsigma + beta[i];
+    }
+    return y;
+}
+
+//! \brief m x N product of a (m x K, stride lda) with b (K x N row major) and optional bias and GELU, checked against
+//! a double precision reference. Columns of c past N up to ldc must be left as they were.
+void checkGemm(cpu::ThreadPool* pool, int m, int K, int N, bool transposed, bool withBias, cpu::Epilogue epilogue)
+{
+    SCOPED_TRACE(::testing::Message() << "m " << m << " K " << K << " N " << N << " transposed " << transposed
+                                      << " bias " << withBias << " gelu " << (epilogue == cpu::Epilogue::kGELU)
+                                      << " pool " << (pool ? pool->size() : 0));
+    Random random(m * 7919 + K * 104729 + N);
+    const int lda = K + 3;
+    const int ldc = N + 5;
+    const std::vector<float> a = random.values(static_cast<size_t>(m) * lda);
+    const std::vector<float> b = random.values(static_cast<size_t>(K) * N);
+    const std::vector<float> bias = random.values(N);
+
+    cpu::PackedMatrix packed;
+    if (transposed)
+    {
+        // the same matrix given as its N x K transpose with a padded stride
+        const int ldw = K + 2;
+        std::vector<float> w(static_cast<size_t>(N) * ldw, NAN);
+        for (int k = 0; k < K; k++)
+        {
+            for (int n = 0; n < N; n++)
+            {
+                w[static_cast<size_t>(n) * ldw + k] = b[static_cast<size_t>(k) * N + n];
+            }
+        }
+        packed.packTransposed(w.data(), N, K, ldw);
+    }
+    else
+    {
+        packed.pack(b.data(), K, N, N);
+    }
+    ASSERT_EQ(packed.rows(), K);
+    ASSERT_EQ(packed.cols(), N);
+
+    constexpr float kSENTINEL = 1234.5f;
+    std::vector<float> c(static_cast<size_t>(m) * ldc, kSENTINEL);
+    if (pool)
+    {
+        cpu::gemm(*pool, m, a.data(), lda, packed, withBias ? bias.data() : nullptr, c.data(), ldc, epilogue);
+    }
+    else
+    {
+        cpu::gemmSerial(m, a.data(), lda, packed, c.data(), ldc);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < m && failures < 10; i++)
+    {
+        for (int n = 0; n < ldc; n++)
+        {
+            const float got = c[static_cast<size_t>(i) * ldc + n];
+            if (n >= N)
+            {
+                failures += got != kSENTINEL;
+                EXPECT_EQ(got, kSENTINEL) << "padding written at " << i << ", " << n;
+                continue;
+            }
+            double sum = withBias ? bias[n] : 0.0;
+            double magnitude = std::abs(sum);
+            for (int k = 0; k < K; k++)
+            {
+                const double p = static_cast<double>(a[static_cast<size_t>(i) * lda + k]) * b[static_cast<size_t>(k) * N + n];
+                sum += p;
+                magnitude += std::abs(p);
+            }
+            const double expected = epilogue == cpu::Epilogue::kGELU ? geluReference(sum) : sum;
+            const double tolerance = 1e-5 * magnitude + 1e-6;
+            failures += std::abs(got - expected) > tolerance;
+            EXPECT_NEAR(got, expected, tolerance) << "at " << i << ", " << n;
+        }
+    }
+}
+
+//! \brief A tiny BERT: 2 layers of hidden 8, 2 heads and intermediate 16, 20 words, 3 intents
+constexpr int kHIDDEN = 8;
+constexpr int kHEADS = 2;
+constexpr int kINTERMEDIATE = 16;
+constexpr int kLAYERS = 2;
+constexpr int kVOCAB = 20;
+constexpr int kTOKEN_TYPES = 2;
+constexpr int kINTENTS = 3;
+constexpr int kBMAX = 4;
+constexpr int kS = 5;
+
+//! \brief Synthetic weights in the layout loadWeights returns (kernels [out][in]) and a naive forward pass over them
+class NaiveBert
+{
+public:
+    NaiveBert()
+    {
+        Random random(42);
+        const auto add = [&](const std::string& name, size_t count, float scale, float offset = 0.f) {
+            std::vector<float> v = random.values(count, scale);
+            for (float& x : v)
+            {
+                x += offset;
+            }
+            mValues[name] = v;
+        };
+        add("bert_embeddings_word_embeddings", kVOCAB * kHIDDEN, 1.f);
+        add("bert_embeddings_token_type_embeddings", kTOKEN_TYPES * kHIDDEN, 0.5f);
+        add("bert_embeddings_position_embeddings", kS * kHIDDEN, 0.5f);
+        add("bert_embeddings_layernorm_gamma", kHIDDEN, 0.2f, 1.f);
+        add("bert_embeddings_layernorm_beta", kHIDDEN, 0.2f);
+        for (int l = 0; l < kLAYERS; l++)
+        {
+            const std::string prefix = "l" + std::to_string(l) + "_";
+            add(prefix + "attention_self_" + WQKV, 3 * kHIDDEN * kHIDDEN, 0.5f);
+            add(prefix + "attention_self_" + BQKV, 3 * kHIDDEN, 0.1f);
+            add(prefix + W_AOUT, kHIDDEN * kHIDDEN, 0.5f);
+            add(prefix + B_AOUT, kHIDDEN, 0.1f);
+            add(prefix + AOUT_LN_GAMMA, kHIDDEN, 0.2f, 1.f);
+            add(prefix + AOUT_LN_BETA, kHIDDEN, 0.2f);
+            add(prefix + W_MID, kINTERMEDIATE * kHIDDEN, 0.5f);
+            add(prefix + B_MID, kINTERMEDIATE, 0.1f);
+            add(prefix + W_LOUT, kHIDDEN * kINTERMEDIATE, 0.5f);
+            add(prefix + B_LOUT, kHIDDEN, 0.1f);
+            add(prefix + LOUT_LN_GAMMA, kHIDDEN, 0.2f, 1.f);
+            add(prefix + LOUT_LN_BETA, kHIDDEN, 0.2f);
+        }
+        add("cls_squad_output_weights", 2 * kHIDDEN, 0.5f);
+        add("cls_squad_output_bias", 2, 0.1f);
+        add("dense_kernel", kHIDDEN * kHIDDEN, 0.5f);
+        add("dense_bias", kHIDDEN, 0.1f);
+        add("dense_1_kernel", kINTENTS * kHIDDEN, 0.5f);
+        add("dense_1_bias", kINTENTS, 0.1f);
+
+        for (const auto& kv : mValues)
+        {
+            mWeightMap[kv.first] = Weights{DataType::kFLOAT, kv.second.data(), static_cast<int64_t>(kv.second.size())};
+        }
+    }
+
+    const WeightMap& weightMap() const
+    {
+        return mWeightMap;
+    }
+
+    //! \brief The five outputs of forward2: start and end logits, start and end probabilities, intent probabilities
+    std::vector<std::vector<double>> forward(
+        int B, int S, const std::vector<int>& ids, const std::vector<int>& segments, const std::vector<int>& masks) const
+    {
+        const int M = B * S;
+        std::vector<std::vector<double>> x(M);
+        for (int r = 0; r < M; r++)
+        {
+            const int word = std::min(std::max(ids[r], 0), kVOCAB - 1);
+            const int token = std::min(std::max(segments[r], 0), kTOKEN_TYPES - 1);
+            std::vector<double> sum(kHIDDEN);
+            for (int i = 0; i < kHIDDEN; i++)
+            {
+                sum[i] = at("bert_embeddings_word_embeddings")[word * kHIDDEN + i]
+                    + at("bert_embeddings_token_type_embeddings")[token * kHIDDEN + i]
+                    + at("bert_embeddings_position_embeddings")[(r % S) * kHIDDEN + i];
+            }
+            x[r] = layerNormReference(
+                sum, at("bert_embeddings_layernorm_gamma"), at("bert_embeddings_layernorm_beta"));
+        }
+
+        // the leading unmasked tokens of each sequence
+        std::vector<int> valid(B, 0);
+        for (int b = 0; b < B; b++)
+        {
+            while (valid[b] < S && masks[b * S + valid[b]] != 0)
+            {
+                valid[b]++;
+            }
+        }
+
+        for (int l = 0; l < kLAYERS; l++)
+        {
+            const std::string prefix = "l" + std::to_string(l) + "_";
+            x = layer(prefix, B, S, valid, x);
+        }
+
+        std::vector<std::vector<double>> outputs(kNB_OUTPUTS);
+        outputs[kSTART_LOGITS].resize(M);
+        outputs[kEND_LOGITS].resize(M);
+        for (int r = 0; r < M; r++)
+        {
+            outputs[kSTART_LOGITS][r] = dot(at("cls_squad_output_weights"), x[r]) + at("cls_squad_output_bias")[0];
+            outputs[kEND_LOGITS][r]
+                = dot(at("cls_squad_output_weights") + kHIDDEN, x[r]) + at("cls_squad_output_bias")[1];
+        }
+        for (int p = 0; p < 2; p++)
+        {
+            for (int b = 0; b < B; b++)
+            {
+                const std::vector<double>& logits = outputs[p == 0 ? kSTART_LOGITS : kEND_LOGITS];
+                std::vector<double> row(logits.begin() + b * S, logits.begin() + (b + 1) * S);
+                softmaxReference(row, S);
+                std::vector<double>& prob = outputs[p == 0 ? kSTART_PROB : kEND_PROB];
+                prob.insert(prob.end(), row.begin(), row.end());
+            }
+        }
+        for (int b = 0; b < B; b++)
+        {
+            std::vector<double> cls = dense("dense_kernel", "dense_bias", kHIDDEN, x[b * S]);
+            for (double& v : cls)
+            {
+                v = std::tanh(v);
+            }
+            std::vector<double> intents = dense("dense_1_kernel", "dense_1_bias", kINTENTS, cls);
+            softmaxReference(intents, kINTENTS);
+            outputs[kINTENT_PROB].insert(outputs[kINTENT_PROB].end(), intents.begin(), intents.end());
+        }
+        return outputs;
+    }
+
+private:
+    const float* at(const std::string& name) const
+    {
+        return mValues.at(name).data();
+    }
+
+    static double dot(const float* w, const std::vector<double>& x)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            sum += w[i] * x[i];
+        }
+        return sum;
+    }
+
+    std::vector<double> dense(const std::string& kernel, const std::string& bias, int out,
+        const std::vector<double>& x) const
+    {
+        std::vector<double> y(out);
+        for (int o = 0; o < out; o++)
+        {
+            y[o] = dot(at(kernel) + o * x.size(), x) + at(bias)[o];
+        }
+        return y;
+    }
+
+    std::vector<std::vector<double>> layer(const std::string& prefix, int B, int S, const std::vector<int>& valid,
+        const std::vector<std::vector<double>>& x) const
+    {
+        const int M = B * S;
+        const int h = kHIDDEN / kHEADS;
+        std::vector<std::vector<double>> qkv(M);
+        for (int r = 0; r < M; r++)
+        {
+            qkv[r] = dense(prefix + "attention_self_" + WQKV, prefix + "attention_self_" + BQKV, 3 * kHIDDEN, x[r]);
+        }
+
+        // rows of qkv are [q | k | v], each head n at n * h
+        std::vector<std::vector<double>> ctx(M, std::vector<double>(kHIDDEN, 0.0));
+        for (int b = 0; b < B; b++)
+        {
+            for (int n = 0; n < kHEADS; n++)
+            {
+                for (int s = 0; s < S && valid[b] > 0; s++)
+                {
+                    const std::vector<double>& q = qkv[b * S + s];
+                    std::vector<double> scores(valid[b]);
+                    for (int j = 0; j < valid[b]; j++)
+                    {
+                        const std::vector<double>& k = qkv[b * S + j];
+                        for (int d = 0; d < h; d++)
+                        {
+                            scores[j] += q[n * h + d] * k[kHIDDEN + n * h + d];
+                        }
+                        scores[j] /= std::sqrt(static_cast<double>(h));
+                    }
+                    softmaxReference(scores, valid[b]);
+                    for (int j = 0; j < valid[b]; j++)
+                    {
+                        for (int d = 0; d < h; d++)
+                        {
+                            ctx[b * S + s][n * h + d] += scores[j] * qkv[b * S + j][2 * kHIDDEN + n * h + d];
+                        }
+                    }
+                }
+            }
+        }
+
+        std::vector<std::vector<double>> y(M);
+        for (int r = 0; r < M; r++)
+        {
+            std::vector<double> attn = dense(prefix + W_AOUT, prefix + B_AOUT, kHIDDEN, ctx[r]);
+            for (int i = 0; i < kHIDDEN; i++)
+            {
+                attn[i] += x[r][i];
+            }
+            attn = layerNormReference(attn, at(prefix + AOUT_LN_GAMMA), at(prefix + AOUT_LN_BETA));
+            std::vector<double> mid = dense(prefix + W_MID, prefix + B_MID, kINTERMEDIATE, attn);
+            for (double& v : mid)
+            {
+                v = geluReference(v);
+            }
+            std::vector<double> out = dense(prefix + W_LOUT, prefix + B_LOUT, kHIDDEN, mid);
+            for (int i = 0; i < kHIDDEN; i++)
+            {
+                out[i] += attn[i];
+            }
+            y[r] = layerNormReference(out, at(prefix + LOUT_LN_GAMMA), at(prefix + LOUT_LN_BETA));
+        }
+        return y;
+    }
+
+    std::map<std::string, std::vector<float>> mValues;
+    WeightMap mWeightMap;
+};
+
+//! \brief Runs B x S inputs through BertCPU and the naive forward and compares the five outputs
+void checkForward(BertCPU& bert, const NaiveBert& naive, int B, int S, const std::vector<int>& ids,
+    const std::vector<int>& segments, const std::vector<int>& masks)
+{
+    SCOPED_TRACE(::testing::Message() << B << " x " << S);
+    Weights idWeights{DataType::kINT32, ids.data(), B * S};
+    Weights segmentWeights{DataType::kINT32, segments.data(), B * S};
+    Weights maskWeights{DataType::kINT32, masks.data(), B * S};
+    Dims dims;
+    dims.nbDims = 2;
+    dims.d[0] = B;
+    dims.d[1] = S;
+    std::vector<float> outputs[kNB_OUTPUTS];
+    ASSERT_TRUE(bert.forward2(idWeights, segmentWeights, maskWeights, dims, outputs[0], outputs[1], outputs[2],
+        outputs[3], outputs[4]));
+
+    const std::vector<std::vector<double>> expected = naive.forward(B, S, ids, segments, masks);
+    for (int o = 0; o < kNB_OUTPUTS; o++)
+    {
+        SCOPED_TRACE(o);
+        ASSERT_EQ(outputs[o].size(), expected[o].size());
+        for (size_t i = 0; i < expected[o].size(); i++)
+        {
+            EXPECT_NEAR(outputs[o][i], expected[o][i], 1e-4) << "at " << i;
+        }
+    }
+}
+} // namespace
+
+TEST(CpuOpsTest, IsaFollowsTheEnvironment)
+{
+    const char* env = std::getenv("BERT_CPU_ISA");
+    const cpu::Isa isa = cpu::gemmIsa();
+    std::cout << "gemm kernels: " << cpu::isaName(isa) << std::endl;
+    if (env && !std::strcmp(env, "scalar"))
+    {
+        EXPECT_EQ(isa, cpu::Isa::kSCALAR);
+    }
+    else if (env && !std::strcmp(env, "avx2"))
+    {
+        EXPECT_NE(isa, cpu::Isa::kAVX512);
+    }
+}
+
+TEST(CpuOpsTest, ParallelForRunsEveryIndexOnce)
+{
+    for (int threads : {1, 3})
+    {
+        cpu::ThreadPool pool(threads);
+        ASSERT_EQ(pool.size(), threads);
+        for (int n : {0, 1, 2, 1000})
+        {
+            std::vector<std::atomic<int>> calls(n);
+            std::atomic<bool> badThread{false};
+            pool.parallelFor(n, [&](int index, int thread) {
+                calls[index]++;
+                badThread = badThread || thread < 0 || thread >= pool.size();
+            });
+            for (int i = 0; i < n; i++)
+            {
+                ASSERT_EQ(calls[i], 1) << threads << " threads, " << n << " tasks, index " << i;
+            }
+            EXPECT_FALSE(badThread);
+        }
+    }
+}
+
+TEST(CpuOpsTest, GemmMatchesTheReference)
+{
+    // rows around the micro-tile heights (4, 6) and past one row block, K past one k block (256), columns around a
+    // panel (16) and past one column block (4 panels)
+    cpu::ThreadPool pool(3);
+    for (int m : {1, 7, 50, 97})
+    {
+        for (int K : {1, 5, 300})
+        {
+            for (int N : {1, 17, 33, 130})
+            {
+                checkGemm(&pool, m, K, N, true, true, cpu::Epilogue::kNONE);
+                checkGemm(&pool, m, K, N, false, false, cpu::Epilogue::kGELU);
+            }
+        }
+    }
+    checkGemm(&pool, 6, 16, 16, true, true, cpu::Epilogue::kGELU);
+    checkGemm(&pool, 3, 0, 20, true, true, cpu::Epilogue::kNONE);
+}
+
+TEST(CpuOpsTest, GemmSerialMatchesTheReference)
+{
+    for (int m : {1, 4, 6, 13, 64})
+    {
+        for (int K : {1, 9, 257})
+        {
+            for (int N : {1, 16, 31, 64})
+            {
+                checkGemm(nullptr, m, K, N, (m + N) % 2 == 0, false, cpu::Epilogue::kNONE);
+            }
+        }
+    }
+}
+
+TEST(CpuOpsTest, GeluIsTheTanhApproximation)
+{
+    for (float x = -6.f; x <= 6.f; x += 0.25f)
+    {
+        EXPECT_NEAR(cpu::gelu(x), geluReference(x), 1e-6) << x;
+    }
+}
+
+TEST(CpuOpsTest, SoftmaxScalesAndZeroesThePadding)
+{
+    Random random(3);
+    const std::vector<float> input = random.values(7, 4.f);
+    for (int valid : {7, 4, 1, 0, 9})
+    {
+        SCOPED_TRACE(valid);
+        std::vector<float> x = input;
+        cpu::softmax(x.data(), 7, valid, 0.5f);
+        std::vector<double> expected(input.begin(), input.end());
+        for (double& v : expected)
+        {
+            v *= 0.5;
+        }
+        softmaxReference(expected, std::min(valid, 7));
+        for (int i = 0; i < 7; i++)
+        {
+            EXPECT_NEAR(x[i], expected[i], 1e-6) << i;
+        }
+    }
+}
+
+TEST(CpuOpsTest, LayerNormMatchesTheReference)
+{
+    Random random(5);
+    for (int n : {2, 13, 768})
+    {
+        SCOPED_TRACE(n);
+        const std::vector<float> x = random.values(n, 3.f);
+        const std::vector<float> gamma = random.values(n);
+        const std::vector<float> beta = random.values(n);
+        std::vector<float> y(n);
+        cpu::layerNorm(x.data(), gamma.data(), beta.data(), y.data(), n);
+        const std::vector<double> expected
+            = layerNormReference(std::vector<double>(x.begin(), x.end()), gamma.data(), beta.data());
+        for (int i = 0; i < n; i++)
+        {
+            EXPECT_NEAR(y[i], expected[i], 1e-5) << i;
+        }
+    }
+}
+
+TEST(BertCpuTest, ForwardMatchesANaiveBert)
+{
+    const NaiveBert naive;
+    BertCPU bert(kHEADS, kBMAX, kS, false);
+    bert.setNumThreads(2);
+    ASSERT_TRUE(bert.initWithWeights(naive.weightMap()));
+
+    // a full sequence, one padded after 3 tokens with out of range ids and segments, and one fully masked
+    const std::vector<int> ids = {1, 7, 3, 19, 2, 4, 25, -1, 0, 0, 5, 6, 7, 8, 9};
+    const std::vector<int> segments = {0, 0, 1, 1, 1, 0, 3, 1, 0, 0, 0, 1, 0, 1, 0};
+    const std::vector<int> masks = {1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    checkForward(bert, naive, 3, kS, ids, segments, masks);
+
+    // fewer and shorter sequences reuse the buffers; the second mask stops at its first 0
+    const std::vector<int> shortIds = {3, 4, 5, 6, 10, 11, 12, 13};
+    const std::vector<int> shortSegments = {0, 1, 1, 1, 0, 0, 1, 1};
+    const std::vector<int> shortMasks = {1, 1, 1, 1, 1, 1, 0, 1};
+    checkForward(bert, naive, 2, kS - 1, shortIds, shortSegments, shortMasks);
+}
+
+TEST(BertCpuTest, RejectsInputsLargerThanTheInstance)
+{
+    const NaiveBert naive;
+    BertCPU bert(kHEADS, kBMAX, kS, false);
+    bert.setNumThreads(1);
+    ASSERT_TRUE(bert.initWithWeights(naive.weightMap()));
+
+    const std::vector<int> zeros((kBMAX + 1) * kS, 0);
+    Weights input{DataType::kINT32, zeros.data(), static_cast<int64_t>(zeros.size())};
+    Dims dims;
+    dims.nbDims = 2;
+    dims.d[0] = kBMAX + 1;
+    dims.d[1] = kS;
+    std::vector<float> o1, o2, o3, o4, o5;
+    EXPECT_FALSE(bert.forward2(input, input, input, dims, o1, o2, o3, o4, o5));
+    dims.d[0] = 1;
+    dims.d[1] = kS + 1;
+    EXPECT_FALSE(bert.forward2(input, input, input, dims, o1, o2, o3, o4, o5));
+}
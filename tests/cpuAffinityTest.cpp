@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cpuAffinity.h"
+#include "tempDir.h"
+#include <gtest/gtest.h>
+
+using namespace bert;
+
+namespace
+{
+using Cpus = std::vector<int>;
+
+Cpus parse(const std::string& list)
+{
+    Cpus cpus{-1};
+    EXPECT_TRUE(parseCpuList(list, cpus)) << list;
+    return cpus;
+}
+
+//! \brief A two node machine: node 0 has CPUs 0-3 and 8-11, node 1 has 4-7 and 12-15. Device 0000:3b:00.0 is on
+//! node 1, 0000:5e:00.0 outside any node and 0000:af:00.0 on a node that is not online.
+class CpuTopologyTest : public ::testing::Test
+{
+protected:
+    CpuTopologyTest()
+    {
+        dir.write("devices/system/node/online", "0-1\n");
+        dir.write("devices/system/node/node0/cpulist", "0-3,8-11\n");
+        dir.write("devices/system/node/node1/cpulist", "4-7,12-15\n");
+        dir.write("bus/pci/devices/0000:3b:00.0/numa_node", "1\n");
+        dir.write("bus/pci/devices/0000:5e:00.0/numa_node", "-1\n");
+        dir.write("bus/pci/devices/0000:af:00.0/numa_node", "3\n");
+    }
+
+    TempDir dir;
+};
+} // namespace
+
+TEST(ParseCpuListTest, RangesAndSingleCpus)
+{
+    EXPECT_EQ(parse("0"), Cpus({0}));
+    EXPECT_EQ(parse("0-3"), Cpus({0, 1, 2, 3}));
+    EXPECT_EQ(parse("0-1,4,6-7\n"), Cpus({0, 1, 4, 6, 7}));
+    EXPECT_EQ(parse("5-5"), Cpus({5}));
+}
+
+TEST(ParseCpuListTest, EmptyListsHaveNoCpus)
+{
+    EXPECT_EQ(parse(""), Cpus());
+    EXPECT_EQ(parse("\n"), Cpus());
+}
+
+TEST(ParseCpuListTest, RejectsMalformedLists)
+{
+    for (const char* list : {"a", "1-", "-1", "3-1", "1,,2", "1;2", "0-3,x"})
+    {
+        Cpus cpus{7};
+        EXPECT_FALSE(parseCpuList(list, cpus)) << list;
+        EXPECT_TRUE(cpus.empty()) << list;
+    }
+}
+
+TEST_F(CpuTopologyTest, NodesAndTheirCpus)
+{
+    const CpuTopology topology(dir.path());
+    EXPECT_EQ(topology.nodes(), Cpus({0, 1}));
+    EXPECT_EQ(topology.nodeCpus(0), Cpus({0, 1, 2, 3, 8, 9, 10, 11}));
+    EXPECT_EQ(topology.nodeCpus(1), Cpus({4, 5, 6, 7, 12, 13, 14, 15}));
+    EXPECT_EQ(topology.nodeCpus(2), Cpus());
+    EXPECT_EQ(topology.nodeCpus(-1), Cpus());
+}
+
+TEST_F(CpuTopologyTest, PciDevicesInEitherCase)
+{
+    const CpuTopology topology(dir.path());
+    EXPECT_EQ(topology.pciDeviceNode("0000:3b:00.0"), 1);
+    // cudaDeviceGetPCIBusId returns upper case hex digits, sysfs has lower case names
+    EXPECT_EQ(topology.pciDeviceNode("0000:3B:00.0"), 1);
+}
+
+TEST_F(CpuTopologyTest, UnknownDevicesHaveNoNode)
+{
+    const CpuTopology topology(dir.path());
+    EXPECT_EQ(topology.pciDeviceNode("0000:5e:00.0"), -1);
+    EXPECT_EQ(topology.pciDeviceNode("0000:af:00.0"), -1);
+    // no numa_node file
+    EXPECT_EQ(topology.pciDeviceNode("0000:d8:00.0"), -1);
+    EXPECT_EQ(topology.nodeCpus(topology.pciDeviceNode("0000:d8:00.0")), Cpus());
+}
+
+TEST(CpuTopologyFallbackTest, NoNodeDirectory)
+{
+    // a kernel without NUMA: the caller falls back to the CPUs of the process
+    TempDir dir;
+    dir.write("bus/pci/devices/0000:3b:00.0/numa_node", "0\n");
+    const CpuTopology topology(dir.path());
+    EXPECT_TRUE(topology.nodes().empty());
+    EXPECT_EQ(topology.nodeCpus(0), Cpus());
+    EXPECT_EQ(topology.pciDeviceNode("0000:3b:00.0"), -1);
+}
+
+TEST(CpuTopologyFallbackTest, SysfsRootFromTheEnvironment)
+{
+    const char* saved = getenv("BERT_SYSFS_ROOT");
+    const std::string previous = saved ? saved : "";
+    setenv("BERT_SYSFS_ROOT", "/tmp/fake_sys", 1);
+    EXPECT_EQ(CpuTopology::defaultSysfsRoot(), "/tmp/fake_sys");
+    setenv("BERT_SYSFS_ROOT", "", 1);
+    EXPECT_EQ(CpuTopology::defaultSysfsRoot(), "/sys");
+    if (saved)
+    {
+        setenv("BERT_SYSFS_ROOT", previous.c_str(), 1);
+    }
+    else
+    {
+        unsetenv("BERT_SYSFS_ROOT");
+    }
+}
+
+TEST(PinCurrentThreadTest, PinsToTheGivenCpus)
+{
+    Cpus cpus;
+    ASSERT_TRUE(currentThreadCpus(cpus));
+    ASSERT_FALSE(cpus.empty());
+    EXPECT_FALSE(pinCurrentThread(Cpus()));
+
+    // pin to the first allowed CPU and back to the whole set
+    ASSERT_TRUE(pinCurrentThread(Cpus({cpus[0]})));
+    Cpus pinned;
+    ASSERT_TRUE(currentThreadCpus(pinned));
+    EXPECT_EQ(pinned, Cpus({cpus[0]}));
+    ASSERT_TRUE(pinCurrentThread(cpus));
+    ASSERT_TRUE(currentThreadCpus(pinned));
+    EXPECT_EQ(pinned, cpus);
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "attentionKeys.h"
+#include "dataUtils.h"
+#include "half.h"
+#include "tempDir.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <sstream>
+
+using namespace bert;
+using nvinfer1::DataType;
+using nvinfer1::Weights;
+
+namespace
+{
+const std::string kPREFIX = "l0_attention_self_";
+const std::string kDENSE = "l0_attention_output_dense_kernel";
+const std::string kSQUAD = "cls_squad_output_weights";
+const std::string kGAMMA = "bert_embeddings_layernorm_gamma";
+
+//! \brief One row of a weights file: name, dimensions and row major fp32 values
+struct Tensor
+{
+    std::string name;
+    std::vector<int> dims;
+    std::vector<float> values;
+};
+
+//! \brief rows x cols tensor with values exact in fp16, distinct per seed
+Tensor matrix(const std::string& name, int rows, int cols, int seed)
+{
+    Tensor t{name, {rows, cols}, std::vector<float>(rows * cols)};
+    for (size_t i = 0; i < t.values.size(); i++)
+    {
+        t.values[i] = 0.25f * static_cast<int>((i * 7 + seed * 13) % 64) - 8.f;
+    }
+    return t;
+}
+
+Tensor bias(const std::string& name, int n, int seed)
+{
+    Tensor t = matrix(name, 1, n, seed);
+    t.dims = {n};
+    return t;
+}
+
+//! \brief The format of helpers/convert_weights.py: a count, then "name type nbDims dims... " and the raw values
+std::string weightsFile(const std::vector<Tensor>& tensors)
+{
+    std::ostringstream out;
+    out << tensors.size() << "\n";
+    for (const Tensor& t : tensors)
+    {
+        out << t.name << " " << static_cast<int>(DataType::kFLOAT) << " " << t.dims.size();
+        for (int d : t.dims)
+        {
+            out << " " << d;
+        }
+        out << " ";
+        out.write(reinterpret_cast<const char*>(t.values.data()), t.values.size() * sizeof(float));
+        out << "\n";
+    }
+    return out.str();
+}
+
+std::vector<float> transposed(const Tensor& t)
+{
+    const int rows = t.dims[0];
+    const int cols = t.dims[1];
+    std::vector<float> out(t.values.size());
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < cols; c++)
+        {
+            out[c * rows + r] = t.values[r * cols + c];
+        }
+    }
+    return out;
+}
+
+std::vector<float> floats(const Weights& w)
+{
+    EXPECT_EQ(w.type, DataType::kFLOAT);
+    const float* p = static_cast<const float*>(w.values);
+    return std::vector<float>(p, p + w.count);
+}
+
+std::vector<float> halves(const Weights& w)
+{
+    EXPECT_EQ(w.type, DataType::kHALF);
+    const half_float::half* p = static_cast<const half_float::half*>(w.values);
+    return std::vector<float>(p, p + w.count);
+}
+
+//! \brief q/k/v kernels (4 x 3) and biases, a dense kernel larger than one transpose block with 4x4 tails, the squad
+//! weights (fp16 but not transposed) and a vector left as is. Loaded with 1 and 4 preparation threads.
+class LoadWeightsTest : public ::testing::TestWithParam<int>
+{
+protected:
+    LoadWeightsTest()
+        : tensors{matrix(kPREFIX + WQ, 4, 3, 1), matrix(kPREFIX + WK, 4, 3, 2), matrix(kPREFIX + WV, 4, 3, 3),
+            bias(kPREFIX + BQ, 3, 4), bias(kPREFIX + BK, 3, 5), bias(kPREFIX + BV, 3, 6),
+            matrix(kDENSE, 70, 67, 7), matrix(kSQUAD, 2, 5, 8), bias(kGAMMA, 5, 9)}
+    {
+        path = dir.write("weights.bin", weightsFile(tensors));
+    }
+
+    WeightMap load(bool fp16Kernels)
+    {
+        WeightPrepOptions options;
+        options.fp16Kernels = fp16Kernels;
+        options.numThreads = GetParam();
+        WeightMap weightMap;
+        loadWeights(path, weightMap, options, &storage);
+        return weightMap;
+    }
+
+    const Tensor& tensor(const std::string& name) const
+    {
+        for (const Tensor& t : tensors)
+        {
+            if (t.name == name)
+            {
+                return t;
+            }
+        }
+        throw std::out_of_range(name);
+    }
+
+    //! \brief Naive fused tensor: the transposed (kernels) or plain (biases) q, k and v one after the other
+    std::vector<float> fused(const std::string& q, const std::string& k, const std::string& v, bool kernels) const
+    {
+        std::vector<float> out;
+        for (const std::string* name : {&q, &k, &v})
+        {
+            const Tensor& t = tensor(kPREFIX + *name);
+            const std::vector<float> part = kernels ? transposed(t) : t.values;
+            out.insert(out.end(), part.begin(), part.end());
+        }
+        return out;
+    }
+
+    TempDir dir;
+    std::string path;
+    std::vector<Tensor> tensors;
+    WeightStorage storage;
+};
+} // namespace
+
+TEST_P(LoadWeightsTest, KernelsAreTransposed)
+{
+    const WeightMap weightMap = load(false);
+    EXPECT_EQ(floats(weightMap.at(kDENSE)), transposed(tensor(kDENSE)));
+    EXPECT_EQ(floats(weightMap.at(kSQUAD)), tensor(kSQUAD).values);
+    EXPECT_EQ(floats(weightMap.at(kGAMMA)), tensor(kGAMMA).values);
+    EXPECT_EQ(weightMap.at(kDENSE).count, 70 * 67);
+}
+
+TEST_P(LoadWeightsTest, QkvIsFusedAndAliased)
+{
+    const WeightMap weightMap = load(false);
+    const Weights& w = weightMap.at(kPREFIX + WQKV);
+    const Weights& b = weightMap.at(kPREFIX + BQKV);
+    EXPECT_EQ(floats(w), fused(WQ, WK, WV, true));
+    EXPECT_EQ(floats(b), fused(BQ, BK, BV, false));
+
+    // the separate weights are views of their slot
+    const float* wAll = static_cast<const float*>(w.values);
+    const float* bAll = static_cast<const float*>(b.values);
+    const std::string kernels[3] = {WQ, WK, WV};
+    const std::string biases[3] = {BQ, BK, BV};
+    for (int i = 0; i < 3; i++)
+    {
+        SCOPED_TRACE(kernels[i]);
+        EXPECT_EQ(weightMap.at(kPREFIX + kernels[i]).values, wAll + i * 12);
+        EXPECT_EQ(weightMap.at(kPREFIX + kernels[i]).count, 12);
+        EXPECT_EQ(weightMap.at(kPREFIX + biases[i]).values, bAll + i * 3);
+        EXPECT_EQ(weightMap.at(kPREFIX + biases[i]).count, 3);
+    }
+    EXPECT_EQ(weightMap.size(), tensors.size() + 2);
+}
+
+TEST_P(LoadWeightsTest, Fp16KernelsConvertsFullyConnectedKernelsOnly)
+{
+    const WeightMap weightMap = load(true);
+    EXPECT_EQ(halves(weightMap.at(kDENSE)), transposed(tensor(kDENSE)));
+    EXPECT_EQ(halves(weightMap.at(kSQUAD)), tensor(kSQUAD).values);
+    EXPECT_EQ(halves(weightMap.at(kPREFIX + WQKV)), fused(WQ, WK, WV, true));
+    EXPECT_EQ(floats(weightMap.at(kPREFIX + BQKV)), fused(BQ, BK, BV, false));
+    EXPECT_EQ(floats(weightMap.at(kGAMMA)), tensor(kGAMMA).values);
+
+    // the fp32 q/k/v kernel views are gone with the fp32 fused kernel, the bias views stay
+    EXPECT_EQ(weightMap.count(kPREFIX + WQ), 0u);
+    EXPECT_EQ(weightMap.count(kPREFIX + WK), 0u);
+    EXPECT_EQ(weightMap.count(kPREFIX + WV), 0u);
+    EXPECT_EQ(floats(weightMap.at(kPREFIX + BK)), tensor(kPREFIX + BK).values);
+}
+
+TEST_P(LoadWeightsTest, StorageOwnsEveryBuffer)
+{
+    const WeightMap weightMap = load(true);
+    std::set<const void*> owned;
+    for (const auto& p : storage)
+    {
+        owned.insert(p.get());
+    }
+    for (const auto& kv : weightMap)
+    {
+        if (kv.first != kPREFIX + BK && kv.first != kPREFIX + BV)
+        {
+            EXPECT_EQ(owned.count(kv.second.values), 1u) << kv.first;
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(Threads, LoadWeightsTest, ::testing::Values(1, 4));
+
+TEST(ConvertToHalfTest, MatchesTheScalarConversion)
+{
+    // lengths around the 8-wide vector loop, values that round in both directions and overflow
+    for (size_t n : {1u, 7u, 8u, 9u, 33u})
+    {
+        std::vector<float> src(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            src[i] = (i % 2 ? -1.f : 1.f) * (1.f + i / 3072.f) * (i == 5 ? 1e6f : 1.f);
+        }
+        std::vector<uint16_t> dst(n);
+        convertToHalf(src.data(), dst.data(), n);
+        for (size_t i = 0; i < n; i++)
+        {
+            EXPECT_EQ(dst[i], half_float::detail::float2half<std::round_to_nearest>(src[i])) << n << " at " << i;
+        }
+    }
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver.h"
+#include "hostDeviceOps.h"
+#include <gtest/gtest.h>
+
+using namespace bert;
+using nvinfer1::DataType;
+
+namespace
+{
+typedef HostDeviceOps::Op Op;
+
+constexpr size_t kCOUNT = 64;
+
+cudaStream_t testStream()
+{
+    return reinterpret_cast<cudaStream_t>(0x5);
+}
+
+//! \brief Driver with two host bindings, "input_ids" (int32) and "output" (float). Its engine doubles the input.
+class HostDriver : public Driver
+{
+public:
+    explicit HostDriver(HostDeviceOps& ops)
+        : Driver(1, false, 0)
+        , mOps(ops)
+    {
+        setDeviceOps(&ops);
+        mBuffers.push_back(ops.deviceMalloc(kCOUNT * sizeof(int32_t)));
+        mBuffers.push_back(ops.deviceMalloc(kCOUNT * sizeof(float)));
+    }
+
+    ~HostDriver() override
+    {
+        // Driver frees its bindings with cudaFree
+        for (void* buffer : mBuffers)
+        {
+            mDeviceOps->deviceFree(buffer);
+        }
+        mBuffers.clear();
+    }
+
+    int getBindingIndex(const std::string& name, DataType type) const override
+    {
+        if (name == "input_ids" && type == DataType::kINT32)
+        {
+            return 0;
+        }
+        if (name == "output" && type == DataType::kFLOAT)
+        {
+            return 1;
+        }
+        ADD_FAILURE() << "unexpected binding " << name;
+        return -1;
+    }
+
+    void infer(const int batchSize, cudaStream_t stream) override
+    {
+        mOps.enqueue(stream);
+        const int32_t* in = static_cast<const int32_t*>(mBuffers[0]);
+        float* out = static_cast<float*>(mBuffers[1]);
+        for (size_t i = 0; i < kCOUNT; i++)
+        {
+            out[i] = 2.f * in[i];
+        }
+    }
+
+private:
+    HostDeviceOps& mOps;
+};
+
+class DriverRunTest : public ::testing::Test
+{
+protected:
+    DriverRunTest()
+        : ids(kCOUNT)
+        , output(kCOUNT, -1.f)
+    {
+        for (size_t i = 0; i < kCOUNT; i++)
+        {
+            ids[i] = static_cast<int32_t>(i) + 1;
+        }
+        inputs["input_ids"] = std::make_shared<HostTensor>(ids.data(), DataType::kINT32, std::vector<size_t>{kCOUNT});
+        outputs["output"] = std::make_shared<HostTensor>(output.data(), DataType::kFLOAT, std::vector<size_t>{kCOUNT});
+    }
+
+    void expectDoubled() const
+    {
+        for (size_t i = 0; i < kCOUNT; i++)
+        {
+            ASSERT_EQ(output[i], 2.f * ids[i]) << "at " << i;
+        }
+    }
+
+    // declared before the driver: the driver's event pool destroys its events through it
+    HostDeviceOps ops;
+    std::vector<int32_t> ids;
+    std::vector<float> output;
+    HostTensorMap inputs;
+    HostTensorMap outputs;
+};
+} // namespace
+
+TEST_F(DriverRunTest, UntimedRunCopiesEnqueuesAndSyncsTheStreamOnly)
+{
+    HostDriver driver(ops);
+    const size_t first = ops.calls.size();
+    driver.run(inputs, outputs, 1, testStream());
+
+    const std::vector<Op> expected{HostDeviceOps::kH2D, HostDeviceOps::kENQUEUE, HostDeviceOps::kD2H,
+        HostDeviceOps::kSTREAM_SYNC};
+    EXPECT_EQ(ops.ops(first), expected);
+    for (size_t i = first; i < ops.calls.size(); i++)
+    {
+        EXPECT_EQ(ops.calls[i].stream, testStream());
+    }
+    EXPECT_EQ(ops.calls[first].len, kCOUNT * sizeof(int32_t));
+    EXPECT_EQ(ops.calls[first + 2].target, output.data());
+    EXPECT_EQ(ops.calls[first + 2].len, kCOUNT * sizeof(float));
+    EXPECT_EQ(ops.liveEvents(), 0);
+    expectDoubled();
+}
+
+TEST_F(DriverRunTest, TimedRunsReusePooledEvents)
+{
+    HostDriver driver(ops);
+    RunTimes times;
+    std::vector<const void*> recorded[2];
+    for (int run = 0; run < 2; run++)
+    {
+        const size_t first = ops.calls.size();
+        driver.run(inputs, outputs, 1, testStream(), &times);
+
+        std::vector<Op> expected;
+        if (run == 0)
+        {
+            expected.assign(4, HostDeviceOps::kEVENT_CREATE);
+        }
+        const std::vector<Op> timed{HostDeviceOps::kEVENT_RECORD, HostDeviceOps::kH2D, HostDeviceOps::kEVENT_RECORD,
+            HostDeviceOps::kENQUEUE, HostDeviceOps::kEVENT_RECORD, HostDeviceOps::kD2H, HostDeviceOps::kEVENT_RECORD,
+            HostDeviceOps::kSTREAM_SYNC, HostDeviceOps::kEVENT_ELAPSED, HostDeviceOps::kEVENT_ELAPSED};
+        expected.insert(expected.end(), timed.begin(), timed.end());
+        EXPECT_EQ(ops.ops(first), expected) << "run " << run;
+
+        for (size_t i = first; i < ops.calls.size(); i++)
+        {
+            if (ops.calls[i].op == HostDeviceOps::kEVENT_RECORD)
+            {
+                recorded[run].push_back(ops.calls[i].target);
+            }
+        }
+        // the elapsed times are the distances between the records: one call inside compute, five in total
+        EXPECT_EQ(times.msCompute, 2.f);
+        EXPECT_EQ(times.msTotal, 6.f);
+        expectDoubled();
+    }
+    EXPECT_EQ(recorded[0], recorded[1]);
+    EXPECT_EQ(ops.liveEvents(), 4);
+}
+
+TEST_F(DriverRunTest, BindingRunSkipsNegativeIndices)
+{
+    HostDriver driver(ops);
+    const HostBinding in[2] = {HostBinding{0, ids.data(), kCOUNT * sizeof(int32_t)}, HostBinding{-1, nullptr, 0}};
+    const HostBinding out[2] = {HostBinding{-1, nullptr, 0}, HostBinding{1, output.data(), kCOUNT * sizeof(float)}};
+    const size_t first = ops.calls.size();
+    driver.run(in, 2, out, 2, 1, testStream());
+
+    const std::vector<Op> expected{HostDeviceOps::kH2D, HostDeviceOps::kENQUEUE, HostDeviceOps::kD2H,
+        HostDeviceOps::kSTREAM_SYNC};
+    EXPECT_EQ(ops.ops(first), expected);
+    EXPECT_EQ(ops.calls[first].len, kCOUNT * sizeof(int32_t));
+    EXPECT_EQ(ops.calls[first + 2].target, output.data());
+    EXPECT_EQ(ops.calls[first + 3].stream, testStream());
+    EXPECT_EQ(ops.liveEvents(), 0);
+    expectDoubled();
+}
+
+TEST_F(DriverRunTest, PooledEventsAndBuffersAreReleased)
+{
+    {
+        HostDriver driver(ops);
+        RunTimes times;
+        driver.run(inputs, outputs, 1, testStream(), &times);
+        EXPECT_EQ(ops.liveEvents(), 4);
+    }
+    EXPECT_EQ(ops.liveEvents(), 0);
+    EXPECT_EQ(ops.liveBuffers(), 0);
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_HOST_DEVICE_OPS_H
+#define TRT_HOST_DEVICE_OPS_H
+
+#include "deviceOps.h"
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief DeviceOps on host memory that records every call, so the run and calibration paths execute without a GPU
+//! \details Device buffers are malloc'ed and copies are plain memcpys. An event holds the index of the call that last
+//! recorded it, so eventElapsedMs returns the number of calls between two events.
+class HostDeviceOps : public DeviceOps
+{
+public:
+    enum Op
+    {
+        kMALLOC,
+        kFREE,
+        kH2D,
+        kD2H,
+        kEVENT_CREATE,
+        kEVENT_DESTROY,
+        kEVENT_RECORD,
+        kEVENT_ELAPSED,
+        kSTREAM_SYNC,
+        kENQUEUE, //!< recorded by the fake engines of the tests, see enqueue
+    };
+
+    struct Call
+    {
+        Op op;
+        const void* target; //!< buffer, destination of a copy or event
+        size_t len;
+        cudaStream_t stream;
+    };
+
+    std::vector<Call> calls;
+
+    void* deviceMalloc(size_t len) override
+    {
+        void* ptr = malloc(len);
+        record(kMALLOC, ptr, len);
+        mLiveBuffers++;
+        return ptr;
+    }
+
+    void deviceFree(void* ptr) override
+    {
+        record(kFREE, ptr);
+        mLiveBuffers--;
+        free(ptr);
+    }
+
+    void memcpyH2D(void* dst, const void* src, size_t len, cudaStream_t stream) override
+    {
+        record(kH2D, dst, len, stream);
+        memcpy(dst, src, len);
+    }
+
+    void memcpyD2H(void* dst, const void* src, size_t len, cudaStream_t stream) override
+    {
+        record(kD2H, dst, len, stream);
+        memcpy(dst, src, len);
+    }
+
+    void eventCreate(cudaEvent_t* event) override
+    {
+        *event = reinterpret_cast<cudaEvent_t>(new size_t(0));
+        record(kEVENT_CREATE, *event);
+        mLiveEvents++;
+    }
+
+    void eventDestroy(cudaEvent_t event) override
+    {
+        record(kEVENT_DESTROY, event);
+        mLiveEvents--;
+        delete reinterpret_cast<size_t*>(event);
+    }
+
+    void eventRecord(cudaEvent_t event, cudaStream_t stream) override
+    {
+        *reinterpret_cast<size_t*>(event) = calls.size();
+        record(kEVENT_RECORD, event, 0, stream);
+    }
+
+    float eventElapsedMs(cudaEvent_t start, cudaEvent_t stop) override
+    {
+        record(kEVENT_ELAPSED, stop);
+        return static_cast<float>(*reinterpret_cast<size_t*>(stop)) - *reinterpret_cast<size_t*>(start);
+    }
+
+    void streamSynchronize(cudaStream_t stream) override
+    {
+        record(kSTREAM_SYNC, nullptr, 0, stream);
+    }
+
+    //! \brief Marks the point where an engine would have been enqueued on \p stream
+    void enqueue(cudaStream_t stream)
+    {
+        record(kENQUEUE, nullptr, 0, stream);
+    }
+
+    //! \brief Operations of the calls since \p first
+    std::vector<Op> ops(size_t first = 0) const
+    {
+        std::vector<Op> result;
+        for (size_t i = first; i < calls.size(); i++)
+        {
+            result.push_back(calls[i].op);
+        }
+        return result;
+    }
+
+    int liveBuffers() const
+    {
+        return mLiveBuffers;
+    }
+
+    int liveEvents() const
+    {
+        return mLiveEvents;
+    }
+
+private:
+    void record(Op op, const void* target, size_t len = 0, cudaStream_t stream = nullptr)
+    {
+        calls.push_back(Call{op, target, len, stream});
+    }
+
+    int mLiveBuffers{0};
+    int mLiveEvents{0};
+};
+}
+
+#endif // TRT_HOST_DEVICE_OPS_H
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "localTransport.h"
+#include "tempDir.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <gtest/gtest.h>
+
+using namespace bert;
+
+namespace
+{
+constexpr int kB = 2;
+constexpr int kS = 3;
+constexpr int kCOUNT = kB * kS;
+
+//! \brief Input ids, segment ids and input mask of a request, derived from \p seed
+std::vector<int32_t> inputs(int seed)
+{
+    std::vector<int32_t> v(3 * kCOUNT);
+    for (int i = 0; i < kCOUNT; i++)
+    {
+        v[i] = seed * 100 + i;
+        v[kCOUNT + i] = i % 2;
+        v[2 * kCOUNT + i] = i % kS != kS - 1;
+    }
+    return v;
+}
+
+LocalRequestHeader inferHeader(uint32_t op, uint64_t requestId)
+{
+    LocalRequestHeader header{};
+    header.op = op;
+    header.requestId = requestId;
+    header.batchSize = kB;
+    header.seqLength = kS;
+    header.outputMask = 3;
+    return header;
+}
+
+//! \brief A server on a socket of a temporary directory whose handler queues the requests for the test to reply
+class LocalTransportTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ASSERT_TRUE(server.start(
+            path, kB, kS,
+            [this](LocalRequest* request) {
+                std::lock_guard<std::mutex> lock(mutex);
+                requests.push_back(request);
+                changed.notify_all();
+            },
+            [this](LocalConnection&) {
+                std::lock_guard<std::mutex> lock(mutex);
+                closes++;
+                changed.notify_all();
+            }));
+        ASSERT_TRUE(client.connect(path));
+    }
+
+    void TearDown() override
+    {
+        for (LocalRequest* request : requests)
+        {
+            server.reply(request, kLOCAL_UNAVAILABLE);
+        }
+        server.stop();
+    }
+
+    //! \brief The next request handed to the handler, null if none comes within 5 s
+    LocalRequest* next()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!changed.wait_for(lock, std::chrono::seconds(5), [this] { return !requests.empty(); }))
+        {
+            return nullptr;
+        }
+        LocalRequest* request = requests.front();
+        requests.pop_front();
+        return request;
+    }
+
+    //! \brief Replies the outputs of a request: its input ids as floats, then their negation
+    void replyOutputs(LocalRequest* request)
+    {
+        std::vector<float> start(request->inputIds, request->inputIds + kCOUNT);
+        std::vector<float> end(kCOUNT);
+        for (int i = 0; i < kCOUNT; i++)
+        {
+            end[i] = -start[i];
+        }
+        iovec outputs[2] = {{start.data(), start.size() * sizeof(float)}, {end.data(), end.size() * sizeof(float)}};
+        server.reply(request, kLOCAL_OK, outputs, 2);
+    }
+
+    static void expectOutputs(const float* outputs, int seed)
+    {
+        for (int i = 0; i < kCOUNT; i++)
+        {
+            EXPECT_EQ(outputs[i], seed * 100 + i) << i;
+            EXPECT_EQ(outputs[kCOUNT + i], -(seed * 100 + i)) << i;
+        }
+    }
+
+    static void expectInputs(const LocalRequest& request, const std::vector<int32_t>& expected)
+    {
+        EXPECT_EQ(std::vector<int32_t>(request.inputIds, request.inputIds + kCOUNT),
+            std::vector<int32_t>(expected.begin(), expected.begin() + kCOUNT));
+        EXPECT_EQ(std::vector<int32_t>(request.segmentIds, request.segmentIds + kCOUNT),
+            std::vector<int32_t>(expected.begin() + kCOUNT, expected.begin() + 2 * kCOUNT));
+        EXPECT_EQ(std::vector<int32_t>(request.inputMask, request.inputMask + kCOUNT),
+            std::vector<int32_t>(expected.begin() + 2 * kCOUNT, expected.end()));
+    }
+
+    //! \brief Sends a request the server must reject itself, without handing it to the handler
+    void expectRejected(const LocalRequestHeader& header, const void* payload)
+    {
+        ASSERT_TRUE(client.send(header, payload));
+        LocalReplyHeader reply;
+        ASSERT_TRUE(client.receive(reply));
+        EXPECT_EQ(reply.status, kLOCAL_BAD_REQUEST);
+        EXPECT_EQ(reply.requestId, header.requestId);
+        EXPECT_EQ(reply.nbBytes, 0u);
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_TRUE(requests.empty());
+    }
+
+    TempDir dir;
+    std::string path = dir.file("bert.sock");
+    LocalServer server;
+    LocalClient client;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<LocalRequest*> requests;
+    int closes{0};
+};
+} // namespace
+
+TEST_F(LocalTransportTest, ConnectFetchesTheDimensions)
+{
+    EXPECT_EQ(client.batchSize(), kB);
+    EXPECT_EQ(client.seqLength(), kS);
+}
+
+TEST_F(LocalTransportTest, InlineRoundTrip)
+{
+    const std::vector<int32_t> in = inputs(1);
+    ASSERT_TRUE(client.send(inferHeader(kLOCAL_INFER, 11), in.data()));
+    LocalRequest* request = next();
+    ASSERT_NE(request, nullptr);
+    EXPECT_EQ(request->header.requestId, 11u);
+    EXPECT_EQ(request->header.outputMask, 3u);
+    EXPECT_EQ(request->slot, nullptr);
+    expectInputs(*request, in);
+    replyOutputs(request);
+
+    LocalReplyHeader reply;
+    std::vector<float> outputs(2 * kCOUNT);
+    ASSERT_TRUE(client.receive(reply, outputs.data(), outputs.size() * sizeof(float)));
+    EXPECT_EQ(reply.status, kLOCAL_OK);
+    EXPECT_EQ(reply.requestId, 11u);
+    EXPECT_EQ(reply.batchSize, kB);
+    EXPECT_EQ(reply.seqLength, kS);
+    ASSERT_EQ(reply.nbBytes, outputs.size() * sizeof(float));
+    expectOutputs(outputs.data(), 1);
+}
+
+TEST_F(LocalTransportTest, RingRoundTrip)
+{
+    const size_t inputBytes = localInputBytes(kB, kS);
+    const size_t slotBytes = inputBytes + 2 * kCOUNT * sizeof(float);
+    ASSERT_TRUE(client.mapRing(4, slotBytes));
+
+    // two requests in flight in different slots, replied out of order
+    for (uint32_t slot : {1u, 3u})
+    {
+        const std::vector<int32_t> in = inputs(slot);
+        memcpy(client.slot(slot), in.data(), inputBytes);
+        LocalRequestHeader header = inferHeader(kLOCAL_RING_INFER, 20 + slot);
+        header.slot = slot;
+        ASSERT_TRUE(client.send(header));
+    }
+    LocalRequest* first = next();
+    LocalRequest* second = next();
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    for (LocalRequest* request : {second, first})
+    {
+        ASSERT_NE(request->slot, nullptr);
+        expectInputs(*request, inputs(request->header.slot));
+        EXPECT_EQ(server.outputCapacity(request), slotBytes - inputBytes);
+        replyOutputs(request);
+    }
+
+    for (uint32_t expectedSlot : {3u, 1u})
+    {
+        LocalReplyHeader reply;
+        ASSERT_TRUE(client.receive(reply));
+        EXPECT_EQ(reply.status, kLOCAL_OK);
+        EXPECT_EQ(reply.slot, expectedSlot);
+        EXPECT_EQ(reply.requestId, 20 + expectedSlot);
+        ASSERT_EQ(reply.nbBytes, 2 * kCOUNT * sizeof(float));
+        // the outputs follow the inputs, which are left as they were
+        expectOutputs(reinterpret_cast<const float*>(client.slot(expectedSlot) + inputBytes), expectedSlot);
+        const std::vector<int32_t> in = inputs(expectedSlot);
+        EXPECT_EQ(memcmp(client.slot(expectedSlot), in.data(), inputBytes), 0);
+    }
+}
+
+TEST_F(LocalTransportTest, RejectsBadSlots)
+{
+    // no ring mapped yet
+    LocalRequestHeader header = inferHeader(kLOCAL_RING_INFER, 30);
+    expectRejected(header, nullptr);
+
+    ASSERT_TRUE(client.mapRing(2, localInputBytes(kB, kS)));
+    header.slot = 2;
+    expectRejected(header, nullptr);
+    header.slot = UINT32_MAX;
+    expectRejected(header, nullptr);
+}
+
+TEST_F(LocalTransportTest, RejectsOtherShapes)
+{
+    const std::vector<int32_t> in = inputs(2);
+    LocalRequestHeader header = inferHeader(kLOCAL_INFER, 40);
+    header.batchSize = 1;
+    expectRejected(header, in.data());
+
+    header.batchSize = kB;
+    header.seqLength = kS - 1;
+    expectRejected(header, in.data());
+
+    // the right dimensions but a payload cut short
+    header.seqLength = kS;
+    ASSERT_TRUE(client.send(header, nullptr));
+    LocalReplyHeader reply;
+    ASSERT_TRUE(client.receive(reply));
+    EXPECT_EQ(reply.status, kLOCAL_BAD_REQUEST);
+
+    header.op = 99;
+    expectRejected(header, in.data());
+}
+
+TEST_F(LocalTransportTest, RejectsOutputsLargerThanTheSlot)
+{
+    const size_t inputBytes = localInputBytes(kB, kS);
+    ASSERT_TRUE(client.mapRing(1, inputBytes + kCOUNT * sizeof(float)));
+    const std::vector<int32_t> in = inputs(3);
+    memcpy(client.slot(0), in.data(), inputBytes);
+    ASSERT_TRUE(client.send(inferHeader(kLOCAL_RING_INFER, 50)));
+    LocalRequest* request = next();
+    ASSERT_NE(request, nullptr);
+    EXPECT_EQ(server.outputCapacity(request), kCOUNT * sizeof(float));
+    // two outputs of kCOUNT floats do not fit
+    replyOutputs(request);
+
+    LocalReplyHeader reply;
+    ASSERT_TRUE(client.receive(reply));
+    EXPECT_EQ(reply.status, kLOCAL_BAD_REQUEST);
+    EXPECT_EQ(reply.nbBytes, 0u);
+    EXPECT_EQ(memcmp(client.slot(0), in.data(), inputBytes), 0);
+}
+
+TEST_F(LocalTransportTest, ClientDisconnectingMidRequest)
+{
+    std::unique_ptr<LocalClient> leaving(new LocalClient);
+    ASSERT_TRUE(leaving->connect(path));
+    ASSERT_TRUE(leaving->mapRing(2, localInputBytes(kB, kS) + 2 * kCOUNT * sizeof(float)));
+    const std::vector<int32_t> in = inputs(4);
+    memcpy(leaving->slot(1), in.data(), in.size() * sizeof(int32_t));
+    LocalRequestHeader header = inferHeader(kLOCAL_RING_INFER, 60);
+    header.slot = 1;
+    ASSERT_TRUE(leaving->send(header));
+    ASSERT_TRUE(leaving->send(inferHeader(kLOCAL_INFER, 61), in.data()));
+    LocalRequest* ringRequest = next();
+    LocalRequest* inlineRequest = next();
+    ASSERT_NE(ringRequest, nullptr);
+    ASSERT_NE(inlineRequest, nullptr);
+
+    leaving.reset();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(5), [this] { return closes == 1; }));
+    }
+    // the requests in flight keep the connection and its ring until they are replied
+    EXPECT_TRUE(ringRequest->connection->closed);
+    expectInputs(*ringRequest, in);
+    replyOutputs(ringRequest);
+    replyOutputs(inlineRequest);
+
+    // the other clients are served as before
+    ASSERT_TRUE(client.send(inferHeader(kLOCAL_INFER, 62), in.data()));
+    LocalRequest* request = next();
+    ASSERT_NE(request, nullptr);
+    replyOutputs(request);
+    LocalReplyHeader reply;
+    std::vector<float> outputs(2 * kCOUNT);
+    ASSERT_TRUE(client.receive(reply, outputs.data(), outputs.size() * sizeof(float)));
+    EXPECT_EQ(reply.requestId, 62u);
+    expectOutputs(outputs.data(), 4);
+}
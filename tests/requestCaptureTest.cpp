@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "requestCapture.h"
+#include "tempDir.h"
+#include <gtest/gtest.h>
+
+using namespace bert;
+
+namespace
+{
+constexpr int kB = 2;
+constexpr int kS = 3;
+
+//! \brief A 2 x 3 request whose values and arrival time are derived from \p index
+struct Request
+{
+    explicit Request(int index)
+        : inputIds(kB * kS)
+        , segmentIds(kB * kS)
+        , inputMask(kB * kS)
+    {
+        header.batchSize = kB;
+        header.seqLength = kS;
+        header.latencyUs = 100 + index;
+        header.arrivalUs = 1000000 + index;
+        for (int i = 0; i < kB * kS; i++)
+        {
+            inputIds[i] = (index * 131 + i * 7) % 30000;
+            segmentIds[i] = i % kS >= 1;
+            inputMask[i] = i % kS != kS - 1;
+        }
+    }
+
+    bool submitTo(RequestCapture& capture) const
+    {
+        return capture.submit(header, inputIds.data(), segmentIds.data(), inputMask.data());
+    }
+
+    CaptureRecordHeader header;
+    std::vector<int32_t> inputIds;
+    std::vector<int32_t> segmentIds;
+    std::vector<int32_t> inputMask;
+};
+
+void expectRecord(const CaptureRecord& record, const Request& request)
+{
+    EXPECT_EQ(record.header.batchSize, kB);
+    EXPECT_EQ(record.header.seqLength, kS);
+    EXPECT_EQ(record.header.latencyUs, request.header.latencyUs);
+    EXPECT_EQ(record.header.arrivalUs, request.header.arrivalUs);
+    EXPECT_EQ(record.inputIds, request.inputIds);
+    EXPECT_EQ(record.segmentIds, request.segmentIds);
+    EXPECT_EQ(record.inputMask, request.inputMask);
+}
+
+std::vector<CaptureRecord> readAll(const std::string& path)
+{
+    CaptureReader reader;
+    EXPECT_TRUE(reader.open(path));
+    std::vector<CaptureRecord> records;
+    CaptureRecord record;
+    while (reader.next(record))
+    {
+        records.push_back(record);
+    }
+    return records;
+}
+
+class RequestCaptureTest : public ::testing::Test
+{
+protected:
+    TempDir dir;
+    std::string path = dir.file("requests.cap");
+    RequestCapture capture;
+};
+} // namespace
+
+TEST_F(RequestCaptureTest, RecordsAreReadBackInSubmissionOrder)
+{
+    ASSERT_TRUE(capture.start(path, 1.0, 8));
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_TRUE(Request(i).submitTo(capture));
+    }
+    capture.stop();
+    EXPECT_EQ(capture.captured(), 5u);
+    EXPECT_EQ(capture.dropped(), 0u);
+
+    const std::vector<CaptureRecord> records = readAll(path);
+    ASSERT_EQ(records.size(), 5u);
+    for (int i = 0; i < 5; i++)
+    {
+        SCOPED_TRACE(i);
+        expectRecord(records[i], Request(i));
+    }
+}
+
+TEST_F(RequestCaptureTest, AFullRingDropsAndCounts)
+{
+    // the writer drains every 50 ms, submitting in a loop fills two slots long before that
+    ASSERT_TRUE(capture.start(path, 1.0, 2));
+    int submitted = 0;
+    while (capture.dropped() == 0 && submitted < 100000)
+    {
+        Request(submitted++).submitTo(capture);
+    }
+    capture.stop();
+    ASSERT_GT(capture.dropped(), 0u);
+    EXPECT_EQ(capture.captured() + capture.dropped(), static_cast<uint64_t>(submitted));
+
+    // what was captured is intact and in order
+    const std::vector<CaptureRecord> records = readAll(path);
+    ASSERT_EQ(records.size(), capture.captured());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const int index = static_cast<int>(records[i].header.arrivalUs - 1000000);
+        SCOPED_TRACE(index);
+        expectRecord(records[i], Request(index));
+        if (i > 0)
+        {
+            EXPECT_GT(records[i].header.arrivalUs, records[i - 1].header.arrivalUs);
+        }
+    }
+}
+
+TEST_F(RequestCaptureTest, ValuesOutOfTheEncodingAreDropped)
+{
+    ASSERT_TRUE(capture.start(path, 1.0, 8));
+    Request tooLarge(0);
+    tooLarge.inputIds[2] = 70000;
+    EXPECT_FALSE(tooLarge.submitTo(capture));
+    // its slot is published empty and skipped by the writer
+    for (int i = 1; i <= 4; i++)
+    {
+        EXPECT_TRUE(Request(i).submitTo(capture));
+    }
+    capture.stop();
+    EXPECT_EQ(capture.captured(), 4u);
+    EXPECT_EQ(capture.dropped(), 1u);
+
+    const std::vector<CaptureRecord> records = readAll(path);
+    ASSERT_EQ(records.size(), 4u);
+    expectRecord(records[0], Request(1));
+}
+
+TEST_F(RequestCaptureTest, NothingIsQueuedWhileStopped)
+{
+    EXPECT_FALSE(capture.enabled());
+    EXPECT_FALSE(capture.sample());
+    EXPECT_FALSE(Request(0).submitTo(capture));
+
+    ASSERT_TRUE(capture.start(path, 1.0, 4));
+    EXPECT_TRUE(Request(1).submitTo(capture));
+    capture.stop();
+    EXPECT_FALSE(Request(2).submitTo(capture));
+    EXPECT_EQ(capture.captured(), 1u);
+    EXPECT_EQ(capture.dropped(), 0u);
+    EXPECT_EQ(readAll(path).size(), 1u);
+}
+
+TEST_F(RequestCaptureTest, SampleRatesZeroAndOne)
+{
+    ASSERT_TRUE(capture.start(path, 0.0, 4));
+    for (int i = 0; i < 1000; i++)
+    {
+        ASSERT_FALSE(capture.sample());
+    }
+    capture.stop();
+
+    RequestCapture all;
+    ASSERT_TRUE(all.start(dir.file("all.cap"), 1.0, 4));
+    for (int i = 0; i < 1000; i++)
+    {
+        ASSERT_TRUE(all.sample());
+    }
+    EXPECT_FALSE(all.start(dir.file("again.cap"), 1.0, 4));
+}
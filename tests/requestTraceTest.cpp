@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "json.hpp"
+#include "requestTrace.h"
+#include <gtest/gtest.h>
+
+using namespace bert;
+using nlohmann::json;
+
+namespace
+{
+//! \brief Runs one request with a "stage" span through the tracer, pretending it took elapsedUs
+uint64_t request(RequestTracer& tracer, uint64_t elapsedUs = 0)
+{
+    RequestTrace trace;
+    tracer.begin(trace);
+    trace.startNs -= elapsedUs * 1000;
+    trace.add("stage", trace.startNs, trace.startNs + 1000);
+    tracer.finish(trace);
+    return trace.id;
+}
+
+//! \brief Ids of the "request" events of a dump in the process pid, in the order of the dump
+std::vector<uint64_t> requestIds(const json& dump, int pid)
+{
+    std::vector<uint64_t> ids;
+    for (const json& event : dump.at("traceEvents"))
+    {
+        if (event.at("name") == "request" && event.at("pid") == pid)
+        {
+            ids.push_back(event.at("args").at("request").get<uint64_t>());
+        }
+    }
+    return ids;
+}
+
+json dump(const RequestTracer& tracer)
+{
+    std::string out;
+    tracer.dumpChromeJson(out);
+    return json::parse(out);
+}
+
+constexpr int kSLOW_PID = 1;
+constexpr int kSAMPLED_PID = 2;
+} // namespace
+
+TEST(RequestTraceTest, SpansPastTheCapAreDropped)
+{
+    static const char* const names[] = {"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+        "s12", "s13", "s14", "s15", "s16", "s17"};
+    RequestTrace trace;
+    for (int i = 0; i < 18; i++)
+    {
+        trace.add(names[i], i, i + 1);
+    }
+    ASSERT_EQ(trace.count, kMAX_TRACE_SPANS);
+    EXPECT_STREQ(trace.spans[kMAX_TRACE_SPANS - 1].name, "s15");
+    EXPECT_EQ(trace.spans[3].startNs, 3u);
+    EXPECT_EQ(trace.spans[3].tid, RequestTracer::threadId());
+}
+
+TEST(RequestTraceTest, ScopesRecordIntoTheCurrentTrace)
+{
+    RequestTrace trace;
+    {
+        TraceScope untraced("untraced");
+    }
+    RequestTracer::setCurrent(&trace);
+    {
+        TraceScope scope("scope");
+    }
+    RequestTracer::setCurrent(nullptr);
+    ASSERT_EQ(trace.count, 1);
+    EXPECT_STREQ(trace.spans[0].name, "scope");
+    EXPECT_LE(trace.spans[0].startNs, trace.spans[0].endNs);
+}
+
+TEST(RequestTracerTest, SampleRateZeroKeepsNone)
+{
+    RequestTracer tracer;
+    tracer.configure(0.0, 0, 8);
+    for (int i = 0; i < 1000; i++)
+    {
+        request(tracer, 1000000);
+    }
+    EXPECT_EQ(tracer.keptSampled(), 0u);
+    EXPECT_EQ(tracer.keptSlow(), 0u);
+    EXPECT_TRUE(requestIds(dump(tracer), kSAMPLED_PID).empty());
+}
+
+TEST(RequestTracerTest, SampleRateOneKeepsAll)
+{
+    RequestTracer tracer;
+    tracer.configure(1.0, 0, 1000);
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 1000; i++)
+    {
+        ids.push_back(request(tracer));
+    }
+    EXPECT_EQ(tracer.keptSampled(), 1000u);
+    EXPECT_EQ(requestIds(dump(tracer), kSAMPLED_PID), ids);
+}
+
+TEST(RequestTracerTest, SlowRequestsAreKeptApart)
+{
+    RequestTracer tracer;
+    tracer.configure(0.0, 500, 8);
+    request(tracer, 10);
+    const uint64_t slow = request(tracer, 600);
+    EXPECT_EQ(tracer.keptSlow(), 1u);
+    EXPECT_EQ(tracer.keptSampled(), 0u);
+    const json events = dump(tracer);
+    EXPECT_EQ(requestIds(events, kSLOW_PID), std::vector<uint64_t>{slow});
+    EXPECT_TRUE(requestIds(events, kSAMPLED_PID).empty());
+}
+
+TEST(RequestTracerTest, FullRingsOverwriteTheOldest)
+{
+    RequestTracer tracer;
+    tracer.configure(1.0, 0, 3);
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 5; i++)
+    {
+        ids.push_back(request(tracer));
+    }
+    EXPECT_EQ(tracer.keptSampled(), 5u);
+    // oldest first
+    EXPECT_EQ(requestIds(dump(tracer), kSAMPLED_PID), std::vector<uint64_t>(ids.begin() + 2, ids.end()));
+
+    // reconfiguring empties the rings
+    tracer.configure(1.0, 0, 3);
+    EXPECT_TRUE(requestIds(dump(tracer), kSAMPLED_PID).empty());
+}
+
+TEST(RequestTracerTest, ChromeTraceEvents)
+{
+    RequestTracer tracer;
+    tracer.configure(1.0, 0, 4);
+    RequestTrace trace;
+    tracer.begin(trace);
+    trace.add("queue", trace.startNs, trace.startNs + 2500);
+    trace.add("infer", trace.startNs + 2500, trace.startNs + 10000);
+    tracer.finish(trace);
+
+    const json events = dump(tracer).at("traceEvents");
+    ASSERT_TRUE(events.is_array());
+    // two process names, the request and its two stages
+    ASSERT_EQ(events.size(), 5u);
+    EXPECT_EQ(events[0].at("ph"), "M");
+    EXPECT_EQ(events[1].at("ph"), "M");
+    EXPECT_EQ(events[1].at("args").at("name"), "sampled requests");
+    EXPECT_EQ(events[2].at("name"), "request");
+    EXPECT_EQ(events[2].at("tid"), 0);
+    const char* stages[] = {"queue", "infer"};
+    const double durations[] = {2.5, 7.5};
+    for (int i = 0; i < 2; i++)
+    {
+        const json& event = events[3 + i];
+        EXPECT_EQ(event.at("name"), stages[i]);
+        EXPECT_EQ(event.at("ph"), "X");
+        EXPECT_EQ(event.at("pid"), kSAMPLED_PID);
+        EXPECT_EQ(event.at("tid").get<uint32_t>(), RequestTracer::threadId());
+        EXPECT_EQ(event.at("args").at("request").get<uint64_t>(), trace.id);
+        EXPECT_NEAR(event.at("dur").get<double>(), durations[i], 1e-3);
+        EXPECT_GE(event.at("ts").get<double>(), events[2].at("ts").get<double>());
+    }
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "half.h"
+#include "responseEncoding.h"
+#include <cmath>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+#include <zlib.h>
+#ifdef BERT_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace bert;
+
+namespace
+{
+#ifdef BERT_WITH_ZSTD
+const ContentEncoding kBEST = ContentEncoding::kZSTD;
+#else
+const ContentEncoding kBEST = ContentEncoding::kGZIP;
+#endif
+
+//! \brief Reads the entries and values of a tensor response back as floats
+struct ParsedResponse
+{
+    explicit ParsedResponse(const std::string& body)
+    {
+        memcpy(&header, body.data(), sizeof(header));
+        const char* p = body.data() + sizeof(header);
+        entries.resize(header.count);
+        memcpy(entries.data(), p, header.count * sizeof(TensorResponseEntry));
+        p += header.count * sizeof(TensorResponseEntry);
+        for (const TensorResponseEntry& entry : entries)
+        {
+            std::vector<float> v(entry.rows * entry.cols);
+            for (float& x : v)
+            {
+                if (header.dtype == static_cast<uint32_t>(TensorDtype::kFP16))
+                {
+                    half_float::half h;
+                    memcpy(&h, p, sizeof(h));
+                    x = h;
+                    p += sizeof(h);
+                }
+                else
+                {
+                    memcpy(&x, p, sizeof(x));
+                    p += sizeof(x);
+                }
+            }
+            values.push_back(v);
+        }
+        size = p - body.data();
+    }
+
+    TensorResponseHeader header;
+    std::vector<TensorResponseEntry> entries;
+    std::vector<std::vector<float>> values;
+    size_t size;
+};
+
+std::string gunzip(const std::string& data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    EXPECT_EQ(inflateInit2(&stream, 15 + 16), Z_OK);
+    std::string out;
+    char buffer[4096];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    int status = Z_OK;
+    while (status == Z_OK)
+    {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    EXPECT_EQ(status, Z_STREAM_END);
+    inflateEnd(&stream);
+    return out;
+}
+
+//! \brief Compressible floats like the outputs of a response
+std::string body(size_t n)
+{
+    std::vector<float> values(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        values[i] = static_cast<float>(i % 37) * 0.125f;
+    }
+    return std::string(reinterpret_cast<const char*>(values.data()), n * sizeof(float));
+}
+} // namespace
+
+TEST(ChooseEncodingTest, PrefersTheBestListedCoding)
+{
+    EXPECT_EQ(chooseEncoding(""), ContentEncoding::kIDENTITY);
+    EXPECT_EQ(chooseEncoding("gzip"), ContentEncoding::kGZIP);
+    EXPECT_EQ(chooseEncoding("deflate, GZip;q=0.5, br"), ContentEncoding::kGZIP);
+    EXPECT_EQ(chooseEncoding("gzip, zstd"), kBEST);
+    EXPECT_EQ(chooseEncoding("br, deflate"), ContentEncoding::kIDENTITY);
+}
+
+TEST(ChooseEncodingTest, QZeroRefusesACoding)
+{
+    EXPECT_EQ(chooseEncoding("gzip;q=0"), ContentEncoding::kIDENTITY);
+    EXPECT_EQ(chooseEncoding("gzip; q=0.0"), ContentEncoding::kIDENTITY);
+    EXPECT_EQ(chooseEncoding("gzip;q=0.001"), ContentEncoding::kGZIP);
+    EXPECT_EQ(chooseEncoding("zstd;q=0, gzip"), ContentEncoding::kGZIP);
+    EXPECT_EQ(chooseEncoding("gzip;q=0, zstd;q=0"), ContentEncoding::kIDENTITY);
+}
+
+TEST(ChooseEncodingTest, WildcardAcceptsTheUnnamedCodings)
+{
+    EXPECT_EQ(chooseEncoding("*"), kBEST);
+    EXPECT_EQ(chooseEncoding("*;q=0.1"), kBEST);
+    EXPECT_EQ(chooseEncoding("*;q=0"), ContentEncoding::kIDENTITY);
+    // a named coding wins over the wildcard either way
+    EXPECT_EQ(chooseEncoding("zstd;q=0, *"), ContentEncoding::kGZIP);
+    EXPECT_EQ(chooseEncoding("gzip;q=0, zstd;q=0, *"), ContentEncoding::kIDENTITY);
+    EXPECT_EQ(chooseEncoding("gzip, *;q=0"), ContentEncoding::kGZIP);
+}
+
+TEST(ChooseEncodingTest, IdentityIsNotACompression)
+{
+    EXPECT_EQ(chooseEncoding("identity"), ContentEncoding::kIDENTITY);
+    EXPECT_EQ(chooseEncoding("identity;q=0"), ContentEncoding::kIDENTITY);
+    EXPECT_EQ(chooseEncoding("identity, gzip"), ContentEncoding::kGZIP);
+    EXPECT_EQ(encodingName(ContentEncoding::kIDENTITY), nullptr);
+    EXPECT_STREQ(encodingName(ContentEncoding::kGZIP), "gzip");
+    EXPECT_STREQ(encodingName(ContentEncoding::kZSTD), "zstd");
+}
+
+TEST(AcceptsTensorTest, Dtypes)
+{
+    TensorDtype dtype = TensorDtype::kFP16;
+    EXPECT_TRUE(acceptsTensor("application/x-bert-tensor", dtype));
+    EXPECT_EQ(dtype, TensorDtype::kFP32);
+    EXPECT_TRUE(acceptsTensor("application/json, Application/X-Bert-Tensor; dtype=fp16", dtype));
+    EXPECT_EQ(dtype, TensorDtype::kFP16);
+    EXPECT_TRUE(acceptsTensor("application/x-bert-tensor;q=0.9;dtype=fp16", dtype));
+    EXPECT_EQ(dtype, TensorDtype::kFP16);
+    EXPECT_TRUE(acceptsTensor("application/x-bert-tensor; dtype=fp32", dtype));
+    EXPECT_EQ(dtype, TensorDtype::kFP32);
+}
+
+TEST(AcceptsTensorTest, OtherTypesKeepJson)
+{
+    TensorDtype dtype = TensorDtype::kFP16;
+    EXPECT_FALSE(acceptsTensor("", dtype));
+    EXPECT_FALSE(acceptsTensor("application/json", dtype));
+    EXPECT_FALSE(acceptsTensor("*/*", dtype));
+    EXPECT_FALSE(acceptsTensor("application/x-bert-tensor;q=0", dtype));
+    EXPECT_FALSE(acceptsTensor("application/x-bert-tensors", dtype));
+    EXPECT_EQ(dtype, TensorDtype::kFP16);
+}
+
+TEST(TensorResponseWriterTest, HeaderEntriesThenArrays)
+{
+    const float start[6] = {1.f, -2.f, 3.5f, 0.f, 1e-3f, 7.f};
+    const float intent[2] = {0.25f, 0.75f};
+    TensorResponseWriter writer(TensorDtype::kFP32);
+    writer.add("start_logits", start, 2, 3);
+    writer.add("a_name_longer_than_sixteen", intent, 1, 2);
+    const std::string& body = writer.finish();
+
+    ASSERT_EQ(body.size(), sizeof(TensorResponseHeader) + 2 * sizeof(TensorResponseEntry) + 8 * sizeof(float));
+    const ParsedResponse parsed(body);
+    EXPECT_EQ(memcmp(parsed.header.magic, kTENSOR_MAGIC, 4), 0);
+    EXPECT_EQ(parsed.header.version, kTENSOR_VERSION);
+    EXPECT_EQ(parsed.header.dtype, static_cast<uint32_t>(TensorDtype::kFP32));
+    ASSERT_EQ(parsed.header.count, 2u);
+    EXPECT_STREQ(parsed.entries[0].name, "start_logits");
+    EXPECT_EQ(parsed.entries[0].rows, 2u);
+    EXPECT_EQ(parsed.entries[0].cols, 3u);
+    // names are cut to keep their terminator
+    EXPECT_STREQ(parsed.entries[1].name, "a_name_longer_t");
+    EXPECT_EQ(parsed.values[0], std::vector<float>(start, start + 6));
+    EXPECT_EQ(parsed.values[1], std::vector<float>(intent, intent + 2));
+    EXPECT_EQ(parsed.size, body.size());
+}
+
+TEST(TensorResponseWriterTest, Fp16RoundTrip)
+{
+    std::vector<float> values(33);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = (i % 2 ? -1.f : 1.f) * (0.001f + i * 0.37f);
+    }
+    TensorResponseWriter writer(TensorDtype::kFP32);
+    writer.add("stale", values.data(), 1, 1);
+    // reset drops the previous entries and switches the dtype
+    writer.reset(TensorDtype::kFP16);
+    writer.add("end_prob", values.data(), 3, 11);
+    const std::string& body = writer.finish();
+
+    ASSERT_EQ(body.size(), sizeof(TensorResponseHeader) + sizeof(TensorResponseEntry) + 33 * sizeof(uint16_t));
+    const ParsedResponse parsed(body);
+    EXPECT_EQ(parsed.header.dtype, static_cast<uint32_t>(TensorDtype::kFP16));
+    ASSERT_EQ(parsed.header.count, 1u);
+    EXPECT_STREQ(parsed.entries[0].name, "end_prob");
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        // fp16 keeps 11 significant bits
+        EXPECT_NEAR(parsed.values[0][i], values[i], std::abs(values[i]) / 1024) << i;
+    }
+}
+
+TEST(CompressBodyTest, GzipDecompressesToTheInput)
+{
+    for (size_t n : {0u, 1u, 1000u, 100000u})
+    {
+        const std::string input = body(n);
+        std::string compressed;
+        // twice: the second body goes through the reset stream of the thread
+        for (int pass = 0; pass < 2; pass++)
+        {
+            ASSERT_TRUE(compressBody(ContentEncoding::kGZIP, input.data(), input.size(), compressed)) << n;
+            EXPECT_EQ(gunzip(compressed), input) << n;
+        }
+        if (n >= 1000)
+        {
+            EXPECT_LT(compressed.size(), input.size() / 2) << n;
+        }
+    }
+}
+
+TEST(CompressBodyTest, ZstdDecompressesToTheInput)
+{
+    const std::string input = body(50000);
+    std::string compressed;
+#ifdef BERT_WITH_ZSTD
+    for (int pass = 0; pass < 2; pass++)
+    {
+        ASSERT_TRUE(compressBody(ContentEncoding::kZSTD, input.data(), input.size(), compressed));
+        std::string output(input.size(), '\0');
+        const size_t n = ZSTD_decompress(&output[0], output.size(), compressed.data(), compressed.size());
+        ASSERT_FALSE(ZSTD_isError(n));
+        output.resize(n);
+        EXPECT_EQ(output, input);
+    }
+#else
+    EXPECT_FALSE(compressBody(ContentEncoding::kZSTD, input.data(), input.size(), compressed));
+#endif
+    EXPECT_FALSE(compressBody(ContentEncoding::kIDENTITY, input.data(), input.size(), compressed));
+}
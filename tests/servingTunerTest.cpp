@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "servingTuner.h"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <set>
+
+using namespace bert;
+
+namespace
+{
+//! \brief Backend with hand-set timings: msMean = fixedMs + msPerSentence x B x S / 128, p99 = 1.5 x mean, the same
+//! for any instance count. Shapes in rejected cannot be run.
+class FakeBackend : public TunerBackend
+{
+public:
+    float fixedMs{0.f};
+    float msPerSentence{0.5f};
+    std::set<EngineShape> rejected;
+    std::vector<std::pair<EngineShape, int>> calls;
+
+    bool measure(const EngineShape& shape, int instances, BatchTiming& timing) override
+    {
+        calls.emplace_back(shape, instances);
+        if (rejected.count(shape))
+        {
+            return false;
+        }
+        timing.msMean = fixedMs + msPerSentence * shape.batchSize * shape.seqLength / 128.f;
+        timing.msP99 = 1.5f * timing.msMean;
+        return true;
+    }
+};
+
+//! \brief Ten sentences of 20 tokens and ten of 100
+LengthHistogram shortAndLong()
+{
+    LengthHistogram histogram;
+    histogram.add(20, 10);
+    histogram.add(100, 10);
+    return histogram;
+}
+
+//! \brief One batch size, one instance, fp32, no SLO
+TunerOptions singleOptions(std::vector<int> seqLengths, int maxBuckets)
+{
+    TunerOptions options;
+    options.batchSizes = {8};
+    options.seqLengths = seqLengths;
+    options.maxBuckets = maxBuckets;
+    options.instanceCounts = {1};
+    options.precisions = {false};
+    options.sloMs = 1000.f;
+    return options;
+}
+
+std::set<std::vector<int>> bucketSetsOf(const std::vector<ServingConfig>& configs)
+{
+    std::set<std::vector<int>> sets;
+    for (const ServingConfig& config : configs)
+    {
+        sets.insert(config.buckets);
+    }
+    return sets;
+}
+
+const ServingConfig* find(const std::vector<ServingConfig>& configs, const std::vector<int>& buckets)
+{
+    for (const ServingConfig& config : configs)
+    {
+        if (config.buckets == buckets)
+        {
+            return &config;
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+TEST(ServingTunerTest, BucketSetsEndWithTheLargestLength)
+{
+    FakeBackend backend;
+    ServingTuner tuner(backend, singleOptions({128, 32, 256, 64, 128}, 2));
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+    const std::set<std::vector<int>> expected{{256}, {32, 256}, {64, 256}, {128, 256}};
+    EXPECT_EQ(bucketSetsOf(all), expected);
+    EXPECT_EQ(all.size(), expected.size());
+}
+
+TEST(ServingTunerTest, BucketSetsRespectMaxBuckets)
+{
+    const std::vector<int> lengths{32, 64, 128, 256};
+    for (int maxBuckets = 1; maxBuckets <= 5; maxBuckets++)
+    {
+        FakeBackend backend;
+        ServingTuner tuner(backend, singleOptions(lengths, maxBuckets));
+        ServingConfig best;
+        std::vector<ServingConfig> all;
+        ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+        // the largest length plus up to maxBuckets - 1 of the three others
+        const size_t expected[] = {1, 4, 7, 8, 8};
+        EXPECT_EQ(all.size(), expected[maxBuckets - 1]) << "maxBuckets " << maxBuckets;
+        for (const ServingConfig& config : all)
+        {
+            ASSERT_FALSE(config.buckets.empty());
+            EXPECT_LE(static_cast<int>(config.buckets.size()), maxBuckets);
+            EXPECT_EQ(config.buckets.back(), 256);
+            EXPECT_TRUE(std::is_sorted(config.buckets.begin(), config.buckets.end()));
+        }
+    }
+}
+
+TEST(ServingTunerTest, ThroughputAndPaddingOfAKnownHistogram)
+{
+    FakeBackend backend;
+    TunerOptions options = singleOptions({32, 128}, 2);
+    options.devices = 2;
+    ServingTuner tuner(backend, options);
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+    // batches of 8 take 1 ms at 32 tokens and 4 ms at 128: (10 x 1 / 8 + 10 x 4 / 8) / 20 = 0.3125 ms a sentence
+    const ServingConfig* twoBuckets = find(all, {32, 128});
+    ASSERT_NE(twoBuckets, nullptr);
+    EXPECT_DOUBLE_EQ(twoBuckets->sentencesPerSecond, 2 * 1000. / 0.3125);
+    EXPECT_DOUBLE_EQ(twoBuckets->paddedFraction, 1. - (10. * 20 + 10. * 100) / (10. * 32 + 10. * 128));
+    EXPECT_DOUBLE_EQ(twoBuckets->truncatedFraction, 0.);
+    // p99 plus mean of the 128 batch
+    EXPECT_FLOAT_EQ(twoBuckets->latencyMs, 6.f + 4.f);
+
+    const ServingConfig* oneBucket = find(all, {128});
+    ASSERT_NE(oneBucket, nullptr);
+    EXPECT_DOUBLE_EQ(oneBucket->sentencesPerSecond, 2 * 1000. / 0.5);
+    EXPECT_DOUBLE_EQ(oneBucket->paddedFraction, 1. - (10. * 20 + 10. * 100) / (20. * 128));
+    EXPECT_FLOAT_EQ(oneBucket->latencyMs, 6.f + 4.f);
+
+    EXPECT_EQ(best.buckets, std::vector<int>({32, 128}));
+    EXPECT_TRUE(best.meetsSlo);
+}
+
+TEST(ServingTunerTest, LongerSentencesAreTruncatedToTheLargestBucket)
+{
+    FakeBackend backend;
+    ServingTuner tuner(backend, singleOptions({32, 64}, 2));
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+    const ServingConfig* config = find(all, {32, 64});
+    ASSERT_NE(config, nullptr);
+    EXPECT_DOUBLE_EQ(config->truncatedFraction, 0.5);
+    // the 100 token sentences count 64 real positions
+    EXPECT_DOUBLE_EQ(config->paddedFraction, 1. - (10. * 20 + 10. * 64) / (10. * 32 + 10. * 64));
+}
+
+TEST(ServingTunerTest, BestIsTheFastestWithinTheSlo)
+{
+    // with a fixed cost, larger batches are faster and slower: latency 2.5 x (1 + B / 4) ms
+    FakeBackend backend;
+    backend.fixedMs = 1.f;
+    backend.msPerSentence = 0.25f;
+    TunerOptions options = singleOptions({128}, 1);
+    options.batchSizes = {4, 8, 16};
+    options.sloMs = 8.f;
+    ServingTuner tuner(backend, options);
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+    EXPECT_EQ(best.batchSize, 8);
+    EXPECT_TRUE(best.meetsSlo);
+    EXPECT_FLOAT_EQ(best.latencyMs, 7.5f);
+    ASSERT_EQ(all.size(), 3u);
+    EXPECT_EQ(all[1].batchSize, 4);
+    EXPECT_TRUE(all[1].meetsSlo);
+    EXPECT_EQ(all[2].batchSize, 16);
+    EXPECT_FALSE(all[2].meetsSlo);
+    EXPECT_GT(all[2].sentencesPerSecond, best.sentencesPerSecond);
+}
+
+TEST(ServingTunerTest, WithoutAnyConfigInTheSloBestHasTheLowestLatency)
+{
+    FakeBackend backend;
+    backend.fixedMs = 1.f;
+    backend.msPerSentence = 0.25f;
+    TunerOptions options = singleOptions({128}, 1);
+    options.batchSizes = {16, 4, 8};
+    options.sloMs = 1.f;
+    ServingTuner tuner(backend, options);
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+    EXPECT_FALSE(best.meetsSlo);
+    EXPECT_EQ(best.batchSize, 4);
+    EXPECT_FLOAT_EQ(best.latencyMs, 5.f);
+    ASSERT_EQ(all.size(), 3u);
+    EXPECT_EQ(all[1].batchSize, 8);
+    EXPECT_EQ(all[2].batchSize, 16);
+}
+
+TEST(ServingTunerTest, RejectedShapesAreLeftOut)
+{
+    FakeBackend backend;
+    backend.rejected.insert(EngineShape{8, 128, false});
+    TunerOptions options = singleOptions({32, 128}, 2);
+    options.precisions = {false, true};
+    ServingTuner tuner(backend, options);
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best, &all));
+
+    // every fp32 set runs the 100 token sentences at 128
+    ASSERT_EQ(all.size(), 2u);
+    for (const ServingConfig& config : all)
+    {
+        EXPECT_TRUE(config.fp16);
+    }
+    EXPECT_TRUE(best.fp16);
+}
+
+TEST(ServingTunerTest, RejectedBucketsThatAreNotUsedDoNotMatter)
+{
+    FakeBackend backend;
+    backend.rejected.insert(EngineShape{8, 128, false});
+    ServingTuner tuner(backend, singleOptions({32, 128}, 2));
+    LengthHistogram histogram;
+    histogram.add(20, 10);
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    ASSERT_TRUE(tuner.tune(histogram, best, &all));
+
+    // {32, 128} runs everything at 32, {128} cannot run
+    ASSERT_EQ(all.size(), 1u);
+    EXPECT_EQ(best.buckets, std::vector<int>({32, 128}));
+    EXPECT_DOUBLE_EQ(best.truncatedFraction, 0.);
+}
+
+TEST(ServingTunerTest, FailsWhenNothingCanBeMeasured)
+{
+    FakeBackend backend;
+    backend.rejected.insert(EngineShape{8, 32, false});
+    backend.rejected.insert(EngineShape{8, 128, false});
+    ServingTuner tuner(backend, singleOptions({32, 128}, 2));
+    ServingConfig best;
+    EXPECT_FALSE(tuner.tune(shortAndLong(), best));
+}
+
+TEST(ServingTunerTest, EveryShapeIsMeasuredOnce)
+{
+    FakeBackend backend;
+    TunerOptions options = singleOptions({32, 64, 128}, 3);
+    options.batchSizes = {4, 8};
+    options.instanceCounts = {2, 1};
+    options.precisions = {false, true};
+    ServingTuner tuner(backend, options);
+    ServingConfig best;
+    ASSERT_TRUE(tuner.tune(shortAndLong(), best));
+
+    std::set<std::pair<EngineShape, int>> distinct(backend.calls.begin(), backend.calls.end());
+    EXPECT_EQ(backend.calls.size(), 2u * 2u * 3u * 2u);
+    EXPECT_EQ(distinct.size(), backend.calls.size());
+    // instance counts ascend for each shape
+    for (size_t i = 1; i < backend.calls.size(); i++)
+    {
+        const EngineShape& previous = backend.calls[i - 1].first;
+        const EngineShape& shape = backend.calls[i].first;
+        if (!(previous < shape) && !(shape < previous))
+        {
+            EXPECT_GT(backend.calls[i].second, backend.calls[i - 1].second);
+        }
+    }
+}
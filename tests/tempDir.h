@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_TEMP_DIR_H
+#define TRT_TEMP_DIR_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ftw.h>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Directory under TMPDIR (or /tmp) removed with its content when the object goes away
+class TempDir
+{
+public:
+    TempDir()
+    {
+        const char* tmp = getenv("TMPDIR");
+        std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/bert_test_XXXXXX";
+        std::vector<char> buffer(pattern.begin(), pattern.end());
+        buffer.push_back('\0');
+        if (mkdtemp(buffer.data()))
+        {
+            mPath = buffer.data();
+        }
+    }
+
+    ~TempDir()
+    {
+        if (!mPath.empty())
+        {
+            nftw(mPath.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+        }
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::string& path() const
+    {
+        return mPath;
+    }
+
+    //! \brief Path of name inside the directory
+    std::string file(const std::string& name) const
+    {
+        return mPath + "/" + name;
+    }
+
+    //! \brief Creates name and its missing parent directories with the given content
+    std::string write(const std::string& name, const std::string& content) const
+    {
+        for (size_t slash = name.find('/'); slash != std::string::npos; slash = name.find('/', slash + 1))
+        {
+            mkdir(file(name.substr(0, slash)).c_str(), 0755);
+        }
+        std::ofstream output(file(name), std::ios_base::binary);
+        output << content;
+        return file(name);
+    }
+
+    //! \brief Content of the file at path, empty if it cannot be read
+    static std::string read(const std::string& path)
+    {
+        std::ifstream input(path, std::ios_base::binary);
+        return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+private:
+    static int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+    {
+        return ::remove(path);
+    }
+
+    std::string mPath;
+};
+} // namespace bert
+
+#endif // TRT_TEMP_DIR_H
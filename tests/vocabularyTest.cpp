@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tempDir.h"
+#include "vocabulary.h"
+#include <gtest/gtest.h>
+
+using namespace bert;
+
+namespace
+{
+using Ids = std::vector<int>;
+
+enum : int
+{
+    kPAD = 0,
+    kUNK = 1,
+    kCLS = 2,
+    kSEP = 3,
+    kHELLO = 4,
+    kWORLD = 5,
+    kZHONG = 6,
+    kGUO = 7,
+    kZHONGGUO = 8,
+    kA = 9,
+};
+
+//! \brief A vocab.txt with the special tokens, two words, two Chinese characters and their word, a CRLF line and a
+//! duplicate of "hello" that must not take its id
+class VocabularyTest : public ::testing::Test
+{
+protected:
+    VocabularyTest()
+    {
+        const std::string path = dir.write("vocab.txt",
+            "[PAD]\n[UNK]\n[CLS]\n[SEP]\nhello\nworld\r\n\xe4\xb8\xad\n\xe5\x9b\xbd\n\xe4\xb8\xad\xe5\x9b\xbd\na\nhello\n");
+        EXPECT_TRUE(vocab.load(path));
+    }
+
+    Ids term(const std::string& t) const
+    {
+        Ids ids;
+        vocab.appendTerm(t, ids);
+        return ids;
+    }
+
+    //! \brief One encoded row
+    struct Row
+    {
+        Ids ids;
+        Ids segs;
+        Ids mask;
+        int n;
+    };
+
+    Row encode(const Ids& query, const Ids& doc, int seqLength) const
+    {
+        // one guard element past the row, which must stay untouched
+        Row row{Ids(seqLength + 1, -7), Ids(seqLength + 1, -7), Ids(seqLength + 1, -7), 0};
+        row.n = encodePair(vocab, query, doc, seqLength, row.ids.data(), row.segs.data(), row.mask.data());
+        EXPECT_EQ(row.ids.back(), -7);
+        EXPECT_EQ(row.segs.back(), -7);
+        EXPECT_EQ(row.mask.back(), -7);
+        row.ids.pop_back();
+        row.segs.pop_back();
+        row.mask.pop_back();
+        return row;
+    }
+
+    TempDir dir;
+    Vocabulary vocab;
+};
+} // namespace
+
+TEST_F(VocabularyTest, LoadsIdsByLine)
+{
+    EXPECT_FALSE(vocab.empty());
+    EXPECT_EQ(vocab.cls(), kCLS);
+    EXPECT_EQ(vocab.sep(), kSEP);
+    EXPECT_EQ(vocab.unk(), kUNK);
+    EXPECT_EQ(vocab.find("[PAD]"), kPAD);
+    // the first of two lines wins, CR of CRLF files is dropped
+    EXPECT_EQ(vocab.find("hello"), kHELLO);
+    EXPECT_EQ(vocab.find("world"), kWORLD);
+    EXPECT_EQ(vocab.find("world\r"), -1);
+    EXPECT_EQ(vocab.find("missing"), -1);
+}
+
+TEST(VocabularyLoadTest, RejectsFilesWithoutTheSpecialTokens)
+{
+    TempDir dir;
+    Vocabulary vocab;
+    EXPECT_FALSE(vocab.load(dir.file("none.txt")));
+    EXPECT_TRUE(vocab.empty());
+    for (const char* content : {"[UNK]\n[SEP]\nhello\n", "[CLS]\n[UNK]\n", "[CLS]\n[SEP]\n", ""})
+    {
+        EXPECT_FALSE(vocab.load(dir.write("vocab.txt", content))) << content;
+        EXPECT_TRUE(vocab.empty()) << content;
+    }
+}
+
+TEST_F(VocabularyTest, WholeTermsThenCharacters)
+{
+    EXPECT_EQ(term("hello"), Ids({kHELLO}));
+    EXPECT_EQ(term("\xe4\xb8\xad\xe5\x9b\xbd"), Ids({kZHONGGUO}));
+    EXPECT_EQ(term(""), Ids());
+    // a term missing as a whole falls back to its UTF-8 characters: "国中", "中a国"
+    EXPECT_EQ(term("\xe5\x9b\xbd\xe4\xb8\xad"), Ids({kGUO, kZHONG}));
+    EXPECT_EQ(term("\xe4\xb8\xad" "a\xe5\x9b\xbd"), Ids({kZHONG, kA, kGUO}));
+}
+
+TEST_F(VocabularyTest, UnknownCharactersBecomeUnk)
+{
+    // "中人": the second character is not in the vocabulary
+    EXPECT_EQ(term("\xe4\xb8\xad\xe4\xba\xba"), Ids({kZHONG, kUNK}));
+    // a missing word becomes one [UNK] per character
+    EXPECT_EQ(term("ab"), Ids({kA, kUNK}));
+    // a character cut by the end of the term is one [UNK]
+    EXPECT_EQ(term("a\xe4\xb8"), Ids({kA, kUNK}));
+    // appends to what is there
+    Ids ids{kHELLO};
+    vocab.appendTerm("world", ids);
+    EXPECT_EQ(ids, Ids({kHELLO, kWORLD}));
+}
+
+TEST_F(VocabularyTest, EncodePairLayout)
+{
+    const Row row = encode({kHELLO, kWORLD}, {kZHONG, kGUO, kA}, 10);
+    EXPECT_EQ(row.n, 8);
+    EXPECT_EQ(row.ids, Ids({kCLS, kHELLO, kWORLD, kSEP, kZHONG, kGUO, kA, kSEP, 0, 0}));
+    // the first [SEP] closes segment 0, the second belongs to the doc
+    EXPECT_EQ(row.segs, Ids({0, 0, 0, 0, 1, 1, 1, 1, 0, 0}));
+    EXPECT_EQ(row.mask, Ids({1, 1, 1, 1, 1, 1, 1, 1, 0, 0}));
+}
+
+TEST_F(VocabularyTest, EncodePairFillsTheRow)
+{
+    const Row row = encode({kHELLO}, {kWORLD}, 5);
+    EXPECT_EQ(row.n, 5);
+    EXPECT_EQ(row.ids, Ids({kCLS, kHELLO, kSEP, kWORLD, kSEP}));
+    EXPECT_EQ(row.mask, Ids(5, 1));
+
+    // an empty pair still has its [CLS] and [SEP]s
+    const Row empty = encode({}, {}, 4);
+    EXPECT_EQ(empty.n, 3);
+    EXPECT_EQ(empty.ids, Ids({kCLS, kSEP, kSEP, 0}));
+    EXPECT_EQ(empty.segs, Ids({0, 0, 1, 0}));
+    EXPECT_EQ(empty.mask, Ids({1, 1, 1, 0}));
+}
+
+TEST_F(VocabularyTest, EncodePairCutsTheLongerSideFirst)
+{
+    const Ids query{kHELLO, kWORLD};
+    const Ids doc{kA, kA, kA, kA, kA, kA, kA, kA};
+
+    // 7 tokens for the pair: the doc loses 3, the query keeps all of its terms
+    Row row = encode(query, doc, 10);
+    EXPECT_EQ(row.n, 10);
+    EXPECT_EQ(row.ids, Ids({kCLS, kHELLO, kWORLD, kSEP, kA, kA, kA, kA, kA, kSEP}));
+    EXPECT_EQ(row.segs, Ids({0, 0, 0, 0, 1, 1, 1, 1, 1, 1}));
+
+    // the longer side is cut down to the other, then the two are cut in turn starting with the doc: 1 + 1 tokens
+    row = encode(doc, query, 5);
+    EXPECT_EQ(row.ids, Ids({kCLS, kA, kSEP, kHELLO, kSEP}));
+    row = encode({kHELLO, kWORLD, kA}, {kZHONG, kGUO, kA}, 8);
+    EXPECT_EQ(row.ids, Ids({kCLS, kHELLO, kWORLD, kA, kSEP, kZHONG, kGUO, kSEP}));
+
+    // only the first terms of a side are kept
+    row = encode(query, {kZHONG, kGUO, kZHONGGUO, kA}, 7);
+    EXPECT_EQ(row.ids, Ids({kCLS, kHELLO, kWORLD, kSEP, kZHONG, kGUO, kSEP}));
+}
+
+TEST_F(VocabularyTest, EncodePairShorterThanTheSpecialTokens)
+{
+    // no room for any term, the special tokens are cut at the end of the row
+    const Row row = encode({kHELLO}, {kWORLD}, 2);
+    EXPECT_EQ(row.n, 2);
+    EXPECT_EQ(row.ids, Ids({kCLS, kSEP}));
+    EXPECT_EQ(row.segs, Ids({0, 0}));
+    EXPECT_EQ(row.mask, Ids({1, 1}));
+    EXPECT_EQ(encode({kHELLO}, {kWORLD}, 0).n, 0);
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "half.h"
+#include "tempDir.h"
+#include "weightContainer.h"
+#include <cmath>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+using namespace bert;
+using nvinfer1::DataType;
+using nvinfer1::Weights;
+
+namespace
+{
+//! \brief Small map with every stored type: an fp32 kernel and bias, an int8 kernel with its scales, an fp16 tensor
+class WeightContainerTest : public ::testing::Test
+{
+protected:
+    WeightContainerTest()
+        : kernel(6 * 5)
+        , bias(5)
+        , int8Kernel(4 * 3)
+        , int8Scale(4)
+        , halves(7)
+    {
+        for (size_t i = 0; i < kernel.size(); i++)
+        {
+            kernel[i] = 0.25f * i - 3.f;
+        }
+        for (size_t i = 0; i < bias.size(); i++)
+        {
+            bias[i] = 1.f / (i + 1);
+        }
+        for (size_t i = 0; i < int8Kernel.size(); i++)
+        {
+            int8Kernel[i] = static_cast<int8_t>(i * 37 - 128);
+        }
+        for (size_t i = 0; i < int8Scale.size(); i++)
+        {
+            int8Scale[i] = 0.01f * (i + 1);
+        }
+        for (size_t i = 0; i < halves.size(); i++)
+        {
+            halves[i] = half_float::half(0.5f * i);
+        }
+        weights["l0_attention_self_qkv_kernel"] = Weights{DataType::kFLOAT, kernel.data(), int64_t(kernel.size())};
+        weights["l0_attention_self_qkv_bias"] = Weights{DataType::kFLOAT, bias.data(), int64_t(bias.size())};
+        weights["l0_intermediate_dense_kernel"]
+            = Weights{DataType::kINT8, int8Kernel.data(), int64_t(int8Kernel.size())};
+        weights["l0_intermediate_dense_kernel" + kINT8_SCALE_SUFFIX]
+            = Weights{DataType::kFLOAT, int8Scale.data(), int64_t(int8Scale.size())};
+        weights["bert_embeddings_layernorm_gamma"] = Weights{DataType::kHALF, halves.data(), int64_t(halves.size())};
+    }
+
+    //! \brief Writes the map to weights.wc and returns its bytes
+    std::string writeFile(bool fp16 = false)
+    {
+        path = dir.file("weights.wc");
+        EXPECT_TRUE(writeWeightContainer(path, weights, fp16));
+        return TempDir::read(path);
+    }
+
+    void rewrite(const std::string& bytes)
+    {
+        dir.write("weights.wc", bytes);
+    }
+
+    static WeightContainerHeader& header(std::string& bytes)
+    {
+        return *reinterpret_cast<WeightContainerHeader*>(&bytes[0]);
+    }
+
+    static WeightContainerEntry& entry(std::string& bytes, int index)
+    {
+        return reinterpret_cast<WeightContainerEntry*>(&bytes[header(bytes).indexOffset])[index];
+    }
+
+    //! \brief Index crc after the entries were edited, so only the edited field is wrong
+    static void fixIndexCrc(std::string& bytes)
+    {
+        const WeightContainerHeader& h = header(bytes);
+        const size_t size = h.count * sizeof(WeightContainerEntry);
+        header(bytes).indexCrc
+            = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(&bytes[h.indexOffset]), size));
+    }
+
+    template <typename T>
+    static std::vector<T> values(const Weights& w)
+    {
+        const T* p = static_cast<const T*>(w.values);
+        return std::vector<T>(p, p + w.count);
+    }
+
+    TempDir dir;
+    std::string path;
+    std::vector<float> kernel;
+    std::vector<float> bias;
+    std::vector<int8_t> int8Kernel;
+    std::vector<float> int8Scale;
+    std::vector<half_float::half> halves;
+    WeightMap weights;
+};
+} // namespace
+
+TEST_F(WeightContainerTest, RoundTripKeepsEveryType)
+{
+    writeFile();
+    ASSERT_TRUE(WeightContainer::isContainer(path));
+    WeightContainer container;
+    ASSERT_TRUE(container.open(path));
+    EXPECT_EQ(container.flags(), kWC_FLAG_FP16 | kWC_FLAG_INT8);
+
+    const WeightMap& loaded = container.weights();
+    ASSERT_EQ(loaded.size(), weights.size());
+    for (const auto& kv : weights)
+    {
+        SCOPED_TRACE(kv.first);
+        const auto it = loaded.find(kv.first);
+        ASSERT_NE(it, loaded.end());
+        EXPECT_EQ(it->second.type, kv.second.type);
+        ASSERT_EQ(it->second.count, kv.second.count);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(it->second.values) % kWC_ALIGNMENT, 0u);
+        const size_t size = kv.second.type == DataType::kFLOAT ? 4 : kv.second.type == DataType::kHALF ? 2 : 1;
+        EXPECT_EQ(memcmp(it->second.values, kv.second.values, kv.second.count * size), 0);
+    }
+}
+
+TEST_F(WeightContainerTest, Fp16StoresOnlyKernelsAsHalf)
+{
+    writeFile(true);
+    WeightContainer container;
+    ASSERT_TRUE(container.open(path));
+    EXPECT_TRUE(container.flags() & kWC_FLAG_FP16);
+    const WeightMap& loaded = container.weights();
+
+    const Weights& k = loaded.at("l0_attention_self_qkv_kernel");
+    ASSERT_EQ(k.type, DataType::kHALF);
+    const std::vector<half_float::half> h = values<half_float::half>(k);
+    for (size_t i = 0; i < kernel.size(); i++)
+    {
+        // multiples of 0.25 in [-3, 4.25] are exact in fp16
+        EXPECT_EQ(static_cast<float>(h[i]), kernel[i]) << "at " << i;
+    }
+    EXPECT_EQ(loaded.at("l0_attention_self_qkv_bias").type, DataType::kFLOAT);
+    EXPECT_EQ(loaded.at("l0_intermediate_dense_kernel").type, DataType::kINT8);
+    EXPECT_EQ(loaded.at("l0_intermediate_dense_kernel" + kINT8_SCALE_SUFFIX).type, DataType::kFLOAT);
+    EXPECT_EQ(values<float>(loaded.at("l0_intermediate_dense_kernel" + kINT8_SCALE_SUFFIX)), int8Scale);
+}
+
+TEST_F(WeightContainerTest, SkippedEntriesAreLeftOut)
+{
+    path = dir.file("weights.wc");
+    ASSERT_TRUE(writeWeightContainer(path, weights, false, {"l0_attention_self_qkv_bias"}));
+    WeightContainer container;
+    ASSERT_TRUE(container.open(path));
+    EXPECT_EQ(container.weights().size(), weights.size() - 1);
+    EXPECT_EQ(container.weights().count("l0_attention_self_qkv_bias"), 0u);
+}
+
+TEST_F(WeightContainerTest, RejectsTruncatedFiles)
+{
+    const std::string bytes = writeFile();
+    WeightContainer container;
+
+    rewrite(bytes.substr(0, bytes.size() - kWC_ALIGNMENT));
+    EXPECT_FALSE(container.open(path));
+    rewrite(bytes.substr(0, sizeof(WeightContainerHeader) + sizeof(WeightContainerEntry)));
+    EXPECT_FALSE(container.open(path));
+    rewrite(bytes.substr(0, sizeof(WeightContainerHeader) - 1));
+    EXPECT_FALSE(container.open(path));
+    rewrite("");
+    EXPECT_FALSE(container.open(path));
+    EXPECT_TRUE(container.weights().empty());
+}
+
+TEST_F(WeightContainerTest, RejectsBadMagicAndVersion)
+{
+    std::string bytes = writeFile();
+    WeightContainer container;
+
+    bytes[0] = 'X';
+    rewrite(bytes);
+    EXPECT_FALSE(WeightContainer::isContainer(path));
+    EXPECT_FALSE(container.open(path));
+
+    bytes[0] = kWC_MAGIC[0];
+    header(bytes).version = kWC_VERSION + 1;
+    rewrite(bytes);
+    EXPECT_TRUE(WeightContainer::isContainer(path));
+    EXPECT_FALSE(container.open(path));
+}
+
+TEST_F(WeightContainerTest, RejectsOutOfRangeEntries)
+{
+    const std::string bytes = writeFile();
+    const uint64_t size = bytes.size();
+    WeightContainer container;
+
+    struct Edit
+    {
+        const char* what;
+        void (*apply)(WeightContainerEntry& e, uint64_t fileSize);
+    };
+    const Edit edits[] = {
+        {"offset past the end", [](WeightContainerEntry& e, uint64_t fileSize) { e.offset = fileSize + kWC_ALIGNMENT; }},
+        {"misaligned offset", [](WeightContainerEntry& e, uint64_t) { e.offset += 4; }},
+        {"payload past the end", [](WeightContainerEntry& e, uint64_t fileSize) { e.count = fileSize; }},
+        {"offset + count wraps around",
+            [](WeightContainerEntry& e, uint64_t) { e.count = ~uint64_t(0) / 4 + 2; }},
+        {"unknown type", [](WeightContainerEntry& e, uint64_t) { e.type = static_cast<int32_t>(DataType::kINT32); }},
+        {"unterminated name", [](WeightContainerEntry& e, uint64_t) { memset(e.name, 'a', kWC_MAX_NAME); }},
+    };
+    for (const Edit& edit : edits)
+    {
+        SCOPED_TRACE(edit.what);
+        std::string edited = bytes;
+        edit.apply(entry(edited, 0), size);
+        fixIndexCrc(edited);
+        rewrite(edited);
+        EXPECT_FALSE(container.open(path, false));
+        EXPECT_TRUE(container.weights().empty());
+    }
+}
+
+TEST_F(WeightContainerTest, RejectsACorruptedIndexOrPayload)
+{
+    std::string bytes = writeFile();
+    WeightContainer container;
+
+    std::string index = bytes;
+    entry(index, 1).count--;
+    rewrite(index);
+    EXPECT_FALSE(container.open(path));
+
+    // a payload byte: caught by the payload crc, unless verification is off
+    std::string payload = bytes;
+    const WeightContainerEntry& e = entry(payload, 0);
+    payload[e.offset] ^= 0x40;
+    rewrite(payload);
+    EXPECT_FALSE(container.open(path, true));
+    EXPECT_TRUE(container.open(path, false));
+}
+
+TEST_F(WeightContainerTest, UnsupportedTypesAreNotWritten)
+{
+    const int32_t ids[3] = {1, 2, 3};
+    weights["input_ids"] = Weights{DataType::kINT32, ids, 3};
+    path = dir.file("weights.wc");
+    EXPECT_FALSE(writeWeightContainer(path, weights, false));
+    EXPECT_TRUE(TempDir::read(path).empty());
+
+    // left out, the rest is written
+    EXPECT_TRUE(writeWeightContainer(path, weights, false, {"input_ids"}));
+    weights.erase("input_ids");
+    weights["missing"] = Weights{DataType::kFLOAT, nullptr, 4};
+    EXPECT_FALSE(writeWeightContainer(dir.file("other.wc"), weights, false));
+}
+
+TEST(QuantizeInt8Test, ScalesEachRowToItsLargestMagnitude)
+{
+    const float src[3 * 4] = {0.5f, -2.f, 1.f, 0.25f, 0.f, 0.f, 0.f, 0.f, -3.f, -1.5f, 0.001f, 2.9f};
+    int8_t dst[3 * 4];
+    float scales[3];
+    quantizeInt8(src, 3, 4, dst, scales);
+
+    EXPECT_FLOAT_EQ(scales[0], 2.f / 127.f);
+    EXPECT_FLOAT_EQ(scales[1], 1.f);
+    EXPECT_FLOAT_EQ(scales[2], 3.f / 127.f);
+    EXPECT_EQ(dst[1], -127);
+    EXPECT_EQ(dst[8], -127);
+    for (int i = 0; i < 12; i++)
+    {
+        const float scale = scales[i / 4];
+        EXPECT_LE(std::fabs(dst[i] * scale - src[i]), scale / 2 + 1e-6f) << "at " << i;
+    }
+    EXPECT_EQ(dst[4], 0);
+    EXPECT_EQ(dst[10], 0);
+}
+
+TEST_F(WeightContainerTest, QuantizedKernelsRoundTrip)
+{
+    // the qkv kernel as 6 rows of 5, as quantize_weights stores it
+    std::vector<int8_t> q(kernel.size());
+    std::vector<float> scales(6);
+    quantizeInt8(kernel.data(), 6, 5, q.data(), scales.data());
+    const std::string name = "l0_attention_self_qkv_kernel";
+    weights[name] = Weights{DataType::kINT8, q.data(), int64_t(q.size())};
+    weights[name + kINT8_SCALE_SUFFIX] = Weights{DataType::kFLOAT, scales.data(), int64_t(scales.size())};
+
+    // fp16 leaves int8 kernels and their scales as they are
+    writeFile(true);
+    WeightContainer container;
+    ASSERT_TRUE(container.open(path));
+    EXPECT_TRUE(container.flags() & kWC_FLAG_INT8);
+    const Weights& k = container.weights().at(name);
+    const Weights& s = container.weights().at(name + kINT8_SCALE_SUFFIX);
+    ASSERT_EQ(k.type, DataType::kINT8);
+    ASSERT_EQ(s.type, DataType::kFLOAT);
+    EXPECT_EQ(values<int8_t>(k), q);
+    EXPECT_EQ(values<float>(s), scales);
+
+    const int8_t* stored = static_cast<const int8_t*>(k.values);
+    const float* storedScales = static_cast<const float*>(s.values);
+    for (size_t i = 0; i < kernel.size(); i++)
+    {
+        const float scale = storedScales[i / 5];
+        EXPECT_NEAR(stored[i] * scale, kernel[i], scale / 2 + 1e-6f) << "at " << i;
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common.h"
+#include "tempDir.h"
+#include "weightStore.h"
+#include <gtest/gtest.h>
+#include <sstream>
+
+using namespace bert;
+using nvinfer1::DataType;
+
+namespace
+{
+//! \brief Weights file with a 2 x 2 kernel and a bias, the kernel values offset by \p base
+std::string weightsFile(float base)
+{
+    const float kernel[4] = {base, base + 1, base + 2, base + 3};
+    const float bias[2] = {0.5f, -0.5f};
+    std::ostringstream out;
+    out << "2\n";
+    out << "l0_output_dense_kernel 0 2 2 2 ";
+    out.write(reinterpret_cast<const char*>(kernel), sizeof(kernel));
+    out << "\nl0_output_dense_bias 0 1 2 ";
+    out.write(reinterpret_cast<const char*>(bias), sizeof(bias));
+    out << "\n";
+    return out.str();
+}
+
+WeightPrepOptions fp16Options()
+{
+    WeightPrepOptions options;
+    options.fp16Kernels = true;
+    return options;
+}
+
+//! \brief Each test has its own files: the store is process-wide and keyed by content
+class WeightStoreTest : public ::testing::Test
+{
+protected:
+    TempDir dir;
+    WeightStore& store = WeightStore::instance();
+};
+} // namespace
+
+TEST_F(WeightStoreTest, SamePathAndOptionsShareOneLoad)
+{
+    const std::string path = dir.write("bert.weights", weightsFile(1.f));
+    std::shared_ptr<const HostWeights> a = store.acquire(path);
+    std::shared_ptr<const HostWeights> b = store.acquire(path);
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a->weights().at("l0_output_dense_kernel").type, DataType::kFLOAT);
+    EXPECT_EQ(a->weights().at("l0_output_dense_bias").count, 2);
+}
+
+TEST_F(WeightStoreTest, SameContentAtAnotherPathIsShared)
+{
+    const std::string content = weightsFile(2.f);
+    std::shared_ptr<const HostWeights> a = store.acquire(dir.write("a.weights", content));
+    std::shared_ptr<const HostWeights> b = store.acquire(dir.write("b.weights", content));
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(a, b);
+
+    std::shared_ptr<const HostWeights> other = store.acquire(dir.write("c.weights", weightsFile(3.f)));
+    ASSERT_NE(other, nullptr);
+    EXPECT_NE(other, a);
+    EXPECT_NE(other->contentHash(), a->contentHash());
+}
+
+TEST_F(WeightStoreTest, DifferentOptionsDoNotShare)
+{
+    const std::string path = dir.write("bert.weights", weightsFile(4.f));
+    std::shared_ptr<const HostWeights> fp32 = store.acquire(path);
+    std::shared_ptr<const HostWeights> fp16 = store.acquire(path, fp16Options());
+    ASSERT_NE(fp32, nullptr);
+    ASSERT_NE(fp16, nullptr);
+    EXPECT_NE(fp32, fp16);
+    EXPECT_EQ(fp32->contentHash(), fp16->contentHash());
+    EXPECT_EQ(fp32->weights().at("l0_output_dense_kernel").type, DataType::kFLOAT);
+    EXPECT_EQ(fp16->weights().at("l0_output_dense_kernel").type, DataType::kHALF);
+    EXPECT_EQ(store.acquire(path, fp16Options()), fp16);
+}
+
+TEST_F(WeightStoreTest, ReleasedWithTheLastReference)
+{
+    const std::string path = dir.write("bert.weights", weightsFile(5.f));
+    std::shared_ptr<const HostWeights> a = store.acquire(path);
+    std::shared_ptr<const HostWeights> b = store.acquire(path);
+    std::weak_ptr<const HostWeights> watch = a;
+    a.reset();
+    EXPECT_FALSE(watch.expired());
+    b.reset();
+    EXPECT_TRUE(watch.expired());
+
+    // loaded again on the next acquire
+    std::shared_ptr<const HostWeights> again = store.acquire(path);
+    ASSERT_NE(again, nullptr);
+    EXPECT_EQ(again->weights().size(), 2u);
+}
+
+TEST_F(WeightStoreTest, RetainKeepsWeightsUntilItGoesAway)
+{
+    const std::string path = dir.write("bert.weights", weightsFile(6.f));
+    std::weak_ptr<const HostWeights> watch;
+    {
+        WeightStore::Retain retain;
+        watch = store.acquire(path);
+        EXPECT_FALSE(watch.expired());
+        EXPECT_EQ(store.acquire(path), watch.lock());
+    }
+    EXPECT_TRUE(watch.expired());
+}
+
+TEST_F(WeightStoreTest, UnreadableFilesGiveNothing)
+{
+    EXPECT_EQ(store.acquire(dir.file("missing.weights")), nullptr);
+    // a container magic with nothing behind it
+    EXPECT_EQ(store.acquire(dir.write("bad.wc", std::string(kWC_MAGIC, sizeof(kWC_MAGIC)))), nullptr);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "workQueue.h"
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+using namespace bert;
+
+namespace
+{
+//! \brief Waits until pred holds, for at most 5 s
+template <typename Pred>
+bool eventually(Pred pred)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!pred())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+//! \brief A job that blocks the worker until open is called
+class Gate
+{
+public:
+    Gate()
+        : mOpened(mOpen.get_future().share())
+    {
+    }
+
+    WorkQueue::Job job()
+    {
+        std::shared_future<void> opened = mOpened;
+        std::promise<void>* entered = &mEntered;
+        return [opened, entered] {
+            entered->set_value();
+            opened.wait();
+        };
+    }
+
+    //! \brief Returns once the worker runs the job
+    void waitEntered()
+    {
+        mEntered.get_future().wait();
+    }
+
+    void open()
+    {
+        mOpen.set_value();
+    }
+
+private:
+    std::promise<void> mOpen;
+    std::promise<void> mEntered;
+    std::shared_future<void> mOpened;
+};
+} // namespace
+
+TEST(WorkQueueTest, RunsJobsInOrderOnTheWorker)
+{
+    std::vector<int> order;
+    std::vector<std::thread::id> threads;
+    std::thread::id initThread;
+    {
+        WorkQueue queue([&] { initThread = std::this_thread::get_id(); });
+        for (int i = 0; i < 100; i++)
+        {
+            queue.push([&, i] {
+                order.push_back(i);
+                threads.push_back(std::this_thread::get_id());
+            });
+        }
+        ASSERT_TRUE(eventually([&] { return queue.processed() == 100; }));
+    }
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(order[i], i);
+        EXPECT_EQ(threads[i], initThread);
+    }
+    EXPECT_NE(initThread, std::this_thread::get_id());
+}
+
+TEST(WorkQueueTest, DepthCountsQueuedAndRunningJobs)
+{
+    WorkQueue queue;
+    EXPECT_EQ(queue.depth(), 0u);
+    Gate gate;
+    queue.push(gate.job());
+    gate.waitEntered();
+    // the running job counts until it returns
+    EXPECT_EQ(queue.depth(), 1u);
+    for (int i = 0; i < 3; i++)
+    {
+        queue.push([] {});
+    }
+    EXPECT_EQ(queue.depth(), 4u);
+    EXPECT_EQ(queue.processed(), 0u);
+
+    gate.open();
+    ASSERT_TRUE(eventually([&] { return queue.processed() == 4; }));
+    EXPECT_EQ(queue.depth(), 0u);
+}
+
+TEST(WorkQueueTest, DestructorRunsTheQueuedJobs)
+{
+    int ran = 0;
+    Gate gate;
+    std::unique_ptr<WorkQueue> queue(new WorkQueue);
+    queue->push(gate.job());
+    gate.waitEntered();
+    for (int i = 0; i < 5; i++)
+    {
+        queue->push([&] { ran++; });
+    }
+    // the destructor waits for the worker, which still has the gate and 5 jobs ahead of it
+    std::thread opener([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        gate.open();
+    });
+    queue.reset();
+    opener.join();
+    EXPECT_EQ(ran, 5);
+}
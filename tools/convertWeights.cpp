@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Converts a bert.weights file (see helpers/convert_weights.py) into a memory-mappable weight container.
+// The separate query/key/value tensors are dropped, only the fused qkv tensors the network uses are kept.
+
+#include "common.h"
+#include "logger.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "attentionKeys.h"
+#include "dataUtils.h"
+#include "weightContainer.h"
+
+using namespace bert;
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./convert_weights <bert.weights> <output container> [--fp16] [--keep-qkv]\n";
+    std::cout << "--fp16          Store fully connected kernels as fp16.\n";
+    std::cout << "--keep-qkv      Also store the unfused query/key/value tensors.\n";
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    const std::string inputPath(argv[1]);
+    const std::string outputPath(argv[2]);
+    bool fp16 = false;
+    bool keepQkv = false;
+    for (int it = 3; it < argc; it++)
+    {
+        if (!strcmp(argv[it], "--fp16"))
+        {
+            fp16 = true;
+        }
+        else if (!strcmp(argv[it], "--keep-qkv"))
+        {
+            keepQkv = true;
+        }
+        else
+        {
+            printHelpInfo();
+            return EXIT_FAILURE;
+        }
+    }
+
+    WeightMap weightMap;
+    loadWeights(inputPath, weightMap);
+
+    std::vector<std::string> skip;
+    if (!keepQkv)
+    {
+        for (const auto& kv : weightMap)
+        {
+            const size_t pos = kv.first.find(WQKV);
+            if (pos == std::string::npos)
+            {
+                continue;
+            }
+            const std::string prefix = kv.first.substr(0, pos);
+            for (const std::string& key : {WQ, WK, WV, BQ, BK, BV})
+            {
+                skip.push_back(prefix + key);
+            }
+        }
+    }
+
+    return writeWeightContainer(outputPath, weightMap, fp16, skip) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Writes fp16 and int8 variants of a bert.weights file as weight containers (see util/weightContainer.h) and reports
+// how far each one moves the network away from fp32 on a test_inputs.weights_int32 file, per output and per layer.
+// int8 kernels are quantized symmetrically per output channel. The forward runs on BertCPU with the variant weights
+// widened back to fp32, so the reported error is the one of the weight format alone, activations stay in fp32.
+
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BertCPU.h"
+#include "attentionKeys.h"
+#include "dataUtils.h"
+#include "transformerKeys.h"
+#include "weightContainer.h"
+
+using namespace bert;
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./quantize_weights <bert.weights> <test_inputs.weights_int32> <output prefix> [--heads <n>]\n"
+                 "       [--int8-layers <list>] [--sweep] [--threads <n>]\n";
+    std::cout << "Writes <output prefix>.fp16.wc and <output prefix>.int8.wc and prints their error against fp32.\n";
+    std::cout << "--heads         Number of attention heads. Default 12.\n";
+    std::cout << "--int8-layers   Kernels stored as int8 in the int8 variant: comma separated layer indices or\n"
+                 "                ranges (0-5) and 'heads' for the squad and intent heads, or 'all'. Default all.\n";
+    std::cout << "--sweep         Also report the output error of int8 in one layer at a time.\n";
+    std::cout << "--threads       Threads of the CPU forward, 0 means one per hardware thread. Default 0.\n";
+}
+
+namespace
+{
+
+// index of the transformer layer a weight belongs to, -1 for the embeddings and the heads
+int layerOf(const std::string& name)
+{
+    if (name.size() < 2 || name[0] != 'l' || !isdigit(name[1]))
+    {
+        return -1;
+    }
+    return std::stoi(name.substr(1, name.find('_') - 1));
+}
+
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// in features of a kernel [out][in]: only the output dense kernel reads the intermediate activations
+int inputSize(const std::string& name, int hiddenSize, int intermediateSize)
+{
+    return endsWith(name, W_LOUT) && !endsWith(name, W_AOUT) ? intermediateSize : hiddenSize;
+}
+
+template <typename T>
+T* allocate(WeightStorage& storage, size_t n)
+{
+    T* p = new T[n];
+    storage.emplace_back(p, [](void* q) { delete[] static_cast<T*>(q); });
+    return p;
+}
+
+struct Variant
+{
+    std::string name;
+    WeightMap weights;
+    WeightStorage storage;
+};
+
+Variant makeFp16(const WeightMap& base)
+{
+    Variant v;
+    v.name = "fp16";
+    for (const auto& kv : base)
+    {
+        const Weights& w = kv.second;
+        if (!isFcKernel(kv.first))
+        {
+            v.weights[kv.first] = w;
+            continue;
+        }
+        uint16_t* dst = allocate<uint16_t>(v.storage, w.count);
+        convertToHalf(static_cast<const float*>(w.values), dst, w.count);
+        v.weights[kv.first] = Weights{DataType::kHALF, dst, w.count};
+    }
+    return v;
+}
+
+// int8 for the kernels whose layer (-1 for the heads) is in layers, fp32 elsewhere
+Variant makeInt8(const std::string& name, const WeightMap& base, const std::set<int>& layers, int hiddenSize,
+    int intermediateSize)
+{
+    Variant v;
+    v.name = name;
+    for (const auto& kv : base)
+    {
+        const Weights& w = kv.second;
+        v.weights[kv.first] = w;
+        if (!isFcKernel(kv.first) || !layers.count(layerOf(kv.first)))
+        {
+            continue;
+        }
+        const int64_t in = inputSize(kv.first, hiddenSize, intermediateSize);
+        assert(w.count % in == 0);
+        const int64_t out = w.count / in;
+        const float* src = static_cast<const float*>(w.values);
+        int8_t* dst = allocate<int8_t>(v.storage, w.count);
+        float* scales = allocate<float>(v.storage, out);
+        quantizeInt8(src, out, in, dst, scales);
+        v.weights[kv.first] = Weights{DataType::kINT8, dst, w.count};
+        v.weights[kv.first + kINT8_SCALE_SUFFIX] = Weights{DataType::kFLOAT, scales, out};
+    }
+    return v;
+}
+
+// "all" or a comma separated list of layer indices, ranges a-b and "heads" (-1)
+bool parseLayers(const std::string& list, int numLayers, std::set<int>& layers)
+{
+    if (list == "all")
+    {
+        for (int l = -1; l < numLayers; l++)
+        {
+            layers.insert(l);
+        }
+        return true;
+    }
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        const size_t end = std::min(list.find(',', start), list.size());
+        const std::string item = list.substr(start, end - start);
+        start = end + 1;
+        if (item == "heads")
+        {
+            layers.insert(-1);
+            continue;
+        }
+        const size_t dash = item.find('-');
+        const char* digits = item.c_str();
+        char* tail = nullptr;
+        const long first = strtol(digits, &tail, 10);
+        bool valid = tail != digits;
+        long last = first;
+        if (dash != std::string::npos)
+        {
+            valid = valid && tail == digits + dash;
+            digits += dash + 1;
+            last = strtol(digits, &tail, 10);
+            valid = valid && tail != digits;
+        }
+        if (!valid || *tail || first < 0 || last < first || last >= numLayers)
+        {
+            gLogError << "Invalid layer list " << list << endl;
+            return false;
+        }
+        for (long l = first; l <= last; l++)
+        {
+            layers.insert(static_cast<int>(l));
+        }
+    }
+    return true;
+}
+
+struct ErrorStats
+{
+    double maxAbs{0};
+    double sumAbs{0};
+    double sumSqDiff{0};
+    double sumSqRef{0};
+    size_t count{0};
+
+    void add(const float* ref, const float* x, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            const double d = static_cast<double>(x[i]) - ref[i];
+            maxAbs = std::max(maxAbs, std::fabs(d));
+            sumAbs += std::fabs(d);
+            sumSqDiff += d * d;
+            sumSqRef += static_cast<double>(ref[i]) * ref[i];
+        }
+        count += n;
+    }
+    double meanAbs() const
+    {
+        return count ? sumAbs / count : 0.;
+    }
+    double relL2() const
+    {
+        return sumSqRef > 0 ? std::sqrt(sumSqDiff / sumSqRef) : 0.;
+    }
+};
+
+struct Outputs
+{
+    std::vector<float> values[kNB_OUTPUTS];
+};
+
+struct Report
+{
+    ErrorStats outputs[kNB_OUTPUTS];
+    size_t top1Agree[kNB_OUTPUTS] = {};
+    size_t top1Count[kNB_OUTPUTS] = {};
+    std::vector<ErrorStats> layers;
+};
+
+struct Dataset
+{
+    int Bmax{0};
+    int S{0};
+    std::vector<Weights> inputIds;
+    std::vector<Weights> inputMasks;
+    std::vector<Weights> segmentIds;
+    std::vector<Dims> inputDims;
+};
+
+void forward(BertCPU& bert, const Dataset& data, size_t batch, Outputs& out)
+{
+    Dims dims = data.inputDims[batch];
+    Weights ids = data.inputIds[batch];
+    Weights segments = data.segmentIds[batch];
+    Weights masks = data.inputMasks[batch];
+    bert.forward2(ids, segments, masks, dims, out.values[kSTART_LOGITS], out.values[kEND_LOGITS],
+        out.values[kSTART_PROB], out.values[kEND_PROB], out.values[kINTENT_PROB]);
+}
+
+// argmax agreement of every row of rowSize values
+void compareTop1(const std::vector<float>& ref, const std::vector<float>& x, int rows, int rowSize, size_t& agree)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        const auto refRow = ref.begin() + static_cast<size_t>(r) * rowSize;
+        const auto row = x.begin() + static_cast<size_t>(r) * rowSize;
+        if (std::max_element(refRow, refRow + rowSize) - refRow == std::max_element(row, row + rowSize) - row)
+        {
+            agree++;
+        }
+    }
+}
+
+//! \param reference fp32 instance, rerun per batch to capture its hidden states when layers are compared
+//! \param refOutputs outputs of the reference on every batch of data
+bool evaluate(const Variant& variant, BertCPU& reference, const std::vector<Outputs>& refOutputs,
+    const Dataset& data, int numHeads, int numThreads, bool compareLayers, Report& report)
+{
+    BertCPU bert(numHeads, data.Bmax, data.S, false);
+    bert.setNumThreads(numThreads);
+    if (!bert.initWithWeights(variant.weights))
+    {
+        gLogError << "Cannot build the " << variant.name << " network" << endl;
+        return false;
+    }
+
+    std::vector<std::vector<float>> refHidden;
+    if (compareLayers)
+    {
+        reference.setLayerObserver([&](int layer, const float* hidden, int rows, int hiddenSize) {
+            refHidden.resize(std::max(refHidden.size(), static_cast<size_t>(layer) + 1));
+            refHidden[layer].assign(hidden, hidden + static_cast<size_t>(rows) * hiddenSize);
+        });
+        bert.setLayerObserver([&](int layer, const float* hidden, int rows, int hiddenSize) {
+            report.layers.resize(std::max(report.layers.size(), static_cast<size_t>(layer) + 1));
+            report.layers[layer].add(refHidden[layer].data(), hidden, static_cast<size_t>(rows) * hiddenSize);
+        });
+    }
+
+    Outputs out;
+    Outputs scratch;
+    for (size_t batch = 0; batch < data.inputIds.size(); batch++)
+    {
+        if (compareLayers)
+        {
+            forward(reference, data, batch, scratch);
+        }
+        forward(bert, data, batch, out);
+        const Outputs& ref = refOutputs[batch];
+        const int B = data.inputDims[batch].d[0];
+        const int S = data.inputDims[batch].d[1];
+        for (int i = 0; i < kNB_OUTPUTS; i++)
+        {
+            const int rowSize = i == kINTENT_PROB ? static_cast<int>(ref.values[i].size()) / B : S;
+            report.outputs[i].add(ref.values[i].data(), out.values[i].data(), static_cast<size_t>(B) * rowSize);
+            if (i != kEND_PROB && i != kSTART_PROB && rowSize > 0)
+            {
+                compareTop1(ref.values[i], out.values[i], B, rowSize, report.top1Agree[i]);
+                report.top1Count[i] += B;
+            }
+        }
+    }
+    reference.setLayerObserver(nullptr);
+    return true;
+}
+
+void printReport(const std::string& name, const Report& report)
+{
+    std::cout << "\n== " << name << " ==\n";
+    std::cout << std::left << std::setw(14) << "output" << std::right << std::setw(14) << "max abs" << std::setw(14)
+              << "mean abs" << std::setw(14) << "rel L2" << std::setw(12) << "top-1" << "\n";
+    for (int i = 0; i < kNB_OUTPUTS; i++)
+    {
+        const ErrorStats& e = report.outputs[i];
+        std::cout << std::left << std::setw(14) << getOutputKey(i) << std::right << std::scientific
+                  << std::setprecision(3) << std::setw(14) << e.maxAbs << std::setw(14) << e.meanAbs() << std::setw(14)
+                  << e.relL2() << std::fixed << std::setprecision(2) << std::setw(11);
+        if (report.top1Count[i])
+        {
+            std::cout << 100. * report.top1Agree[i] / report.top1Count[i] << "%";
+        }
+        else
+        {
+            std::cout << "-";
+        }
+        std::cout << "\n";
+    }
+    if (report.layers.empty())
+    {
+        return;
+    }
+    // layer 0 is the embeddings; growth is the relative error of a layer over the one of its input
+    std::cout << std::left << std::setw(14) << "hidden" << std::right << std::setw(14) << "max abs" << std::setw(14)
+              << "rel L2" << std::setw(12) << "growth" << "\n";
+    for (size_t l = 0; l < report.layers.size(); l++)
+    {
+        const ErrorStats& e = report.layers[l];
+        std::cout << std::left << std::setw(14) << (l == 0 ? std::string("embeddings") : "l" + std::to_string(l - 1))
+                  << std::right << std::scientific << std::setprecision(3) << std::setw(14) << e.maxAbs
+                  << std::setw(14) << e.relL2() << std::fixed << std::setprecision(2) << std::setw(12);
+        const double previous = l > 0 ? report.layers[l - 1].relL2() : 0.;
+        if (previous > 0)
+        {
+            std::cout << e.relL2() / previous;
+        }
+        else
+        {
+            std::cout << "-";
+        }
+        std::cout << "\n";
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    const std::string weightsPath(argv[1]);
+    const std::string inputsPath(argv[2]);
+    const std::string prefix(argv[3]);
+    int numHeads = 12;
+    int numThreads = 0;
+    std::string int8Layers = "all";
+    bool sweep = false;
+    for (int it = 4; it < argc; it++)
+    {
+        if (!strcmp(argv[it], "--heads") && it + 1 < argc)
+        {
+            numHeads = atoi(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--int8-layers") && it + 1 < argc)
+        {
+            int8Layers = argv[++it];
+        }
+        else if (!strcmp(argv[it], "--sweep"))
+        {
+            sweep = true;
+        }
+        else if (!strcmp(argv[it], "--threads") && it + 1 < argc)
+        {
+            numThreads = atoi(argv[++it]);
+        }
+        else
+        {
+            printHelpInfo();
+            return EXIT_FAILURE;
+        }
+    }
+    if (numHeads <= 0 || numThreads < 0)
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+
+    WeightMap loaded;
+    WeightStorage loadedStorage;
+    loadWeights(weightsPath, loaded, WeightPrepOptions(), &loadedStorage);
+
+    // the network only reads the fused qkv tensors, the q/k/v ones alias them
+    std::set<std::string> skip;
+    for (const auto& kv : loaded)
+    {
+        const size_t pos = kv.first.find(WQKV);
+        if (pos == std::string::npos)
+        {
+            continue;
+        }
+        const std::string layerPrefix = kv.first.substr(0, pos);
+        for (const std::string& key : {WQ, WK, WV, BQ, BK, BV})
+        {
+            skip.insert(layerPrefix + key);
+        }
+    }
+    WeightMap base;
+    for (const auto& kv : loaded)
+    {
+        if (!skip.count(kv.first))
+        {
+            base.insert(kv);
+        }
+    }
+
+    int hiddenSize = 0;
+    int intermediateSize = 0;
+    int numLayers = 0;
+    inferNetworkSizes(base, hiddenSize, intermediateSize, numLayers);
+    std::set<int> layers;
+    if (!parseLayers(int8Layers, numLayers, layers))
+    {
+        return EXIT_FAILURE;
+    }
+
+    Dataset data;
+    loadInputs(inputsPath, data.Bmax, data.S, data.inputIds, data.inputMasks, data.segmentIds, data.inputDims);
+
+    std::vector<Variant> variants;
+    variants.push_back(makeFp16(base));
+    variants.push_back(makeInt8("int8", base, layers, hiddenSize, intermediateSize));
+    for (const Variant& v : variants)
+    {
+        const std::string path = prefix + "." + v.name + ".wc";
+        if (!writeWeightContainer(path, v.weights, false))
+        {
+            return EXIT_FAILURE;
+        }
+        gLogInfo << "Wrote " << path << endl;
+    }
+
+    BertCPU reference(numHeads, data.Bmax, data.S, false);
+    reference.setNumThreads(numThreads);
+    if (!reference.initWithWeights(base))
+    {
+        return EXIT_FAILURE;
+    }
+    std::vector<Outputs> refOutputs(data.inputIds.size());
+    for (size_t batch = 0; batch < data.inputIds.size(); batch++)
+    {
+        forward(reference, data, batch, refOutputs[batch]);
+    }
+
+    std::cout << numLayers << " layers, hidden " << hiddenSize << ", " << data.inputIds.size() << " batches of up to "
+              << data.Bmax << " x " << data.S << ". Errors against fp32, weights only (activations in fp32).\n";
+    for (const Variant& v : variants)
+    {
+        Report report;
+        if (!evaluate(v, reference, refOutputs, data, numHeads, numThreads, true, report))
+        {
+            return EXIT_FAILURE;
+        }
+        printReport(v.name, report);
+    }
+
+    if (sweep)
+    {
+        // one layer at a time, the final error shows which layers can take int8
+        std::cout << "\n== int8 sweep ==\n";
+        std::cout << std::left << std::setw(10) << "int8 in" << std::right;
+        for (int i = 0; i < kNB_OUTPUTS; i++)
+        {
+            std::cout << std::setw(14) << getOutputKey(i);
+        }
+        std::cout << std::setw(12) << "start top-1" << std::setw(12) << "end top-1" << "\n";
+        for (int l = -1; l < numLayers; l++)
+        {
+            const std::string name = l < 0 ? std::string("heads") : "l" + std::to_string(l);
+            const Variant v = makeInt8(name, base, std::set<int>{l}, hiddenSize, intermediateSize);
+            Report report;
+            if (!evaluate(v, reference, refOutputs, data, numHeads, numThreads, false, report))
+            {
+                return EXIT_FAILURE;
+            }
+            std::cout << std::left << std::setw(10) << name << std::right << std::scientific << std::setprecision(3);
+            for (int i = 0; i < kNB_OUTPUTS; i++)
+            {
+                std::cout << std::setw(14) << report.outputs[i].maxAbs;
+            }
+            std::cout << std::fixed << std::setprecision(2);
+            for (int i : {kSTART_LOGITS, kEND_LOGITS})
+            {
+                std::cout << std::setw(11) << 100. * report.top1Agree[i] / std::max<size_t>(1, report.top1Count[i])
+                          << "%";
+            }
+            std::cout << "\n";
+        }
+    }
+    return EXIT_SUCCESS;
+}
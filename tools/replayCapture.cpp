@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Re-sends the requests of a capture file (see util/requestCapture.h) to an http_gpu_server.
+// Requests are issued at their captured inter-arrival times divided by --speed, or back to back with --speed 0,
+// and the latencies seen now are reported next to the captured ones.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "workflow/HttpMessage.h"
+#include "workflow/WFFacilities.h"
+#include "workflow/WFTaskFactory.h"
+
+#include "captureFile.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+using namespace bert;
+using namespace std::chrono;
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./replay_capture <capture file> <url> [--speed <factor>] [--limit <n>]\n";
+    std::cout << "--speed         Replay rate relative to the captured one, 0 sends back to back. Default 1.\n";
+    std::cout << "--limit         Replay at most n requests.\n";
+}
+
+// body in the format process2 parses: {"inputs": {"input_ids": [[...] x B], ...}}
+std::string toRequestBody(const CaptureRecord& record)
+{
+    const int B = record.header.batchSize;
+    const int S = record.header.seqLength;
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    auto writeInput = [&](const char* name, const std::vector<int32_t>& values) {
+        writer.Key(name);
+        writer.StartArray();
+        for (int b = 0; b < B; b++)
+        {
+            writer.StartArray();
+            for (int s = 0; s < S; s++)
+            {
+                writer.Int(values[b * S + s]);
+            }
+            writer.EndArray();
+        }
+        writer.EndArray();
+    };
+
+    writer.StartObject();
+    writer.Key("inputs");
+    writer.StartObject();
+    writeInput("input_ids", record.inputIds);
+    writeInput("input_mask", record.inputMask);
+    writeInput("segment_ids", record.segmentIds);
+    writer.EndObject();
+    writer.EndObject();
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+float percentile(std::vector<float>& values, float p)
+{
+    if (values.empty())
+    {
+        return 0.f;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t idx = std::min(values.size() - 1, static_cast<size_t>(p / 100.f * values.size()));
+    return values[idx];
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    const std::string capturePath(argv[1]);
+    const std::string url(argv[2]);
+    double speed = 1.0;
+    size_t limit = 0;
+    for (int it = 3; it < argc; it++)
+    {
+        if (!strcmp(argv[it], "--speed") && it + 1 < argc)
+        {
+            speed = atof(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--limit") && it + 1 < argc)
+        {
+            limit = strtoul(argv[++it], nullptr, 10);
+        }
+        else
+        {
+            printHelpInfo();
+            return EXIT_FAILURE;
+        }
+    }
+
+    CaptureReader reader;
+    if (!reader.open(capturePath))
+    {
+        std::cerr << "Cannot open capture file " << capturePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<CaptureRecord> records;
+    CaptureRecord record;
+    while ((!limit || records.size() < limit) && reader.next(record))
+    {
+        records.push_back(record);
+    }
+    if (records.empty())
+    {
+        std::cerr << "No requests in " << capturePath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::mutex statsMutex;
+    std::vector<float> latenciesMs;
+    std::vector<float> capturedMs;
+    std::atomic<int> failures{0};
+    WFFacilities::WaitGroup waitGroup(records.size());
+
+    // writers append in completion order, so arrivals are only roughly sorted in the file. Records of unknown arrival
+    // (0) sort first and go out right away, the others are paced from the earliest known arrival.
+    std::stable_sort(records.begin(), records.end(), [](const CaptureRecord& a, const CaptureRecord& b) {
+        return a.header.arrivalUs < b.header.arrivalUs;
+    });
+    uint64_t firstArrivalUs = 0;
+    for (const auto& r : records)
+    {
+        if (r.header.arrivalUs)
+        {
+            firstArrivalUs = r.header.arrivalUs;
+            break;
+        }
+    }
+    const auto replayStart = steady_clock::now();
+    for (const auto& r : records)
+    {
+        if (speed > 0 && r.header.arrivalUs)
+        {
+            const auto offset = microseconds(static_cast<int64_t>((r.header.arrivalUs - firstArrivalUs) / speed));
+            std::this_thread::sleep_until(replayStart + offset);
+        }
+
+        const auto sent = steady_clock::now();
+        const float capturedLatencyMs = r.header.latencyUs / 1000.f;
+        WFHttpTask* task = WFTaskFactory::create_http_task(url, 0, 0, [&, sent, capturedLatencyMs](WFHttpTask* t) {
+            const float ms = duration_cast<microseconds>(steady_clock::now() - sent).count() / 1000.f;
+            if (t->get_state() != WFT_STATE_SUCCESS || strcmp(t->get_resp()->get_status_code(), "200"))
+            {
+                failures++;
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                latenciesMs.push_back(ms);
+                if (capturedLatencyMs > 0)
+                {
+                    capturedMs.push_back(capturedLatencyMs);
+                }
+            }
+            waitGroup.done();
+        });
+        protocol::HttpRequest* req = task->get_req();
+        req->set_method("POST");
+        req->add_header_pair("Content-Type", "application/json");
+        const std::string body = toRequestBody(r);
+        req->append_output_body(body.data(), body.size());
+        task->start();
+    }
+    waitGroup.wait();
+
+    const float seconds = duration_cast<microseconds>(steady_clock::now() - replayStart).count() / 1e6f;
+    std::cout << "Replayed " << records.size() << " requests in " << seconds << " s ("
+              << records.size() / seconds << " req/s), " << failures << " failed" << std::endl;
+    std::cout << "latency ms      p50      p90      p99" << std::endl;
+    std::cout << "replayed   " << percentile(latenciesMs, 50) << " " << percentile(latenciesMs, 90) << " "
+              << percentile(latenciesMs, 99) << std::endl;
+    std::cout << "captured   " << percentile(capturedMs, 50) << " " << percentile(capturedMs, 90) << " "
+              << percentile(capturedMs, 99) << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
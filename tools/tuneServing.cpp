@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Picks the serving configuration (Bmax, sequence buckets, instances per device, fp16) with the highest throughput
+// within a latency SLO for the sentence lengths of a capture file (see util/requestCapture.h).
+// Every candidate engine is built through BERTDriver and timed on the GPU, with as many instances running at once
+// as the configuration puts on a device; see util/servingTuner.h for how configurations are scored.
+
+#include "common.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bert.h"
+#include "servingTuner.h"
+#include "weightStore.h"
+
+using namespace bert;
+
+void printHelpInfo()
+{
+    std::cout << "Usage: ./tune_serving <capture file> <bert.weights> --slo-ms <ms> [options]\n";
+    std::cout << "Prints the scored configurations, best last, then the best one as JSON.\n"
+                 "Fails if none meets the SLO.\n";
+    std::cout << "--slo-ms        Latency budget of a request, queueing behind one batch included.\n";
+    std::cout << "--heads         Number of attention heads. Default 12.\n";
+    std::cout << "--batch-sizes   Candidate Bmax values. Default 4,8,16,32.\n";
+    std::cout << "--seq-lengths   Candidate bucket lengths, the largest is always used. Default 32,64,128,200,256.\n";
+    std::cout << "--max-buckets   Most buckets (engines) per instance. Default 3.\n";
+    std::cout << "--instances     Candidate instances per device. Default 1,2.\n";
+    std::cout << "--precisions    fp32, fp16 or both (fp32,fp16). Default both.\n";
+    std::cout << "--devices       Devices the configuration is served on, scales the throughput. Default 1.\n";
+    std::cout << "--device        Device the engines are timed on. Default 0.\n";
+    std::cout << "--iterations    Timed batches per instance and shape. Default 50.\n";
+    std::cout << "--model         Use the analytic cost model instead of the GPU, to try the search out. The weights\n"
+                 "                are not read.\n";
+    std::cout << "--output        Also write the best configuration to this file.\n";
+}
+
+namespace
+{
+
+bool parseIntList(const char* list, std::vector<int>& values)
+{
+    values.clear();
+    const char* p = list;
+    while (*p)
+    {
+        char* end = nullptr;
+        const long v = strtol(p, &end, 10);
+        if (end == p || v <= 0 || (*end && *end != ','))
+        {
+            return false;
+        }
+        values.push_back(static_cast<int>(v));
+        p = *end ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+//! \brief Times engines built through BERTDriver
+//! \details The engines of the current shape are kept, so measuring k + 1 instances after k only builds one more.
+//! Each instance runs its batches from a thread and a stream of its own, like the server's instance queues.
+class DriverBackend : public TunerBackend
+{
+public:
+    DriverBackend(const std::string& weightsPath, int numHeads, int device, int iterations)
+        : mWeightsPath(weightsPath)
+        , mNumHeads(numHeads)
+        , mDevice(device)
+        , mIterations(iterations)
+    {
+    }
+
+    bool measure(const EngineShape& shape, int instances, BatchTiming& timing) override
+    {
+        cudaSetDevice(mDevice);
+        if (mDrivers.empty() || shape < mShape || mShape < shape)
+        {
+            mDrivers.clear();
+            mShape = shape;
+        }
+        while (static_cast<int>(mDrivers.size()) < instances)
+        {
+            std::unique_ptr<BERTDriver> driver = build(shape);
+            if (!driver)
+            {
+                return false;
+            }
+            mDrivers.push_back(std::move(driver));
+        }
+
+        const size_t n = static_cast<size_t>(shape.batchSize) * shape.seqLength;
+        std::vector<int32_t> ids(n, 0);
+        std::vector<int32_t> segments(n, 0);
+        std::vector<int32_t> mask(n, 1);
+        const std::vector<size_t> inputShape{
+            static_cast<size_t>(shape.batchSize), static_cast<size_t>(shape.seqLength)};
+        const nvinfer1::DataType type = nvinfer1::DataType::kINT32;
+        const HostTensorMap inCfg{
+            std::make_pair(kMODEL_INPUT0_NAME, std::make_shared<HostTensor>(ids.data(), type, inputShape)),
+            std::make_pair(kMODEL_INPUT1_NAME, std::make_shared<HostTensor>(segments.data(), type, inputShape)),
+            std::make_pair(kMODEL_INPUT2_NAME, std::make_shared<HostTensor>(mask.data(), type, inputShape))};
+
+        std::vector<std::vector<float>> times(instances);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < instances; i++)
+        {
+            threads.emplace_back([&, i] {
+                cudaSetDevice(mDevice);
+                cudaStream_t stream;
+                cudaStreamCreate(&stream);
+                HostTensorMap outCfg;
+                RunTimes t;
+                // warm up, then time with every instance busy
+                for (int it = 0; it < 5 + mIterations; it++)
+                {
+                    mDrivers[i]->run(inCfg, outCfg, shape.batchSize, stream, &t);
+                    if (it >= 5)
+                    {
+                        times[i].push_back(t.msTotal);
+                    }
+                }
+                cudaStreamDestroy(stream);
+            });
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::vector<float> all;
+        for (const std::vector<float>& t : times)
+        {
+            all.insert(all.end(), t.begin(), t.end());
+        }
+        if (all.empty())
+        {
+            return false;
+        }
+        std::sort(all.begin(), all.end());
+        double sum = 0.;
+        for (float t : all)
+        {
+            sum += t;
+        }
+        timing.msMean = static_cast<float>(sum / all.size());
+        timing.msP99 = all[std::min(all.size() - 1, all.size() * 99 / 100)];
+        gLogInfo << "B=" << shape.batchSize << " S=" << shape.seqLength << (shape.fp16 ? " fp16" : " fp32")
+                 << " instances=" << instances << ": mean " << timing.msMean << " ms, p99 " << timing.msP99 << " ms"
+                 << std::endl;
+        return true;
+    }
+
+private:
+    std::unique_ptr<BERTDriver> build(const EngineShape& shape)
+    {
+        WeightPrepOptions prepOptions;
+        prepOptions.fp16Kernels = shape.fp16;
+        std::shared_ptr<const HostWeights> weights = WeightStore::instance().acquire(mWeightsPath, prepOptions);
+        if (!weights)
+        {
+            gLogError << "Cannot load weights " << mWeightsPath << std::endl;
+            return nullptr;
+        }
+        HostTensorMap params;
+        for (const auto& kv : weights->weights())
+        {
+            std::vector<size_t> tensorShape{static_cast<size_t>(kv.second.count)};
+            params[kv.first]
+                = std::make_shared<HostTensor>(const_cast<void*>(kv.second.values), kv.second.type, tensorShape);
+        }
+        const nvinfer1::Dims dims{2, shape.batchSize, shape.seqLength};
+        const auto profile = std::make_tuple(dims, dims, dims);
+        OptProfileMap optProfileMap = {std::make_pair(kMODEL_INPUT0_NAME, profile),
+            std::make_pair(kMODEL_INPUT1_NAME, profile), std::make_pair(kMODEL_INPUT2_NAME, profile)};
+        std::unique_ptr<BERTDriver> driver(new BERTDriver(mNumHeads, shape.fp16, 5000_MiB, {optProfileMap}));
+        driver->init(params);
+        return driver;
+    }
+
+    std::string mWeightsPath;
+    int mNumHeads;
+    int mDevice;
+    int mIterations;
+    EngineShape mShape{0, 0, false};
+    std::vector<std::unique_ptr<BERTDriver>> mDrivers;
+};
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+    const std::string capturePath(argv[1]);
+    const std::string weightsPath(argv[2]);
+    TunerOptions options;
+    options.sloMs = 0.f;
+    int numHeads = 12;
+    int device = 0;
+    int iterations = 50;
+    bool model = false;
+    std::string outputPath;
+    for (int it = 3; it < argc; it++)
+    {
+        bool ok = true;
+        if (!strcmp(argv[it], "--slo-ms") && it + 1 < argc)
+        {
+            options.sloMs = atof(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--heads") && it + 1 < argc)
+        {
+            numHeads = atoi(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--batch-sizes") && it + 1 < argc)
+        {
+            ok = parseIntList(argv[++it], options.batchSizes);
+        }
+        else if (!strcmp(argv[it], "--seq-lengths") && it + 1 < argc)
+        {
+            ok = parseIntList(argv[++it], options.seqLengths);
+        }
+        else if (!strcmp(argv[it], "--max-buckets") && it + 1 < argc)
+        {
+            options.maxBuckets = atoi(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--instances") && it + 1 < argc)
+        {
+            ok = parseIntList(argv[++it], options.instanceCounts);
+        }
+        else if (!strcmp(argv[it], "--precisions") && it + 1 < argc)
+        {
+            const std::string precisions(argv[++it]);
+            options.precisions.clear();
+            if (precisions.find("fp32") != std::string::npos)
+            {
+                options.precisions.push_back(false);
+            }
+            if (precisions.find("fp16") != std::string::npos)
+            {
+                options.precisions.push_back(true);
+            }
+            ok = !options.precisions.empty();
+        }
+        else if (!strcmp(argv[it], "--devices") && it + 1 < argc)
+        {
+            options.devices = atoi(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--device") && it + 1 < argc)
+        {
+            device = atoi(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--iterations") && it + 1 < argc)
+        {
+            iterations = atoi(argv[++it]);
+        }
+        else if (!strcmp(argv[it], "--model"))
+        {
+            model = true;
+        }
+        else if (!strcmp(argv[it], "--output") && it + 1 < argc)
+        {
+            outputPath = argv[++it];
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            printHelpInfo();
+            return EXIT_FAILURE;
+        }
+    }
+    if (options.sloMs <= 0.f || numHeads <= 0 || options.maxBuckets <= 0 || options.devices <= 0 || iterations <= 0)
+    {
+        printHelpInfo();
+        return EXIT_FAILURE;
+    }
+
+    LengthHistogram histogram;
+    if (!loadLengthHistogram(capturePath, histogram))
+    {
+        gLogError << "No sentences in " << capturePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    gLogInfo << histogram.total << " sentences, longest " << histogram.counts.size() - 1 << " tokens" << std::endl;
+
+    CostModelBackend costModel;
+    DriverBackend driverBackend(weightsPath, numHeads, device, iterations);
+    TunerBackend& backend = model ? static_cast<TunerBackend&>(costModel) : driverBackend;
+    // keep the weights loaded between the engines of the sweep
+    WeightStore::Retain retainWeights;
+
+    ServingTuner tuner(backend, options);
+    ServingConfig best;
+    std::vector<ServingConfig> all;
+    if (!tuner.tune(histogram, best, &all))
+    {
+        gLogError << "No configuration could be measured" << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (auto config = all.rbegin(); config != all.rend(); ++config)
+    {
+        std::cout << config->toJson() << std::endl;
+    }
+    if (!best.meetsSlo)
+    {
+        gLogWarning << "No configuration meets the " << options.sloMs << " ms SLO, best is the fastest to answer"
+                    << std::endl;
+    }
+    std::cout << "best: " << best.toJson() << std::endl;
+    if (!outputPath.empty())
+    {
+        std::ofstream output(outputPath);
+        output << best.toJson() << std::endl;
+        if (!output)
+        {
+            gLogError << "Cannot write " << outputPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return best.meetsSlo ? EXIT_SUCCESS : EXIT_FAILURE;
+}
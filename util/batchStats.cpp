@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "batchStats.h"
+
+namespace bert
+{
+
+int BatchStats::bin(uint64_t part, uint64_t whole)
+{
+    if (!whole)
+    {
+        return 0;
+    }
+    return static_cast<int>(std::min<uint64_t>(part * kFILL_BINS / whole, kFILL_BINS - 1));
+}
+
+void BatchStats::record(const int* mask, size_t maskCount, int batchSize, int seqLength, uint64_t forwardNs)
+{
+    const size_t rows = std::min<size_t>(maskCount / std::max(seqLength, 1), std::max(batchSize, 0));
+    uint64_t filled = 0;
+    uint64_t real = 0;
+    for (size_t r = 0; r < rows; r++)
+    {
+        const int* row = mask + r * seqLength;
+        const uint64_t tokens = std::count_if(row, row + seqLength, [](int m) { return m != 0; });
+        filled += tokens != 0;
+        real += tokens;
+    }
+    const uint64_t slots = std::max(batchSize, 0);
+    const uint64_t positions = slots * std::max(seqLength, 0);
+
+    mBatches.fetch_add(1, std::memory_order_relaxed);
+    mSlots.fetch_add(slots, std::memory_order_relaxed);
+    mFilledSlots.fetch_add(filled, std::memory_order_relaxed);
+    mPositions.fetch_add(positions, std::memory_order_relaxed);
+    mRealTokens.fetch_add(real, std::memory_order_relaxed);
+    mBusyNs.fetch_add(forwardNs, std::memory_order_relaxed);
+    mTokenFill[bin(real, positions)].fetch_add(1, std::memory_order_relaxed);
+    mSlotFill[bin(filled, slots)].fetch_add(1, std::memory_order_relaxed);
+}
+
+BatchStats::Snapshot BatchStats::snapshot() const
+{
+    // the counters are read one by one, a batch recorded meanwhile may be counted in some of them only
+    Snapshot s;
+    s.batches = mBatches.load(std::memory_order_relaxed);
+    s.slots = mSlots.load(std::memory_order_relaxed);
+    s.filledSlots = mFilledSlots.load(std::memory_order_relaxed);
+    s.positions = mPositions.load(std::memory_order_relaxed);
+    s.realTokens = mRealTokens.load(std::memory_order_relaxed);
+    s.busyNs = mBusyNs.load(std::memory_order_relaxed);
+    for (int i = 0; i < kFILL_BINS; i++)
+    {
+        s.tokenFill[i] = mTokenFill[i].load(std::memory_order_relaxed);
+        s.slotFill[i] = mSlotFill[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_BATCH_STATS_H
+#define TRT_BATCH_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bert
+{
+
+//! \brief Histogram bins of the fill ratios, bin i counts batches filled in [i/kFILL_BINS, (i+1)/kFILL_BINS), a full
+//! batch goes in the last one
+constexpr int kFILL_BINS = 10;
+
+//! \brief How much of the executed batches of one instance was real work
+//! \details A batch has batchSize slots of seqLength positions. A slot is filled when its input_mask has at least one
+//! 1, a token is real when its mask is 1. Everything else is padding the engine computes anyway: padded positions of
+//! filled slots and the whole of the empty ones. record is called by the worker of the instance, the snapshot can be
+//! taken from any thread.
+class BatchStats
+{
+public:
+    struct Snapshot
+    {
+        uint64_t batches{0};
+        uint64_t slots{0};        //!< batchSize of every batch
+        uint64_t filledSlots{0};  //!< sentences
+        uint64_t positions{0};    //!< slots x seqLength
+        uint64_t realTokens{0};
+        uint64_t busyNs{0};       //!< time spent in the forwards
+        uint64_t tokenFill[kFILL_BINS]; //!< batches by realTokens / positions
+        uint64_t slotFill[kFILL_BINS];  //!< batches by filledSlots / slots
+
+        //! \brief Positions that were padding, in filled slots or empty ones
+        uint64_t paddedTokens() const
+        {
+            return positions > realTokens ? positions - realTokens : 0;
+        }
+
+        //! \brief Real tokens per second of forward time, 0 before the first batch
+        double effectiveTokensPerSecond() const
+        {
+            return busyNs ? realTokens * 1e9 / busyNs : 0.;
+        }
+    };
+
+    BatchStats() = default;
+    BatchStats(const BatchStats&) = delete;
+    BatchStats& operator=(const BatchStats&) = delete;
+
+    //! \param mask input_mask of the batch, row major, maskCount values. Rows it does not cover are empty slots.
+    //! \param forwardNs duration of the forward
+    void record(const int* mask, size_t maskCount, int batchSize, int seqLength, uint64_t forwardNs);
+
+    Snapshot snapshot() const;
+
+private:
+    static int bin(uint64_t part, uint64_t whole);
+
+    std::atomic<uint64_t> mBatches{0};
+    std::atomic<uint64_t> mSlots{0};
+    std::atomic<uint64_t> mFilledSlots{0};
+    std::atomic<uint64_t> mPositions{0};
+    std::atomic<uint64_t> mRealTokens{0};
+    std::atomic<uint64_t> mBusyNs{0};
+    std::atomic<uint64_t> mTokenFill[kFILL_BINS] = {};
+    std::atomic<uint64_t> mSlotFill[kFILL_BINS] = {};
+};
+
+//! \brief Writes the fields of a snapshot as /debug/queues reports them, into the object a rapidjson Writer is in
+//! \details tokens: real vs padded positions (input_mask), slots: sentences vs batchSize. The fill histograms have
+//! kFILL_BINS bins.
+template <typename Writer>
+void writeBatchStats(Writer& writer, const BatchStats::Snapshot& stats)
+{
+    writer.Key("batches");
+    writer.Uint64(stats.batches);
+    writer.Key("real_tokens");
+    writer.Uint64(stats.realTokens);
+    writer.Key("padded_tokens");
+    writer.Uint64(stats.paddedTokens());
+    writer.Key("sentences");
+    writer.Uint64(stats.filledSlots);
+    writer.Key("slots");
+    writer.Uint64(stats.slots);
+    writer.Key("effective_tokens_per_s");
+    writer.Double(stats.effectiveTokensPerSecond());
+    writer.Key("token_fill");
+    writer.StartArray();
+    for (int b = 0; b < kFILL_BINS; b++)
+    {
+        writer.Uint64(stats.tokenFill[b]);
+    }
+    writer.EndArray();
+    writer.Key("slot_fill");
+    writer.StartArray();
+    for (int b = 0; b < kFILL_BINS; b++)
+    {
+        writer.Uint64(stats.slotFill[b]);
+    }
+    writer.EndArray();
+}
+}
+
+#endif // TRT_BATCH_STATS_H
@@ -22,6 +22,8 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <map>
+#include <string>
 
 namespace bert
 {
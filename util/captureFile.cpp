@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#include "captureFile.h"
+
+namespace bert
+{
+
+bool encodeCaptureRecord(const CaptureRecordHeader& header, const int32_t* inputIds, const int32_t* segmentIds,
+    const int32_t* inputMask, std::vector<char>& out)
+{
+    const size_t n = static_cast<size_t>(header.batchSize) * header.seqLength;
+    const uint32_t length = static_cast<uint32_t>(sizeof(CaptureRecordHeader) + capturePayloadSize(header.batchSize, header.seqLength));
+    out.resize(sizeof(length) + length);
+
+    char* p = out.data();
+    memcpy(p, &length, sizeof(length));
+    p += sizeof(length);
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    uint16_t* ids = reinterpret_cast<uint16_t*>(p);
+    uint8_t* segs = reinterpret_cast<uint8_t*>(p + n * sizeof(uint16_t));
+    uint8_t* mask = segs + n;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (inputIds[i] < 0 || inputIds[i] > 0xffff || segmentIds[i] < 0 || segmentIds[i] > 0xff || inputMask[i] < 0
+            || inputMask[i] > 0xff)
+        {
+            return false;
+        }
+        ids[i] = static_cast<uint16_t>(inputIds[i]);
+        segs[i] = static_cast<uint8_t>(segmentIds[i]);
+        mask[i] = static_cast<uint8_t>(inputMask[i]);
+    }
+    return true;
+}
+
+bool CaptureWriter::open(const std::string& path)
+{
+    mOutput.open(path, std::ios_base::binary | std::ios_base::trunc);
+    if (!mOutput)
+    {
+        return false;
+    }
+    CaptureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCAPTURE_MAGIC, sizeof(kCAPTURE_MAGIC));
+    header.version = kCAPTURE_VERSION;
+    mOutput.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(mOutput);
+}
+
+bool CaptureWriter::write(const CaptureRecordHeader& header, const int32_t* inputIds, const int32_t* segmentIds,
+    const int32_t* inputMask)
+{
+    if (!encodeCaptureRecord(header, inputIds, segmentIds, inputMask, mScratch))
+    {
+        return false;
+    }
+    return writeEncoded(mScratch.data(), mScratch.size());
+}
+
+bool CaptureWriter::writeEncoded(const char* data, size_t size)
+{
+    mOutput.write(data, size);
+    return static_cast<bool>(mOutput);
+}
+
+void CaptureWriter::flush()
+{
+    mOutput.flush();
+}
+
+void CaptureWriter::close()
+{
+    mOutput.close();
+}
+
+bool CaptureReader::open(const std::string& path)
+{
+    mInput.open(path, std::ios_base::binary);
+    CaptureFileHeader header;
+    if (!mInput.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        return false;
+    }
+    return memcmp(header.magic, kCAPTURE_MAGIC, sizeof(kCAPTURE_MAGIC)) == 0 && header.version == kCAPTURE_VERSION;
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+    uint32_t length = 0;
+    if (!mInput.read(reinterpret_cast<char*>(&length), sizeof(length)) || length < sizeof(CaptureRecordHeader))
+    {
+        return false;
+    }
+    mScratch.resize(length);
+    if (!mInput.read(mScratch.data(), length))
+    {
+        return false;
+    }
+    memcpy(&record.header, mScratch.data(), sizeof(CaptureRecordHeader));
+    const size_t n = static_cast<size_t>(record.header.batchSize) * record.header.seqLength;
+    if (length != sizeof(CaptureRecordHeader) + capturePayloadSize(record.header.batchSize, record.header.seqLength))
+    {
+        return false;
+    }
+
+    const char* p = mScratch.data() + sizeof(CaptureRecordHeader);
+    const uint16_t* ids = reinterpret_cast<const uint16_t*>(p);
+    const uint8_t* segs = reinterpret_cast<const uint8_t*>(p + n * sizeof(uint16_t));
+    const uint8_t* mask = segs + n;
+    record.inputIds.assign(ids, ids + n);
+    record.segmentIds.assign(segs, segs + n);
+    record.inputMask.assign(mask, mask + n);
+    return true;
+}
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_CAPTURE_FILE_H
+#define TRT_CAPTURE_FILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bert
+{
+
+// Capture file of network inputs seen in production:
+//   CaptureFileHeader
+//   records, each: uint32 length (bytes after the length field), CaptureRecordHeader, payload
+// The payload of a B x S record is the input ids as uint16 (the vocabulary fits), then the segment ids
+// and the input mask as uint8, each B*S elements in row major order.
+
+constexpr char kCAPTURE_MAGIC[8] = {'B', 'E', 'R', 'T', 'C', 'A', 'P', '\n'};
+constexpr uint32_t kCAPTURE_VERSION = 1;
+
+struct CaptureFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct CaptureRecordHeader
+{
+    uint16_t batchSize;   // B
+    uint16_t seqLength;   // S
+    uint32_t latencyUs;   // end to end latency of the request, 0 if unknown
+    uint64_t arrivalUs;   // arrival time, microseconds since the epoch, 0 if unknown
+};
+
+static_assert(sizeof(CaptureFileHeader) == 16, "unexpected capture header size");
+static_assert(sizeof(CaptureRecordHeader) == 16, "unexpected capture record size");
+
+//! \brief One captured batch, expanded to the int32 layout the network takes
+struct CaptureRecord
+{
+    CaptureRecordHeader header;
+    std::vector<int32_t> inputIds;
+    std::vector<int32_t> segmentIds;
+    std::vector<int32_t> inputMask;
+};
+
+//! \brief Size in bytes of the encoded payload of a B x S record
+inline size_t capturePayloadSize(int B, int S)
+{
+    return static_cast<size_t>(B) * S * (sizeof(uint16_t) + 2 * sizeof(uint8_t));
+}
+
+//! \brief Encodes a record (length, header, payload) into \p out, which is cleared first
+//! \return false if a value does not fit the compact encoding
+bool encodeCaptureRecord(const CaptureRecordHeader& header, const int32_t* inputIds, const int32_t* segmentIds,
+    const int32_t* inputMask, std::vector<char>& out);
+
+//! \brief Sequential writer of capture files
+class CaptureWriter
+{
+public:
+    bool open(const std::string& path);
+    bool write(const CaptureRecordHeader& header, const int32_t* inputIds, const int32_t* segmentIds,
+        const int32_t* inputMask);
+    //! \brief Writes an already encoded record, see encodeCaptureRecord
+    bool writeEncoded(const char* data, size_t size);
+    void flush();
+    void close();
+
+private:
+    std::ofstream mOutput;
+    std::vector<char> mScratch;
+};
+
+//! \brief Sequential reader of capture files
+class CaptureReader
+{
+public:
+    bool open(const std::string& path);
+    //! \return false at the end of the file or on a malformed record
+    bool next(CaptureRecord& record);
+
+private:
+    std::ifstream mInput;
+    std::vector<char> mScratch;
+};
+}
+
+#endif // TRT_CAPTURE_FILE_H
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "cpuAffinity.h"
+
+namespace bert
+{
+
+namespace
+{
+// linux/mempolicy.h
+constexpr int kMPOL_DEFAULT = 0;
+constexpr int kMPOL_PREFERRED = 1;
+
+//! \brief First line of a sysfs file, empty if it cannot be read
+std::string readLine(const std::string& path)
+{
+    std::ifstream input(path);
+    std::string line;
+    std::getline(input, line);
+    return line;
+}
+} // namespace
+
+bool parseCpuList(const std::string& list, std::vector<int>& cpus)
+{
+    cpus.clear();
+    const char* p = list.c_str();
+    while (*p && !isspace(*p))
+    {
+        char* end = nullptr;
+        const long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+        {
+            cpus.clear();
+            return false;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(++p, &end, 10);
+            if (end == p || last < first)
+            {
+                cpus.clear();
+                return false;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p && !isspace(*p))
+        {
+            cpus.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string CpuTopology::defaultSysfsRoot()
+{
+    const char* root = getenv("BERT_SYSFS_ROOT");
+    return root && *root ? root : "/sys";
+}
+
+CpuTopology::CpuTopology(const std::string& sysfsRoot)
+    : mRoot(sysfsRoot)
+{
+    parseCpuList(readLine(mRoot + "/devices/system/node/online"), mNodes);
+}
+
+std::vector<int> CpuTopology::nodeCpus(int node) const
+{
+    std::vector<int> cpus;
+    if (std::find(mNodes.begin(), mNodes.end(), node) != mNodes.end())
+    {
+        parseCpuList(readLine(mRoot + "/devices/system/node/node" + std::to_string(node) + "/cpulist"), cpus);
+    }
+    return cpus;
+}
+
+int CpuTopology::pciDeviceNode(const std::string& pciBusId) const
+{
+    std::string id(pciBusId);
+    std::transform(id.begin(), id.end(), id.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+    const std::string line = readLine(mRoot + "/bus/pci/devices/" + id + "/numa_node");
+    if (line.empty())
+    {
+        return -1;
+    }
+    // -1 is also what the kernel reports for devices outside any node
+    const int node = atoi(line.c_str());
+    return std::find(mNodes.begin(), mNodes.end(), node) != mNodes.end() ? node : -1;
+}
+
+bool currentThreadCpus(std::vector<int>& cpus)
+{
+    cpus.clear();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        return false;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return true;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus)
+{
+    if (cpus.empty())
+    {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool preferNode(int node)
+{
+    if (node < 0)
+    {
+        return syscall(SYS_set_mempolicy, kMPOL_DEFAULT, nullptr, 0) == 0;
+    }
+    const int bitsPerWord = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(node / bitsPerWord + 1, 0);
+    mask[node / bitsPerWord] = 1ul << (node % bitsPerWord);
+    // maxnode counts one past the last bit the kernel reads
+    return syscall(SYS_set_mempolicy, kMPOL_PREFERRED, mask.data(), mask.size() * bitsPerWord + 1) == 0;
+}
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_CPU_AFFINITY_H
+#define TRT_CPU_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief NUMA layout of the host as sysfs describes it
+//! \details Everything is read below a sysfs root, /sys unless BERT_SYSFS_ROOT names another directory, so a fake
+//! tree with the same files (devices/system/node/online, devices/system/node/node<N>/cpulist and
+//! bus/pci/devices/<bus id>/numa_node) can stand in for the machine.
+class CpuTopology
+{
+public:
+    explicit CpuTopology(const std::string& sysfsRoot = defaultSysfsRoot());
+
+    //! \brief BERT_SYSFS_ROOT if set, /sys otherwise
+    static std::string defaultSysfsRoot();
+
+    //! \brief NUMA nodes with memory or CPUs, empty if sysfs has no node directory (non-NUMA kernel)
+    const std::vector<int>& nodes() const
+    {
+        return mNodes;
+    }
+
+    //! \brief CPUs of a node, empty if the node is unknown
+    std::vector<int> nodeCpus(int node) const;
+
+    //! \brief Node of a PCI device, -1 if unknown
+    //! \param pciBusId domain:bus:device.function as cudaDeviceGetPCIBusId returns it, in either case
+    int pciDeviceNode(const std::string& pciBusId) const;
+
+private:
+    std::string mRoot;
+    std::vector<int> mNodes;
+};
+
+//! \brief Parses a kernel cpu list such as "0-3,8,10-11" (also the format of node lists)
+//! \return false if the list is malformed, cpus is left empty then
+bool parseCpuList(const std::string& list, std::vector<int>& cpus);
+
+//! \brief CPUs the calling thread may run on
+bool currentThreadCpus(std::vector<int>& cpus);
+
+//! \brief Restricts the calling thread to cpus. Threads it creates afterwards inherit the set.
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+//! \brief Makes node the preferred node of the pages the calling thread touches first from now on
+//! \details Allocations fall back to other nodes when node is full. -1 restores the default policy (local node).
+//! Returns false on kernels without NUMA.
+bool preferNode(int node);
+}
+
+#endif // TRT_CPU_AFFINITY_H
@@ -14,15 +14,24 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cuda_runtime_api.h>
+#include <deque>
 #include <fstream>
+#include <immintrin.h>
 #include <iostream>
+#include <mutex>
 #include <numeric>
+#include <thread>
 
 #include "attentionKeys.h"
 #include "common.h"
 #include "dataUtils.h"
+#include "half.h"
+#include "weightContainer.h"
 
 namespace bert
 {
@@ -41,28 +50,203 @@ void parseDims(std::ifstream& input, const std::string& name, Dims& d)
     input.get();
 }
 
-//! \brief Inplace transpose of a column major matrix in host memory
-//! \param data dense storage of matrix in column major format
-//! \param d dimensions of matrix
-void transposeMatrix(float* data, const Dims& d)
+namespace
 {
-    // data represents a d0xd1 RowMajor matrix, i.e. d1xd0 ColMajor
-    // which we transpose into d0xd1 ColMajor
-    assert(d.nbDims == 2);
-    const int len = d.d[0] * d.d[1];
-    std::vector<float> tmp(data, data + len);
-
-    int idx = 0; // result matrix linear idx
-    for (int c = 0; c < d.d[1]; c++)
-    { // columns of the result matrix
-        for (int r = 0; r < d.d[0]; r++)
-        { // rows of the result matrix
-            const int srcIdx = r * d.d[1] + c;
-            data[idx++] = tmp[srcIdx];
+constexpr int kTRANSPOSE_BLOCK = 64; // 64x64 floats: src and dst tiles both stay in L1
+
+inline uint16_t toHalf(float v)
+{
+    return half_float::detail::float2half<std::round_to_nearest>(v);
+}
+
+inline void storeRow(float* dst, const float* src, int n)
+{
+    std::copy(src, src + n, dst);
+}
+
+inline void storeRow(uint16_t* dst, const float* src, int n)
+{
+    convertToHalf(src, dst, n);
+}
+
+//! \brief 4x4 SSE transpose of src (row stride ldSrc) into dst (row stride ldDst)
+inline void transpose4x4(const float* src, int ldSrc, float* dst, int ldDst)
+{
+    __m128 r0 = _mm_loadu_ps(src);
+    __m128 r1 = _mm_loadu_ps(src + ldSrc);
+    __m128 r2 = _mm_loadu_ps(src + 2 * ldSrc);
+    __m128 r3 = _mm_loadu_ps(src + 3 * ldSrc);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(dst, r0);
+    _mm_storeu_ps(dst + ldDst, r1);
+    _mm_storeu_ps(dst + 2 * ldDst, r2);
+    _mm_storeu_ps(dst + 3 * ldDst, r3);
+}
+
+//! \brief Cache-blocked out-of-place transpose of a rows x cols row major matrix
+//! \details Each tile is transposed with 4x4 SSE kernels into a local buffer, then written out row by row,
+//! converting to the destination type on the way.
+template <typename T>
+void transposeBlocked(const float* src, T* dst, const int rows, const int cols)
+{
+    float tile[kTRANSPOSE_BLOCK * kTRANSPOSE_BLOCK];
+    for (int r0 = 0; r0 < rows; r0 += kTRANSPOSE_BLOCK)
+    {
+        const int nr = std::min(kTRANSPOSE_BLOCK, rows - r0);
+        for (int c0 = 0; c0 < cols; c0 += kTRANSPOSE_BLOCK)
+        {
+            const int nc = std::min(kTRANSPOSE_BLOCK, cols - c0);
+            // tile[c][r] = src[r0 + r][c0 + c]
+            int r = 0;
+            for (; r + 4 <= nr; r += 4)
+            {
+                int c = 0;
+                for (; c + 4 <= nc; c += 4)
+                {
+                    transpose4x4(src + (r0 + r) * cols + c0 + c, cols, tile + c * kTRANSPOSE_BLOCK + r, kTRANSPOSE_BLOCK);
+                }
+                for (; c < nc; c++)
+                {
+                    for (int i = 0; i < 4; i++)
+                    {
+                        tile[c * kTRANSPOSE_BLOCK + r + i] = src[(r0 + r + i) * cols + c0 + c];
+                    }
+                }
+            }
+            for (; r < nr; r++)
+            {
+                for (int c = 0; c < nc; c++)
+                {
+                    tile[c * kTRANSPOSE_BLOCK + r] = src[(r0 + r) * cols + c0 + c];
+                }
+            }
+            for (int c = 0; c < nc; c++)
+            {
+                storeRow(dst + static_cast<size_t>(c0 + c) * rows + r0, tile + c * kTRANSPOSE_BLOCK, nr);
+            }
         }
     }
 }
 
+//! \brief One unit of work for the preparation stage
+struct PrepJob
+{
+    std::string name;
+    float* src;       // owned, freed by the job if it is not the final storage
+    void* dst;        // final storage, allocated by the reader
+    Dims d;           // dimensions of src
+    bool transpose;   // kernels: transpose d0xd1 RowMajor into d1xd0 RowMajor
+    bool half;        // dst holds fp16
+    bool freeSrc;
+    size_t count;
+
+    void operator()() const
+    {
+        if (transpose)
+        {
+            assert(d.nbDims == 2);
+            if (half)
+            {
+                transposeBlocked(src, static_cast<uint16_t*>(dst), d.d[0], d.d[1]);
+            }
+            else
+            {
+                transposeBlocked(src, static_cast<float*>(dst), d.d[0], d.d[1]);
+            }
+        }
+        else if (half)
+        {
+            convertToHalf(src, static_cast<uint16_t*>(dst), count);
+        }
+        else if (dst != src)
+        {
+            std::copy(src, src + count, static_cast<float*>(dst));
+        }
+        if (freeSrc)
+        {
+            delete[] src;
+        }
+    }
+};
+
+//! \brief Blocking job queue between the reader and the preparation workers
+class PrepQueue
+{
+public:
+    void push(PrepJob&& job)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+        mCond.notify_one();
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mCond.notify_all();
+    }
+
+    bool pop(PrepJob& job)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCond.wait(lock, [this] { return !mJobs.empty() || mClosed; });
+        if (mJobs.empty())
+        {
+            return false;
+        }
+        job = std::move(mJobs.front());
+        mJobs.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<PrepJob> mJobs;
+    bool mClosed{false};
+};
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+} // namespace
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("f16c"))) static void convertToHalfF16C(const float* src, uint16_t* dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    for (; i < n; i++)
+    {
+        dst[i] = toHalf(src[i]);
+    }
+}
+#endif
+
+void convertToHalf(const float* src, uint16_t* dst, size_t n)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool hasF16C = __builtin_cpu_supports("f16c");
+    if (hasF16C)
+    {
+        convertToHalfF16C(src, dst, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = toHalf(src[i]);
+    }
+}
+
 template <typename T>
 DataType getDType()
 {
@@ -124,14 +308,52 @@ void loadInputRow(std::ifstream& input, std::string& name, T*& data, int& nbWeig
     input.get();
 }
 
-void loadWeights(const std::string& wts_path, WeightMap& weightMap)
+void loadWeights(const std::string& wts_path, WeightMap& weightMap, const WeightPrepOptions& options, WeightStorage* storage)
 {
+    // Two stage pipeline: this thread parses rows and hands each tensor that needs work to a pool of workers,
+    // which transpose kernels (straight into the fused qkv tensors for q/k/v) and optionally convert to fp16
+    // while the next rows are being read.
+    const Clock::time_point start = Clock::now();
 
     std::ifstream input(wts_path, std::ios_base::binary);
     int32_t count;
     input >> count;
     gLogInfo << "Number of parameters: " << count << std::endl;
 
+    int numThreads = options.numThreads;
+    if (numThreads <= 0)
+    {
+        numThreads = std::max(1u, std::min(16u, std::thread::hardware_concurrency()));
+    }
+    PrepQueue queue;
+    std::vector<double> busyMs(numThreads, 0.0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < numThreads; t++)
+    {
+        workers.emplace_back([&queue, &busyMs, t] {
+            PrepJob job;
+            while (queue.pop(job))
+            {
+                const Clock::time_point jobStart = Clock::now();
+                job();
+                busyMs[t] += msSince(jobStart);
+            }
+        });
+    }
+
+    // fused qkv tensors, allocated when the first of their q/k/v components is read
+    struct Fused
+    {
+        float* w{nullptr};
+        float* b{nullptr};
+    };
+    std::map<std::string, Fused> fused;
+    const std::string qkvKeys[6] = {WQ, WK, WV, BQ, BK, BV};
+
+    // final storage of every weight, handed to storage at the end
+    std::vector<float*> ownedFloat;
+    std::vector<uint16_t*> ownedHalf;
+
     for (int it = 0; it < count; it++)
     {
         int param_size = 0;
@@ -142,65 +364,121 @@ void loadWeights(const std::string& wts_path, WeightMap& weightMap)
         assert(data);
         assert(param_size);
 
+        PrepJob job;
+        job.name = name;
+        job.src = data;
+        job.dst = data;
+        job.d = d;
+        job.count = param_size;
         // Need to be careful here. This is highly dependent on the TF implementation.
         // The TF squad output does not use a fully connected layer but a matmul op with a transpose, which names the
         // output as squad_output_weights
-        if (name.find("kernel") != std::string::npos)
+        job.transpose = name.find("kernel") != std::string::npos;
+        job.half = options.fp16Kernels && isFcKernel(name);
+        job.freeSrc = false;
+
+        int qkv = -1;
+        std::string prefix;
+        for (int k = 0; k < 6; k++)
         {
-            gLogVerbose << "Transposing\n";
-            transposeMatrix(data, d);
+            const size_t pos = name.rfind(qkvKeys[k]);
+            if (pos != std::string::npos && pos + qkvKeys[k].size() == name.size())
+            {
+                qkv = k;
+                prefix = name.substr(0, pos);
+                break;
+            }
         }
-        Weights tmp;
-        tmp.type = DataType::kFLOAT;
-        tmp.values = data;
-        tmp.count = param_size;
 
-        weightMap[name] = tmp;
+        if (qkv >= 0)
+        {
+            // q/k/v land in their slot of the fused tensor, the separate weights alias that slot
+            Fused& f = fused[prefix];
+            const bool isKernel = qkv < 3;
+            float*& all = isKernel ? f.w : f.b;
+            if (!all)
+            {
+                all = new float[3 * param_size];
+                ownedFloat.push_back(all);
+                weightMap[prefix + (isKernel ? WQKV : BQKV)] = Weights{DataType::kFLOAT, all, 3 * param_size};
+            }
+            job.dst = all + (qkv % 3) * param_size;
+            job.half = false; // the fused kernel is converted as a whole below if requested
+            job.freeSrc = true;
+            weightMap[name] = Weights{DataType::kFLOAT, job.dst, param_size};
+        }
+        else if (job.transpose || job.half)
+        {
+            if (job.half)
+            {
+                ownedHalf.push_back(new uint16_t[param_size]);
+                job.dst = ownedHalf.back();
+            }
+            else
+            {
+                ownedFloat.push_back(new float[param_size]);
+                job.dst = ownedFloat.back();
+            }
+            job.freeSrc = true;
+            weightMap[name] = Weights{job.half ? DataType::kHALF : DataType::kFLOAT, job.dst, param_size};
+        }
+        else
+        {
+            weightMap[name] = Weights{DataType::kFLOAT, data, param_size};
+            ownedFloat.push_back(data);
+            continue;
+        }
+        queue.push(std::move(job));
     }
-
     input.close();
+    const double readMs = msSince(start);
+
+    queue.close();
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    const double prepMs = msSince(start);
 
-    for (auto& kv : weightMap)
+    if (options.fp16Kernels)
     {
+        // the fused kernels are complete only now. The aliasing q/k/v weights are dropped, they would not match.
+        for (auto& kv : fused)
+        {
+            const int wcount = static_cast<int>(weightMap[kv.first + WQKV].count);
+            uint16_t* h = new uint16_t[wcount];
+            convertToHalf(kv.second.w, h, wcount);
+            ownedFloat.erase(std::find(ownedFloat.begin(), ownedFloat.end(), kv.second.w));
+            delete[] kv.second.w;
+            ownedHalf.push_back(h);
+            weightMap[kv.first + WQKV] = Weights{DataType::kHALF, h, wcount};
+            weightMap.erase(kv.first + WQ);
+            weightMap.erase(kv.first + WK);
+            weightMap.erase(kv.first + WV);
+        }
+    }
 
-        const int pos = kv.first.find(BQ); // starting pos of BQ
-        if (pos != std::string::npos)
+    if (storage)
+    {
+        for (float* p : ownedFloat)
+        {
+            storage->emplace_back(p, std::default_delete<float[]>());
+        }
+        for (uint16_t* p : ownedHalf)
         {
-            const int hidden_size = kv.second.count;
-            const std::string prefix = kv.first.substr(0, pos);
-
-            const Weights& Bq_ = kv.second;
-            const Weights Bk_ = weightMap.at(prefix + BK);
-            const Weights Bv_ = weightMap.at(prefix + BV);
-            const Weights Wq_ = weightMap.at(prefix + WQ);
-            const Weights Wk_ = weightMap.at(prefix + WK);
-            const Weights Wv_ = weightMap.at(prefix + WV);
-
-            const int mat_size = hidden_size * hidden_size;
-            const int wcount = 3 * mat_size;
-            float* Wall_ptr = new float[wcount];
-
-            const int bcount = 3 * hidden_size;
-            float* Ball_ptr = new float[bcount];
-
-            std::copy(reinterpret_cast<const float*>(Wq_.values),
-                (reinterpret_cast<const float*>(Wq_.values)) + mat_size, Wall_ptr);
-            std::copy(reinterpret_cast<const float*>(Wk_.values),
-                (reinterpret_cast<const float*>(Wk_.values)) + mat_size, Wall_ptr + mat_size);
-            std::copy(reinterpret_cast<const float*>(Wv_.values),
-                (reinterpret_cast<const float*>(Wv_.values)) + mat_size, Wall_ptr + 2 * mat_size);
-            std::copy(reinterpret_cast<const float*>(Bq_.values),
-                (reinterpret_cast<const float*>(Bq_.values)) + hidden_size, Ball_ptr);
-            std::copy(reinterpret_cast<const float*>(Bk_.values),
-                (reinterpret_cast<const float*>(Bk_.values)) + hidden_size, Ball_ptr + hidden_size);
-            std::copy(reinterpret_cast<const float*>(Bv_.values),
-                (reinterpret_cast<const float*>(Bv_.values)) + hidden_size, Ball_ptr + 2 * hidden_size);
-
-            weightMap[prefix + WQKV] = {DataType::kFLOAT, Wall_ptr, wcount};
-            weightMap[prefix + BQKV] = {DataType::kFLOAT, Ball_ptr, bcount};
+            storage->emplace_back(p, std::default_delete<uint16_t[]>());
         }
     }
+
+    double busy = 0;
+    for (double b : busyMs)
+    {
+        busy += b;
+    }
+    gLogInfo << "Loaded weights in " << msSince(start) << " ms (read " << readMs << " ms, prepare done at " << prepMs
+             << " ms, " << busy << " ms cpu on " << numThreads << " threads)" << std::endl;
 }
+
 //sds: input file must be beishu of 3, first is input_id /input_mask/ segment_id
 void loadInputs(const std::string& weightsPath, int& Bmax, int& S, std::vector<nvinfer1::Weights>& inputIds,
     std::vector<nvinfer1::Weights>& inputMasks, std::vector<nvinfer1::Weights>& segmentIds,
@@ -19,19 +19,41 @@
 
 #include <NvInfer.h>
 #include <bertUtils.h>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace bert
 {
 
+//! \brief Options of the weight preparation stage of loadWeights
+struct WeightPrepOptions
+{
+    bool fp16Kernels{false}; //!< convert fully connected kernels to fp16 while transposing them
+    int numThreads{0};       //!< preparation threads, 0 means one per hardware thread (at most 16)
+};
+
+//! \brief Owning handles to the buffers behind the Weights returned by loadWeights
+using WeightStorage = std::vector<std::shared_ptr<void>>;
+
 //! \brief Loads a dictionary of weights
-//! \details The function loads the weights of the BERT network from a weights file. The Weights in the dictionary own
-//! the storage behind the Weights::values pointer. It is therefore the callers responsibility to free it. See also helpers/convert_weights.py
+//! \details The function loads the weights of the BERT network from a weights file. Kernels are transposed with a
+//! cache-blocked kernel on a pool of threads while the file is read, and q/k/v kernels and biases are written straight
+//! into the fused qkv tensors. The q/k/v weights alias their slot of the fused tensor. If \p storage is given, it
+//! receives ownership of every buffer, and the weights stay valid as long as it does. Otherwise the Weights in the
+//! dictionary own the storage behind the Weights::values pointer and it is the callers responsibility to free it.
+//! See also helpers/convert_weights.py
 //!\param path path to inputs
 //!\param weightMap map of weights that the function will populate
-void loadWeights(const std::string& path, WeightMap& weightMap);
+//!\param options see WeightPrepOptions. With fp16Kernels, the separate q/k/v kernels are not returned.
+//!\param storage optional, receives the buffers backing weightMap
+void loadWeights(const std::string& path, WeightMap& weightMap, const WeightPrepOptions& options = WeightPrepOptions(),
+    WeightStorage* storage = nullptr);
+
+//! \brief Converts fp32 to fp16 (round to nearest even), with F16C when the CPU has it
+void convertToHalf(const float* src, uint16_t* dst, size_t n);
 
 //! \brief Loads a batch of inputs
 //! \details The function loads inputs for the network consisting batches of tokenized text, input masks and segement ids.
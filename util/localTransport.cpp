@@ -0,0 +1,630 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <limits>
+
+#include "localTransport.h"
+#include "logger.h"
+#include "objectPool.h"
+
+// memfd sealing, missing from the headers of older distributions
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+namespace bert
+{
+
+namespace
+{
+// messages read from one connection per wake-up, so a busy client cannot starve the others
+constexpr int kREAD_BURST = 64;
+constexpr int kMAX_EVENTS = 64;
+// room for the inline replies of a few batches, replies that do not fit disconnect the client
+constexpr int kSEND_BUFFER = 4 << 20;
+
+bool fillAddress(const std::string& path, sockaddr_un& address)
+{
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        gLogError << "Invalid local socket path " << path << std::endl;
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+int createMemfd(const char* name)
+{
+#ifdef SYS_memfd_create
+    return static_cast<int>(syscall(SYS_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void closeFd(int& fd)
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+} // namespace
+
+LocalConnection::~LocalConnection()
+{
+    if (ring)
+    {
+        munmap(ring, ringBytes);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+LocalServer::~LocalServer()
+{
+    stop();
+}
+
+bool LocalServer::start(
+    const std::string& path, int batchSize, int seqLength, RequestHandler onRequest, CloseHandler onClose)
+{
+    if (mPoller.joinable())
+    {
+        gLogError << "Local server already started" << std::endl;
+        return false;
+    }
+    sockaddr_un address;
+    if (!fillAddress(path, address) || batchSize <= 0 || seqLength <= 0)
+    {
+        return false;
+    }
+    mPath = path;
+    mBatchSize = batchSize;
+    mSeqLength = seqLength;
+    mInputBytes = localInputBytes(batchSize, seqLength);
+    mOnRequest = std::move(onRequest);
+    mOnClose = std::move(onClose);
+    mStop = false;
+
+    mListenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    unlink(path.c_str());
+    bool ok = mListenFd >= 0 && mEpollFd >= 0 && mWakeFd >= 0
+        && bind(mListenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0
+        && listen(mListenFd, SOMAXCONN) == 0;
+    for (int fd : {mListenFd, mWakeFd})
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        ok = ok && epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+    if (!ok)
+    {
+        gLogError << "Cannot listen on " << path << ": " << strerror(errno) << std::endl;
+        closeFd(mListenFd);
+        closeFd(mEpollFd);
+        closeFd(mWakeFd);
+        return false;
+    }
+    mPoller = std::thread(&LocalServer::poll, this);
+    return true;
+}
+
+void LocalServer::stop()
+{
+    if (!mPoller.joinable())
+    {
+        return;
+    }
+    mStop = true;
+    const uint64_t one = 1;
+    if (write(mWakeFd, &one, sizeof(one)) != sizeof(one))
+    {
+        gLogWarning << "Cannot wake the local server" << std::endl;
+    }
+    mPoller.join();
+    for (auto& entry : mConnections)
+    {
+        LocalConnection& connection = *entry.second;
+        std::lock_guard<std::mutex> lock(connection.sendMutex);
+        connection.closed = true;
+        shutdown(connection.fd, SHUT_RDWR);
+    }
+    mConnections.clear();
+    closeFd(mListenFd);
+    closeFd(mEpollFd);
+    closeFd(mWakeFd);
+    unlink(mPath.c_str());
+}
+
+void LocalServer::poll()
+{
+    epoll_event events[kMAX_EVENTS];
+    while (!mStop)
+    {
+        const int n = epoll_wait(mEpollFd, events, kMAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+        {
+            gLogError << "Local server poll failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == mWakeFd)
+            {
+                continue;
+            }
+            if (fd == mListenFd)
+            {
+                accept();
+                continue;
+            }
+            auto it = mConnections.find(fd);
+            if (it == mConnections.end())
+            {
+                continue;
+            }
+            // hanging up drops the entry of the map
+            const std::shared_ptr<LocalConnection> connection = it->second;
+            if (events[i].events & EPOLLIN)
+            {
+                read(connection);
+            }
+            else
+            {
+                hangUp(connection);
+            }
+        }
+    }
+}
+
+void LocalServer::accept()
+{
+    for (;;)
+    {
+        const int fd = accept4(mListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                gLogWarning << "Local server accept failed: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        const std::shared_ptr<LocalConnection> connection = std::make_shared<LocalConnection>();
+        connection->fd = fd;
+        const int sendBuffer = kSEND_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) == 0)
+        {
+            mConnections[fd] = connection;
+        }
+    }
+}
+
+void LocalServer::read(const std::shared_ptr<LocalConnection>& connection)
+{
+    for (int burst = 0; burst < kREAD_BURST; burst++)
+    {
+        LocalRequest* request = ObjectPool<LocalRequest>::acquire();
+        if (request->payload.size() != mInputBytes)
+        {
+            request->payload.resize(mInputBytes);
+        }
+        iovec iov[2];
+        iov[0].iov_base = &request->header;
+        iov[0].iov_len = sizeof(LocalRequestHeader);
+        iov[1].iov_base = request->payload.data();
+        iov[1].iov_len = mInputBytes;
+        union
+        {
+            cmsghdr align;
+            char buffer[CMSG_SPACE(4 * sizeof(int))];
+        } control;
+        msghdr message{};
+        message.msg_iov = iov;
+        message.msg_iovlen = 2;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        const ssize_t n = recvmsg(connection->fd, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+
+        // descriptors are only expected with kLOCAL_MAP_RING, the first one is kept
+        int fd = -1;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&message); n > 0 && c; c = CMSG_NXTHDR(&message, c))
+        {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            {
+                continue;
+            }
+            const size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t k = 0; k < count; k++)
+            {
+                int received;
+                memcpy(&received, CMSG_DATA(c) + k * sizeof(int), sizeof(int));
+                if (fd < 0)
+                {
+                    fd = received;
+                }
+                else
+                {
+                    close(received);
+                }
+            }
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        {
+            release(request);
+            return;
+        }
+        const LocalRequestHeader& header = request->header;
+        if (n < static_cast<ssize_t>(sizeof(LocalRequestHeader)) || header.magic != kLOCAL_MAGIC)
+        {
+            // end of stream, error or not a client of this protocol
+            closeFd(fd);
+            release(request);
+            hangUp(connection);
+            return;
+        }
+        request->connection = connection;
+        const bool truncated = message.msg_flags & (MSG_TRUNC | MSG_CTRUNC);
+        const size_t payloadBytes = n - sizeof(LocalRequestHeader);
+        const bool shape = !truncated && header.batchSize == mBatchSize && header.seqLength == mSeqLength;
+        switch (header.op)
+        {
+        case kLOCAL_INFO:
+            reply(request, kLOCAL_OK);
+            break;
+        case kLOCAL_MAP_RING:
+        {
+            const bool mapped = !truncated && fd >= 0 && mapRing(*connection, fd);
+            fd = -1;
+            reply(request, mapped ? kLOCAL_OK : kLOCAL_BAD_REQUEST);
+            break;
+        }
+        case kLOCAL_INFER:
+            if (shape && payloadBytes == mInputBytes)
+            {
+                const int32_t* inputs = reinterpret_cast<const int32_t*>(request->payload.data());
+                const size_t count = static_cast<size_t>(mBatchSize) * mSeqLength;
+                request->inputIds = inputs;
+                request->segmentIds = inputs + count;
+                request->inputMask = inputs + 2 * count;
+                mOnRequest(request);
+            }
+            else
+            {
+                reply(request, kLOCAL_BAD_REQUEST);
+            }
+            break;
+        case kLOCAL_RING_INFER:
+            if (shape && payloadBytes == 0 && connection->ring && header.slot < connection->nbSlots)
+            {
+                request->slot = connection->slot(header.slot);
+                const int32_t* inputs = reinterpret_cast<const int32_t*>(request->slot);
+                const size_t count = static_cast<size_t>(mBatchSize) * mSeqLength;
+                request->inputIds = inputs;
+                request->segmentIds = inputs + count;
+                request->inputMask = inputs + 2 * count;
+                mOnRequest(request);
+            }
+            else
+            {
+                reply(request, kLOCAL_BAD_REQUEST);
+            }
+            break;
+        default:
+            reply(request, kLOCAL_BAD_REQUEST);
+            break;
+        }
+        closeFd(fd);
+    }
+}
+
+void LocalServer::hangUp(const std::shared_ptr<LocalConnection>& connection)
+{
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    {
+        std::lock_guard<std::mutex> lock(connection->sendMutex);
+        connection->closed = true;
+    }
+    if (mOnClose)
+    {
+        mOnClose(*connection);
+    }
+    // the descriptor and the ring go once the last request in flight is replied
+    mConnections.erase(connection->fd);
+}
+
+bool LocalServer::mapRing(LocalConnection& connection, int fd)
+{
+    struct stat st;
+    const int seals = fcntl(fd, F_GET_SEALS);
+    if (connection.ring || seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &st) != 0
+        || st.st_size < static_cast<off_t>(kLOCAL_RING_DATA))
+    {
+        close(fd);
+        return false;
+    }
+    const size_t bytes = st.st_size;
+    void* ring = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED)
+    {
+        return false;
+    }
+    // the client may rewrite the header later, only this copy is trusted
+    LocalRingHeader header;
+    memcpy(&header, ring, sizeof(header));
+    if (header.magic != kLOCAL_MAGIC || header.nbSlots == 0 || header.slotBytes < mInputBytes
+        || header.slotBytes % sizeof(float) || (bytes - kLOCAL_RING_DATA) / header.slotBytes < header.nbSlots)
+    {
+        munmap(ring, bytes);
+        return false;
+    }
+    connection.ring = static_cast<char*>(ring);
+    connection.ringBytes = bytes;
+    connection.nbSlots = header.nbSlots;
+    connection.slotBytes = header.slotBytes;
+    return true;
+}
+
+size_t LocalServer::outputCapacity(const LocalRequest* request) const
+{
+    return request->slot ? request->connection->slotBytes - mInputBytes : std::numeric_limits<size_t>::max();
+}
+
+void LocalServer::reply(LocalRequest* request, uint32_t status, const iovec* outputs, int nbOutputs)
+{
+    LocalReplyHeader header;
+    header.magic = kLOCAL_MAGIC;
+    header.status = status;
+    header.requestId = request->header.requestId;
+    header.slot = request->header.slot;
+    header.batchSize = mBatchSize;
+    header.seqLength = mSeqLength;
+    header.nbBytes = 0;
+    iovec iov[1 + kMAX_OUTPUTS];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    int iovCount = 1;
+    if (status == kLOCAL_OK && nbOutputs > 0)
+    {
+        size_t total = 0;
+        for (int i = 0; i < nbOutputs; i++)
+        {
+            total += outputs[i].iov_len;
+        }
+        if (nbOutputs > kMAX_OUTPUTS || total > outputCapacity(request) || total > UINT32_MAX)
+        {
+            header.status = kLOCAL_BAD_REQUEST;
+        }
+        else if (request->slot)
+        {
+            char* dst = request->slot + mInputBytes;
+            for (int i = 0; i < nbOutputs; i++)
+            {
+                memcpy(dst, outputs[i].iov_base, outputs[i].iov_len);
+                dst += outputs[i].iov_len;
+            }
+            header.nbBytes = static_cast<uint32_t>(total);
+        }
+        else
+        {
+            for (int i = 0; i < nbOutputs; i++)
+            {
+                iov[iovCount++] = outputs[i];
+            }
+            header.nbBytes = static_cast<uint32_t>(total);
+        }
+    }
+    send(*request->connection, iov, iovCount);
+    release(request);
+}
+
+void LocalServer::send(LocalConnection& connection, const iovec* iov, int iovCount)
+{
+    std::lock_guard<std::mutex> lock(connection.sendMutex);
+    if (connection.closed)
+    {
+        return;
+    }
+    msghdr message{};
+    message.msg_iov = const_cast<iovec*>(iov);
+    message.msg_iovlen = iovCount;
+    if (sendmsg(connection.fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+    {
+        // the poll thread sees the hang-up and cleans up
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            gLogWarning << "Local client does not read its replies, disconnected" << std::endl;
+        }
+        connection.closed = true;
+        shutdown(connection.fd, SHUT_RDWR);
+    }
+}
+
+void LocalServer::release(LocalRequest* request)
+{
+    request->connection.reset();
+    request->slot = nullptr;
+    ObjectPool<LocalRequest>::release(request);
+}
+
+LocalClient::~LocalClient()
+{
+    if (mRing)
+    {
+        munmap(mRing, mRingBytes);
+    }
+    closeFd(mFd);
+}
+
+bool LocalClient::connect(const std::string& path)
+{
+    sockaddr_un address;
+    if (mFd >= 0 || !fillAddress(path, address))
+    {
+        return false;
+    }
+    mFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (mFd < 0 || ::connect(mFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        gLogError << "Cannot connect to " << path << ": " << strerror(errno) << std::endl;
+        closeFd(mFd);
+        return false;
+    }
+    LocalRequestHeader header{};
+    header.op = kLOCAL_INFO;
+    LocalReplyHeader reply;
+    if (!send(header) || !receive(reply) || reply.status != kLOCAL_OK)
+    {
+        closeFd(mFd);
+        return false;
+    }
+    mBatchSize = reply.batchSize;
+    mSeqLength = reply.seqLength;
+    return true;
+}
+
+bool LocalClient::mapRing(uint32_t nbSlots, size_t slotBytes)
+{
+    if (mFd < 0 || mRing || !nbSlots)
+    {
+        return false;
+    }
+    const size_t bytes = kLOCAL_RING_DATA + nbSlots * slotBytes;
+    int fd = createMemfd("bert_ring");
+    if (fd < 0 || ftruncate(fd, bytes) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0)
+    {
+        gLogError << "Cannot create the ring memfd: " << strerror(errno) << std::endl;
+        closeFd(fd);
+        return false;
+    }
+    void* ring = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED)
+    {
+        closeFd(fd);
+        return false;
+    }
+    LocalRingHeader ringHeader;
+    ringHeader.magic = kLOCAL_MAGIC;
+    ringHeader.nbSlots = nbSlots;
+    ringHeader.slotBytes = slotBytes;
+    memcpy(ring, &ringHeader, sizeof(ringHeader));
+
+    LocalRequestHeader header{};
+    header.magic = kLOCAL_MAGIC;
+    header.op = kLOCAL_MAP_RING;
+    iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    union
+    {
+        cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    cmsghdr* c = CMSG_FIRSTHDR(&message);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    LocalReplyHeader reply;
+    const bool ok = sendmsg(mFd, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(header)) && receive(reply)
+        && reply.status == kLOCAL_OK;
+    closeFd(fd);
+    if (!ok)
+    {
+        munmap(ring, bytes);
+        return false;
+    }
+    mRing = static_cast<char*>(ring);
+    mRingBytes = bytes;
+    mSlotBytes = slotBytes;
+    return true;
+}
+
+bool LocalClient::send(LocalRequestHeader header, const void* inputs)
+{
+    header.magic = kLOCAL_MAGIC;
+    iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<void*>(inputs);
+    iov[1].iov_len = inputs ? localInputBytes(header.batchSize, header.seqLength) : 0;
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = inputs ? 2 : 1;
+    const ssize_t expected = iov[0].iov_len + iov[1].iov_len;
+    return sendmsg(mFd, &message, MSG_NOSIGNAL) == expected;
+}
+
+bool LocalClient::receive(LocalReplyHeader& reply, void* outputs, size_t capacity)
+{
+    iovec iov[2];
+    iov[0].iov_base = &reply;
+    iov[0].iov_len = sizeof(reply);
+    iov[1].iov_base = outputs;
+    iov[1].iov_len = outputs ? capacity : 0;
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = 2;
+    ssize_t n;
+    do
+    {
+        n = recvmsg(mFd, &message, 0);
+    } while (n < 0 && errno == EINTR);
+    return n >= static_cast<ssize_t>(sizeof(reply)) && reply.magic == kLOCAL_MAGIC && !(message.msg_flags & MSG_TRUNC);
+}
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_LOCAL_TRANSPORT_H
+#define TRT_LOCAL_TRANSPORT_H
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace bert
+{
+
+//! \file
+//! Transport for clients on the same host: one message per request and per reply on a SOCK_SEQPACKET Unix socket,
+//! no HTTP framing. A client may also map a ring of slots shared with the server (a sealed memfd sent once with
+//! kLOCAL_MAP_RING): it then writes the inputs of a request into a slot, sends only a header naming the slot and finds
+//! the outputs in the same slot when the reply header arrives. Tensors never go through the socket.
+//!
+//! Inputs are batchSize x seqLength int32 input ids, then segment ids, then input mask. Outputs are float32, in the
+//! order of the bits of outputMask. Inline requests carry the inputs after their header and inline replies the
+//! outputs after theirs; in a slot the outputs follow the inputs. Integers are in host order.
+
+constexpr uint32_t kLOCAL_MAGIC = 0x54524542; // "BERT"
+
+enum LocalOp : uint32_t
+{
+    kLOCAL_INFO = 1,       //!< replies the batch size and sequence length of the server
+    kLOCAL_INFER = 2,      //!< inputs follow the header
+    kLOCAL_MAP_RING = 3,   //!< the memfd of a ring is attached (SCM_RIGHTS), once per connection
+    kLOCAL_RING_INFER = 4, //!< inputs are in the slot named by the header
+};
+
+enum LocalStatus : uint32_t
+{
+    kLOCAL_OK = 0,
+    kLOCAL_BAD_REQUEST,  //!< malformed header, dimensions other than the server's, no or invalid ring
+    kLOCAL_EXPIRED,      //!< timeoutMs passed before the request ran or was replied
+    kLOCAL_UNAVAILABLE,  //!< the request was dropped
+};
+
+struct LocalRequestHeader
+{
+    uint32_t magic;
+    uint32_t op;          //!< LocalOp
+    uint64_t requestId;   //!< echoed in the reply, replies may come out of order
+    int32_t batchSize;
+    int32_t seqLength;
+    uint32_t outputMask;  //!< bit per output, see BertOutput
+    uint32_t timeoutMs;   //!< 0: the server's default deadline
+    uint32_t slot;        //!< kLOCAL_RING_INFER
+    uint32_t reserved;
+};
+
+struct LocalReplyHeader
+{
+    uint32_t magic;
+    uint32_t status;      //!< LocalStatus
+    uint64_t requestId;
+    uint32_t slot;
+    int32_t batchSize;    //!< of the server
+    int32_t seqLength;    //!< of the server
+    uint32_t nbBytes;     //!< outputs after the header (inline) or after the inputs in the slot (ring)
+};
+
+//! \brief Start of a ring memfd. The slots follow at kLOCAL_RING_DATA, slotBytes apart.
+//! \details The memfd must be sealed against shrinking (F_SEAL_SHRINK) so the server cannot fault on it.
+struct LocalRingHeader
+{
+    uint32_t magic;
+    uint32_t nbSlots;
+    uint64_t slotBytes;
+};
+
+constexpr size_t kLOCAL_RING_DATA = 4096;
+
+//! \brief Bytes of the three input tensors of a batchSize x seqLength request
+inline size_t localInputBytes(int batchSize, int seqLength)
+{
+    return 3 * static_cast<size_t>(batchSize) * seqLength * sizeof(int32_t);
+}
+
+//! \brief A client connection; requests in flight keep it, and the ring it mapped, alive
+struct LocalConnection
+{
+    int fd{-1};
+    std::atomic<bool> closed{false};
+    std::mutex sendMutex;
+    char* ring{nullptr};
+    size_t ringBytes{0};
+    uint32_t nbSlots{0};
+    size_t slotBytes{0};
+    //! \brief Owned by the user of the server, e.g. the liveness state of the connection. Only touched on the
+    //! server's thread.
+    std::shared_ptr<void> context;
+
+    ~LocalConnection();
+
+    char* slot(uint32_t index) const
+    {
+        return ring + kLOCAL_RING_DATA + index * slotBytes;
+    }
+};
+
+//! \brief A request handed to the server's handler, replied with LocalServer::reply
+struct LocalRequest
+{
+    LocalRequestHeader header;
+    //! batchSize x seqLength each, in the message or in the slot
+    const int32_t* inputIds;
+    const int32_t* segmentIds;
+    const int32_t* inputMask;
+    std::shared_ptr<LocalConnection> connection;
+    //! the slot of a ring request, null for inline requests
+    char* slot{nullptr};
+    //! receive buffer of inline requests, kept by pooled requests
+    std::vector<char> payload;
+};
+
+//! \brief Unix socket listener of the local transport, with a poll thread of its own
+//! \details The handler runs on the poll thread and must only queue the request: it owns the request until it passes
+//! it to reply, from any thread. Malformed requests and kLOCAL_INFO / kLOCAL_MAP_RING are replied by the server
+//! itself. Requests come from an ObjectPool and keep their receive buffer, so serving them does not allocate.
+class LocalServer
+{
+public:
+    using RequestHandler = std::function<void(LocalRequest*)>;
+    //! \brief Called on the poll thread when a client hangs up, before its requests in flight are replied
+    using CloseHandler = std::function<void(LocalConnection&)>;
+
+    LocalServer() = default;
+    ~LocalServer();
+
+    LocalServer(const LocalServer&) = delete;
+    LocalServer& operator=(const LocalServer&) = delete;
+
+    //! \brief Listens on path (an existing socket file is replaced) for batchSize x seqLength requests
+    bool start(const std::string& path, int batchSize, int seqLength, RequestHandler onRequest,
+        CloseHandler onClose = CloseHandler());
+
+    //! \brief Stops accepting and reading; requests in flight may still be replied
+    void stop();
+
+    //! \brief Sends the reply of a request and releases it
+    //! \details Inline replies send outputs straight from the given buffers; ring replies copy them into the slot,
+    //! after the inputs. A client that does not read its replies fast enough is disconnected rather than blocking
+    //! the calling thread.
+    void reply(LocalRequest* request, uint32_t status, const iovec* outputs = nullptr, int nbOutputs = 0);
+
+    //! \brief Room for the outputs of a request: the rest of its slot, unbounded inline
+    size_t outputCapacity(const LocalRequest* request) const;
+
+    static constexpr int kMAX_OUTPUTS = 8;
+
+private:
+    void poll();
+    void accept();
+    void read(const std::shared_ptr<LocalConnection>& connection);
+    void hangUp(const std::shared_ptr<LocalConnection>& connection);
+    bool mapRing(LocalConnection& connection, int fd);
+    void send(LocalConnection& connection, const iovec* iov, int iovCount);
+    void release(LocalRequest* request);
+
+    std::string mPath;
+    int mBatchSize{0};
+    int mSeqLength{0};
+    size_t mInputBytes{0};
+    int mListenFd{-1};
+    int mEpollFd{-1};
+    int mWakeFd{-1};
+    std::atomic<bool> mStop{false};
+    RequestHandler mOnRequest;
+    CloseHandler mOnClose;
+    std::unordered_map<int, std::shared_ptr<LocalConnection>> mConnections;
+    std::thread mPoller;
+};
+
+//! \brief Blocking client of a LocalServer, e.g. for tools and tests. Not thread safe.
+class LocalClient
+{
+public:
+    LocalClient() = default;
+    ~LocalClient();
+
+    LocalClient(const LocalClient&) = delete;
+    LocalClient& operator=(const LocalClient&) = delete;
+
+    //! \brief Connects and fetches the dimensions of the server
+    bool connect(const std::string& path);
+
+    //! \brief Creates a sealed memfd of nbSlots slots of slotBytes and maps it on the server
+    bool mapRing(uint32_t nbSlots, size_t slotBytes);
+
+    //! \brief Start of a slot: the client writes the inputs there and reads the outputs after them
+    char* slot(uint32_t index) const
+    {
+        return mRing + kLOCAL_RING_DATA + index * mSlotBytes;
+    }
+
+    //! \brief Sends a request; inputs is null for kLOCAL_RING_INFER
+    bool send(LocalRequestHeader header, const void* inputs = nullptr);
+
+    //! \brief Waits for the next reply; the outputs of an inline reply are copied to outputs
+    bool receive(LocalReplyHeader& reply, void* outputs = nullptr, size_t capacity = 0);
+
+    int batchSize() const
+    {
+        return mBatchSize;
+    }
+
+    int seqLength() const
+    {
+        return mSeqLength;
+    }
+
+private:
+    int mFd{-1};
+    int mBatchSize{0};
+    int mSeqLength{0};
+    char* mRing{nullptr};
+    size_t mRingBytes{0};
+    size_t mSlotBytes{0};
+};
+}
+
+#endif // TRT_LOCAL_TRANSPORT_H
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_OBJECT_POOL_H
+#define TRT_OBJECT_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Process-wide free list of T, so per-request objects keep their buffers from one request to the next
+//! \details Every thread keeps up to kTHREAD_CACHE released objects of its own and only takes the shared list's lock
+//! when its cache is empty or full. Objects may be released by another thread than the one that acquired them.
+//! Released objects are not reset: the caller clears them, keeping their capacity.
+template <typename T>
+class ObjectPool
+{
+public:
+    static constexpr size_t kTHREAD_CACHE = 64;
+
+    static T* acquire()
+    {
+        Cache& cache = threadCache();
+        if (cache.free.empty())
+        {
+            Shared& shared = sharedList();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            // take half a cache at once, the next acquires of this thread stay lock free
+            while (!shared.free.empty() && cache.free.size() < kTHREAD_CACHE / 2)
+            {
+                cache.free.push_back(shared.free.back());
+                shared.free.pop_back();
+            }
+        }
+        if (cache.free.empty())
+        {
+            return new T;
+        }
+        T* obj = cache.free.back();
+        cache.free.pop_back();
+        return obj;
+    }
+
+    static void release(T* obj)
+    {
+        if (!obj)
+        {
+            return;
+        }
+        Cache& cache = threadCache();
+        if (cache.free.size() == kTHREAD_CACHE)
+        {
+            cache.flush(kTHREAD_CACHE / 2);
+        }
+        cache.free.push_back(obj);
+    }
+
+private:
+    struct Shared
+    {
+        std::mutex mutex;
+        std::vector<T*> free;
+
+        ~Shared()
+        {
+            for (T* obj : free)
+            {
+                delete obj;
+            }
+        }
+    };
+
+    struct Cache
+    {
+        std::vector<T*> free;
+
+        Cache()
+        {
+            free.reserve(kTHREAD_CACHE);
+        }
+
+        //! \brief Moves the last n objects to the shared list
+        void flush(size_t n)
+        {
+            Shared& shared = sharedList();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            for (; n && !free.empty(); n--)
+            {
+                shared.free.push_back(free.back());
+                free.pop_back();
+            }
+        }
+
+        // objects of an exiting thread go back to the shared list
+        ~Cache()
+        {
+            flush(free.size());
+        }
+    };
+
+    static Shared& sharedList()
+    {
+        static Shared shared;
+        return shared;
+    }
+
+    static Cache& threadCache()
+    {
+        static thread_local Cache cache;
+        return cache;
+    }
+};
+
+template <typename T>
+constexpr size_t ObjectPool<T>::kTHREAD_CACHE;
+}
+
+#endif // TRT_OBJECT_POOL_H
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "logger.h"
+#include "requestCapture.h"
+
+namespace bert
+{
+
+namespace
+{
+// the writer wakes up this often to drain the ring, producers never signal it
+constexpr auto kDRAIN_PERIOD = std::chrono::milliseconds(50);
+
+uint64_t nextRandom()
+{
+    // xorshift64*, one generator per thread
+    static thread_local uint64_t state
+        = (std::hash<std::thread::id>()(std::this_thread::get_id()) ^ RequestCapture::nowUs()) | 1;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+} // namespace
+
+RequestCapture& RequestCapture::instance()
+{
+    static RequestCapture capture;
+    return capture;
+}
+
+RequestCapture::~RequestCapture()
+{
+    stop();
+}
+
+uint64_t RequestCapture::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+bool RequestCapture::start(const std::string& path, double sampleRate, size_t ringSlots)
+{
+    if (mWriterThread.joinable())
+    {
+        gLogError << "Request capture already started" << std::endl;
+        return false;
+    }
+    if (!mWriter.open(path))
+    {
+        gLogError << "Cannot open capture file " << path << std::endl;
+        return false;
+    }
+
+    size_t capacity = 1;
+    while (capacity < ringSlots)
+    {
+        capacity <<= 1;
+    }
+    mSlots.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        mSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mMask = capacity - 1;
+    mEnqueuePos.store(0, std::memory_order_relaxed);
+    mDequeuePos = 0;
+
+    if (sampleRate >= 1.0)
+    {
+        mThreshold = UINT64_MAX;
+    }
+    else
+    {
+        mThreshold = sampleRate > 0.0 ? static_cast<uint64_t>(sampleRate * 18446744073709551616.0) : 0;
+    }
+
+    mStop = false;
+    mWriterThread = std::thread(&RequestCapture::drain, this);
+    mEnabled.store(true, std::memory_order_release);
+    gLogInfo << "Capturing " << sampleRate * 100 << "% of the requests into " << path << std::endl;
+    return true;
+}
+
+void RequestCapture::stop()
+{
+    mEnabled.store(false, std::memory_order_release);
+    if (!mWriterThread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+    mWriterThread.join();
+    mWriter.close();
+    gLogInfo << "Request capture stopped: " << captured() << " captured, " << dropped() << " dropped" << std::endl;
+}
+
+bool RequestCapture::sample() const
+{
+    return enabled() && nextRandom() < mThreshold;
+}
+
+bool RequestCapture::submit(const CaptureRecordHeader& header, const int32_t* inputIds, const int32_t* segmentIds,
+    const int32_t* inputMask)
+{
+    if (!enabled())
+    {
+        return false;
+    }
+
+    // claim a position
+    Slot* slot;
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        slot = &mSlots[pos & mMask];
+        const size_t seq = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // the writer is a full ring behind
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // an empty record still has to be published to free the position, the writer skips it
+    const bool encoded = encodeCaptureRecord(header, inputIds, segmentIds, inputMask, slot->record);
+    if (!encoded)
+    {
+        slot->record.clear();
+        mDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    if (encoded)
+    {
+        mCaptured.fetch_add(1, std::memory_order_relaxed);
+    }
+    return encoded;
+}
+
+void RequestCapture::drain()
+{
+    bool stopping = false;
+    while (!stopping)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait_for(lock, kDRAIN_PERIOD, [this] { return mStop; });
+            stopping = mStop;
+        }
+
+        bool wrote = false;
+        for (;;)
+        {
+            Slot& slot = mSlots[mDequeuePos & mMask];
+            if (slot.sequence.load(std::memory_order_acquire) != mDequeuePos + 1)
+            {
+                break;
+            }
+            if (!slot.record.empty())
+            {
+                mWriter.writeEncoded(slot.record.data(), slot.record.size());
+                wrote = true;
+            }
+            slot.sequence.store(mDequeuePos + mMask + 1, std::memory_order_release);
+            mDequeuePos++;
+        }
+        if (wrote)
+        {
+            mWriter.flush();
+        }
+    }
+}
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_REQUEST_CAPTURE_H
+#define TRT_REQUEST_CAPTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "captureFile.h"
+
+namespace bert
+{
+
+//! \brief Sampled capture of served requests into a capture file (see captureFile.h)
+//! \details Request threads encode a sampled request into a slot of a bounded lock-free ring and return; a background
+//! thread drains the ring into the file. Nothing on the request path blocks or allocates once the slots have grown
+//! to the request size: when the ring is full the record is dropped and counted.
+//! Requests that are not sampled cost one thread-local random draw.
+class RequestCapture
+{
+public:
+    //! \brief Process-wide capture used by the server
+    static RequestCapture& instance();
+
+    RequestCapture() = default;
+    ~RequestCapture();
+
+    RequestCapture(const RequestCapture&) = delete;
+    RequestCapture& operator=(const RequestCapture&) = delete;
+
+    //! \param sampleRate fraction of the requests captured, in [0, 1]
+    //! \param ringSlots capacity of the ring, rounded up to a power of two
+    bool start(const std::string& path, double sampleRate, size_t ringSlots = 1024);
+
+    //! \brief Drains what is left in the ring and closes the file
+    void stop();
+
+    bool enabled() const
+    {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    //! \brief Decides whether the current request is captured
+    bool sample() const;
+
+    //! \brief Queues a B x S request. Never blocks.
+    //! \return false if the record was dropped (ring full, capture stopped or values out of range)
+    bool submit(const CaptureRecordHeader& header, const int32_t* inputIds, const int32_t* segmentIds,
+        const int32_t* inputMask);
+
+    uint64_t captured() const
+    {
+        return mCaptured.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const
+    {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+    //! \brief Microseconds since the epoch, the clock of CaptureRecordHeader::arrivalUs
+    static uint64_t nowUs();
+
+private:
+    // slot of a bounded multi-producer queue (D. Vyukov): sequence == position when free for that producer,
+    // position + 1 once filled for the consumer
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        std::vector<char> record;
+    };
+
+    void drain();
+
+    std::atomic<bool> mEnabled{false};
+    uint64_t mThreshold{0}; // a request is sampled when a 64-bit random draw is below it
+    std::unique_ptr<Slot[]> mSlots;
+    size_t mMask{0};
+    alignas(64) std::atomic<size_t> mEnqueuePos{0};
+    alignas(64) size_t mDequeuePos{0};
+
+    std::atomic<uint64_t> mCaptured{0};
+    std::atomic<uint64_t> mDropped{0};
+
+    CaptureWriter mWriter;
+    std::thread mWriterThread;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mStop{false};
+};
+}
+
+#endif // TRT_REQUEST_CAPTURE_H
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#include "requestTrace.h"
+
+namespace bert
+{
+
+namespace
+{
+thread_local RequestTrace* tCurrent = nullptr;
+
+uint64_t nextRandom()
+{
+    // xorshift64*, one generator per thread
+    static thread_local uint64_t state = (std::hash<std::thread::id>()(std::this_thread::get_id()) ^ traceNowNs()) | 1;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+void appendEvent(std::string& out, const char* name, int pid, uint32_t tid, uint64_t startNs, uint64_t endNs,
+    uint64_t id)
+{
+    char buf[256];
+    const int n = snprintf(buf, sizeof(buf),
+        "%s{\"name\":\"%s\",\"cat\":\"bert\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+        "\"args\":{\"request\":%llu}}",
+        out.back() == '[' ? "" : ",", name, pid, tid, startNs / 1000.0, (endNs - startNs) / 1000.0,
+        static_cast<unsigned long long>(id));
+    out.append(buf, n);
+}
+
+void appendProcessName(std::string& out, int pid, const char* name)
+{
+    char buf[128];
+    const int n = snprintf(buf, sizeof(buf), "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+        out.back() == '[' ? "" : ",", pid, name);
+    out.append(buf, n);
+}
+} // namespace
+
+uint64_t traceNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void RequestTrace::add(const char* name, uint64_t start, uint64_t end)
+{
+    if (count < kMAX_TRACE_SPANS)
+    {
+        spans[count++] = TraceSpan{name, start, end, RequestTracer::threadId()};
+    }
+}
+
+RequestTracer& RequestTracer::instance()
+{
+    static RequestTracer tracer;
+    return tracer;
+}
+
+void RequestTracer::configure(double sampleRate, uint64_t slowUs, size_t ringSize)
+{
+    if (sampleRate >= 1.0)
+    {
+        mThreshold = UINT64_MAX;
+    }
+    else
+    {
+        mThreshold = sampleRate > 0.0 ? static_cast<uint64_t>(sampleRate * 18446744073709551616.0) : 0;
+    }
+    mSlowNs = slowUs * 1000;
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (Ring* ring : {&mSampled, &mSlow})
+    {
+        ring->slots.assign(ringSize, RequestTrace());
+        ring->next = 0;
+        ring->size = 0;
+    }
+}
+
+void RequestTracer::begin(RequestTrace& trace)
+{
+    trace.id = mNextId.fetch_add(1, std::memory_order_relaxed);
+    trace.startNs = traceNowNs();
+    trace.endNs = 0;
+    trace.count = 0;
+    const uint64_t threshold = mThreshold.load(std::memory_order_relaxed);
+    trace.sampled = threshold && nextRandom() < threshold;
+}
+
+void RequestTracer::finish(RequestTrace& trace)
+{
+    trace.endNs = traceNowNs();
+    const uint64_t slowNs = mSlowNs.load(std::memory_order_relaxed);
+    const bool slow = slowNs && trace.endNs - trace.startNs >= slowNs;
+    if (!slow && !trace.sampled)
+    {
+        return;
+    }
+    (slow ? mKeptSlow : mKeptSampled).fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mMutex);
+    (slow ? mSlow : mSampled).push(trace);
+}
+
+void RequestTracer::Ring::push(const RequestTrace& trace)
+{
+    if (slots.empty())
+    {
+        return;
+    }
+    slots[next] = trace;
+    next = (next + 1) % slots.size();
+    size = std::min(size + 1, slots.size());
+}
+
+RequestTrace* RequestTracer::current()
+{
+    return tCurrent;
+}
+
+void RequestTracer::setCurrent(RequestTrace* trace)
+{
+    tCurrent = trace;
+}
+
+uint32_t RequestTracer::threadId()
+{
+    static std::atomic<uint32_t> nextId{1};
+    static thread_local uint32_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void RequestTracer::dumpChromeJson(std::string& out) const
+{
+    // the slow traces and the sampled ones are shown as two processes
+    constexpr int kSLOW_PID = 1;
+    constexpr int kSAMPLED_PID = 2;
+    out.assign("{\"traceEvents\":[");
+    appendProcessName(out, kSLOW_PID, "slow requests");
+    appendProcessName(out, kSAMPLED_PID, "sampled requests");
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const Ring* ring : {&mSlow, &mSampled})
+    {
+        const int pid = ring == &mSlow ? kSLOW_PID : kSAMPLED_PID;
+        // oldest first
+        const size_t first = ring->size < ring->slots.size() ? 0 : ring->next;
+        for (size_t i = 0; i < ring->size; i++)
+        {
+            const RequestTrace& trace = ring->slots[(first + i) % ring->slots.size()];
+            // the whole request on a track of its own, keyed by request id, above its stages
+            appendEvent(out, "request", pid, 0, trace.startNs, trace.endNs, trace.id);
+            for (int s = 0; s < trace.count; s++)
+            {
+                const TraceSpan& span = trace.spans[s];
+                appendEvent(out, span.name, pid, span.tid, span.startNs, span.endNs, trace.id);
+            }
+        }
+    }
+    out.append("]}");
+}
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_REQUEST_TRACE_H
+#define TRT_REQUEST_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace bert
+{
+
+constexpr int kMAX_TRACE_SPANS = 16;
+
+//! \brief Monotonic clock of the traces, nanoseconds
+uint64_t traceNowNs();
+
+//! \brief One stage of a request. name must be a string literal, spans keep the pointer.
+struct TraceSpan
+{
+    const char* name;
+    uint64_t startNs;
+    uint64_t endNs;
+    uint32_t tid; // see RequestTracer::threadId
+};
+
+//! \brief Stages of one request, stored inline so recording never allocates
+//! \details The stages of a request run one after the other on different threads (handler, instance worker, reply),
+//! so the trace is written without locking. Spans past kMAX_TRACE_SPANS are dropped.
+struct RequestTrace
+{
+    uint64_t id{0};
+    uint64_t startNs{0};
+    uint64_t endNs{0};
+    bool sampled{false};
+    int count{0};
+    TraceSpan spans[kMAX_TRACE_SPANS];
+
+    void add(const char* name, uint64_t startNs, uint64_t endNs);
+};
+
+//! \brief Keeps the traces of head-sampled requests and of every slow request, and dumps them for chrome://tracing
+//! \details Each kind goes into a bounded ring allocated by configure: a burst of slow requests overwrites the oldest
+//! ones and never grows memory. Requests neither sampled nor slow cost their spans and a clock read at finish.
+class RequestTracer
+{
+public:
+    //! \brief Process-wide tracer used by the server
+    static RequestTracer& instance();
+
+    //! \param sampleRate fraction of the requests kept whatever their latency, in [0, 1]
+    //! \param slowUs requests at least this long are always kept, 0 keeps none for being slow
+    //! \param ringSize traces kept of each kind
+    void configure(double sampleRate, uint64_t slowUs, size_t ringSize = 256);
+
+    //! \brief Starts the trace of a new request: id, start time and head sampling decision
+    void begin(RequestTrace& trace);
+
+    //! \brief Ends the trace and keeps a copy if it was sampled or is slow
+    void finish(RequestTrace& trace);
+
+    //! \brief Trace the calling thread records TraceScope spans into, nullptr outside of traced work
+    static RequestTrace* current();
+    static void setCurrent(RequestTrace* trace);
+
+    //! \brief Small id of the calling thread, the tid of its spans
+    static uint32_t threadId();
+
+    //! \brief Kept traces as a Chrome trace-event JSON document ({"traceEvents": [...]}), timestamps in microseconds
+    void dumpChromeJson(std::string& out) const;
+
+    uint64_t keptSampled() const
+    {
+        return mKeptSampled.load(std::memory_order_relaxed);
+    }
+
+    uint64_t keptSlow() const
+    {
+        return mKeptSlow.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Ring
+    {
+        std::vector<RequestTrace> slots;
+        size_t next{0};
+        size_t size{0};
+
+        void push(const RequestTrace& trace);
+    };
+
+    std::atomic<uint64_t> mNextId{1};
+    std::atomic<uint64_t> mThreshold{0}; // a request is sampled when a 64-bit random draw is below it
+    std::atomic<uint64_t> mSlowNs{0};
+    std::atomic<uint64_t> mKeptSampled{0};
+    std::atomic<uint64_t> mKeptSlow{0};
+    mutable std::mutex mMutex;
+    Ring mSampled;
+    Ring mSlow;
+};
+
+//! \brief Records the lifetime of the scope as a span of RequestTracer::current(), if there is one
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : mTrace(RequestTracer::current())
+        , mName(name)
+        , mStartNs(mTrace ? traceNowNs() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (mTrace)
+        {
+            mTrace->add(mName, mStartNs, traceNowNs());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    RequestTrace* mTrace;
+    const char* mName;
+    uint64_t mStartNs;
+};
+}
+
+#endif // TRT_REQUEST_TRACE_H
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <zlib.h>
+#ifdef BERT_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "common.h"
+#include "dataUtils.h"
+#include "responseEncoding.h"
+
+namespace bert
+{
+
+namespace
+{
+constexpr int kGZIP_LEVEL = 1;  // responses are floats, higher levels cost much more time for a few percent
+constexpr int kZSTD_LEVEL = 1;
+constexpr int kGZIP_WINDOW = 15 + 16; // deflate window with a gzip wrapper
+
+//! \brief Part of a header value, not owned: headers are parsed in place
+struct Range
+{
+    const char* p;
+    size_t n;
+};
+
+Range trim(const char* begin, const char* end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t'))
+    {
+        begin++;
+    }
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+        end--;
+    }
+    return Range{begin, static_cast<size_t>(end - begin)};
+}
+
+//! \brief Case-insensitive comparison with a lower case literal
+bool equals(const Range& r, const char* literal)
+{
+    return r.n == strlen(literal) && strncasecmp(r.p, literal, r.n) == 0;
+}
+
+bool startsWith(const Range& r, const char* literal)
+{
+    const size_t n = strlen(literal);
+    return r.n >= n && strncasecmp(r.p, literal, n) == 0;
+}
+
+//! \brief Calls fn(item) for every element of a separated list, trimmed
+template <typename Fn>
+void forEachItem(const Range& list, char separator, Fn fn)
+{
+    const char* p = list.p;
+    const char* end = list.p + list.n;
+    while (true)
+    {
+        const char* next = static_cast<const char*>(memchr(p, separator, end - p));
+        const char* itemEnd = next ? next : end;
+        fn(trim(p, itemEnd));
+        if (!next)
+        {
+            return;
+        }
+        p = next + 1;
+    }
+}
+
+//! \brief Calls fn(token, params) for every comma separated element of a header: "a;q=0.5, b" gives ("a", "q=0.5")
+template <typename Fn>
+void forEachToken(const std::string& header, Fn fn)
+{
+    forEachItem(Range{header.data(), header.size()}, ',', [&](const Range& item) {
+        const char* semicolon = static_cast<const char*>(memchr(item.p, ';', item.n));
+        if (!semicolon)
+        {
+            fn(item, Range{item.p + item.n, 0});
+            return;
+        }
+        fn(trim(item.p, semicolon), Range{semicolon + 1, static_cast<size_t>(item.p + item.n - semicolon - 1)});
+    });
+}
+
+//! \brief True if one of the ; separated params is name (e.g. "dtype=fp16")
+bool hasParam(const Range& params, const char* name)
+{
+    bool found = false;
+    forEachItem(params, ';', [&](const Range& param) { found = found || equals(param, name); });
+    return found;
+}
+
+//! \brief True unless params has q=0
+bool accepted(const Range& params)
+{
+    bool zero = false;
+    forEachItem(params, ';', [&](const Range& param) {
+        // the value ends at the next separator or at the end of the header, both stop strtod
+        zero = zero || (startsWith(param, "q=") && !(strtod(param.p + 2, nullptr) > 0.));
+    });
+    return !zero;
+}
+
+//! \brief Compressor contexts of one thread
+struct Compressors
+{
+    z_stream gzip;
+    bool gzipReady{false};
+#ifdef BERT_WITH_ZSTD
+    ZSTD_CCtx* zstd{nullptr};
+#endif
+
+    Compressors()
+    {
+        memset(&gzip, 0, sizeof(gzip));
+    }
+
+    ~Compressors()
+    {
+        if (gzipReady)
+        {
+            deflateEnd(&gzip);
+        }
+#ifdef BERT_WITH_ZSTD
+        ZSTD_freeCCtx(zstd);
+#endif
+    }
+
+    bool compressGzip(const void* data, size_t size, std::string& out)
+    {
+        if (!gzipReady)
+        {
+            if (deflateInit2(&gzip, kGZIP_LEVEL, Z_DEFLATED, kGZIP_WINDOW, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                return false;
+            }
+            gzipReady = true;
+        }
+        else if (deflateReset(&gzip) != Z_OK)
+        {
+            return false;
+        }
+        out.resize(deflateBound(&gzip, size));
+        gzip.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+        gzip.avail_in = static_cast<uInt>(size);
+        gzip.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        gzip.avail_out = static_cast<uInt>(out.size());
+        if (deflate(&gzip, Z_FINISH) != Z_STREAM_END)
+        {
+            return false;
+        }
+        out.resize(gzip.total_out);
+        return true;
+    }
+
+    bool compressZstd(const void* data, size_t size, std::string& out)
+    {
+#ifdef BERT_WITH_ZSTD
+        if (!zstd && !(zstd = ZSTD_createCCtx()))
+        {
+            return false;
+        }
+        out.resize(ZSTD_compressBound(size));
+        const size_t n = ZSTD_compressCCtx(zstd, &out[0], out.size(), data, size, kZSTD_LEVEL);
+        if (ZSTD_isError(n))
+        {
+            return false;
+        }
+        out.resize(n);
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+} // namespace
+
+TensorResponseWriter::TensorResponseWriter(TensorDtype dtype)
+    : mDtype(dtype)
+{
+}
+
+void TensorResponseWriter::reset(TensorDtype dtype)
+{
+    mDtype = dtype;
+    mEntries.clear();
+    mArrays.clear();
+    mBody.clear();
+}
+
+void TensorResponseWriter::add(const char* name, const float* values, int rows, int cols)
+{
+    TensorResponseEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    strncpy(entry.name, name, sizeof(entry.name) - 1);
+    entry.rows = rows;
+    entry.cols = cols;
+    mEntries.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+
+    const size_t n = static_cast<size_t>(rows) * cols;
+    const size_t offset = mArrays.size();
+    if (mDtype == TensorDtype::kFP16)
+    {
+        mArrays.resize(offset + n * sizeof(uint16_t));
+        convertToHalf(values, reinterpret_cast<uint16_t*>(&mArrays[offset]), n);
+    }
+    else
+    {
+        mArrays.append(reinterpret_cast<const char*>(values), n * sizeof(float));
+    }
+}
+
+const std::string& TensorResponseWriter::finish()
+{
+    TensorResponseHeader header;
+    memcpy(header.magic, kTENSOR_MAGIC, sizeof(header.magic));
+    header.version = kTENSOR_VERSION;
+    header.dtype = static_cast<uint32_t>(mDtype);
+    header.count = static_cast<uint32_t>(mEntries.size() / sizeof(TensorResponseEntry));
+    mBody.reserve(sizeof(header) + mEntries.size() + mArrays.size());
+    mBody.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    mBody.append(mEntries);
+    mBody.append(mArrays);
+    return mBody;
+}
+
+bool acceptsTensor(const std::string& accept, TensorDtype& dtype)
+{
+    bool tensor = false;
+    forEachToken(accept, [&](const Range& type, const Range& params) {
+        if (tensor || !equals(type, kTENSOR_CONTENT_TYPE) || !accepted(params))
+        {
+            return;
+        }
+        tensor = true;
+        dtype = hasParam(params, "dtype=fp16") ? TensorDtype::kFP16 : TensorDtype::kFP32;
+    });
+    return tensor;
+}
+
+ContentEncoding chooseEncoding(const std::string& acceptEncoding)
+{
+    // RFC 7231 5.3.4: "*" stands for every coding the header does not name, q=0 refuses a coding
+    enum Listed
+    {
+        kUNLISTED,
+        kREFUSED,
+        kACCEPTED
+    };
+    Listed gzipListed = kUNLISTED;
+    Listed zstdListed = kUNLISTED;
+    Listed anyListed = kUNLISTED;
+    forEachToken(acceptEncoding, [&](const Range& coding, const Range& params) {
+        const Listed listed = accepted(params) ? kACCEPTED : kREFUSED;
+        if (equals(coding, "gzip"))
+        {
+            gzipListed = listed;
+        }
+        else if (equals(coding, "zstd"))
+        {
+            zstdListed = listed;
+        }
+        else if (equals(coding, "*"))
+        {
+            anyListed = listed;
+        }
+    });
+    const auto allowed = [&](Listed listed) {
+        return listed == kACCEPTED || (listed == kUNLISTED && anyListed == kACCEPTED);
+    };
+    const bool gzip = allowed(gzipListed);
+    const bool zstd = allowed(zstdListed);
+#ifdef BERT_WITH_ZSTD
+    if (zstd)
+    {
+        return ContentEncoding::kZSTD;
+    }
+#else
+    (void) zstd;
+#endif
+    return gzip ? ContentEncoding::kGZIP : ContentEncoding::kIDENTITY;
+}
+
+const char* encodingName(ContentEncoding encoding)
+{
+    switch (encoding)
+    {
+    case ContentEncoding::kGZIP: return "gzip";
+    case ContentEncoding::kZSTD: return "zstd";
+    default: return nullptr;
+    }
+}
+
+bool compressBody(ContentEncoding encoding, const void* data, size_t size, std::string& out)
+{
+    static thread_local Compressors compressors;
+    switch (encoding)
+    {
+    case ContentEncoding::kGZIP: return compressors.compressGzip(data, size, out);
+    case ContentEncoding::kZSTD: return compressors.compressZstd(data, size, out);
+    default: return false;
+    }
+}
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_RESPONSE_ENCODING_H
+#define TRT_RESPONSE_ENCODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bert
+{
+
+// Binary tensor response (Content-Type kTENSOR_CONTENT_TYPE), all integers little endian:
+//   TensorResponseHeader
+//   TensorResponseEntry[header.count]
+//   the arrays of the entries one after the other, rows x cols values of header.dtype each
+// It replaces the JSON body when the request accepts it; fp16 halves it again.
+constexpr char kTENSOR_MAGIC[4] = {'B', 'T', 'N', 'S'};
+constexpr uint32_t kTENSOR_VERSION = 1;
+constexpr const char* kTENSOR_CONTENT_TYPE = "application/x-bert-tensor";
+
+enum class TensorDtype : uint32_t
+{
+    kFP32 = 0,
+    kFP16 = 1
+};
+
+struct TensorResponseHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t dtype; // TensorDtype
+    uint32_t count; // number of entries
+};
+
+struct TensorResponseEntry
+{
+    char name[16]; // zero terminated output key, see getOutputKey
+    uint32_t rows;
+    uint32_t cols;
+};
+
+static_assert(sizeof(TensorResponseHeader) == 16, "unexpected tensor header size");
+static_assert(sizeof(TensorResponseEntry) == 24, "unexpected tensor entry size");
+
+//! \brief Builds a binary tensor response, one entry at a time
+class TensorResponseWriter
+{
+public:
+    explicit TensorResponseWriter(TensorDtype dtype);
+
+    //! \brief Starts a new response, keeping the buffers of the previous one
+    void reset(TensorDtype dtype);
+
+    //! \brief Adds rows x cols values. Entries are laid out in the order they are added.
+    void add(const char* name, const float* values, int rows, int cols);
+
+    //! \brief Header, entries and arrays. Valid until the next add.
+    const std::string& finish();
+
+private:
+    TensorDtype mDtype;
+    std::string mEntries;
+    std::string mArrays;
+    std::string mBody;
+};
+
+enum class ContentEncoding
+{
+    kIDENTITY,
+    kGZIP,
+    kZSTD
+};
+
+//! \brief Body format a request asks for with its Accept header
+//! \details "application/x-bert-tensor" selects the binary format in fp32, "application/x-bert-tensor; dtype=fp16" in
+//! fp16. Anything else keeps JSON.
+//! \return false for JSON
+bool acceptsTensor(const std::string& accept, TensorDtype& dtype);
+
+//! \brief Best compression listed in an Accept-Encoding header: zstd (when built with it), then gzip
+//! \details Codings with q=0 are skipped, "*" accepts the ones not named. identity is always acceptable: a header
+//! refusing it still gets an uncompressed body rather than 406.
+ContentEncoding chooseEncoding(const std::string& acceptEncoding);
+
+//! \brief Content-Encoding value, nullptr for identity
+const char* encodingName(ContentEncoding encoding);
+
+//! \brief Compresses data with the compressor contexts of the calling thread
+//! \details The gzip stream and the zstd context are created on the first call of a thread and reset, not
+//! reallocated, for the next bodies.
+//! \return false if the encoding is not available or compression fails, out is then unspecified
+bool compressBody(ContentEncoding encoding, const void* data, size_t size, std::string& out);
+}
+
+#endif // TRT_RESPONSE_ENCODING_H
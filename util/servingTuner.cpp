@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+
+#include "captureFile.h"
+#include "servingTuner.h"
+
+namespace bert
+{
+
+namespace
+{
+//! \brief Every ascending subset of \p lengths with at most maxBuckets elements that ends with the largest length,
+//! so no set truncates more than the candidates themselves
+std::vector<std::vector<int>> bucketSets(std::vector<int> lengths, int maxBuckets)
+{
+    std::sort(lengths.begin(), lengths.end());
+    lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+    std::vector<std::vector<int>> sets;
+    if (lengths.empty() || maxBuckets < 1)
+    {
+        return sets;
+    }
+    const int largest = lengths.back();
+    lengths.pop_back();
+    const size_t n = lengths.size();
+    for (uint64_t bits = 0; bits < (1ull << n); bits++)
+    {
+        std::vector<int> set;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (bits & (1ull << i))
+            {
+                set.push_back(lengths[i]);
+            }
+        }
+        if (static_cast<int>(set.size()) < maxBuckets)
+        {
+            set.push_back(largest);
+            sets.push_back(set);
+        }
+    }
+    return sets;
+}
+
+//! \brief Configurations within the SLO first, by throughput then latency and number of engines; the others by latency
+bool better(const ServingConfig& a, const ServingConfig& b)
+{
+    if (a.meetsSlo != b.meetsSlo)
+    {
+        return a.meetsSlo;
+    }
+    if (!a.meetsSlo && a.latencyMs != b.latencyMs)
+    {
+        return a.latencyMs < b.latencyMs;
+    }
+    if (a.sentencesPerSecond != b.sentencesPerSecond)
+    {
+        return a.sentencesPerSecond > b.sentencesPerSecond;
+    }
+    if (a.latencyMs != b.latencyMs)
+    {
+        return a.latencyMs < b.latencyMs;
+    }
+    return a.buckets.size() * a.instancesPerDevice < b.buckets.size() * b.instancesPerDevice;
+}
+} // namespace
+
+void LengthHistogram::add(int length, uint64_t n)
+{
+    if (length < 0 || !n)
+    {
+        return;
+    }
+    if (counts.size() <= static_cast<size_t>(length))
+    {
+        counts.resize(length + 1, 0);
+    }
+    counts[length] += n;
+    total += n;
+}
+
+bool loadLengthHistogram(const std::string& capturePath, LengthHistogram& histogram)
+{
+    histogram = LengthHistogram();
+    CaptureReader reader;
+    if (!reader.open(capturePath))
+    {
+        return false;
+    }
+    CaptureRecord record;
+    while (reader.next(record))
+    {
+        const int B = record.header.batchSize;
+        const int S = record.header.seqLength;
+        for (int b = 0; b < B; b++)
+        {
+            const int32_t* row = record.inputMask.data() + static_cast<size_t>(b) * S;
+            const int length = static_cast<int>(std::count_if(row, row + S, [](int32_t m) { return m != 0; }));
+            if (length > 0)
+            {
+                histogram.add(length);
+            }
+        }
+    }
+    return histogram.total > 0;
+}
+
+bool CostModelBackend::measure(const EngineShape& shape, int instances, BatchTiming& timing)
+{
+    const float tokens = static_cast<float>(shape.batchSize) * shape.seqLength;
+    float ms = fixedMs + perTokenMs * tokens + perAttentionMs * tokens * shape.seqLength;
+    if (shape.fp16)
+    {
+        ms /= fp16Speedup;
+    }
+    // the other instances take their share of the device, less what they overlap with this one
+    ms *= 1.f + (instances - 1) * (1.f - overlap);
+    timing.msMean = ms;
+    timing.msP99 = ms * p99Factor;
+    return true;
+}
+
+std::string ServingConfig::toJson() const
+{
+    std::string buckets;
+    for (size_t i = 0; i < this->buckets.size(); i++)
+    {
+        buckets += (i ? "," : "") + std::to_string(this->buckets[i]);
+    }
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+        "{\"batch_size\":%d,\"buckets\":[%s],\"instances_per_device\":%d,\"fp16\":%s,"
+        "\"sentences_per_s\":%.1f,\"latency_ms\":%.3f,\"padded_fraction\":%.4f,\"truncated_fraction\":%.4f,"
+        "\"meets_slo\":%s}",
+        batchSize, buckets.c_str(), instancesPerDevice, fp16 ? "true" : "false", sentencesPerSecond, latencyMs,
+        paddedFraction, truncatedFraction, meetsSlo ? "true" : "false");
+    return buf;
+}
+
+ServingTuner::ServingTuner(TunerBackend& backend, const TunerOptions& options)
+    : mBackend(backend)
+    , mOptions(options)
+{
+    std::sort(mOptions.instanceCounts.begin(), mOptions.instanceCounts.end());
+}
+
+bool ServingTuner::timing(const EngineShape& shape, int instances, BatchTiming& result)
+{
+    const auto key = std::make_pair(shape, instances);
+    auto it = mTimings.find(key);
+    if (it == mTimings.end())
+    {
+        BatchTiming t;
+        const bool ok = mBackend.measure(shape, instances, t) && t.msMean > 0.f;
+        it = mTimings.insert(std::make_pair(key, std::make_pair(ok, t))).first;
+    }
+    result = it->second.second;
+    return it->second.first;
+}
+
+bool ServingTuner::score(const LengthHistogram& histogram, ServingConfig& config)
+{
+    const int B = config.batchSize;
+    const int k = config.instancesPerDevice;
+    uint64_t real = 0;
+    uint64_t positions = 0;
+    uint64_t truncated = 0;
+    double msPerSentence = 0.;
+    int largestUsed = -1;
+    for (size_t L = 0; L < histogram.counts.size(); L++)
+    {
+        const uint64_t n = histogram.counts[L];
+        if (!n)
+        {
+            continue;
+        }
+        auto bucket = std::lower_bound(config.buckets.begin(), config.buckets.end(), static_cast<int>(L));
+        if (bucket == config.buckets.end())
+        {
+            --bucket;
+            truncated += n;
+        }
+        BatchTiming t;
+        if (!timing(EngineShape{B, *bucket, config.fp16}, k, t))
+        {
+            return false;
+        }
+        // k instances each run a batch of B sentences in msMean
+        msPerSentence += n * static_cast<double>(t.msMean) / (static_cast<double>(k) * B);
+        real += std::min<uint64_t>(L, *bucket) * n;
+        positions += static_cast<uint64_t>(*bucket) * n;
+        largestUsed = std::max(largestUsed, *bucket);
+    }
+    if (largestUsed < 0)
+    {
+        return false;
+    }
+    BatchTiming worst;
+    timing(EngineShape{B, largestUsed, config.fp16}, k, worst);
+
+    msPerSentence /= histogram.total;
+    config.sentencesPerSecond = mOptions.devices * 1000. / msPerSentence;
+    config.latencyMs = worst.msP99 + worst.msMean;
+    config.paddedFraction = 1. - static_cast<double>(real) / positions;
+    config.truncatedFraction = static_cast<double>(truncated) / histogram.total;
+    config.meetsSlo = config.latencyMs <= mOptions.sloMs;
+    return true;
+}
+
+bool ServingTuner::tune(const LengthHistogram& histogram, ServingConfig& best, std::vector<ServingConfig>* all)
+{
+    std::vector<ServingConfig> configs;
+    const std::vector<std::vector<int>> sets = bucketSets(mOptions.seqLengths, mOptions.maxBuckets);
+    for (bool fp16 : mOptions.precisions)
+    {
+        for (int B : mOptions.batchSizes)
+        {
+            // measure every shape up front, one shape at a time, see TunerBackend
+            for (int S : mOptions.seqLengths)
+            {
+                for (int k : mOptions.instanceCounts)
+                {
+                    BatchTiming t;
+                    timing(EngineShape{B, S, fp16}, k, t);
+                }
+            }
+            for (int k : mOptions.instanceCounts)
+            {
+                for (const std::vector<int>& buckets : sets)
+                {
+                    ServingConfig config;
+                    config.batchSize = B;
+                    config.buckets = buckets;
+                    config.instancesPerDevice = k;
+                    config.fp16 = fp16;
+                    if (score(histogram, config))
+                    {
+                        configs.push_back(config);
+                    }
+                }
+            }
+        }
+    }
+    if (configs.empty())
+    {
+        return false;
+    }
+    std::stable_sort(configs.begin(), configs.end(), better);
+    best = configs.front();
+    if (all)
+    {
+        all->swap(configs);
+    }
+    return true;
+}
+}
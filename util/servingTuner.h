@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_SERVING_TUNER_H
+#define TRT_SERVING_TUNER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Number of sentences of every length (real tokens, from input_mask) in some traffic
+struct LengthHistogram
+{
+    std::vector<uint64_t> counts; //!< counts[L]: sentences of L tokens
+    uint64_t total{0};
+
+    void add(int length, uint64_t n = 1);
+};
+
+//! \brief Lengths of the sentences of a capture file (see util/captureFile.h), empty rows are skipped
+//! \return false if the file cannot be read or holds no sentence
+bool loadLengthHistogram(const std::string& capturePath, LengthHistogram& histogram);
+
+//! \brief Shape and precision of one engine
+struct EngineShape
+{
+    int batchSize;
+    int seqLength;
+    bool fp16;
+
+    bool operator<(const EngineShape& other) const
+    {
+        return std::make_tuple(batchSize, seqLength, fp16)
+            < std::make_tuple(other.batchSize, other.seqLength, other.fp16);
+    }
+};
+
+//! \brief Latency of one full batch on one instance while \p instances instances run batches on the same device
+struct BatchTiming
+{
+    float msMean{0.f};
+    float msP99{0.f};
+};
+
+//! \brief Where the tuner gets its timings from
+//! \details The tool times real engines built through BERTDriver; CostModelBackend stands in for the GPU to exercise
+//! the search. measure is called for one shape at a time, with increasing instance counts, so a backend can keep
+//! the engines of the current shape between calls.
+class TunerBackend
+{
+public:
+    virtual ~TunerBackend() {}
+
+    //! \return false if the shape cannot be run (e.g. does not fit the device), it is then left out of the search
+    virtual bool measure(const EngineShape& shape, int instances, BatchTiming& timing) = 0;
+};
+
+//! \brief Analytic batch latency: fixed + perToken x B x S + perAttention x B x S^2, scaled by fp16Speedup in fp16
+//! \details Instances sharing a device overlap by overlap (0: run one after the other, 1: perfectly in parallel), the
+//! p99 is p99Factor x the mean. The defaults are in the range of a 12 layer base model on a T4, but only the search is
+//! meant to be tested with them.
+class CostModelBackend : public TunerBackend
+{
+public:
+    float fixedMs{0.5f};
+    float perTokenMs{0.0012f};
+    float perAttentionMs{0.0000015f};
+    float fp16Speedup{2.5f};
+    float overlap{0.3f};
+    float p99Factor{1.2f};
+
+    bool measure(const EngineShape& shape, int instances, BatchTiming& timing) override;
+};
+
+//! \brief Candidates of the search
+struct TunerOptions
+{
+    std::vector<int> batchSizes{4, 8, 16, 32};          //!< Bmax
+    std::vector<int> seqLengths{32, 64, 128, 200, 256}; //!< possible bucket lengths
+    int maxBuckets{3};                                   //!< most engines per instance, one per bucket
+    std::vector<int> instanceCounts{1, 2};               //!< instances per device
+    std::vector<bool> precisions{false, true};           //!< fp16 off / on
+    int devices{1};
+    float sloMs{50.f}; //!< latency budget of a request, queueing included
+};
+
+//! \brief One serving configuration and what the tuner predicts for it
+struct ServingConfig
+{
+    int batchSize{0};
+    std::vector<int> buckets; //!< ascending, a sentence runs in the smallest one it fits, longer ones are truncated
+    int instancesPerDevice{0};
+    bool fp16{false};
+
+    double sentencesPerSecond{0.}; //!< all devices, batches full
+    float latencyMs{0.f};          //!< p99 of a batch plus the mean of the one ahead of it on its instance
+    double paddedFraction{0.};     //!< padded positions over all positions
+    double truncatedFraction{0.};  //!< sentences longer than the largest bucket
+    bool meetsSlo{false};
+
+    //! \brief Single line JSON object with the fields above
+    std::string toJson() const;
+};
+
+//! \brief Sweeps batch sizes, bucket sets, instance counts and precisions and picks the highest throughput within
+//! the latency SLO
+//! \details Every (shape, instance count) is measured once by the backend; the bucket sets are then scored against
+//! the length histogram without running anything. Throughput assumes saturated, full batches: a device runs
+//! instances x Bmax sentences per batch time of the bucket, weighted by the share of the traffic in each bucket.
+//! Latency is the p99 of the largest bucket used plus the mean of one batch already running on the instance.
+class ServingTuner
+{
+public:
+    ServingTuner(TunerBackend& backend, const TunerOptions& options);
+
+    //! \brief best is the fastest configuration within the SLO or, when none meets it, the one with the lowest latency
+    //! (best.meetsSlo tells which)
+    //! \param all if given, receives every configuration scored, best first
+    //! \return false if no configuration could be measured
+    bool tune(const LengthHistogram& histogram, ServingConfig& best, std::vector<ServingConfig>* all = nullptr);
+
+private:
+    bool timing(const EngineShape& shape, int instances, BatchTiming& result);
+    bool score(const LengthHistogram& histogram, ServingConfig& config);
+
+    TunerBackend& mBackend;
+    TunerOptions mOptions;
+    //! (shape, instances) -> timing, false entries could not be measured
+    std::map<std::pair<EngineShape, int>, std::pair<bool, BatchTiming>> mTimings;
+};
+}
+
+#endif // TRT_SERVING_TUNER_H
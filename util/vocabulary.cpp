@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <fstream>
+
+#include "vocabulary.h"
+
+namespace bert
+{
+
+namespace
+{
+//! \brief Bytes of the UTF-8 character starting with lead, 1 for invalid lead bytes
+size_t utf8Length(unsigned char lead)
+{
+    if (lead >= 0xF0)
+    {
+        return 4;
+    }
+    if (lead >= 0xE0)
+    {
+        return 3;
+    }
+    if (lead >= 0xC0)
+    {
+        return 2;
+    }
+    return 1;
+}
+} // namespace
+
+bool Vocabulary::load(const std::string& path)
+{
+    mIds.clear();
+    std::ifstream input(path);
+    if (!input)
+    {
+        return false;
+    }
+    std::string token;
+    int id = 0;
+    while (std::getline(input, token))
+    {
+        if (!token.empty() && token.back() == '\r')
+        {
+            token.pop_back();
+        }
+        // the first line wins if a token is listed twice
+        mIds.insert(std::make_pair(token, id++));
+    }
+    mCls = find("[CLS]");
+    mSep = find("[SEP]");
+    mUnk = find("[UNK]");
+    if (mCls < 0 || mSep < 0 || mUnk < 0)
+    {
+        mIds.clear();
+        return false;
+    }
+    return true;
+}
+
+int Vocabulary::find(const std::string& token) const
+{
+    const auto it = mIds.find(token);
+    return it == mIds.end() ? -1 : it->second;
+}
+
+void Vocabulary::appendTerm(const std::string& term, std::vector<int>& ids) const
+{
+    if (term.empty())
+    {
+        return;
+    }
+    const int id = find(term);
+    if (id >= 0)
+    {
+        ids.push_back(id);
+        return;
+    }
+    for (size_t pos = 0; pos < term.size();)
+    {
+        const size_t n = std::min(utf8Length(static_cast<unsigned char>(term[pos])), term.size() - pos);
+        const int c = find(term.substr(pos, n));
+        ids.push_back(c >= 0 ? c : mUnk);
+        pos += n;
+    }
+}
+
+int encodePair(const Vocabulary& vocabulary, const std::vector<int>& query, const std::vector<int>& doc,
+    int seqLength, int* inputIds, int* segmentIds, int* inputMask)
+{
+    std::fill(inputIds, inputIds + seqLength, 0);
+    std::fill(segmentIds, segmentIds + seqLength, 0);
+    std::fill(inputMask, inputMask + seqLength, 0);
+
+    // [CLS] and two [SEP]
+    const int available = std::max(seqLength - 3, 0);
+    int q = static_cast<int>(query.size());
+    int d = static_cast<int>(doc.size());
+    while (q + d > available)
+    {
+        if (q > d)
+        {
+            q--;
+        }
+        else
+        {
+            d--;
+        }
+    }
+
+    int n = 0;
+    auto put = [&](int id, int segment) {
+        if (n < seqLength)
+        {
+            inputIds[n] = id;
+            segmentIds[n] = segment;
+            inputMask[n] = 1;
+            n++;
+        }
+    };
+    put(vocabulary.cls(), 0);
+    for (int i = 0; i < q; i++)
+    {
+        put(query[i], 0);
+    }
+    put(vocabulary.sep(), 0);
+    for (int i = 0; i < d; i++)
+    {
+        put(doc[i], 1);
+    }
+    put(vocabulary.sep(), 1);
+    return n;
+}
+}
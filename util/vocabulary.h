@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_VOCABULARY_H
+#define TRT_VOCABULARY_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Token ids of a BERT vocab.txt (one token per line, the id is the line number)
+//! \details Maps terms that callers have already segmented, e.g. the words of a GpuRequest. A term missing from the
+//! vocabulary is looked up one UTF-8 character at a time, as the Chinese models tokenize, and what is still missing
+//! becomes [UNK].
+class Vocabulary
+{
+public:
+    //! \return false if the file cannot be read or lacks [CLS], [SEP] or [UNK]
+    bool load(const std::string& path);
+
+    bool empty() const
+    {
+        return mIds.empty();
+    }
+
+    //! \brief Id of a token, -1 if it is not in the vocabulary
+    int find(const std::string& token) const;
+
+    //! \brief Appends the ids of a term, see the class details
+    void appendTerm(const std::string& term, std::vector<int>& ids) const;
+
+    int cls() const
+    {
+        return mCls;
+    }
+
+    int sep() const
+    {
+        return mSep;
+    }
+
+    int unk() const
+    {
+        return mUnk;
+    }
+
+private:
+    std::unordered_map<std::string, int> mIds;
+    int mCls{-1};
+    int mSep{-1};
+    int mUnk{-1};
+};
+
+//! \brief Writes the sentence pair "[CLS] query [SEP] doc [SEP]" as one row of seqLength input ids, segment ids (0 up
+//! to the first [SEP], 1 after) and input mask, padded with zeros
+//! \details When the pair does not fit, the longer of the two is cut first, so a long doc cannot push the query out.
+//! \return real tokens of the row
+int encodePair(const Vocabulary& vocabulary, const std::vector<int>& query, const std::vector<int>& doc,
+    int seqLength, int* inputIds, int* segmentIds, int* inputMask);
+}
+
+#endif // TRT_VOCABULARY_H
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+#include "common.h"
+#include "half.h"
+#include "weightContainer.h"
+
+namespace bert
+{
+
+using namespace nvinfer1;
+
+namespace
+{
+uint64_t alignUp(uint64_t v)
+{
+    return (v + kWC_ALIGNMENT - 1) / kWC_ALIGNMENT * kWC_ALIGNMENT;
+}
+
+uint32_t checksum(const void* data, size_t len)
+{
+    // zlib's crc32 takes a uInt length, feed it in chunks
+    uLong crc = crc32(0L, Z_NULL, 0);
+    const Bytef* p = static_cast<const Bytef*>(data);
+    while (len > 0)
+    {
+        const uInt chunk = static_cast<uInt>(std::min<size_t>(len, 1u << 30));
+        crc = crc32(crc, p, chunk);
+        p += chunk;
+        len -= chunk;
+    }
+    return static_cast<uint32_t>(crc);
+}
+
+size_t elementSize(DataType type)
+{
+    switch (type)
+    {
+    case DataType::kHALF: return 2;
+    case DataType::kINT8: return 1;
+    default: return 4;
+    }
+}
+
+//! \brief Types a container may hold, anything else comes from a corrupted or foreign index
+bool isStoredType(int32_t type)
+{
+    return type == static_cast<int32_t>(DataType::kFLOAT) || type == static_cast<int32_t>(DataType::kHALF)
+        || type == static_cast<int32_t>(DataType::kINT8);
+}
+} // namespace
+
+bool isFcKernel(const std::string& name)
+{
+    const size_t suffix = kINT8_SCALE_SUFFIX.size();
+    if (name.size() > suffix && name.compare(name.size() - suffix, suffix, kINT8_SCALE_SUFFIX) == 0)
+    {
+        return false; // int8 scales stay fp32
+    }
+    return name.find("kernel") != std::string::npos || name.find("squad_output_weights") != std::string::npos;
+}
+
+WeightContainer::~WeightContainer()
+{
+    close();
+}
+
+void WeightContainer::close()
+{
+    if (mBase)
+    {
+        munmap(mBase, mSize);
+    }
+    mBase = nullptr;
+    mSize = 0;
+    mFlags = 0;
+    mWeights.clear();
+}
+
+bool WeightContainer::isContainer(const std::string& path)
+{
+    std::ifstream input(path, std::ios_base::binary);
+    char magic[sizeof(kWC_MAGIC)];
+    if (!input.read(magic, sizeof(magic)))
+    {
+        return false;
+    }
+    return memcmp(magic, kWC_MAGIC, sizeof(magic)) == 0;
+}
+
+bool WeightContainer::open(const std::string& path, bool verify)
+{
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        gLogError << "Cannot open weight container: " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(WeightContainerHeader))
+    {
+        gLogError << "Weight container too small: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    mSize = st.st_size;
+    mBase = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mBase == MAP_FAILED)
+    {
+        gLogError << "Cannot map weight container: " << path << std::endl;
+        mBase = nullptr;
+        mSize = 0;
+        return false;
+    }
+
+    const char* base = static_cast<const char*>(mBase);
+    const WeightContainerHeader& header = *reinterpret_cast<const WeightContainerHeader*>(base);
+    if (memcmp(header.magic, kWC_MAGIC, sizeof(kWC_MAGIC)) != 0 || header.version != kWC_VERSION)
+    {
+        gLogError << "Not a weight container or unsupported version: " << path << std::endl;
+        close();
+        return false;
+    }
+    const uint64_t indexSize = static_cast<uint64_t>(header.count) * sizeof(WeightContainerEntry);
+    if (header.fileSize != mSize || header.indexOffset + indexSize > mSize)
+    {
+        gLogError << "Truncated weight container: " << path << std::endl;
+        close();
+        return false;
+    }
+    const WeightContainerEntry* entries = reinterpret_cast<const WeightContainerEntry*>(base + header.indexOffset);
+    if (checksum(entries, indexSize) != header.indexCrc)
+    {
+        gLogError << "Corrupted weight container index: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    // tell the kernel we are going to read the payloads, so the build does not fault page by page
+    madvise(mBase, mSize, MADV_WILLNEED);
+
+    mFlags = header.flags;
+    for (uint32_t it = 0; it < header.count; it++)
+    {
+        const WeightContainerEntry& e = entries[it];
+        const DataType type = static_cast<DataType>(e.type);
+        // offset first, then count against the room left: offset + count * size could wrap around
+        if (!isStoredType(e.type) || e.offset % kWC_ALIGNMENT != 0 || e.offset > mSize
+            || e.count > (mSize - e.offset) / elementSize(type) || e.name[kWC_MAX_NAME - 1] != '\0')
+        {
+            gLogError << "Invalid entry " << it << " in weight container: " << path << std::endl;
+            close();
+            return false;
+        }
+        const uint64_t nbBytes = e.count * elementSize(type);
+        if (verify && checksum(base + e.offset, nbBytes) != e.crc)
+        {
+            gLogError << "Checksum mismatch for " << e.name << " in weight container: " << path << std::endl;
+            close();
+            return false;
+        }
+        mWeights[e.name] = Weights{type, base + e.offset, static_cast<int64_t>(e.count)};
+    }
+    gLogInfo << "Mapped " << mWeights.size() << " parameters from weight container" << std::endl;
+    return true;
+}
+
+bool writeWeightContainer(
+    const std::string& path, const WeightMap& weightMap, bool fp16, const std::vector<std::string>& skip)
+{
+    std::vector<WeightContainerEntry> entries;
+    std::vector<std::vector<half_float::half>> halves; // fp16 payloads, kept until written
+    std::vector<const void*> payloads;
+    uint32_t flags = fp16 ? kWC_FLAG_FP16 : 0;
+
+    for (const auto& kv : weightMap)
+    {
+        if (std::find(skip.begin(), skip.end(), kv.first) != skip.end())
+        {
+            continue;
+        }
+        if (kv.first.size() >= kWC_MAX_NAME)
+        {
+            gLogError << "Weight name too long for container: " << kv.first << std::endl;
+            return false;
+        }
+        if (!isStoredType(static_cast<int32_t>(kv.second.type)) || kv.second.count < 0
+            || (kv.second.count > 0 && !kv.second.values))
+        {
+            gLogError << "Cannot store " << kv.first << " in a weight container: unsupported type or no values"
+                      << std::endl;
+            return false;
+        }
+
+        WeightContainerEntry e;
+        memset(&e, 0, sizeof(e));
+        strncpy(e.name, kv.first.c_str(), kWC_MAX_NAME - 1);
+        e.count = kv.second.count;
+        e.type = static_cast<int32_t>(kv.second.type);
+        const void* payload = kv.second.values;
+
+        if (fp16 && kv.second.type == DataType::kFLOAT && isFcKernel(kv.first))
+        {
+            const float* src = static_cast<const float*>(kv.second.values);
+            halves.emplace_back(src, src + kv.second.count);
+            payload = halves.back().data();
+            e.type = static_cast<int32_t>(DataType::kHALF);
+        }
+        if (static_cast<DataType>(e.type) == DataType::kHALF)
+        {
+            flags |= kWC_FLAG_FP16;
+        }
+        else if (static_cast<DataType>(e.type) == DataType::kINT8)
+        {
+            flags |= kWC_FLAG_INT8;
+        }
+        e.crc = checksum(payload, e.count * elementSize(static_cast<DataType>(e.type)));
+        entries.push_back(e);
+        payloads.push_back(payload);
+    }
+
+    WeightContainerHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kWC_MAGIC, sizeof(kWC_MAGIC));
+    header.version = kWC_VERSION;
+    header.count = static_cast<uint32_t>(entries.size());
+    header.indexOffset = sizeof(WeightContainerHeader);
+    header.flags = flags;
+
+    uint64_t offset = alignUp(header.indexOffset + entries.size() * sizeof(WeightContainerEntry));
+    for (auto& e : entries)
+    {
+        e.offset = offset;
+        offset = alignUp(offset + e.count * elementSize(static_cast<DataType>(e.type)));
+    }
+    header.fileSize = offset;
+    header.indexCrc = checksum(entries.data(), entries.size() * sizeof(WeightContainerEntry));
+
+    std::ofstream output(path, std::ios_base::binary);
+    if (!output)
+    {
+        gLogError << "Cannot open weight container for writing: " << path << std::endl;
+        return false;
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(WeightContainerEntry));
+
+    const char zeros[kWC_ALIGNMENT] = {0};
+    uint64_t pos = header.indexOffset + entries.size() * sizeof(WeightContainerEntry);
+    for (size_t it = 0; it < entries.size(); it++)
+    {
+        const WeightContainerEntry& e = entries[it];
+        output.write(zeros, e.offset - pos);
+        const uint64_t nbBytes = e.count * elementSize(static_cast<DataType>(e.type));
+        output.write(static_cast<const char*>(payloads[it]), nbBytes);
+        pos = e.offset + nbBytes;
+    }
+    output.write(zeros, header.fileSize - pos);
+
+    if (!output)
+    {
+        gLogError << "Failed writing weight container: " << path << std::endl;
+        return false;
+    }
+    gLogInfo << "Wrote " << entries.size() << " parameters to weight container " << path << std::endl;
+    return true;
+}
+
+void quantizeInt8(const float* src, int64_t rows, int64_t rowSize, int8_t* dst, float* scales)
+{
+    for (int64_t r = 0; r < rows; r++)
+    {
+        const float* row = src + r * rowSize;
+        float amax = 0.f;
+        for (int64_t i = 0; i < rowSize; i++)
+        {
+            amax = std::max(amax, std::fabs(row[i]));
+        }
+        scales[r] = amax > 0.f ? amax / 127.f : 1.f;
+        for (int64_t i = 0; i < rowSize; i++)
+        {
+            const float q = std::nearbyint(row[i] / scales[r]);
+            dst[r * rowSize + i] = static_cast<int8_t>(std::min(127.f, std::max(-127.f, q)));
+        }
+    }
+}
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_WEIGHT_CONTAINER_H
+#define TRT_WEIGHT_CONTAINER_H
+
+#include <NvInfer.h>
+#include <bertUtils.h>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace bert
+{
+
+// Binary weight container layout (all integers little endian):
+//   WeightContainerHeader                      at offset 0
+//   WeightContainerEntry[header.count]         at header.indexOffset
+//   tensor payloads                            each at a 64 byte aligned offset
+// Payloads are stored exactly as the network consumes them: kernels already transposed and the
+// fused qkv_kernel/qkv_bias already built, so loading is an mmap and pointer fixups.
+
+constexpr char kWC_MAGIC[8] = {'B', 'E', 'R', 'T', 'W', 'C', '\r', '\n'};
+constexpr uint32_t kWC_VERSION = 1;
+constexpr uint64_t kWC_ALIGNMENT = 64;
+constexpr size_t kWC_MAX_NAME = 96;
+
+// header flags
+constexpr uint32_t kWC_FLAG_FP16 = 1u << 0; // fully connected kernels are stored as fp16
+constexpr uint32_t kWC_FLAG_INT8 = 1u << 1; // some fully connected kernels are stored as int8, see kINT8_SCALE_SUFFIX
+
+// An int8 kernel [out][in] named k comes with an fp32 tensor k + kINT8_SCALE_SUFFIX of out values: row r of the
+// kernel is k[r][i] * scale[r] (symmetric, per output channel).
+const std::string kINT8_SCALE_SUFFIX = "_scale";
+
+struct WeightContainerHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;       // number of index entries
+    uint64_t indexOffset; // offset of the first WeightContainerEntry
+    uint64_t fileSize;    // total size, to detect truncation
+    uint32_t flags;
+    uint32_t indexCrc; // crc32 of the whole index
+    uint8_t reserved[24];
+};
+
+struct WeightContainerEntry
+{
+    char name[kWC_MAX_NAME]; // zero terminated
+    int32_t type;            // nvinfer1::DataType of the payload
+    uint32_t reserved;
+    uint64_t offset; // payload offset from the start of the file
+    uint64_t count;  // number of elements
+    uint32_t crc;    // crc32 of the payload
+    uint32_t reserved2;
+};
+
+static_assert(sizeof(WeightContainerHeader) == 64, "unexpected container header size");
+static_assert(sizeof(WeightContainerEntry) == 128, "unexpected container entry size");
+
+//! \brief Read-only, memory-mapped view of a weight container
+//! \details The Weights handed out by weights() point straight into the mapping and stay valid until the
+//! container is closed or destroyed. Nothing is copied on load.
+class WeightContainer
+{
+public:
+    WeightContainer() {}
+    ~WeightContainer();
+
+    WeightContainer(const WeightContainer&) = delete;
+    WeightContainer& operator=(const WeightContainer&) = delete;
+
+    //! \brief Maps the file and builds the weight map
+    //! \param verify also check the crc of every payload, which touches every page of the file
+    //! \return false if the file cannot be mapped or is not a valid container
+    bool open(const std::string& path, bool verify = true);
+
+    void close();
+
+    const WeightMap& weights() const
+    {
+        return mWeights;
+    }
+
+    uint32_t flags() const
+    {
+        return mFlags;
+    }
+
+    //! \brief True if the file starts with the container magic
+    static bool isContainer(const std::string& path);
+
+private:
+    void* mBase{nullptr};
+    size_t mSize{0};
+    uint32_t mFlags{0};
+    WeightMap mWeights;
+};
+
+//! \brief Writes weights into a container
+//! \details The weights are written as given: transposition and qkv fusion must already have been done, which
+//! is the case for a map produced by loadWeights. Entries named in \p skip are left out.
+//! \param fp16 store the fully connected kernels as fp16. Biases, layer norm parameters and embeddings, which the
+//! plugins read as fp32, are kept in fp32. fp16 and int8 entries of the map are stored as they are.
+//! \return false, without writing anything, if an entry is not fp32, fp16 or int8, or if the file cannot be written
+bool writeWeightContainer(const std::string& path, const WeightMap& weightMap, bool fp16,
+    const std::vector<std::string>& skip = std::vector<std::string>());
+
+//! \brief True if the named weight is a fully connected kernel, which can be stored in fp16
+bool isFcKernel(const std::string& name);
+
+//! \brief Quantizes a [rows][rowSize] kernel to int8, symmetrically per row (see kINT8_SCALE_SUFFIX)
+//! \details scales[r] is the largest magnitude of row r over 127, 1 for a row of zeros.
+void quantizeInt8(const float* src, int64_t rows, int64_t rowSize, int8_t* dst, float* scales);
+}
+
+#endif // TRT_WEIGHT_CONTAINER_H
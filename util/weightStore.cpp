@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "common.h"
+#include "weightStore.h"
+
+namespace bert
+{
+
+namespace
+{
+//! \brief crc32 and adler32 of the whole file, read through a private mapping
+bool hashFile(const std::string& path, int64_t size, uint64_t& hash)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void* base = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uLong adler = adler32(0L, Z_NULL, 0);
+    const Bytef* p = static_cast<const Bytef*>(base);
+    int64_t left = size;
+    while (left > 0)
+    {
+        const uInt chunk = static_cast<uInt>(std::min<int64_t>(left, 1 << 24));
+        crc = crc32(crc, p, chunk);
+        adler = adler32(adler, p, chunk);
+        p += chunk;
+        left -= chunk;
+    }
+    if (base)
+    {
+        munmap(base, size);
+    }
+    hash = (static_cast<uint64_t>(crc) << 32) | static_cast<uint32_t>(adler);
+    return true;
+}
+} // namespace
+
+WeightStore& WeightStore::instance()
+{
+    static WeightStore store;
+    return store;
+}
+
+WeightStore::Retain::Retain()
+{
+    WeightStore& store = WeightStore::instance();
+    std::lock_guard<std::mutex> lock(store.mMutex);
+    store.mRetainCount++;
+}
+
+WeightStore::Retain::~Retain()
+{
+    WeightStore& store = WeightStore::instance();
+    std::vector<std::shared_ptr<const HostWeights>> released;
+    {
+        std::lock_guard<std::mutex> lock(store.mMutex);
+        if (--store.mRetainCount == 0)
+        {
+            released.swap(store.mRetained);
+        }
+    }
+    // freed outside of the lock
+}
+
+std::shared_ptr<const HostWeights> WeightStore::acquire(const std::string& path, const WeightPrepOptions& options)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        gLogError << "Cannot stat weights file: " << path << std::endl;
+        return nullptr;
+    }
+
+    // Loading happens under the lock: concurrent instances wait for the first one instead of parsing the same file.
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    const FileId fileId{path, static_cast<int64_t>(st.st_size), static_cast<int64_t>(st.st_mtime)};
+    auto h = mHashes.find(fileId);
+    uint64_t hash = 0;
+    if (h != mHashes.end())
+    {
+        hash = h->second;
+    }
+    else
+    {
+        if (!hashFile(path, st.st_size, hash))
+        {
+            gLogError << "Cannot read weights file: " << path << std::endl;
+            return nullptr;
+        }
+        mHashes[fileId] = hash;
+    }
+
+    const Key key{static_cast<int64_t>(st.st_size), hash, options.fp16Kernels};
+    auto it = mEntries.find(key);
+    if (it != mEntries.end())
+    {
+        std::shared_ptr<const HostWeights> weights = it->second.lock();
+        if (weights)
+        {
+            gLogInfo << "Sharing already loaded weights of " << path << std::endl;
+            return weights;
+        }
+    }
+
+    std::shared_ptr<HostWeights> weights = std::make_shared<HostWeights>();
+    weights->mHash = hash;
+    if (WeightContainer::isContainer(path))
+    {
+        weights->mContainer.reset(new WeightContainer);
+        if (!weights->mContainer->open(path))
+        {
+            return nullptr;
+        }
+        weights->mWeights = weights->mContainer->weights();
+    }
+    else
+    {
+        loadWeights(path, weights->mWeights, options, &weights->mStorage);
+    }
+
+    mEntries[key] = weights;
+    if (mRetainCount > 0)
+    {
+        mRetained.push_back(weights);
+    }
+    return weights;
+}
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_WEIGHT_STORE_H
+#define TRT_WEIGHT_STORE_H
+
+#include "dataUtils.h"
+#include "weightContainer.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace bert
+{
+
+//! \brief Read-only host weights of one weights file, shared by every engine built from it
+//! \details Owns the buffers produced by loadWeights, or the mapping of a weight container, and frees them when the
+//! last reference goes away.
+class HostWeights
+{
+public:
+    const WeightMap& weights() const
+    {
+        return mWeights;
+    }
+
+    uint64_t contentHash() const
+    {
+        return mHash;
+    }
+
+private:
+    friend class WeightStore;
+
+    WeightMap mWeights;
+    WeightStorage mStorage;
+    std::unique_ptr<WeightContainer> mContainer;
+    uint64_t mHash{0};
+};
+
+//! \brief Process-wide store of host weights, keyed by file content
+//! \details Each file is parsed once no matter how many instances are built from it. Entries are reference counted
+//! and released as soon as the last user drops them; TensorRT copies weights into the engine, so instances only
+//! need them while building. Keep a WeightStore::Retain alive while building several engines one after the other
+//! so the weights are not reloaded in between.
+class WeightStore
+{
+public:
+    static WeightStore& instance();
+
+    //! \brief Returns the weights of \p path, loading them if no live entry has the same content
+    //! \return nullptr if the file cannot be read or is an invalid container
+    std::shared_ptr<const HostWeights> acquire(
+        const std::string& path, const WeightPrepOptions& options = WeightPrepOptions());
+
+    //! \brief While an instance exists, acquired weights are kept even when their last user releases them
+    class Retain
+    {
+    public:
+        Retain();
+        ~Retain();
+        Retain(const Retain&) = delete;
+        Retain& operator=(const Retain&) = delete;
+    };
+
+private:
+    WeightStore() {}
+
+    // (file size, content hash, fp16 kernels)
+    using Key = std::tuple<int64_t, uint64_t, bool>;
+    // (path, size, mtime) -> content hash, so unchanged files are not hashed again
+    using FileId = std::tuple<std::string, int64_t, int64_t>;
+
+    std::mutex mMutex;
+    std::map<Key, std::weak_ptr<const HostWeights>> mEntries;
+    std::map<FileId, uint64_t> mHashes;
+    int mRetainCount{0};
+    std::vector<std::shared_ptr<const HostWeights>> mRetained;
+};
+}
+
+#endif // TRT_WEIGHT_STORE_H
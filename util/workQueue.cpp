@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "workQueue.h"
+
+namespace bert
+{
+
+WorkQueue::WorkQueue(Job init)
+    : mWorker(&WorkQueue::work, this, std::move(init))
+{
+}
+
+WorkQueue::~WorkQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+    mWorker.join();
+}
+
+void WorkQueue::push(Job job)
+{
+    mDepth.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+    }
+    mWake.notify_one();
+}
+
+void WorkQueue::work(Job init)
+{
+    if (init)
+    {
+        init();
+    }
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mWake.wait(lock, [this] { return mStop || !mJobs.empty(); });
+        if (mJobs.empty())
+        {
+            return;
+        }
+        Job job = std::move(mJobs.front());
+        mJobs.pop_front();
+        lock.unlock();
+        job();
+        mProcessed.fetch_add(1, std::memory_order_relaxed);
+        mDepth.fetch_sub(1, std::memory_order_relaxed);
+        lock.lock();
+    }
+}
+}
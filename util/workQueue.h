@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2019, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRT_WORK_QUEUE_H
+#define TRT_WORK_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace bert
+{
+
+//! \brief FIFO of jobs run one after the other by a thread of its own
+//! \details The server gives every Bert instance one, so a slow batch only delays the requests queued on the same
+//! instance. The worker runs an init job first, e.g. to bind itself to the device of the instance.
+class WorkQueue
+{
+public:
+    using Job = std::function<void()>;
+
+    explicit WorkQueue(Job init = Job());
+    //! \brief Runs the jobs still queued, then stops the worker
+    ~WorkQueue();
+
+    WorkQueue(const WorkQueue&) = delete;
+    WorkQueue& operator=(const WorkQueue&) = delete;
+
+    void push(Job job);
+
+    //! \brief Jobs queued or running
+    size_t depth() const
+    {
+        return mDepth.load(std::memory_order_relaxed);
+    }
+
+    //! \brief Jobs completed
+    uint64_t processed() const
+    {
+        return mProcessed.load(std::memory_order_relaxed);
+    }
+
+private:
+    void work(Job init);
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<Job> mJobs;
+    bool mStop{false};
+    std::atomic<size_t> mDepth{0};
+    std::atomic<uint64_t> mProcessed{0};
+    std::thread mWorker;
+};
+}
+
+#endif // TRT_WORK_QUEUE_H